@@ -1,10 +1,12 @@
 #ifndef _COMMAND_LINE_OPTIONS_HPP__
 #define _COMMAND_LINE_OPTIONS_HPP__
 
+#include <algorithm>
 #include <string.h>
 #include <iostream>
 #include <boost/program_options.hpp>
 #include <boost/lexical_cast.hpp>
+#include "sampleBuffer.hpp"
 
 namespace po = boost::program_options;
 
@@ -33,6 +35,28 @@ public:
     int getInputType() { return inputType; };
     int getOutputType() { return outputType; };
     bool getHeaderlessFlag() { return myHeaderlessFlag; };
+    bool getDirectFlag() { return myDirectFlag; };
+    bool getRequantizeFlag() { return myRequantizeFlag; };
+    double getClip() { return clip; };
+    const std::string & getScaleFile() const { return myScaleFile; };
+    const std::string & getIgnoreFile() const { return myIgnoreFile; };
+    double getKurtosis() { return kurtosis; };
+    double getZap() { return zap; };
+    double getRfiClip() { return rfi_clip; };
+    bool getRfiZeroFlag() { return myRfiZeroFlag; };
+    bool rfiEnabled() { return !myIgnoreFile.empty() || kurtosis > 0.0 || zap > 0.0 || rfi_clip > 0.0; };
+    const std::string & getStatsFormat() const { return myStatsFormat; };
+    bool followEnabled() { return follow_timeout >= 0.0 || !mySentinel.empty(); };
+    double getFollowTimeout() { return std::max(0.0, follow_timeout); };
+    const std::string & getSentinel() const { return mySentinel; };
+    bool getVerifyFlag() { return myVerifyFlag; };
+    const std::vector<std::string> & getBatchPatterns() const { return myBatchPatterns; };
+    const std::string & getBatchList() const { return myBatchList; };
+    const std::string & getOutputDirectory() const { return myOutputDirectory; };
+    uint32_t getJobs() { return num_jobs.value; };
+    uint32_t getMemoryBudget() { return memory_budget.value; };
+    bool batchEnabled() { return !myBatchPatterns.empty() || !myBatchList.empty(); };
+    sample_buffer::pages getPages() { return page_policy; };
 
 protected:
     void setup();
@@ -49,6 +73,26 @@ private:
     non_negative num_output_samples;
     non_negative num_bits;
     bool myHeaderlessFlag;
+    bool myDirectFlag;
+    bool myRequantizeFlag;
+    double clip;
+    std::string myScaleFile;
+    std::string myIgnoreFile;
+    double kurtosis;
+    double zap;
+    double rfi_clip;
+    bool myRfiZeroFlag;
+    std::string myStatsFormat;
+    double follow_timeout;
+    std::string mySentinel;
+    bool myVerifyFlag;
+    std::vector<std::string> myBatchPatterns;
+    std::string myBatchList;
+    std::string myOutputDirectory;
+    non_negative num_jobs;
+    non_negative memory_budget;
+    std::string myPages;
+    sample_buffer::pages page_policy;
 };
 
 inline
@@ -6,9 +6,13 @@
 #include <iostream>
 #include "filterbankCore.hpp"
 #include "fileutils.h"
+#include "stats.hpp"
+#include "pipeline.hpp"
+#include "stages.hpp"
 #include "CommandLineOptions.hpp"
 
-void decimate_samples(filterbank& fb, unsigned int n_samples_to_combine);
-void decimate_channels(filterbank& fb, unsigned int n_channels_to_combine);
 void legacy_arguments(int argc, char* argv[], CommandLineOptions& opts);
+uint32_t samples_to_combine(std::map<std::string, header_param>& header, CommandLineOptions& opts);
+int32_t add_stages(pipeline& chain, CommandLineOptions& opts, uint32_t n_samples_to_combine, uint32_t rfi_threads = 0);
+bool run_batch(CommandLineOptions& opts);
 #endif // !DECIMATE_H
@@ -11,7 +11,27 @@ CommandLineOptions::CommandLineOptions():
     num_samps(),
     num_output_samples(),
     num_bits(),
-    myHeaderlessFlag(false)
+    myHeaderlessFlag(false),
+    myDirectFlag(false),
+    myRequantizeFlag(false),
+    clip(3.0),
+    myScaleFile(),
+    myIgnoreFile(),
+    kurtosis(0.0),
+    zap(0.0),
+    rfi_clip(0.0),
+    myRfiZeroFlag(false),
+    myStatsFormat(),
+    follow_timeout(-1.0),
+    mySentinel(),
+    myVerifyFlag(false),
+    myBatchPatterns(),
+    myBatchList(),
+    myOutputDirectory(),
+    num_jobs(),
+    memory_budget(),
+    myPages(),
+    page_policy(sample_buffer::TRANSPARENT_HUGE_PAGES)
 {
     setup();
 }
@@ -21,13 +41,32 @@ void CommandLineOptions::setup() {
 usage: decimate {filename} -{options}\n\noptions");
     options.add_options()
         ("help,h", "produce this help message")
-        ("filename", po::value<std::string>(&myInputFile)->value_name("FILE"), "filterbank data file (def=stdin)")
+        ("filename", po::value<std::string>(&myInputFile)->value_name("FILE"), "filterbank data file, or shm:name to read a shared memory ring (def=stdin)")
         (",o", po::value<std::string>(&myOutputFile)->value_name("FILE"), "filterbank output file (def=stdout)")
         (",c", po::value<non_negative>(&num_chans)->value_name("numchans"), "number of channels to add (def=all)")
         (",t", po::value<non_negative>(&num_samps)->value_name("numsamps"), "number of time samples to add (def=none)")
         (",T", po::value<non_negative>(&num_output_samples)->value_name("numsamps"), "(alternative to -t) specify number of output timesamples")
         (",n", po::value<non_negative>(&num_bits)->value_name("numbits"), "specify output number of bits (def=input)")
-        ("headerless", po::bool_switch(&myHeaderlessFlag), "do not broadcast resulting header (def=broadcast)");
+        ("headerless", po::bool_switch(&myHeaderlessFlag), "do not broadcast resulting header (def=broadcast)")
+        ("direct", po::bool_switch(&myDirectFlag), "write the output file with O_DIRECT, bypassing the page cache")
+        ("pages", po::value<std::string>(&myPages)->value_name("type"), "pages of buffers of 2 MB or more: small, transparent huge pages or reserved huge pages, which fall back to small ones when none are left (def=transparent)")
+        ("requantize", po::bool_switch(&myRequantizeFlag), "normalize every channel and requantize to -n bits instead of clamping (def -n 8)")
+        ("clip", po::value<double>(&clip)->value_name("sigma"), "with --requantize, the number of standard deviations kept (def=3)")
+        ("scales", po::value<std::string>(&myScaleFile)->value_name("FILE"), "with --requantize, record the scaling of every block in a file")
+        (",i", po::value<std::string>(&myIgnoreFile)->value_name("FILE"), "read list of channels to ignore from a file, numbered from 1 (def=none)")
+        ("kurtosis", po::value<double>(&kurtosis)->value_name("sigma"), "flag channels whose spectral kurtosis deviates by sigma in a block (def=off)")
+        ("zap", po::value<double>(&zap)->value_name("sigma"), "flag time samples whose channel average deviates by sigma (def=off)")
+        ("rfi-clip", po::value<double>(&rfi_clip)->value_name("sigma"), "replace values more than sigma from their channel mean (def=off)")
+        ("rfi-zero", po::bool_switch(&myRfiZeroFlag), "replace flagged data by zero instead of the channel mean")
+        ("stats", po::value<std::string>(&myStatsFormat)->implicit_value("text")->value_name("json"), "print a per stage timing breakdown to stderr, as a table or json (def=off)")
+        ("follow", po::value<double>(&follow_timeout)->implicit_value(10.0)->value_name("seconds"), "read the input file while it is still being written, until it has not grown for seconds (def=10, 0 to wait for --sentinel)")
+        ("sentinel", po::value<std::string>(&mySentinel)->value_name("FILE"), "read the input file while it is still being written, until FILE exists")
+        ("verify", po::bool_switch(&myVerifyFlag), "check while reading that the input is not truncated and matches the CRC32C in FILE.crc32c, which is written when missing if it can be, the CRC32C is printed otherwise")
+        ("batch", po::value<std::vector<std::string>>(&myBatchPatterns)->multitoken()->value_name("GLOB"), "decimate every file matching the patterns into --outdir, under the same name")
+        ("batch-list", po::value<std::string>(&myBatchList)->value_name("FILE"), "decimate every file listed in FILE, one per line, into --outdir")
+        ("outdir", po::value<std::string>(&myOutputDirectory)->value_name("DIR"), "output directory of --batch and --batch-list")
+        ("jobs,j", po::value<non_negative>(&num_jobs)->value_name("jobs"), "with --batch, the files or parts of files decimated at once, sharing the cores (def=all cores)")
+        ("memory", po::value<non_negative>(&memory_budget)->value_name("MB"), "with --batch, the memory all jobs together may use for their data (def=no limit)");
 
     myOptions.add(options);
     myPositionalOptions.add("filename", 1);
@@ -49,13 +88,51 @@ CommandLineOptions::statusReturn_e CommandLineOptions::parse(int argc, char* arg
             return OPTS_HELP; 
         }
         if (vm.count("filename")) {
-            inputType = 1;
+            // a file, or shm:name for a shared memory ring
+            inputType = vm["filename"].as<std::string>().compare(0, 4, "shm:") ? 1 : 2;
         }
         if (vm.count("-o")) {
             outputType = 1;
         }
 
         po::notify(vm);
+
+        if (!myRequantizeFlag && (vm.count("clip") || vm.count("scales"))) {
+            std::cerr << "--clip and --scales need --requantize" << std::endl;
+            return ERROR_IN_COMMAND_LINE;
+        }
+        if (batchEnabled() && (myOutputDirectory.empty() || vm.count("filename") || vm.count("-o"))) {
+            std::cerr << "--batch and --batch-list need --outdir, and no input or output file" << std::endl;
+            return ERROR_IN_COMMAND_LINE;
+        }
+        if (batchEnabled() && vm.count("scales")) {
+            std::cerr << "--scales cannot be used with --batch or --batch-list, the files would share it" << std::endl;
+            return ERROR_IN_COMMAND_LINE;
+        }
+        if (!batchEnabled() && (vm.count("outdir") || vm.count("jobs") || vm.count("memory"))) {
+            std::cerr << "--outdir, -j and --memory need --batch or --batch-list" << std::endl;
+            return ERROR_IN_COMMAND_LINE;
+        }
+        if (vm.count("stats") && myStatsFormat.compare("text") && myStatsFormat.compare("json")) {
+            std::cerr << "--stats only accepts text or json" << std::endl;
+            return ERROR_IN_COMMAND_LINE;
+        }
+        if (vm.count("pages") && !sample_buffer::parse_pages(myPages, page_policy)) {
+            std::cerr << "--pages only accepts small, transparent or huge" << std::endl;
+            return ERROR_IN_COMMAND_LINE;
+        }
+        if (followEnabled() && inputType != 1) {
+            std::cerr << "--follow and --sentinel need an input file" << std::endl;
+            return ERROR_IN_COMMAND_LINE;
+        }
+        if (vm.count("follow") && follow_timeout <= 0.0 && mySentinel.empty()) {
+            std::cerr << "--follow=0 needs a --sentinel to end" << std::endl;
+            return ERROR_IN_COMMAND_LINE;
+        }
+        if (followEnabled() && vm.count("-T")) {
+            std::cerr << "-T cannot be used with --follow or --sentinel, the number of input samples is not known" << std::endl;
+            return ERROR_IN_COMMAND_LINE;
+        }
     
     } catch (boost::program_options::required_option& ex_required) { 
         std::cerr << ex_required.what() << std::endl;
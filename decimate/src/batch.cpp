@@ -0,0 +1,236 @@
+#include "decimate.h"
+#include <fstream>
+#include <glob.h>
+#include <set>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+	// Large files are split into parts of about this many input bytes, idle jobs take over the parts of large files
+	const uint64_t part_bytes = 128ull << 20;
+	// The read ahead and write behind buffers of one pipeline
+	const uint64_t io_bytes = 32ull << 20;
+	// The smallest data buffers a job is given before there are fewer jobs
+	const uint64_t min_block_bytes = 1ull << 20;
+
+	/**
+	 * @brief A file, or a range of samples of a file, to decimate
+	 */
+	struct batch_task {
+		std::string input;
+		std::string output;
+		uint32_t block_samples = 0;
+		bool part = false;
+		uint64_t first_sample = 0;
+		uint64_t nsamples = 0;
+		uint32_t n_samples_to_combine = 0; // of the whole file, for parts
+		uint64_t output_offset = 0; // in bytes, for parts
+	};
+
+	std::string base_name(const std::string& path) {
+		size_t slash = path.find_last_of('/');
+		return slash == std::string::npos ? path : path.substr(slash + 1);
+	}
+
+	/**
+	 * @brief The files matching the glob patterns and listed in the list file, in order and without repeats
+	 */
+	std::vector<std::string> batch_inputs(CommandLineOptions& opts) {
+		std::vector<std::string> inputs;
+		for (const std::string& pattern : opts.getBatchPatterns()) {
+			glob_t matches;
+			int result = glob(pattern.c_str(), 0, nullptr, &matches);
+			if (result == GLOB_NOMATCH) {
+				std::cerr << "No files match " << pattern << "\n";
+			} else if (result) {
+				globfree(&matches);
+				throw std::runtime_error("Failed to expand " + pattern);
+			}
+			for (size_t index = 0; index < matches.gl_pathc; ++index) {
+				inputs.push_back(matches.gl_pathv[index]);
+			}
+			globfree(&matches);
+		}
+		if (!opts.getBatchList().empty()) {
+			std::ifstream list(opts.getBatchList());
+			if (!list.is_open()) {
+				throw std::runtime_error("Failed to open " + opts.getBatchList());
+			}
+			std::string line;
+			while (std::getline(list, line)) {
+				size_t first = line.find_first_not_of(" \t\r");
+				if (first == std::string::npos || line[first] == '#') {
+					continue;
+				}
+				size_t last = line.find_last_not_of(" \t\r");
+				inputs.push_back(line.substr(first, last - first + 1));
+			}
+		}
+		std::set<std::string> seen;
+		std::vector<std::string> unique;
+		for (const std::string& input : inputs) {
+			if (seen.insert(input).second) {
+				unique.push_back(input);
+			}
+		}
+		return unique;
+	}
+
+	/**
+	 * @brief Prepares the tasks of a file. Without RFI excision or requantization every output sample only
+	 * depends on its own input samples, so a large file is split into parts that are written in place
+	 * into an output file that already holds the header and has its final size. A file is only verified
+	 * when one task reads all of it.
+	 */
+	void plan_file(const std::string& input, const std::string& output, CommandLineOptions& opts, uint64_t block_bytes, std::vector<batch_task>& tasks) {
+		filterbank fb = filterbank::open(filterbank::ioType::FILEIO, input);
+		fb.close();
+		if (!fb.values_per_sample() || !fb.bytes_per_sample()) {
+			throw std::runtime_error("Input has no channels or IFs");
+		}
+		batch_task task;
+		task.input = input;
+		task.output = output;
+		task.block_samples = (uint32_t)std::max<uint64_t>(1, block_bytes / (fb.values_per_sample() * sizeof(float)));
+
+		const uint64_t nsamples = fb.header["nsamples"].val.i;
+		const bool independent = !opts.rfiEnabled() && !opts.getRequantizeFlag() && !opts.getDirectFlag() && !opts.getVerifyFlag();
+		if (!independent || nsamples * fb.bytes_per_sample() < 2 * part_bytes) {
+			tasks.push_back(task);
+			return;
+		}
+
+		task.part = true;
+		task.n_samples_to_combine = samples_to_combine(fb.header, opts);
+		filterbank out;
+		out.header = fb.header;
+		decimate_stage(task.n_samples_to_combine, opts.getNumberOfChannels()).configure(out.header);
+		if (opts.getNumberOfBits()) {
+			out.header["nbits"].val.i = opts.getNumberOfBits();
+		}
+		if (!out.valid_sample_format()) {
+			throw std::runtime_error("Cannot write " + std::to_string(out.header["nbits"].val.i) + " bit values: supported formats are 1/2/4/8/16/32 bits, with whole bytes per spectrum");
+		}
+		if (!out.create(filterbank::ioType::FILEIO, output, opts.getHeaderlessFlag())) {
+			throw std::runtime_error("Failed to open file for writing: " + output);
+		}
+		out.close();
+		struct stat info;
+		if (stat(output.c_str(), &info) != 0) {
+			throw std::runtime_error("Failed to write the header of " + output);
+		}
+		const uint64_t header_bytes = info.st_size;
+		const uint64_t out_bytes = out.bytes_per_sample();
+		if (truncate(output.c_str(), (off_t)(header_bytes + (uint64_t)out.header["nsamples"].val.i * out_bytes)) != 0) {
+			throw std::runtime_error("Failed to allocate " + output);
+		}
+
+		const uint64_t per_part = std::max<uint64_t>(1, part_bytes / fb.bytes_per_sample() / task.n_samples_to_combine) * task.n_samples_to_combine;
+		for (uint64_t first = 0; first < nsamples; first += per_part) {
+			task.first_sample = first;
+			task.nsamples = std::min(per_part, nsamples - first);
+			task.output_offset = header_bytes + first / task.n_samples_to_combine * out_bytes;
+			tasks.push_back(task);
+		}
+	}
+
+	void run_task(const batch_task& task, CommandLineOptions& opts, size_t queue_depth, bool threaded, uint32_t rfi_threads) {
+		std::unique_ptr<filterbank_source> input(new filterbank_source(filterbank::ioType::FILEIO, task.input, task.block_samples,
+			task.first_sample, task.nsamples));
+		if (opts.getVerifyFlag()) {
+			input->verify();
+		}
+		uint32_t n_samples_to_combine = task.part ? task.n_samples_to_combine : samples_to_combine(input->fb.header, opts);
+
+		pipeline chain;
+		chain.queue_depth = queue_depth;
+		chain.set_source(std::move(input));
+		int32_t nbits = add_stages(chain, opts, n_samples_to_combine, rfi_threads);
+		std::unique_ptr<filterbank_sink> output(new filterbank_sink(filterbank::ioType::FILEIO, task.output,
+			opts.getHeaderlessFlag(), nbits, opts.getDirectFlag()));
+		if (task.part) {
+			output->write_at(task.output_offset);
+		}
+		chain.set_sink(std::move(output));
+		chain.run(threaded);
+	}
+}
+
+/**
+ * Decimates many files into an output directory. Files, and parts of large files, are tasks taken in order
+ * by a fixed number of jobs, so a job that is done takes over the rest of a large file. With a memory budget
+ * every job gets an equal share for its blocks and buffers, and there are fewer jobs when the shares would
+ * get too small, which keeps the peak memory use within the budget. The jobs split the cores between them,
+ * so that together they start about as many busy threads as there are cores.
+ *
+ * @param[in] opts the program options
+ * @return false when any file failed, the others are still decimated
+ */
+bool run_batch(CommandLineOptions& opts) {
+	std::vector<std::string> inputs = batch_inputs(opts);
+	if (inputs.empty()) {
+		throw std::runtime_error("No files to decimate");
+	}
+	struct stat info;
+	if (stat(opts.getOutputDirectory().c_str(), &info) != 0 || !S_ISDIR(info.st_mode)) {
+		throw std::runtime_error("Output directory does not exist: " + opts.getOutputDirectory());
+	}
+
+	uint32_t jobs = opts.getJobs() ? opts.getJobs() : std::max(1u, std::thread::hardware_concurrency());
+	// Blocks of about 4 MB in queues of 4 unless the budget is tighter, a pipeline holds about
+	// (stages + 1) * (queue depth + 2) blocks
+	uint64_t block_bytes = 4ull << 20;
+	size_t queue_depth = 4;
+	const uint64_t stages = 2 + (opts.rfiEnabled() ? 1 : 0) + (opts.getRequantizeFlag() ? 1 : 0);
+	if (opts.getMemoryBudget()) {
+		const uint64_t budget = (uint64_t)opts.getMemoryBudget() << 20;
+		queue_depth = 2;
+		const uint64_t blocks = stages * (queue_depth + 2);
+		jobs = (uint32_t)std::max<uint64_t>(1, std::min<uint64_t>(jobs, budget / (io_bytes + blocks * min_block_bytes)));
+		block_bytes = std::max(min_block_bytes, std::min(block_bytes, (budget / jobs - std::min(budget / jobs, io_bytes)) / blocks));
+	}
+
+	// The jobs share the cores. A threaded chain runs the source and every stage on a thread of their own
+	// besides the job, which runs the sink, so it is only threaded when the share of a job has room for them;
+	// the RFI stage splits its blocks over the rest. The read ahead and write behind threads mostly wait for
+	// the disk and are not counted.
+	const uint32_t cores = std::max(1u, std::thread::hardware_concurrency());
+	const uint32_t job_threads = std::max(1u, cores / jobs);
+	const uint32_t chain_threads = 3 + (opts.rfiEnabled() ? 1 : 0) + (opts.getRequantizeFlag() ? 1 : 0);
+	const bool threaded = job_threads >= chain_threads;
+	const uint32_t rfi_threads = threaded ? 1 + job_threads - chain_threads : job_threads;
+
+	std::vector<batch_task> tasks;
+	std::set<std::string> outputs;
+	bool ok = true;
+	{
+		scoped_timer timer("plan");
+		for (const std::string& input : inputs) {
+			std::string output = opts.getOutputDirectory() + "/" + base_name(input);
+			try {
+				if (!outputs.insert(output).second) {
+					throw std::runtime_error("Another input has the same name");
+				}
+				plan_file(input, output, opts, block_bytes, tasks);
+			} catch (const std::exception& ex) {
+				std::cerr << input << ": " << ex.what() << "\n";
+				ok = false;
+			} catch (const char* msg) {
+				std::cerr << input << ": " << msg << "\n";
+				ok = false;
+			}
+		}
+	}
+
+	// The next task may use other block sizes, the blocks of the last one would stay in the pool unused
+	for_each_item(tasks.size(), jobs, [&](uint32_t, uint64_t index) {
+		run_task(tasks[index], opts, queue_depth, threaded, rfi_threads);
+		block_pool::trim();
+	}, [&](uint64_t index, const std::string& failure) {
+		block_pool::trim();
+		std::cerr << tasks[index].input << ": " << failure << "\n";
+		ok = false;
+	});
+	return ok;
+}
@@ -2,37 +2,54 @@
 
 /**
  * reduces the amount of data by combining measurements from multiple samples 
- * and/or channels.
+ * and/or channels. The file is streamed through a decimate stage block by block.
  * 
  * @param[in] argc the number of arguments provided to the program
  * @param[in] argv the arguments provided to the program
  */
 int main(int argc, char* argv[]) {
-	//TODO: Move some logic to decimate_*** -> null checks, > 1, output samps
-	filterbank fb;
 	CommandLineOptions opts;
 	legacy_arguments(argc, argv, opts);
 	CommandLineOptions::statusReturn_e argumentStatus = opts.parse(argc, argv);
 	if (argumentStatus == CommandLineOptions::OPTS_SUCCESS) {
-		//Casting int to enum filterbank::inputType
-		fb = filterbank::read((filterbank::ioType)opts.getInputType(), opts.getInputFile());
-		if (opts.getNumberOfBits()) {
-			fb.header["nbits"].val.i = opts.getNumberOfBits();
-		}
-		if (opts.getNumberOfOutputSamples()) {
-			decimate_samples(fb, (fb.header["nsamples"].val.i / opts.getNumberOfOutputSamples()));
-		} else if (opts.getNumberOfSamples() > 1){
-			decimate_samples(fb, opts.getNumberOfSamples());
+		if (!opts.getStatsFormat().empty()) {
+			stats::enable(!opts.getStatsFormat().compare("json"));
 		}
+		sample_buffer::set_pages(opts.getPages());
+		try {
+			if (opts.batchEnabled()) {
+				if (!run_batch(opts)) {
+					exit(-3);
+				}
+				stats::report();
+				return 0;
+			}
 
-		//If no decimation factor is given all channels will be decimated.
-		if (opts.getNumberOfChannels() > 1) {
-			decimate_channels(fb, opts.getNumberOfChannels());
-		} else if (opts.getNumberOfChannels() == 0) {
-			decimate_channels(fb, fb.header["nchans"].val.i);
-		}
+			//Casting int to enum filterbank::inputType
+			std::unique_ptr<filterbank_source> input(new filterbank_source((filterbank::ioType)opts.getInputType(), opts.getInputFile()));
+			if (opts.followEnabled()) {
+				input->follow(opts.getFollowTimeout(), opts.getSentinel());
+			}
+			if (opts.getVerifyFlag()) {
+				input->verify();
+			}
+			unsigned int n_samples_to_combine = samples_to_combine(input->fb.header, opts);
 
-		fb.write((filterbank::ioType)opts.getOutputType(), opts.getOutputFile(), opts.getHeaderlessFlag());
+			//If no decimation factor is given all channels will be decimated.
+			pipeline chain;
+			chain.set_source(std::move(input));
+			int32_t nbits = add_stages(chain, opts, n_samples_to_combine);
+			chain.set_sink(std::unique_ptr<sink>(new filterbank_sink((filterbank::ioType)opts.getOutputType(),
+				opts.getOutputFile(), opts.getHeaderlessFlag(), nbits, opts.getDirectFlag())));
+			chain.run();
+		} catch (const std::exception& ex) {
+			std::cerr << ex.what() << "\n";
+			exit(-3);
+		} catch (const char* msg) {
+			std::cerr << msg << "\n";
+			exit(-3);
+		}
+		stats::report();
 	}
 	else if (argumentStatus == CommandLineOptions::OPTS_HELP) {
 		//Help printed
@@ -44,91 +61,52 @@ int main(int argc, char* argv[]) {
 }
 
 /**
- * reduces the amount of data by combining measurements from multiple frequency channels
- * 
- * @param[in] fb Filterbank file to decimate
- * @param[in] n_channels_to_combine number of channels to combine into one measurement
+ * The number of samples to add into one, from -t or from -T and the number of input samples
+ *
+ * @param[in] header the header of the input
+ * @param[in] opts the program options
  */
-void decimate_channels(filterbank& fb, unsigned int n_channels_to_combine) {
-	if (n_channels_to_combine < 1 || fb.header["nchans"].val.i % n_channels_to_combine) {
-		std::cerr << "File does not contain a multiple of: " << n_channels_to_combine << " channels.\n";
-		exit(-3);
-	}
-	
-	unsigned int n_channels_out = fb.header["nchans"].val.i / n_channels_to_combine;
-	unsigned int  n_values_out = fb.header["nifs"].val.i * n_channels_out * fb.header["nsamples"].val.i;
-
-	std::vector<float> temp(n_values_out);
-
-	for (unsigned int interface = 0; interface < fb.header["nifs"].val.i; interface++) {
-		for (unsigned int sample = 0; sample < fb.header["nsamples"].val.i; sample++){
-			unsigned int channel = 0;
-			while (channel < fb.header["nchans"].val.i) {
-				float total = 0;
-				for (unsigned int j = 0; j < n_channels_to_combine; ++j) {
-					unsigned int index = (sample * fb.header["nifs"].val.i * fb.header["nchans"].val.i) 
-					+ (interface * fb.header["nchans"].val.i) 
-					+ channel;
-
-					total += fb.data[index];
-					channel++;
-				}
-				float avg = total / n_channels_to_combine;
-
-				unsigned int out_index = (sample * fb.header["nifs"].val.i * n_channels_out)
-					+ (interface * n_channels_out)
-					+ ((channel / n_channels_to_combine) - 1);
-				temp[out_index] = avg;
-			}
+uint32_t samples_to_combine(std::map<std::string, header_param>& header, CommandLineOptions& opts) {
+	if (opts.getNumberOfOutputSamples()) {
+		if (!header["nsamples"].val.i) {
+			throw std::runtime_error("-T needs the number of input samples, which is unknown for this input.");
 		}
+		return header["nsamples"].val.i / opts.getNumberOfOutputSamples();
 	}
-
-	fb.header["nchans"].val.i = n_channels_out;
-	fb.data = temp;
+	return opts.getNumberOfSamples() > 1 ? opts.getNumberOfSamples() : 1;
 }
 
 /**
- * reduces the amount of data by combining measurements from multiple samples
- * 
- * @param[in] fb Filterbank file to decimate
- * @param[in] n_samples_to_combine number of samples to combine into one measurement
+ * Adds the RFI, decimation and requantization stages the options ask for
+ *
+ * @param[in] chain the pipeline, with its source set
+ * @param[in] opts the program options
+ * @param[in] n_samples_to_combine the number of samples to add into one
+ * @param[in] rfi_threads the threads of the RFI stage, 0 for all cores
+ * @return the number of bits for the sink, 0 when a requantize stage already sets them
  */
-void decimate_samples(filterbank& fb, unsigned int n_samples_to_combine) {
-	if (n_samples_to_combine < 1 || fb.header["nsamples"].val.i % n_samples_to_combine) {
-		std::cerr << "File does not contain a multiple of: " << n_samples_to_combine << " samples.\n";
-		exit(-3);
-	}
-
-	unsigned int n_samples_out = fb.header["nsamples"].val.i / n_samples_to_combine;
-	unsigned int n_values_out = fb.header["nifs"].val.i * fb.header["nchans"].val.i * n_samples_out;
-	std::vector<float> temp(n_values_out);
-    
-	for(unsigned int channel =  0; channel < fb.header["nchans"].val.i; channel++){
-		for(unsigned int interface = 0; interface < fb.header["nifs"].val.i; interface++){
-			unsigned int sample = 0;
-			while (sample < fb.header["nsamples"].val.i){
-				float total = 0;
-				for(unsigned int i= 0; i < n_samples_to_combine; i++){
-					unsigned int index = (sample * fb.header["nifs"].val.i * fb.header["nchans"].val.i) 
-					+ (interface * fb.header["nchans"].val.i)
-					+ channel;
-					total += fb.data[index];
-					sample++;
-				}		
-				
-				unsigned int out_index = ((((sample/n_samples_to_combine) -1) * fb.header["nifs"].val.i * fb.header["nchans"].val.i)
-				+ (interface * fb.header["nchans"].val.i)
-				+ channel);
-				temp[out_index] = total;
-			}
+int32_t add_stages(pipeline& chain, CommandLineOptions& opts, uint32_t n_samples_to_combine, uint32_t rfi_threads) {
+	// Clean before any reduction, so RFI is not spread over the combined samples
+	if (opts.rfiEnabled()) {
+		rfi_options rfi;
+		if (!opts.getIgnoreFile().empty()) {
+			rfi.channels = mask_stage::read_channel_list(opts.getIgnoreFile());
 		}
+		rfi.kurtosis = opts.getKurtosis();
+		rfi.zap = opts.getZap();
+		rfi.clip = opts.getRfiClip();
+		rfi.zero = opts.getRfiZeroFlag();
+		rfi.threads = rfi_threads;
+		chain.add_stage(std::unique_ptr<stage>(new rfi_stage(rfi)));
 	}
-
-	fb.header["nsamples"].val.i = n_samples_out;
-
-	// if we decrease the amount of samples, the time between samples increase
-	fb.header["tsamp"].val.d = fb.header["tsamp"].val.d * n_samples_to_combine;
-	fb.data = temp;
+	chain.add_stage(std::unique_ptr<stage>(new decimate_stage(n_samples_to_combine, opts.getNumberOfChannels())));
+	// The summed samples no longer fit the input bits, requantizing keeps the signal instead of clamping it
+	int32_t nbits = opts.getNumberOfBits();
+	if (opts.getRequantizeFlag()) {
+		chain.add_stage(std::unique_ptr<stage>(new requantize_stage(nbits ? nbits : 8, opts.getClip(), 0, opts.getScaleFile())));
+		nbits = 0;
+	}
+	return nbits;
 }
 
 /**
@@ -1,15 +1,36 @@
 #ifndef DEDISPERSE_H
 #define DEDISPERSE_H
 
-#include <queue>
 #include "filterbankCore.hpp"
-#include "linspaced.h"
+#include "pipeline.hpp"
+#include "stages.hpp"
+#include "stats.hpp"
 
+struct dedisperse_options {
+	std::vector<std::string> inputs; // none for stdin, more than one for the beams of a multibeam
+	std::string output; // empty for stdout
+	std::string output_directory; // -outdir, the outputs of several inputs under their own names
+	uint32_t jobs = 0; // -jobs, beams dedispersed at once, 0 for all cores
+	bool sum_ifs = false; // -sumifs
+	bool verify = false; // -verify, check the input against its stored CRC32C while reading it
+	double dispersion_measure = 0.0;
+	uint32_t n_bands = 1;
+	int32_t nbits = 32;
+	double reference_frequency = 0.0;
+	bool headerless = false;
+	bool remove_mean = false; // -rmean, zero-DM filter
+	bool baseline = true; // -nobaseline switches it off
+	std::string ignore_file;
+	double follow_timeout = -1.0; // -follow, read the input while it grows, until it has not grown for this long
+	std::string sentinel; // -sentinel, read the input while it grows, until this file exists
+	rfi_options rfi;
 
-void dedisperse(filterbank& fb, double max_delay, float dispersion_measure, uint32_t highest_x);
-std::pair<uint32_t, uint32_t> find_line(filterbank* fb, uint32_t start_sample, double max_delay, float pulsar_intensity);
-float find_estimation_intensity(filterbank& fb, uint32_t highest_x);
-float find_dispersion_measure(filterbank& fb, float pulsar_intensity, double max_delay);
+	bool rfi_enabled() const { return !rfi.channels.empty() || rfi.kurtosis > 0.0 || rfi.zap > 0.0 || rfi.clip > 0.0; };
+};
+
+bool parse_arguments(int32_t argc, char* argv[], dedisperse_options& opts);
+void dedisperse_beam(const std::string& input, const std::string& output, const dedisperse_options& opts, bool threaded, uint32_t stage_threads = 0);
+bool run_beams(const dedisperse_options& opts);
 
 void dedisperse_help();
 #endif // !DEDISPERSE_H
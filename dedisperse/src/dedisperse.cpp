@@ -1,157 +1,264 @@
 #include "dedisperse.h"
+#include <algorithm>
+#include <cmath>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
 
 /**
- * corrects for chromatic dispersion in the interstellar medium
+ * corrects for chromatic dispersion in the interstellar medium. The data is streamed
+ * through the optional RFI, zero-DM and baseline stages, the dedisperse stage and an
+ * optional requantize stage.
  * 
  * @param[in] argc the number of arguments provided to the program
  * @param[in] argv the arguments provided to the program
  */
 int32_t main(int32_t argc, char* argv[]) {
-	std::vector<std::string> argList(argv, argv + argc);
-	if (argList.size() < 1)
+	// Without arguments and without piped input there is nothing to do
+	if (argc < 2 && isatty(fileno(stdin))) {
 		dedisperse_help();
-
-	std::string filename = argv[1];
-
-	auto fb = filterbank::read(filterbank::ioType::FILEIO, filename);
-
-	float dispersion_measure = 0;
-	double max_delay = 0;
-	int highest_x = 10;
-
-	//if dispresion measure was not set in the program options, find it
-	if (!dispersion_measure) {
-		float pulsar_intensity = find_estimation_intensity(fb, highest_x);
-		dispersion_measure = find_dispersion_measure(fb, pulsar_intensity, max_delay);
+		exit(0);
 	}
 
-	dedisperse(fb, (double)10, (float)10, 10);
-
-}
-
-/**
- * corrects for chromatic dispersion in the interstellar medium
- * 
- * @param[in] fb Filterbank file to dedisperse
- * @param[in] dispersion_measure the dm to dedisperse at
- */
-void dedisperse(filterbank& fb,  double max_delay, float dispersion_measure, uint32_t highest_x) {
-	std::vector<double> delays_per_sample = linspace(dispersion_measure, (float)0, fb.header["nsamples"].val.i);
+	dedisperse_options opts;
+	if (!parse_arguments(argc, argv, opts)) {
+		dedisperse_help();
+		exit(-1);
+	}
 
-	float* temp = new float[fb.header["nsamples"].val.i];
-	for (uint32_t channel = 0; channel < fb.header["nchans"].val.i; channel++) {
-		// fill temp array with the for a single channel
-		for (uint32_t sample = 0; sample < fb.header["nsamples"].val.i; sample++)
-		{
-			uint32_t index = (sample * fb.header["nifs"].val.i * fb.header["nchans"].val.i) + channel;
-			temp[sample] = fb.data[index];
+	try {
+		// Read once, all beams use the same list
+		if (!opts.ignore_file.empty()) {
+			opts.rfi.channels = mask_stage::read_channel_list(opts.ignore_file);
 		}
-
-		// rotate over the time axis
-		//std::rotate(temp[0], temp[0] + static_cast<float>(delays_per_sample[channel]), temp[fb.n_samples]);
-
-		//write back to array
-		for (uint32_t sample = 0; sample < fb.header["nsamples"].val.i; sample++)
-		{
-			int32_t index = (sample * fb.header["nifs"].val.i * fb.header["nchans"].val.i) + channel;
-			fb.data[index] = temp[sample];
+		if (!opts.output_directory.empty()) {
+			if (!run_beams(opts)) {
+				exit(-3);
+			}
+		} else {
+			dedisperse_beam(opts.inputs.empty() ? "" : opts.inputs[0], opts.output, opts, true);
 		}
+	} catch (const std::exception& ex) {
+		std::cerr << ex.what() << "\n";
+		exit(-3);
+	} catch (const char* msg) {
+		std::cerr << msg << "\n";
+		exit(-3);
 	}
+
+	stats::report();
+	return 0;
 }
 
 /**
- * Attempts to find a pattern in the the data
- * 
- * @param[in] fb Filterbank file to find a line in
- * @param[in] start_sample the sample to start from
- * @param[in] max_delay Maximum amount of time between pulses
- * @param[in] pulsar_intensity the intensity from which a pulse is considered a pulsar
- * @return the start_sample of the pulsar and the estimated dispersion measure
+ * Dedisperses one file, or one beam of a multibeam observation
+ *
+ * @param[in] input the input file, empty for stdin
+ * @param[in] output the output file, empty for stdout
+ * @param[in] opts the options
+ * @param[in] threaded whether every stage runs on its own thread
+ * @param[in] stage_threads the threads of each of the RFI, zero-DM and baseline stages, 0 for all cores
  */
-std::pair<uint32_t, uint32_t> find_line(filterbank& fb, uint32_t start_sample, double max_delay, float pulsar_intensity)
-{
-	uint32_t previous_index = start_sample;
-	bool found_line = false;
-
-	// Loop through the channels
-	for (uint32_t channel = 0; channel < fb.header["nchans"].val.i; ++channel) {
-		//Loop through previous samples
-		for (uint32_t sample = start_sample; sample < fb.header["nsamples"].val.i; ++sample) {
-			// TODO: implement searching for a line
-		}
+void dedisperse_beam(const std::string& input, const std::string& output, const dedisperse_options& opts, bool threaded, uint32_t stage_threads) {
+	std::unique_ptr<filterbank_source> source(new filterbank_source(filterbank::input_type(input), input));
+	if (opts.follow_timeout >= 0.0 || !opts.sentinel.empty()) {
+		source->follow(std::max(0.0, opts.follow_timeout), opts.sentinel);
+	}
+	if (opts.sum_ifs) {
+		source->sum_ifs();
 	}
+	if (opts.verify) {
+		source->verify();
+	}
+	const double tsamp = source->fb.header["tsamp"].val.d;
 
-	return std::pair<uint32_t, uint32_t>(0, 0);
+	pipeline chain;
+	chain.set_source(std::move(source));
+	if (opts.rfi_enabled()) {
+		rfi_options rfi = opts.rfi;
+		rfi.threads = stage_threads;
+		chain.add_stage(std::unique_ptr<stage>(new rfi_stage(rfi)));
+	}
+	if (opts.remove_mean) {
+		chain.add_stage(std::unique_ptr<stage>(new zero_dm_stage(stage_threads)));
+	}
+	if (opts.baseline) {
+		chain.add_stage(baseline_stage::running_median(1.0, tsamp, stage_threads));
+	}
+	chain.add_stage(std::unique_ptr<stage>(new dedisperse_stage(opts.dispersion_measure, opts.n_bands, opts.reference_frequency)));
+	if (opts.nbits != 32) {
+		chain.add_stage(std::unique_ptr<stage>(new requantize_stage(opts.nbits)));
+	}
+	chain.set_sink(std::unique_ptr<sink>(new filterbank_sink(
+		output.empty() ? filterbank::ioType::STDIO : filterbank::ioType::FILEIO, output, opts.headerless)));
+	chain.run(threaded);
 }
 
 /**
- * Attempts to find the dispersion measure in a given dataset
- *  
- * @param[in] fb Filterbank file to find the dispersion measure from
- * @param[in] max_delay Maximum amount of time between pulses
- * @param[in] pulsar_intensity the intensity from which a pulse is considered a pulsar
- * @return the estimated dispersion measure
+ * Dedisperses the files of the beams of a multibeam observation at once, each into a file of the same name
+ * in the output directory. The jobs take the beams in order; the delays are calculated once and shared by
+ * all beams with the same channels. The jobs split the cores between them: a beam only runs its stages on
+ * threads of their own when its share has room for them, and its RFI, zero-DM and baseline stages split
+ * the rest of the share.
+ *
+ * @param[in] opts the options
+ * @return false when any beam failed, the others are still dedispersed
  */
-float find_dispersion_measure(filterbank& fb, float pulsar_intensity, double max_delay)
-{
-	uint32_t start_sample_index = 0;
-	std::pair<uint32_t, uint32_t> line_coordinates;
-
-	// loop through the samples to find a pulsar intensity to start calcultating from
-	for (uint32_t sample = 0; sample < fb.header["nsamples"].val.i; ++sample) {
-		int32_t sample_index = (sample * fb.header["nifs"].val.i * fb.header["nchans"].val.i);
-		for (uint32_t channel = 0; channel < fb.header["nchans"].val.i; ++channel) {
-			//if the sample meets the minimum intensity, attempt to find a line continueing from the intensity
-			if (fb.data[((uint64_t)sample_index) + channel] > pulsar_intensity) {
-				start_sample_index = sample;
-
-				//attempt to find a line, line_coordinates contains the first and last index of the pulsar
-				line_coordinates = find_line(fb, start_sample_index, max_delay, pulsar_intensity);
-			}
+bool run_beams(const dedisperse_options& opts) {
+	struct stat info;
+	if (stat(opts.output_directory.c_str(), &info) != 0 || !S_ISDIR(info.st_mode)) {
+		throw std::runtime_error("Output directory does not exist: " + opts.output_directory);
+	}
+	std::vector<std::string> outputs;
+	for (const std::string& input : opts.inputs) {
+		size_t slash = input.find_last_of('/');
+		std::string output = opts.output_directory + "/" + (slash == std::string::npos ? input : input.substr(slash + 1));
+		if (std::find(outputs.begin(), outputs.end(), output) != outputs.end()) {
+			throw std::runtime_error("Two beams would be written to " + output);
 		}
+		outputs.push_back(output);
 	}
 
-	return 0.0f;
+	const uint32_t cores = std::max(1u, std::thread::hardware_concurrency());
+	const uint32_t jobs = (uint32_t)std::min<uint64_t>(opts.jobs ? opts.jobs : cores, opts.inputs.size());
+	// A threaded chain runs the source, every stage and the sink on threads of their own, and the stages that
+	// split their blocks over threads share the rest of the threads of the job. Unthreaded, the stages run one
+	// after the other on the job thread, so each of them may use all threads of the job.
+	const uint32_t job_threads = std::max(1u, cores / jobs);
+	const uint32_t split_stages = (opts.rfi_enabled() ? 1 : 0) + (opts.remove_mean ? 1 : 0) + (opts.baseline ? 1 : 0);
+	const uint32_t chain_threads = 3 + split_stages + (opts.nbits != 32 ? 1 : 0);
+	const bool threaded = job_threads >= chain_threads;
+	const uint32_t stage_threads = threaded ? 1 + (job_threads - chain_threads) / std::max(1u, split_stages) : job_threads;
+
+	bool ok = true;
+	for_each_item(opts.inputs.size(), jobs, [&](uint32_t, uint64_t index) {
+		dedisperse_beam(opts.inputs[index], outputs[index], opts, threaded, stage_threads);
+	}, [&](uint64_t index, const std::string& failure) {
+		std::cerr << opts.inputs[index] << ": " << failure << "\n";
+		ok = false;
+	});
+	return ok;
 }
 
 /**
- * Attempts to find the approximate intensity of a pulsar
- *  
- * @param[in] fb Filterbank file to find the dispersion measure from
- * @param[in] highest_x the n_highest values to average 
- * @return the estimated pulsar intensity
+ * Parses the sigproc style arguments of dedisperse
+ * 
+ * @param[in] argc the number of arguments provided to the program
+ * @param[in] argv the arguments provided to the program
+ * @param[out] opts the parsed options
+ * @return false when an argument is invalid or not supported
  */
-float find_estimation_intensity(filterbank& fb, uint32_t highest_x)
-{
-	float sum_intensities = 0.0;
-
-	//sum the highest n values per sample;
-	for (uint32_t sample = 0; sample < fb.header["nsamples"].val.i; ++sample) {
-		uint32_t sample_index = (sample * fb.header["nifs"].val.i * fb.header["nchans"].val.i);
-
-		std::priority_queue<float> q;
-		for (uint32_t channel = 0; channel < fb.header["nchans"].val.i; ++channel) {
-			q.push(fb.data[((uint64_t)sample_index) + channel]);
+bool parse_arguments(int32_t argc, char* argv[], dedisperse_options& opts) {
+	for (int32_t i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (stats::parse_argument(argv[i])) {
+			continue;
+		}
+		if (arg.size() < 2 || arg[0] != '-') {
+			opts.inputs.push_back(arg);
+			continue;
+		}
+		if (arg == "-headerless") {
+			opts.headerless = true;
+			continue;
+		}
+		if (arg == "-rmean") {
+			opts.remove_mean = true;
+			continue;
+		}
+		if (arg == "-nobaseline") {
+			opts.baseline = false;
+			continue;
+		}
+		if (arg == "-Z") {
+			opts.rfi.zero = true;
+			continue;
+		}
+		if (arg == "-sumifs") {
+			opts.sum_ifs = true;
+			continue;
+		}
+		if (arg == "-verify") {
+			opts.verify = true;
+			continue;
 		}
 
-		for (uint32_t i = 0; i < highest_x; ++i) {
-			float val = q.top();
-			sum_intensities += val;
-			q.pop();
+		// All other options take a value
+		if (i + 1 >= argc) {
+			std::cerr << "Missing value for " << arg << "\n";
+			return false;
+		}
+		const char* value = argv[++i];
+		char* end = nullptr;
+		double number = strtod(value, &end);
+		bool is_number = end != value && *end == '\0';
+		if (arg == "-o") {
+			opts.output = value;
+		} else if (arg == "-i") {
+			opts.ignore_file = value;
+		} else if (arg == "-sentinel") {
+			opts.sentinel = value;
+		} else if (arg == "-outdir") {
+			opts.output_directory = value;
+		} else if (!is_number) {
+			std::cerr << "Invalid value for " << arg << ": " << value << "\n";
+			return false;
+		} else if (arg == "-d") {
+			opts.dispersion_measure = number;
+		} else if (arg == "-b" && number >= 1) {
+			opts.n_bands = (uint32_t)number;
+		} else if (arg == "-B" && filterbank::supported_bits((int32_t)number)) {
+			opts.nbits = (int32_t)number;
+		} else if (arg == "-f") {
+			opts.reference_frequency = number;
+		} else if (arg == "-c" && number > 0) {
+			opts.rfi.clip = number;
+		} else if (arg == "-k" && number > 0) {
+			opts.rfi.kurtosis = number;
+		} else if (arg == "-z" && number > 0) {
+			opts.rfi.zap = number;
+		} else if (arg == "-follow" && number >= 0) {
+			opts.follow_timeout = number;
+		} else if (arg == "-jobs" && number >= 1) {
+			opts.jobs = (uint32_t)number;
+		} else {
+			std::cerr << "Unsupported option or value: " << arg << " " << value << "\n";
+			return false;
 		}
 	}
-
-
-	float average_intensity = (sum_intensities / (fb.header["nsamples"].val.i * highest_x));
-	return average_intensity;
+	if (opts.inputs.size() > 1 && opts.output_directory.empty()) {
+		std::cerr << "More than one input file, e.g. the beams of a multibeam, needs -outdir\n";
+		return false;
+	}
+	if (!opts.output_directory.empty() && (opts.inputs.empty() || !opts.output.empty())) {
+		std::cerr << "-outdir needs input files and no -o\n";
+		return false;
+	}
+	if (opts.follow_timeout >= 0.0 || !opts.sentinel.empty()) {
+		for (const std::string& input : opts.inputs) {
+			if (filterbank::input_type(input) != filterbank::ioType::FILEIO) {
+				std::cerr << "-follow and -sentinel need input files\n";
+				return false;
+			}
+		}
+		if (opts.inputs.empty()) {
+			std::cerr << "-follow and -sentinel need input files\n";
+			return false;
+		}
+	}
+	if (!opts.follow_timeout && opts.sentinel.empty()) {
+		std::cerr << "-follow 0 needs a -sentinel to end\n";
+		return false;
+	}
+	return true;
 }
 
-
 void dedisperse_help() /*includefile*/
 {
 	std::cout << std::endl;
 	std::cout << ("dedisperse  - form time series from filterbankCore data or profile from folded data") << std::endl << std::endl;
-	std::cout << ("usage: dedisperse {filename} -{options}") << std::endl << std::endl;
+	std::cout << ("usage: dedisperse {filename} -{options}") << std::endl;
+	std::cout << ("       dedisperse {beam files} -outdir directory -{options}") << std::endl << std::endl;
 	std::cout << ("options:") << std::endl << std::endl;
 	std::cout << ("   filename - full name of the raw data file to be read (def=stdin)") << std::endl;
 	std::cout << ("-d dm2ddisp - set DM value to dedisperse at (def=0.0)") << std::endl;
@@ -159,10 +266,15 @@ void dedisperse_help() /*includefile*/
 	std::cout << ("-B num_bits - set output number of bits (def=32)") << std::endl;
 	std::cout << ("-o filename - output file name (def=stdout)") << std::endl;
 	std::cout << ("-c minvalue - clip samples > minvalue*rms (def=noclip)") << std::endl;
+	std::cout << ("-k sigma    - replace channels whose spectral kurtosis deviates by sigma in a block (def=off)") << std::endl;
+	std::cout << ("-z sigma    - replace time samples whose channel average deviates by sigma (def=off)") << std::endl;
+	std::cout << ("-Z          - replace flagged data by zero instead of the channel mean (def=mean)") << std::endl;
 	std::cout << ("-f reffreq  - dedisperse relative to refrf MHz (def=topofsubband)") << std::endl;
 	std::cout << ("-F newfreq  - correct header value of centre frequency to newfreq MHz (def=header value)") << std::endl;
 	std::cout << ("-n num_bins - set number of bins if input is profile (def=input)") << std::endl;
 	std::cout << ("-i filename - read list of channels to ignore from a file (def=none)") << std::endl;
+	std::cout << ("-follow secs - read the file while it is still being written, until it has not grown for secs (def=off)") << std::endl;
+	std::cout << ("-sentinel filename - read the file while it is still being written, until filename exists (def=off)") << std::endl;
 	std::cout << ("-p np1 np2  - add profile numbers np1 thru np2 if multiple WAPP dumps (def=all)") << std::endl;
 	std::cout << ("-j Jyfactor - multiply dedispersed data by Jyfactor to convert to Jy") << std::endl;
 	std::cout << ("-J Jyf1 Jyf2 - multiply dedispersed data by Jyf1 and Jyf2 to convert to Jy (use only for two-polarization data)") << std::endl;
@@ -171,9 +283,13 @@ void dedisperse_help() /*includefile*/
 	std::cout << ("-rmean      - subtract the mean of channels from each sample before dedispersion (def=no)") << std::endl;
 	std::cout << ("-swapout    - perform byte swapping on output data (def=native)") << std::endl;
 	std::cout << ("-nobaseline - don't subtract baseline from the data (def=subtract)") << std::endl;
-	std::cout << ("-sumifs     - sum 2 IFs when creating the final profile (def=don't)") << std::endl;
+	std::cout << ("-sumifs     - sum the IFs, e.g. polarizations, as the data is read (def=don't)") << std::endl;
+	std::cout << ("-verify     - check that the data is not truncated and matches the CRC32C in filename.crc32c, written when missing if it can be") << std::endl;
+	std::cout << ("-outdir dir - write every input file, e.g. beam, to a file of the same name in dir, all at once") << std::endl;
+	std::cout << ("-jobs num   - with -outdir, the number of beams dedispersed at once (def=all cores)") << std::endl;
 	std::cout << ("-headerless - write out data without any header info") << std::endl;
 	std::cout << ("-epn        - write profiles in EPN format (def=ASCII)") << std::endl;
 	std::cout << ("-asciipol   - write profiles in ASCII format for polarization package") << std::endl;
-	std::cout << ("-stream     - write profiles as ASCII streams with START/STOP boundaries") << std::endl << std::endl;
+	std::cout << ("-stream     - write profiles as ASCII streams with START/STOP boundaries") << std::endl;
+	std::cout << ("--stats[=json] - print a per stage timing breakdown to stderr (def=off)") << std::endl << std::endl;
 }
\ No newline at end of file
@@ -0,0 +1,78 @@
+#ifndef _COMMAND_LINE_OPTIONS_HPP__
+#define _COMMAND_LINE_OPTIONS_HPP__
+
+#include <string.h>
+#include <iostream>
+#include <boost/program_options.hpp>
+#include <boost/lexical_cast.hpp>
+#include "sampleBuffer.hpp"
+
+namespace po = boost::program_options;
+
+class CommandLineOptions {
+public:
+    enum statusReturn_e {
+        OPTS_SUCCESS,
+        OPTS_HELP,
+        ERROR_IN_COMMAND_LINE,
+        ERROR_UNHANDLED_EXCEPTION
+    };
+    CommandLineOptions();
+    statusReturn_e parse(int argc, char* argv[]);
+
+    const std::string & getOutputFile() const { return myOutputFile; };
+    int getOutputType() { return outputType; };
+    int32_t getNumberOfBits() { return num_bits; };
+    int32_t getNumberOfChannels() { return num_chans; };
+    int32_t getNumberOfIfs() { return num_ifs; };
+    double getSampleTime() { return tsamp; };
+    double getObservationTime() { return tobs; };
+    double getFirstChannelFrequency() { return fch1; };
+    double getChannelBandwidth() { return foff; };
+    double getStartTime() { return tstart; };
+    double getMean() { return mean; };
+    double getRms() { return rms; };
+    double getPeriod() { return period; };
+    double getSinglePulseTime() { return single; };
+    double getPulseWidth() { return width; };
+    double getSignalToNoise() { return snr; };
+    double getDispersionMeasure() { return dm; };
+    uint64_t getSeed() { return seed; };
+    uint32_t getNumberOfThreads() { return num_threads; };
+    bool getHeaderlessFlag() { return myHeaderlessFlag; };
+    bool getDirectFlag() { return myDirectFlag; };
+    const std::string & getStatsFormat() const { return myStatsFormat; };
+    sample_buffer::pages getPages() { return page_policy; };
+
+protected:
+    void setup();
+
+private:
+    po::options_description myOptions;
+    std::string myOutputFile;
+    int outputType;
+    int32_t num_bits;
+    int32_t num_chans;
+    int32_t num_ifs;
+    double tsamp;
+    double tobs;
+    double fch1;
+    double foff;
+    double tstart;
+    double mean;
+    double rms;
+    double period;
+    double single;
+    double width;
+    double snr;
+    double dm;
+    uint64_t seed;
+    uint32_t num_threads;
+    bool myHeaderlessFlag;
+    bool myDirectFlag;
+    std::string myStatsFormat;
+    std::string myPages;
+    sample_buffer::pages page_policy;
+};
+
+#endif // _COMMAND_LINE_OPTIONS_HPP__
@@ -0,0 +1,52 @@
+#ifndef FAKE_H
+#define FAKE_H
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <iostream>
+#include "filterbankCore.hpp"
+#include "stats.hpp"
+#include "CommandLineOptions.hpp"
+
+/**
+ * @brief Small and fast random number generator (xoshiro256+), seeded through splitmix64.
+ * Every chunk of spectra gets its own stream so the output does not depend on the number of threads.
+ */
+class fake_rng {
+public:
+	explicit fake_rng(uint64_t seed);
+	uint64_t next();
+	double uniform();
+	void gaussian_pair(float& a, float& b);
+
+private:
+	uint64_t state[4];
+};
+
+/**
+ * @brief Everything needed to generate an arbitrary range of spectra
+ */
+struct fake_params {
+	uint32_t nchans;
+	uint32_t nifs;
+	uint32_t nbits;
+	double tsamp; // seconds
+	double mean;
+	double rms;
+	double maximum; // largest value representable at nbits
+	uint64_t seed;
+
+	double period; // seconds, 0 for none
+	double single; // seconds, negative for none
+	double sigma; // gaussian sigma of the pulse in seconds
+	double amplitude; // peak height of the pulse per channel
+	std::vector<double> delays; // dispersion delay per channel in seconds
+};
+
+fake_params make_params(CommandLineOptions& opts);
+void generate_spectra(const fake_params& params, float* block, uint64_t first_sample, uint32_t nsamples);
+void generate_block(const fake_params& params, float* block, uint64_t first_sample, uint32_t nsamples, uint32_t n_threads);
+
+#endif // !FAKE_H
@@ -0,0 +1,113 @@
+#include "CommandLineOptions.hpp"
+#include "filterbankCore.hpp"
+
+CommandLineOptions::CommandLineOptions():
+    myOptions(),
+    myOutputFile(),
+    outputType(0),
+    num_bits(8),
+    num_chans(1024),
+    num_ifs(1),
+    tsamp(64.0),
+    tobs(10.0),
+    fch1(1500.0),
+    foff(-0.25),
+    tstart(56000.0),
+    mean(-1.0),
+    rms(-1.0),
+    period(0.0),
+    single(-1.0),
+    width(5.0),
+    snr(0.0),
+    dm(0.0),
+    seed(1),
+    num_threads(0),
+    myHeaderlessFlag(false),
+    myDirectFlag(false),
+    myStatsFormat(),
+    myPages(),
+    page_policy(sample_buffer::TRANSPARENT_HUGE_PAGES)
+{
+    setup();
+}
+
+void CommandLineOptions::setup() {
+    po::options_description options("fake - produce a filterbank file of gaussian noise with optional dispersed pulses\n\n\
+usage: fake -{options}\n\noptions");
+    options.add_options()
+        ("help,h", "produce this help message")
+        (",o", po::value<std::string>(&myOutputFile)->value_name("FILE"), "filterbank output file (def=stdout)")
+        ("nbits", po::value<int32_t>(&num_bits)->value_name("numbits"), "number of bits per sample: 1, 2, 4, 8, 16 or 32 (def=8)")
+        ("nchans", po::value<int32_t>(&num_chans)->value_name("numchans"), "number of frequency channels (def=1024)")
+        ("nifs", po::value<int32_t>(&num_ifs)->value_name("numifs"), "number of IF channels (def=1)")
+        ("tsamp", po::value<double>(&tsamp)->value_name("us"), "sampling time in microseconds (def=64)")
+        ("tobs", po::value<double>(&tobs)->value_name("s"), "length of the observation in seconds (def=10)")
+        ("fch1", po::value<double>(&fch1)->value_name("MHz"), "frequency of channel 1 (def=1500)")
+        ("foff", po::value<double>(&foff)->value_name("MHz"), "channel bandwidth (def=-0.25)")
+        ("tstart", po::value<double>(&tstart)->value_name("MJD"), "time stamp of the first sample (def=56000)")
+        ("mean", po::value<double>(&mean)->value_name("value"), "mean of the noise (def=middle of the nbits range, 0 for 32 bits)")
+        ("rms", po::value<double>(&rms)->value_name("value"), "rms of the noise (def=1/16 of the nbits range, 1 for 32 bits)")
+        ("period", po::value<double>(&period)->value_name("ms"), "inject a periodic signal with this period (def=none)")
+        ("single", po::value<double>(&single)->value_name("s"), "inject a single pulse arriving at this time (def=none)")
+        ("width", po::value<double>(&width)->value_name("ms"), "full width at half maximum of the pulses (def=5)")
+        ("snr", po::value<double>(&snr)->value_name("value"), "signal to noise ratio of each dedispersed pulse (def=0)")
+        ("dm", po::value<double>(&dm)->value_name("pc/cc"), "dispersion measure of the pulses (def=0)")
+        ("seed", po::value<uint64_t>(&seed)->value_name("value"), "seed of the random number generator (def=1)")
+        ("threads", po::value<uint32_t>(&num_threads)->value_name("numthreads"), "number of generator threads (def=all cores)")
+        ("headerless", po::bool_switch(&myHeaderlessFlag), "do not broadcast resulting header (def=broadcast)")
+        ("direct", po::bool_switch(&myDirectFlag), "write the output file with O_DIRECT, bypassing the page cache")
+        ("pages", po::value<std::string>(&myPages)->value_name("type"), "pages of buffers of 2 MB or more: small, transparent huge pages or reserved huge pages, which fall back to small ones when none are left (def=transparent)")
+        ("stats", po::value<std::string>(&myStatsFormat)->implicit_value("text")->value_name("json"), "print a per stage timing breakdown to stderr, as a table or json (def=off)");
+
+    myOptions.add(options);
+}
+
+CommandLineOptions::statusReturn_e CommandLineOptions::parse(int argc, char* argv[]) {
+    statusReturn_e ret = OPTS_SUCCESS;
+
+    po::variables_map vm;
+
+    try {
+        // Allow the sigproc style single dash long options, e.g. -nbits 8
+        po::store(po::command_line_parser(argc, argv)
+                    .options(myOptions)
+                    .style(po::command_line_style::default_style | po::command_line_style::allow_long_disguise)
+                    .run(),
+                vm);
+
+        if (vm.count("help")) {
+            std::cout << myOptions << std::endl;
+            return OPTS_HELP;
+        }
+        if (vm.count("-o")) {
+            outputType = 1;
+        }
+
+        po::notify(vm);
+
+        if (vm.count("stats") && myStatsFormat.compare("text") && myStatsFormat.compare("json")) {
+            std::cerr << "--stats only accepts text or json" << std::endl;
+            return ERROR_IN_COMMAND_LINE;
+        }
+        if (vm.count("pages") && !sample_buffer::parse_pages(myPages, page_policy)) {
+            std::cerr << "--pages only accepts small, transparent or huge" << std::endl;
+            return ERROR_IN_COMMAND_LINE;
+        }
+
+    } catch (const po::error &ex) {
+        std::cerr << ex.what() << std::endl;
+        std::cout << myOptions << std::endl;
+        return ERROR_IN_COMMAND_LINE;
+    }
+
+    if (!filterbank::supported_bits(num_bits)) {
+        std::cerr << "Invalid number of output bits: supported formats are 1/2/4/8/16/32 bits" << std::endl;
+        return ERROR_IN_COMMAND_LINE;
+    }
+    if (num_chans < 1 || num_ifs < 1 || tsamp <= 0.0 || tobs <= 0.0) {
+        std::cerr << "nchans, nifs, tsamp and tobs must be positive" << std::endl;
+        return ERROR_IN_COMMAND_LINE;
+    }
+
+    return ret;
+}
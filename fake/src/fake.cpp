@@ -0,0 +1,284 @@
+#include "fake.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+// number of spectra that share a single random number stream
+static const uint32_t chunk_samples = 256;
+
+/**
+ * generates a filterbank file containing gaussian noise, optionally with
+ * periodic or single dispersed pulses injected at a known dm, width and s/n
+ * 
+ * @param[in] argc the number of arguments provided to the program
+ * @param[in] argv the arguments provided to the program
+ */
+int main(int argc, char* argv[]) {
+	CommandLineOptions opts;
+	CommandLineOptions::statusReturn_e argumentStatus = opts.parse(argc, argv);
+	if (argumentStatus == CommandLineOptions::OPTS_HELP) {
+		exit(0);
+	} else if (argumentStatus != CommandLineOptions::OPTS_SUCCESS) {
+		exit(-1);
+	}
+
+	if (!opts.getStatsFormat().empty()) {
+		stats::enable(!opts.getStatsFormat().compare("json"));
+	}
+	sample_buffer::set_pages(opts.getPages());
+
+	double tsamp = opts.getSampleTime() * 1.0e-6;
+	double total_samples = std::floor(opts.getObservationTime() / tsamp);
+	if (total_samples < 1 || total_samples > INT32_MAX) {
+		std::cerr << "Observation length must contain between 1 and " << INT32_MAX << " samples\n";
+		exit(-1);
+	}
+	uint32_t nsamples = (uint32_t)total_samples;
+
+	filterbank fb;
+	// Zero is a valid id (Fake), so mark them as set
+	fb.header["telescope_id"].val.i = 0;
+	fb.header["telescope_id"].present = true;
+	fb.header["machine_id"].val.i = 0;
+	fb.header["machine_id"].present = true;
+	fb.header["data_type"].val.i = 1;
+	strncpy(fb.header["source_name"].val.s, "fake", sizeof(headerValue::s) - 1);
+	fb.header["tstart"].val.d = opts.getStartTime();
+	fb.header["tsamp"].val.d = tsamp;
+	fb.header["nbits"].val.i = opts.getNumberOfBits();
+	fb.header["nsamples"].val.i = nsamples;
+	fb.header["fch1"].val.d = opts.getFirstChannelFrequency();
+	fb.header["foff"].val.d = opts.getChannelBandwidth();
+	fb.header["nchans"].val.i = opts.getNumberOfChannels();
+	fb.header["nifs"].val.i = opts.getNumberOfIfs();
+	if (opts.getDispersionMeasure() != 0.0) {
+		fb.header["refdm"].val.d = opts.getDispersionMeasure();
+	}
+	if (opts.getPeriod() > 0.0) {
+		fb.header["period"].val.d = opts.getPeriod() * 1.0e-3;
+	}
+
+	fake_params params = make_params(opts);
+
+	uint32_t n_threads = opts.getNumberOfThreads();
+	if (!n_threads) {
+		n_threads = std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	if (!fb.create(opts.getOutputType() ? filterbank::ioType::FILEIO : filterbank::ioType::STDIO, opts.getOutputFile(), opts.getHeaderlessFlag())) {
+		exit(-2);
+	}
+	// Encoded blocks are written in the background while the next block is generated
+	fb.write_behind(4, 4 << 20, opts.getDirectFlag());
+
+	// Aim for blocks of roughly 16 MB, made of whole random number chunks
+	uint64_t values_per_sample = (uint64_t)params.nchans * params.nifs;
+	uint32_t block_samples = (uint32_t)std::max<uint64_t>(1, (4u << 20) / (values_per_sample * chunk_samples)) * chunk_samples;
+
+	// Not initialized, so every page is first touched by the generator thread that fills it
+	sample_buffer buffer((uint64_t)block_samples * values_per_sample);
+	for (uint64_t sample = 0; sample < nsamples; sample += block_samples) {
+		uint32_t n = (uint32_t)std::min<uint64_t>(block_samples, nsamples - sample);
+		generate_block(params, buffer.data(), sample, n, n_threads);
+		fb.write_block(buffer.data(), n);
+	}
+
+	fb.close();
+	stats::report();
+	return 0;
+}
+
+/**
+ * Derives the generator parameters from the command line options
+ * 
+ * @param[in] opts the parsed command line options
+ * @return the parameters for generate_block
+ */
+fake_params make_params(CommandLineOptions& opts) {
+	fake_params params;
+	params.nchans = opts.getNumberOfChannels();
+	params.nifs = opts.getNumberOfIfs();
+	params.nbits = opts.getNumberOfBits();
+	params.tsamp = opts.getSampleTime() * 1.0e-6;
+	params.seed = opts.getSeed();
+
+	// Default to a mean in the middle and an rms of 1/16 of the range, leaving room for pulses
+	params.maximum = (params.nbits == 32) ? 0.0 : (double)((1u << params.nbits) - 1);
+	params.mean = opts.getMean() >= 0.0 ? opts.getMean() : (params.nbits == 32 ? 0.0 : (params.maximum + 1) / 2.0);
+	params.rms = opts.getRms() >= 0.0 ? opts.getRms() : (params.nbits == 32 ? 1.0 : (params.maximum + 1) / 16.0);
+
+	params.period = std::max(0.0, opts.getPeriod() * 1.0e-3);
+	params.single = opts.getSinglePulseTime();
+	double fwhm = std::max(opts.getPulseWidth() * 1.0e-3, params.tsamp);
+	params.sigma = fwhm / (2.0 * std::sqrt(2.0 * std::log(2.0)));
+
+	// Choose the per channel peak so that summing all channels of the dedispersed
+	// pulse over a boxcar of one fwhm gives the requested signal to noise ratio
+	double width_samples = fwhm / params.tsamp;
+	params.amplitude = opts.getSignalToNoise() * params.rms * std::sqrt(params.nchans * width_samples) * params.tsamp
+		/ (params.nchans * params.sigma * std::sqrt(2.0 * M_PI) * std::erf(std::sqrt(std::log(2.0))));
+
+	// Dispersion delay of every channel relative to the highest frequency
+	double fch1 = opts.getFirstChannelFrequency();
+	double foff = opts.getChannelBandwidth();
+	double f_ref = std::max(fch1, fch1 + (params.nchans - 1) * foff);
+	params.delays.resize(params.nchans);
+	for (uint32_t channel = 0; channel < params.nchans; ++channel) {
+		double freq = fch1 + channel * foff;
+		params.delays[channel] = 4.148808e3 * opts.getDispersionMeasure() * (1.0 / (freq * freq) - 1.0 / (f_ref * f_ref));
+	}
+	return params;
+}
+
+/**
+ * Generates a range of spectra. The range has to start at a multiple of chunk_samples
+ * so every chunk is generated from its own random number stream.
+ * 
+ * @param[in] params the generator parameters
+ * @param[out] block the output, nifs * nchans values per spectrum
+ * @param[in] first_sample the index of the first spectrum in the observation
+ * @param[in] nsamples the number of spectra to generate
+ */
+void generate_spectra(const fake_params& params, float* block, uint64_t first_sample, uint32_t nsamples) {
+	uint64_t values_per_sample = (uint64_t)params.nchans * params.nifs;
+	bool inject = params.amplitude > 0.0 && (params.period > 0.0 || params.single >= 0.0);
+	double reach = 5.0 * params.sigma;
+
+	for (uint32_t chunk = 0; chunk < nsamples; chunk += chunk_samples) {
+		fake_rng rng(params.seed ^ (((first_sample + chunk) / chunk_samples) * 0x9e3779b97f4a7c15ULL));
+		uint32_t chunk_end = std::min(nsamples, chunk + chunk_samples);
+
+		for (uint32_t sample = chunk; sample < chunk_end; ++sample) {
+			float* spectrum = block + sample * values_per_sample;
+			uint64_t i = 0;
+			for (; i + 1 < values_per_sample; i += 2) {
+				rng.gaussian_pair(spectrum[i], spectrum[i + 1]);
+			}
+			if (i < values_per_sample) {
+				float spare;
+				rng.gaussian_pair(spectrum[i], spare);
+			}
+
+			for (uint64_t value = 0; value < values_per_sample; ++value) {
+				spectrum[value] = (float)(params.mean + params.rms * spectrum[value]);
+			}
+
+			if (inject) {
+				double time = (first_sample + sample) * params.tsamp;
+				for (uint32_t channel = 0; channel < params.nchans; ++channel) {
+					double dt;
+					if (params.period > 0.0) {
+						// distance to the nearest pulse, pulses are centred half a period after each period start
+						dt = time - params.delays[channel] - 0.5 * params.period;
+						dt -= params.period * std::floor(dt / params.period + 0.5);
+					} else {
+						dt = time - params.delays[channel] - params.single;
+					}
+					if (std::fabs(dt) < reach) {
+						float pulse = (float)(params.amplitude * std::exp(-0.5 * (dt / params.sigma) * (dt / params.sigma)));
+						for (uint32_t interface = 0; interface < params.nifs; ++interface) {
+							spectrum[interface * params.nchans + channel] += pulse;
+						}
+					}
+				}
+			}
+
+			// Keep the values inside the range that can be written
+			if (params.nbits != 32) {
+				for (uint64_t value = 0; value < values_per_sample; ++value) {
+					spectrum[value] = std::min((float)params.maximum, std::max(0.0f, std::floor(spectrum[value] + 0.5f)));
+				}
+			}
+		}
+	}
+}
+
+/**
+ * Generates a block of spectra using several threads, each taking chunks with their own random number stream
+ * 
+ * @param[in] params the generator parameters
+ * @param[out] block the output, nifs * nchans values per spectrum
+ * @param[in] first_sample the index of the first spectrum in the observation
+ * @param[in] nsamples the number of spectra to generate
+ * @param[in] n_threads the number of threads to use
+ */
+void generate_block(const fake_params& params, float* block, uint64_t first_sample, uint32_t nsamples, uint32_t n_threads) {
+	scoped_timer timer("generate");
+	uint64_t values_per_sample = (uint64_t)params.nchans * params.nifs;
+	stats::count("generate", 0, nsamples * values_per_sample);
+	uint32_t n_chunks = (nsamples + chunk_samples - 1) / chunk_samples;
+	std::atomic<uint32_t> next_chunk(0);
+
+	auto worker = [&]() {
+		uint32_t chunk;
+		while ((chunk = next_chunk.fetch_add(1)) < n_chunks) {
+			uint32_t start = chunk * chunk_samples;
+			uint32_t n = std::min(chunk_samples, nsamples - start);
+			generate_spectra(params, block + start * values_per_sample, first_sample + start, n);
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (uint32_t thread = 1; thread < std::min(n_threads, n_chunks); ++thread) {
+		threads.emplace_back(worker);
+	}
+	worker();
+	for (auto& thread : threads) {
+		thread.join();
+	}
+}
+
+/**
+ * Seeds the four state words from a single seed using splitmix64
+ * 
+ * @param[in] seed the seed of this stream
+ */
+fake_rng::fake_rng(uint64_t seed) {
+	for (unsigned int i = 0; i < 4; ++i) {
+		uint64_t z = (seed += 0x9e3779b97f4a7c15ULL);
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+		state[i] = z ^ (z >> 31);
+	}
+}
+
+/**
+ * @return the next 64 random bits
+ */
+uint64_t fake_rng::next() {
+	const uint64_t result = state[0] + state[3];
+	const uint64_t t = state[1] << 17;
+	state[2] ^= state[0];
+	state[3] ^= state[1];
+	state[1] ^= state[2];
+	state[0] ^= state[3];
+	state[2] ^= t;
+	state[3] = (state[3] << 45) | (state[3] >> 19);
+	return result;
+}
+
+/**
+ * @return a uniform random number in (0, 1]
+ */
+double fake_rng::uniform() {
+	return ((next() >> 11) + 1) * (1.0 / 9007199254740992.0);
+}
+
+/**
+ * Draws two independent standard normal numbers using the Marsaglia polar method,
+ * which avoids the trigonometric functions of the Box-Muller transform
+ * 
+ * @param[out] a the first number
+ * @param[out] b the second number
+ */
+void fake_rng::gaussian_pair(float& a, float& b) {
+	double u, v, s;
+	do {
+		u = 2.0 * uniform() - 1.0;
+		v = 2.0 * uniform() - 1.0;
+		s = u * u + v * v;
+	} while (s >= 1.0 || s == 0.0);
+	double factor = std::sqrt(-2.0 * std::log(s) / s);
+	a = (float)(u * factor);
+	b = (float)(v * factor);
+}
@@ -0,0 +1,44 @@
+#ifndef FOLD_H
+#define FOLD_H
+
+#include <fstream>
+#include "filterbankCore.hpp"
+#include "pipeline.hpp"
+#include "stages.hpp"
+#include "stats.hpp"
+
+struct fold_tool_options {
+	std::string input; // empty for stdin
+	std::string output; // empty for stdout
+	bool ascii = false;
+	bool headerless = false;
+	bool remove_mean = false; // -rmean, zero-DM filter
+	std::string ignore_file;
+	fold_options fold;
+};
+
+/**
+ * @brief Writes folded profiles as text, a comment line per sub-integration followed by
+ * a line per phase bin with the bin number and the value of every IF and sub-band
+ */
+class ascii_profile_sink : public sink {
+public:
+	explicit ascii_profile_sink(const std::string& filename);
+
+	void configure(std::map<std::string, header_param>& header) override;
+	void consume(const block& input) override;
+	void finish() override;
+
+private:
+	std::string filename;
+	std::ofstream file;
+	std::ostream* out = nullptr;
+	uint32_t nbins = 0;
+	uint64_t values = 0;
+	double period = 0.0;
+};
+
+bool parse_arguments(int32_t argc, char* argv[], fold_tool_options& opts);
+
+void fold_help();
+#endif // !FOLD_H
@@ -0,0 +1,193 @@
+#include "fold.h"
+#include <unistd.h>
+
+/**
+ * folds filterbank data or dedispersed time series at the period of a pulsar. The data is
+ * streamed through the optional mask and zero-DM stages into the fold stage, which writes
+ * folded data (data_type 3) or ASCII profiles.
+ *
+ * @param[in] argc the number of arguments provided to the program
+ * @param[in] argv the arguments provided to the program
+ */
+int32_t main(int32_t argc, char* argv[]) {
+	// Without arguments and without piped input there is nothing to do
+	if (argc < 2 && isatty(fileno(stdin))) {
+		fold_help();
+		exit(0);
+	}
+
+	fold_tool_options opts;
+	if (!parse_arguments(argc, argv, opts)) {
+		fold_help();
+		exit(-1);
+	}
+
+	try {
+		pipeline chain;
+		chain.set_source(std::unique_ptr<source>(new filterbank_source(
+			filterbank::input_type(opts.input), opts.input)));
+		if (!opts.ignore_file.empty()) {
+			chain.add_stage(std::unique_ptr<stage>(new mask_stage(mask_stage::read_channel_list(opts.ignore_file))));
+		}
+		if (opts.remove_mean) {
+			chain.add_stage(std::unique_ptr<stage>(new zero_dm_stage()));
+		}
+		chain.add_stage(std::unique_ptr<stage>(new fold_stage(opts.fold)));
+		if (opts.ascii) {
+			chain.set_sink(std::unique_ptr<sink>(new ascii_profile_sink(opts.output)));
+		} else {
+			chain.set_sink(std::unique_ptr<sink>(new filterbank_sink(
+				opts.output.empty() ? filterbank::ioType::STDIO : filterbank::ioType::FILEIO, opts.output, opts.headerless)));
+		}
+		chain.run();
+	} catch (const std::exception& ex) {
+		std::cerr << ex.what() << "\n";
+		exit(-3);
+	} catch (const char* msg) {
+		std::cerr << msg << "\n";
+		exit(-3);
+	}
+
+	stats::report();
+	return 0;
+}
+
+/**
+ * Parses the sigproc style arguments of fold
+ *
+ * @param[in] argc the number of arguments provided to the program
+ * @param[in] argv the arguments provided to the program
+ * @param[out] opts the parsed options
+ * @return false when an argument is invalid or not supported
+ */
+bool parse_arguments(int32_t argc, char* argv[], fold_tool_options& opts) {
+	for (int32_t i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (stats::parse_argument(argv[i])) {
+			continue;
+		}
+		if (arg.size() < 2 || arg[0] != '-') {
+			if (!opts.input.empty()) {
+				std::cerr << "Only one input file can be given: " << arg << "\n";
+				return false;
+			}
+			opts.input = arg;
+			continue;
+		}
+		if (arg == "-ascii") {
+			opts.ascii = true;
+			continue;
+		}
+		if (arg == "-headerless") {
+			opts.headerless = true;
+			continue;
+		}
+		if (arg == "-rmean") {
+			opts.remove_mean = true;
+			continue;
+		}
+
+		// All other options take a value
+		if (i + 1 >= argc) {
+			std::cerr << "Missing value for " << arg << "\n";
+			return false;
+		}
+		const char* value = argv[++i];
+		char* end = nullptr;
+		double number = strtod(value, &end);
+		bool is_number = end != value && *end == '\0';
+		if (arg == "-o") {
+			opts.output = value;
+		} else if (arg == "-P") {
+			opts.fold.polyco_file = value;
+		} else if (arg == "-i") {
+			opts.ignore_file = value;
+		} else if (!is_number) {
+			std::cerr << "Invalid value for " << arg << ": " << value << "\n";
+			return false;
+		} else if (arg == "-p" && number > 0) {
+			opts.fold.period = number * 1.0e-3;
+		} else if (arg == "-n" && number >= 1) {
+			opts.fold.nbins = (uint32_t)number;
+		} else if (arg == "-b" && number >= 1) {
+			opts.fold.n_bands = (uint32_t)number;
+		} else if (arg == "-t" && number >= 0) {
+			opts.fold.subint = number;
+		} else if (arg == "-d") {
+			opts.fold.dispersion_measure = number;
+		} else if (arg == "-j" && number >= 0) {
+			opts.fold.threads = (uint32_t)number;
+		} else {
+			std::cerr << "Unsupported option or value: " << arg << " " << value << "\n";
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * @param filename the output file, empty for stdout
+ */
+ascii_profile_sink::ascii_profile_sink(const std::string& filename) : filename(filename) {
+}
+
+void ascii_profile_sink::configure(std::map<std::string, header_param>& header) {
+	if (filename.empty()) {
+		out = &std::cout;
+	} else {
+		file.open(filename);
+		if (!file.good()) {
+			throw std::runtime_error("Failed to open output file: " + filename);
+		}
+		out = &file;
+	}
+	nbins = header["nbins"].val.i;
+	values = (uint64_t)header["nifs"].val.i * header["nchans"].val.i;
+	period = header["period"].val.d;
+}
+
+/**
+ * @brief Writes the profiles in the block, a block may hold several sub-integrations
+ */
+void ascii_profile_sink::consume(const block& input) {
+	for (uint32_t row = 0; row < input.nsamples; ++row) {
+		uint64_t bin = (input.first_sample + row) % nbins;
+		if (!bin) {
+			*out << "# subint " << (input.first_sample + row) / nbins << " period " << period * 1.0e3 << " ms nbins " << nbins << "\n";
+		}
+		*out << bin;
+		for (uint64_t value = 0; value < values; ++value) {
+			*out << " " << input.data[row * values + value];
+		}
+		*out << "\n";
+	}
+}
+
+void ascii_profile_sink::finish() {
+	out->flush();
+	if (!out->good()) {
+		throw std::runtime_error("Failed to write profiles");
+	}
+}
+
+void fold_help() /*includefile*/
+{
+	std::cout << std::endl;
+	std::cout << ("fold - fold filterbank data or time series at the period of a pulsar") << std::endl << std::endl;
+	std::cout << ("usage: fold {filename} -{options}") << std::endl << std::endl;
+	std::cout << ("options:") << std::endl << std::endl;
+	std::cout << ("   filename - full name of the raw data file to be read (def=stdin)") << std::endl;
+	std::cout << ("-p period   - fold at this period in ms (def=header period)") << std::endl;
+	std::cout << ("-P polyco   - fold with the ephemeris in a TEMPO polyco file") << std::endl;
+	std::cout << ("-n num_bins - set the number of phase bins (def=period/tsamp, at most 256)") << std::endl;
+	std::cout << ("-b numbands - set output number of sub-bands, the number of channels keeps them all (def=1)") << std::endl;
+	std::cout << ("-t subint   - write a profile every subint seconds (def=one profile of all data)") << std::endl;
+	std::cout << ("-d dm       - align the channels at this DM before folding (def=0.0)") << std::endl;
+	std::cout << ("-i filename - read list of channels to ignore from a file (def=none)") << std::endl;
+	std::cout << ("-j threads  - number of folding threads (def=all cores)") << std::endl;
+	std::cout << ("-o filename - output file name (def=stdout)") << std::endl;
+	std::cout << ("-rmean      - subtract the mean of channels from each sample before folding (def=no)") << std::endl;
+	std::cout << ("-ascii      - write the profiles as text instead of folded filterbank data") << std::endl;
+	std::cout << ("-headerless - write out data without any header info") << std::endl;
+	std::cout << ("--stats[=json] - print a per stage timing breakdown to stderr (def=off)") << std::endl << std::endl;
+}
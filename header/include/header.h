@@ -5,6 +5,7 @@
 #include <iostream>
 #include <vector>
 #include "filterbankCore.hpp"
+#include "stats.hpp"
 #include <boost/date_time/gregorian/gregorian.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 
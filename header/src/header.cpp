@@ -45,9 +45,16 @@ int main(int argc, char* argv[]){
 	char sra[6],sde[6], decsign;
 	std::string unit[4] = {"(seconds)    ", "(minutes)    ", "(hours)      ", "(days)      "};
 
-	std::vector<std::string> argList(argv, argv + argc);
-	if (argList.size() == 1) 
+	std::vector<std::string> argList;
+	for (int i = 0; i < argc; ++i) {
+		if (!stats::parse_argument(argv[i])) {
+			argList.push_back(argv[i]);
+		}
+	}
+	if (argList.size() == 1) {
 		std::cout << "Please supply a filterbankCore file \n";
+		exit(1);
+	}
 
 	std::string filename = argList[1];
 	filterbank fb;
@@ -59,6 +66,10 @@ int main(int argc, char* argv[]){
 		std::cout << msg << "\n";
 		exit(1);
 	}
+	catch(const std::exception& ex){
+		std::cout << ex.what() << "\n";
+		exit(1);
+	}
 
 	// Assign values to rah, ram and ras
     angle_split(fb.header["src_raj"].val.d,&rah,&ram,&ras);
@@ -147,6 +158,9 @@ int main(int argc, char* argv[]){
 		std::cout << "Reference frequency    (MHz)     : " << fb.header["fch1"].val.i << "\n";
 		break;
 	case 3:
+		std::cout << "Folding period (s)               : " << fb.header["period"].val.d << "\n";
+		std::cout << "Number of phase bins             : " << fb.header["nbins"].val.i << "\n";
+		std::cout << "Reference DM (pc/cc)             : " << fb.header["refdm"].val.d << "\n";
 		std::cout << "Frequency of channel 1 (MHz)     : " << fb.header["fch1"].val.d << "\n";
 		std::cout << "Channel bandwidth      (MHz)     : " << abs(fb.header["foff"].val.d) << "\n";
 		std::cout << "Number of channels               : " << fb.header["nchans"].val.i << "\n";
@@ -182,5 +196,6 @@ int main(int argc, char* argv[]){
 	std::cout << "Number of bits per sample        : " << fb.header["nbits"].val.i << "\n";
 	std::cout << "Number of IFs                    : " << fb.header["nifs"].val.i << "\n";
 
+	stats::report();
 	return 0;
 }
\ No newline at end of file
@@ -0,0 +1,203 @@
+#ifndef ASYNCIO_H
+#define ASYNCIO_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Reads a stream ahead of its consumer in fixed size chunks, keeping several chunks in flight.
+ * Regular files use io_uring when the kernel supports it, everything else a dedicated reader thread.
+ */
+class async_reader {
+public:
+	static std::shared_ptr<async_reader> create(FILE* fp, uint64_t offset, size_t chunk_bytes, unsigned int depth);
+	virtual ~async_reader() {};
+
+	// Gets the next chunk and releases the previous one, returns 0 at the end of the stream
+	virtual size_t next(const uint8_t*& data) = 0;
+	virtual bool failed() const { return error; };
+	virtual const char* backend() const = 0;
+
+protected:
+	bool error = false;
+};
+
+/**
+ * @brief Writes chunks behind their producer, keeping several chunks in flight.
+ * Regular files use io_uring when the kernel supports it, everything else a dedicated writer thread.
+ */
+class async_writer {
+public:
+	static std::shared_ptr<async_writer> create(FILE* fp, size_t chunk_bytes, unsigned int depth, bool direct = false);
+	virtual ~async_writer() {};
+
+	// Gets a free buffer of chunk_size() bytes, waiting for a write to complete if needed
+	virtual uint8_t* buffer() = 0;
+	// Queues the first bytes of the buffer returned by the last call to buffer()
+	virtual void submit(size_t bytes) = 0;
+	// Waits for all queued writes, returns false if any of them failed
+	virtual bool finish() = 0;
+	virtual const char* backend() const = 0;
+
+	size_t chunk_size() const { return chunk_bytes; };
+
+protected:
+	size_t chunk_bytes = 0;
+	bool error = false;
+};
+
+/**
+ * @brief Page aligned chunk buffer, aligned so it can be used with O_DIRECT as well
+ */
+struct io_chunk {
+	explicit io_chunk(size_t bytes);
+	~io_chunk();
+	io_chunk(const io_chunk&) = delete;
+	io_chunk& operator=(const io_chunk&) = delete;
+
+	uint8_t* data = nullptr;
+	size_t capacity = 0;
+	size_t size = 0;
+	uint64_t offset = 0;
+};
+
+/**
+ * @brief Reads with fread on a dedicated thread, works for pipes and any other stream
+ */
+class thread_reader : public async_reader {
+public:
+	thread_reader(FILE* fp, size_t chunk_bytes, unsigned int depth);
+	~thread_reader();
+
+	size_t next(const uint8_t*& data) override;
+	const char* backend() const override { return "thread"; };
+
+private:
+	void run();
+
+	FILE* fp;
+	std::vector<std::unique_ptr<io_chunk>> chunks;
+	std::deque<io_chunk*> free_chunks;
+	std::deque<io_chunk*> filled_chunks;
+	io_chunk* current = nullptr;
+	bool done = false;
+	bool stopping = false;
+	std::mutex lock;
+	std::condition_variable changed;
+	std::thread worker;
+};
+
+/**
+ * @brief Reads a regular file that is still being written, like tail -f, on a dedicated thread.
+ * Whatever was appended is handed out as soon as it is read. The end is reached once the file
+ * has not grown for timeout seconds, or once the sentinel file exists and the data written
+ * before it was read.
+ */
+class follow_reader : public async_reader {
+public:
+	// How often the end of the file is checked for new data
+	static const unsigned int poll_ms = 50;
+
+	follow_reader(int fd, uint64_t offset, size_t chunk_bytes, unsigned int depth, double timeout, const std::string& sentinel);
+	~follow_reader();
+
+	size_t next(const uint8_t*& data) override;
+	const char* backend() const override { return "follow"; };
+
+private:
+	void run();
+	bool at_end(double idle);
+
+	int fd;
+	uint64_t offset;
+	double timeout; // 0 to wait for the sentinel only
+	std::string sentinel;
+	bool sentinel_seen = false;
+	std::vector<std::unique_ptr<io_chunk>> chunks;
+	std::deque<io_chunk*> free_chunks;
+	std::deque<io_chunk*> filled_chunks;
+	io_chunk* current = nullptr;
+	bool done = false;
+	bool stopping = false;
+	std::mutex lock;
+	std::condition_variable changed;
+	std::thread worker;
+};
+
+/**
+ * @brief Writes with fwrite on a dedicated thread, works for pipes and any other stream
+ */
+class thread_writer : public async_writer {
+public:
+	thread_writer(FILE* fp, size_t chunk_bytes, unsigned int depth);
+	~thread_writer();
+
+	uint8_t* buffer() override;
+	void submit(size_t bytes) override;
+	bool finish() override;
+	const char* backend() const override { return "thread"; };
+
+private:
+	void run();
+
+	FILE* fp;
+	std::vector<std::unique_ptr<io_chunk>> chunks;
+	std::deque<io_chunk*> free_chunks;
+	std::deque<io_chunk*> queued_chunks;
+	io_chunk* current = nullptr;
+	unsigned int busy = 0;
+	bool stopping = false;
+	std::mutex lock;
+	std::condition_variable changed;
+	std::thread worker;
+};
+
+/**
+ * @brief Writes a regular file with O_DIRECT from a dedicated thread, bypassing the page cache.
+ * Only whole blocks are written, the partial block at the end is carried over to the next chunk
+ * and padded on finish, after which the file is truncated to its real size.
+ */
+class direct_writer : public async_writer {
+public:
+	static const size_t alignment = 4096;
+
+	direct_writer(FILE* fp, size_t chunk_bytes, unsigned int depth);
+	~direct_writer();
+
+	bool ok() const { return direct; };
+	uint8_t* buffer() override;
+	void submit(size_t bytes) override;
+	bool finish() override;
+	const char* backend() const override { return "O_DIRECT"; };
+
+private:
+	void run();
+
+	FILE* fp;
+	int fd;
+	int flags = 0;
+	bool direct = false;
+	bool finished = false;
+	uint64_t offset = 0;
+	// The bytes of the last partial block, written with the next chunk
+	io_chunk tail;
+	size_t carry = 0;
+	std::vector<std::unique_ptr<io_chunk>> chunks;
+	std::deque<io_chunk*> free_chunks;
+	std::deque<io_chunk*> queued_chunks;
+	io_chunk* current = nullptr;
+	unsigned int busy = 0;
+	bool stopping = false;
+	std::mutex lock;
+	std::condition_variable changed;
+	std::thread worker;
+};
+
+#endif // !ASYNCIO_H
@@ -0,0 +1,25 @@
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief CRC32C (Castagnoli) checksum of a stream of bytes, updated block by block as the stream is read.
+ * The crc32 instruction of SSE 4.2 is used when the processor has it, tables of 8 bytes at a time otherwise;
+ * both give the value of other crc32c tools for the same bytes.
+ */
+class crc32c {
+public:
+	void update(const void* data, size_t size);
+	uint32_t value() const { return ~state; };
+
+	static uint32_t compute(const void* data, size_t size);
+	// Whether update uses the crc32 instruction
+	static bool hardware();
+
+private:
+	uint32_t state = 0xFFFFFFFF;
+};
+
+#endif // !CRC32C_H
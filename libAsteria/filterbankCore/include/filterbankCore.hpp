@@ -12,8 +12,13 @@
 #include <cstdio>
 #include <cstring>
 #include <vector>
+#include <memory>
 #include <stdio.h>
 #include "headerParam.hpp"
+#include "headerCodec.hpp"
+#include "asyncIO.hpp"
+#include "crc32c.hpp"
+#include "sampleBuffer.hpp"
 
 class filterbank {
 public:
@@ -22,12 +27,48 @@ public:
 	enum ioType
 	{
 		STDIO = 0,
-		FILEIO = 1
+		FILEIO = 1,
+		SHMIO = 2 // a shared memory ring, named shm:name, input only
 	};
 
+	// The input type of a name: stdio when empty, a shared memory ring for shm:name, a file otherwise
+	static ioType input_type(const std::string& input);
+
 
 	static filterbank read(filterbank::ioType inputType, std::string input = "");
 	void write(filterbank::ioType outputType, std::string filename = "", bool headerless = false);
+	void write_header(FILE* fp);
+	void write_data(FILE* fp, const float* block, uint32_t nsamples);
+
+	// Streaming access, one block of spectra at a time
+	static filterbank open(filterbank::ioType inputType, std::string input = "");
+	uint32_t read_block(float* block, uint32_t nsamples);
+	bool create(filterbank::ioType outputType, std::string filename = "", bool headerless = false);
+	// Part of a file at a time: reading from a sample on, and writing into an existing file at a byte offset
+	bool seek_sample(uint64_t sample);
+	bool create_at(std::string filename, uint64_t offset);
+	void write_block(const float* block, uint32_t nsamples);
+	void close();
+	// Reads or writes the stream in the background, call after open or create
+	bool prefetch(unsigned int depth = 4, size_t chunk_bytes = 4 << 20);
+	// Instead of prefetch, reads a file that is still being written until it is complete, see follow_reader
+	bool follow(double timeout, const std::string& sentinel = "", unsigned int depth = 4, size_t chunk_bytes = 4 << 20);
+	bool write_behind(unsigned int depth = 4, size_t chunk_bytes = 4 << 20, bool direct = false);
+
+	// Integrity of the input: a CRC32C of the header and the data as they are read, call after open before reading
+	bool checksum();
+	// The CRC32C of the whole input, the data not read yet is read for it first
+	uint32_t input_crc();
+	// Whether the data ended before the header or the size of the file said, or in the middle of a spectrum
+	bool truncated();
+	// The CRC32C stored for a file in the sidecar file name.crc32c, a line like md5sum writes
+	static bool stored_crc(const std::string& input, uint32_t& crc);
+	static bool store_crc(const std::string& input, uint32_t crc);
+
+	uint32_t values_per_sample();
+	uint64_t bytes_per_sample();
+	bool valid_sample_format();
+	static bool supported_bits(int32_t nbits);
 
 	std::map<std::string, header_param> header
 	{
@@ -52,6 +93,7 @@ public:
 		{"nifs", INT}, // number of seperate if channels
 		{"refdm", DOUBLE}, // reference dispersion measure
 		{"period", DOUBLE}, // folding period (s)
+		{"nbins", INT}, // number of phase bins of folded data
 		{"nbeams", INT},
 		{"ibeam", INT}
 	};
@@ -60,44 +102,56 @@ public:
 	std::string backend;
 
 	uint32_t header_size = 0;
-	uint32_t data_size = 0;
+	uint64_t data_size = 0; // 0 when the size of the input is unknown, e.g. a pipe
 
-	std::vector<float> data;
+	sample_buffer data;
 
 private:
 	static filterbank read_stdio();
-	bool read_header_stdio(std::string input);
-	bool read_data_stdio(std::string input);
-
 	static filterbank read_file(std::string filename);
+	static filterbank open_shm(std::string name);
+	const uint8_t* peek(uint64_t wanted);
 	bool read_header_file(FILE* inf);
-	bool read_data_file(FILE* inf);
-
-	uint32_t n_values = 0;
-	uint32_t n_bytes = 0;
-	uint32_t file_size = 0;
+	bool read_data_file();
+	uint64_t fill(uint8_t* target, uint64_t wanted);
+	void encode(const float* block, uint64_t n_values, uint8_t* out);
+
+	void set_derived_values(uint64_t total_data_size);
+
+	uint64_t n_values = 0;
+	uint64_t file_size = 0;
+
+	// The open input or output stream, shared by copies of this object
+	std::shared_ptr<FILE> stream;
+	// Bytes read together with the header that belong to the data
+	std::vector<char> lookahead;
+	size_t lookahead_pos = 0;
+	// Raw bytes of the last block read or written, reused between blocks
+	std::vector<uint8_t> raw;
+	// The conversion of raw values to floats for decoder_bits bits
+	void (*decoder)(const uint8_t* raw, uint64_t values, float* out, uint32_t nbits) = nullptr;
+	int32_t decoder_bits = 0;
+	// Background reader, the current chunk is consumed from chunk_pos
+	std::shared_ptr<async_reader> reader;
+	const uint8_t* chunk_data = nullptr;
+	size_t chunk_size = 0;
+	size_t chunk_pos = 0;
+	// Background writer, the current buffer is filled up to buffer_fill
+	std::shared_ptr<async_writer> writer;
+	uint8_t* buffer_data = nullptr;
+	size_t buffer_fill = 0;
+	// Integrity of the input: the CRC covers the header from open on and the data once checksum is called
+	crc32c crc;
+	bool checking = false;
+	bool short_read = false;
+	bool sought = false;
+	uint64_t data_read = 0; // bytes of data read, from the start of the data
 
 	double center_freq = 0.0;
 
 	static std::map<uint16_t, std::string> telescope_ids;
 	static std::map<uint16_t, std::string> machine_ids;
 
-	uint32_t read_key_size(FILE* fp);
-	uint32_t read_data(FILE* fp);
-	
-	char* read_string(FILE* fp, uint32_t& keylen);
-	void write_string(FILE* fp, std::string string);
-
-	template <typename T>
-	T read_value(FILE* fp);
-
-	template <typename T>
-	void write_value(FILE* fp, const std::string key, T value) {
-		write_string(fp, key);
-		fwrite(&value, sizeof(T), 1, fp);
-		fflush(fp);
-	};
-
 };
 
 #endif // !FILTERBANK_H
\ No newline at end of file
@@ -0,0 +1,38 @@
+#ifndef HEADERCODEC_H
+#define HEADERCODEC_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include "headerParam.hpp"
+
+/**
+ * @brief Parses and serializes sigproc headers from and into contiguous byte spans.
+ * Neither direction allocates, so every backend (file, stdin, memory map, socket)
+ * can hand over whatever bytes it has and re-emit headers as often as it likes.
+ */
+class header_codec {
+public:
+	enum status {
+		COMPLETE = 0,
+		INCOMPLETE = 1, // the span ends before HEADER_END, try again with more bytes
+		INVALID = 2
+	};
+
+	// Headers are usually a few hundred bytes, buffers of this size avoid a second pass
+	static const size_t typical_size = 4096;
+	// Longest key or string value accepted, limited by header_param
+	static const uint32_t max_string = sizeof(headerValue::s) - 1;
+
+	static status parse(const char* buffer, size_t length, std::map<std::string, header_param>& header, size_t& header_size);
+	static size_t serialized_size(const std::map<std::string, header_param>& header);
+	static size_t serialize(const std::map<std::string, header_param>& header, char* buffer, size_t capacity);
+
+	static bool is_set(const header_param& param);
+
+private:
+	static size_t put_string(char* buffer, const char* string, uint32_t length);
+};
+
+#endif // !HEADERCODEC_H
@@ -1,6 +1,8 @@
 #ifndef HEADERPARAM_H
 #define HEADERPARAM_H
 
+#include <cstdint>
+
 enum dataType
 {
 	INT,
@@ -18,6 +20,7 @@ struct header_param
 {
 	dataType type;
 	headerValue val;
+	bool present = false; // set when the parameter was read from a header
 
 	header_param(){
 		this->type = INT;
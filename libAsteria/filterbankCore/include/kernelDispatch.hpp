@@ -0,0 +1,30 @@
+#ifndef KERNEL_DISPATCH_H
+#define KERNEL_DISPATCH_H
+
+#include <cstdint>
+
+/**
+ * @brief Picks the instantiation of a kernel for a value known only at run time, e.g. the number of bits
+ * or a reduction factor, once per stream. A kernel is a struct with a function pointer type and a function
+ * template run<N>, in which N replaces the value passed as the last argument. With a constant N the compiler
+ * can fully unroll and vectorize the loops; run<0> is the generic kernel that uses the value passed instead.
+ *
+ *	decode_kernel::type decode = kernel_table<decode_kernel, 1, 2, 4, 8, 16>::select(nbits);
+ *	decode(raw, values, out, nbits);
+ */
+template<typename kernel, uint32_t... instantiated>
+struct kernel_table;
+
+template<typename kernel>
+struct kernel_table<kernel> {
+	static typename kernel::type select(uint32_t) { return &kernel::template run<0>; };
+};
+
+template<typename kernel, uint32_t first, uint32_t... rest>
+struct kernel_table<kernel, first, rest...> {
+	static typename kernel::type select(uint32_t value) {
+		return value == first ? &kernel::template run<first> : kernel_table<kernel, rest...>::select(value);
+	};
+};
+
+#endif // !KERNEL_DISPATCH_H
@@ -0,0 +1,70 @@
+#ifndef SAMPLE_BUFFER_H
+#define SAMPLE_BUFFER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief Spectra in memory, filterbank::data and the blocks of a pipeline. The values are 64 byte aligned
+ * and are not initialized on allocation, so a page is first touched by the thread that fills it: no page
+ * is faulted in twice, and the pages of a buffer filled by workers end up on the NUMA nodes of those workers.
+ * Large buffers use huge pages as set by set_pages, which the tools expose as --pages. A buffer is move only,
+ * so it is never copied by accident.
+ */
+class sample_buffer {
+public:
+	enum pages
+	{
+		SMALL_PAGES = 0,
+		TRANSPARENT_HUGE_PAGES = 1, // asks the kernel to back large buffers by huge pages when it can
+		EXPLICIT_HUGE_PAGES = 2 // maps large buffers from the reserved huge pages, small pages when none are left
+	};
+	static const size_t alignment = 64;
+	static const size_t huge_page = 2 << 20;
+
+	sample_buffer() {};
+	explicit sample_buffer(uint64_t size);
+	sample_buffer(uint64_t size, float value);
+	~sample_buffer();
+
+	sample_buffer(sample_buffer&& other) noexcept;
+	sample_buffer& operator=(sample_buffer&& other) noexcept;
+	sample_buffer(const sample_buffer&) = delete;
+	sample_buffer& operator=(const sample_buffer&) = delete;
+
+	float* data() { return values; };
+	const float* data() const { return values; };
+	uint64_t size() const { return count; };
+	uint64_t capacity() const { return allocated; };
+	bool empty() const { return !count; };
+	float& operator[](uint64_t index) { return values[index]; };
+	const float& operator[](uint64_t index) const { return values[index]; };
+	float* begin() { return values; };
+	float* end() { return values + count; };
+	const float* begin() const { return values; };
+	const float* end() const { return values + count; };
+
+	// Keeps the first values, values past the old size are not initialized
+	void resize(uint64_t size);
+	void reserve(uint64_t size);
+	void assign(uint64_t size, float value);
+	// Makes the size 0 and keeps the memory
+	void clear() { count = 0; };
+
+	// The pages of buffers of a huge page or more allocated from now on, transparent huge pages by default
+	static void set_pages(pages policy);
+	static pages get_pages();
+	// The policy of a name of the --pages option: small, transparent or huge
+	static bool parse_pages(const std::string& name, pages& policy);
+
+private:
+	void release();
+
+	float* values = nullptr;
+	uint64_t count = 0;
+	uint64_t allocated = 0;
+	size_t mapped = 0; // bytes mapped with huge pages, 0 when the values come from the heap
+};
+
+#endif // !SAMPLE_BUFFER_H
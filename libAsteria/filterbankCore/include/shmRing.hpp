@@ -0,0 +1,80 @@
+#ifndef SHM_RING_H
+#define SHM_RING_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "asyncIO.hpp"
+
+struct shm_ring_control;
+
+/**
+ * @brief A ring buffer in POSIX shared memory, in the style of a PSRDADA data block: a header block
+ * followed by a ring of data blocks. One process writes the header and fills the data blocks in order,
+ * another attaches and reads them in place as they are filled. The writer waits for the reader when all
+ * blocks are full, the reader waits for the writer when all blocks are read. Both sides poll the
+ * counters in the shared memory, so neither needs a lock the other could leave held.
+ */
+class shm_ring {
+public:
+	static const uint64_t default_header_bytes = 64 << 10;
+
+	// Creates the ring, replacing any ring of the same name, and removes it again when destroyed
+	static std::shared_ptr<shm_ring> create(const std::string& name, uint32_t nblocks, uint64_t block_bytes,
+		uint64_t header_bytes = default_header_bytes);
+	// Attaches to a ring as its reader, waiting up to timeout seconds for the writer to create it, forever when negative
+	static std::shared_ptr<shm_ring> attach(const std::string& name, double timeout = -1.0);
+	~shm_ring();
+
+	shm_ring(const shm_ring&) = delete;
+	shm_ring& operator=(const shm_ring&) = delete;
+
+	// Writer side
+	void write_header(const char* header, uint64_t size);
+	// The next block to fill, waits while the reader still holds all blocks
+	uint8_t* next_free();
+	// Hands the block returned by next_free to the reader, with bytes of data in it
+	void submit(uint64_t bytes);
+	// Marks the end of the data and waits until the reader took all blocks or detached
+	void finish();
+
+	// Reader side
+	// Waits for the header and returns its bytes
+	std::vector<char> read_header();
+	// Releases the previous block and waits for the next, returns its size, 0 at the end of the data
+	uint64_t next_full(const uint8_t*& data);
+
+	uint32_t block_count() const;
+	uint64_t block_size() const;
+	const std::string& name() const { return ring_name; };
+
+private:
+	shm_ring(const std::string& name, bool writer);
+	void map(int fd, uint64_t size);
+	void wait(uint64_t& rounds);
+
+	std::string ring_name;
+	bool writer;
+	uint8_t* memory = nullptr;
+	uint64_t mapped = 0;
+	shm_ring_control* control = nullptr;
+	uint64_t* used = nullptr; // bytes of data per block
+	bool holding = false; // whether the reader holds a block
+};
+
+/**
+ * @brief Reads a shared memory ring like a stream, handing out the data blocks in place
+ */
+class shm_reader : public async_reader {
+public:
+	explicit shm_reader(std::shared_ptr<shm_ring> ring) : ring(ring) {};
+
+	size_t next(const uint8_t*& data) override { return (size_t)ring->next_full(data); };
+	const char* backend() const override { return "shm"; };
+
+private:
+	std::shared_ptr<shm_ring> ring;
+};
+
+#endif // !SHM_RING_H
@@ -0,0 +1,853 @@
+#include "asyncIO.hpp"
+#include "stats.hpp"
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef ASTERIA_HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
+/**
+ * @param bytes the size of the buffer
+ */
+io_chunk::io_chunk(size_t bytes) {
+	void* memory = nullptr;
+	if (posix_memalign(&memory, 4096, std::max<size_t>(bytes, 1))) {
+		throw std::bad_alloc();
+	}
+	data = (uint8_t*)memory;
+	capacity = bytes;
+}
+
+io_chunk::~io_chunk() {
+	free(data);
+}
+
+/**
+ * @brief Starts the reader thread
+ * 
+ * @param fp the stream to read, positioned at the first byte to read
+ * @param chunk_bytes the size of a single read
+ * @param depth the number of chunks that may be read ahead
+ */
+thread_reader::thread_reader(FILE* fp, size_t chunk_bytes, unsigned int depth) : fp(fp) {
+	for (unsigned int i = 0; i < std::max(2u, depth); ++i) {
+		chunks.emplace_back(new io_chunk(chunk_bytes));
+		free_chunks.push_back(chunks.back().get());
+	}
+	worker = std::thread(&thread_reader::run, this);
+}
+
+thread_reader::~thread_reader() {
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+	changed.notify_all();
+	worker.join();
+}
+
+/**
+ * @brief Fills free chunks in order until the end of the stream
+ */
+void thread_reader::run() {
+	while (true) {
+		io_chunk* chunk;
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			changed.wait(guard, [this]() { return !free_chunks.empty() || stopping; });
+			if (stopping) {
+				return;
+			}
+			chunk = free_chunks.front();
+			free_chunks.pop_front();
+		}
+
+		{
+			scoped_timer timer("read_io");
+			chunk->size = fread(chunk->data, sizeof(uint8_t), chunk->capacity, fp);
+		}
+
+		std::lock_guard<std::mutex> guard(lock);
+		filled_chunks.push_back(chunk);
+		if (chunk->size < chunk->capacity) {
+			error = ferror(fp) != 0;
+			done = true;
+		}
+		changed.notify_all();
+		if (done) {
+			return;
+		}
+	}
+}
+
+size_t thread_reader::next(const uint8_t*& data) {
+	std::unique_lock<std::mutex> guard(lock);
+	if (current) {
+		free_chunks.push_back(current);
+		current = nullptr;
+		changed.notify_all();
+	}
+	changed.wait(guard, [this]() { return !filled_chunks.empty() || done; });
+	if (filled_chunks.empty()) {
+		return 0;
+	}
+	current = filled_chunks.front();
+	filled_chunks.pop_front();
+	data = current->data;
+	return current->size;
+}
+
+const unsigned int follow_reader::poll_ms;
+
+/**
+ * @brief Starts the reader thread
+ * 
+ * @param fd the file to follow
+ * @param offset the position of the first byte to read
+ * @param chunk_bytes the most bytes of a single read
+ * @param depth the number of chunks that may be read ahead
+ * @param timeout the seconds without new data after which the file is complete, 0 for no limit
+ * @param sentinel a file that marks the file complete once it exists, empty for none
+ */
+follow_reader::follow_reader(int fd, uint64_t offset, size_t chunk_bytes, unsigned int depth, double timeout, const std::string& sentinel) :
+	fd(fd), offset(offset), timeout(timeout), sentinel(sentinel) {
+	for (unsigned int i = 0; i < std::max(2u, depth); ++i) {
+		chunks.emplace_back(new io_chunk(chunk_bytes));
+		free_chunks.push_back(chunks.back().get());
+	}
+	worker = std::thread(&follow_reader::run, this);
+}
+
+follow_reader::~follow_reader() {
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+	changed.notify_all();
+	worker.join();
+}
+
+/**
+ * @brief Whether the file is complete, called at its current end
+ * 
+ * @param idle the seconds since the file last grew
+ */
+bool follow_reader::at_end(double idle) {
+	if (sentinel_seen || (timeout > 0.0 && idle >= timeout)) {
+		return true;
+	}
+	// The data written before the sentinel may have arrived after the last read, so read once more
+	if (!sentinel.empty() && !access(sentinel.c_str(), F_OK)) {
+		sentinel_seen = true;
+	}
+	return false;
+}
+
+/**
+ * @brief Fills free chunks in order, waiting at the end of the file for it to grow, until it is complete
+ */
+void follow_reader::run() {
+	auto grown = std::chrono::steady_clock::now();
+	while (true) {
+		io_chunk* chunk;
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			changed.wait(guard, [this]() { return !free_chunks.empty() || stopping; });
+			if (stopping) {
+				return;
+			}
+			chunk = free_chunks.front();
+			free_chunks.pop_front();
+		}
+
+		// Read up to a full chunk, but hand out what is there as soon as the end of the file is reached
+		bool complete = false;
+		chunk->size = 0;
+		while (chunk->size < chunk->capacity) {
+			ssize_t n;
+			{
+				scoped_timer timer("read_io");
+				n = pread(fd, chunk->data + chunk->size, chunk->capacity - chunk->size, (off_t)offset);
+			}
+			if (n < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				error = true;
+				complete = true;
+				break;
+			}
+			if (n > 0) {
+				chunk->size += n;
+				offset += n;
+				grown = std::chrono::steady_clock::now();
+				continue;
+			}
+			if (chunk->size) {
+				break;
+			}
+			std::chrono::duration<double> idle = std::chrono::steady_clock::now() - grown;
+			if (at_end(idle.count())) {
+				complete = true;
+				break;
+			}
+			if (sentinel_seen) {
+				continue;
+			}
+			scoped_timer timer("follow_wait");
+			std::unique_lock<std::mutex> guard(lock);
+			if (changed.wait_for(guard, std::chrono::milliseconds(poll_ms), [this]() { return stopping; })) {
+				return;
+			}
+		}
+
+		std::lock_guard<std::mutex> guard(lock);
+		if (chunk->size) {
+			filled_chunks.push_back(chunk);
+		} else {
+			free_chunks.push_back(chunk);
+		}
+		done = complete;
+		changed.notify_all();
+		if (done) {
+			return;
+		}
+	}
+}
+
+size_t follow_reader::next(const uint8_t*& data) {
+	std::unique_lock<std::mutex> guard(lock);
+	if (current) {
+		free_chunks.push_back(current);
+		current = nullptr;
+		changed.notify_all();
+	}
+	changed.wait(guard, [this]() { return !filled_chunks.empty() || done; });
+	if (filled_chunks.empty()) {
+		return 0;
+	}
+	current = filled_chunks.front();
+	filled_chunks.pop_front();
+	data = current->data;
+	return current->size;
+}
+
+/**
+ * @brief Starts the writer thread
+ * 
+ * @param fp the stream to write to
+ * @param chunk_bytes the size of a single write
+ * @param depth the number of chunks that may wait to be written
+ */
+thread_writer::thread_writer(FILE* fp, size_t chunk_bytes, unsigned int depth) : fp(fp) {
+	this->chunk_bytes = chunk_bytes;
+	for (unsigned int i = 0; i < std::max(2u, depth); ++i) {
+		chunks.emplace_back(new io_chunk(chunk_bytes));
+		free_chunks.push_back(chunks.back().get());
+	}
+	worker = std::thread(&thread_writer::run, this);
+}
+
+thread_writer::~thread_writer() {
+	finish();
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+	changed.notify_all();
+	worker.join();
+}
+
+/**
+ * @brief Writes queued chunks in order
+ */
+void thread_writer::run() {
+	while (true) {
+		io_chunk* chunk;
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			changed.wait(guard, [this]() { return !queued_chunks.empty() || stopping; });
+			if (queued_chunks.empty()) {
+				return;
+			}
+			chunk = queued_chunks.front();
+			queued_chunks.pop_front();
+		}
+
+		size_t written;
+		{
+			scoped_timer timer("write_io");
+			written = fwrite(chunk->data, sizeof(uint8_t), chunk->size, fp);
+		}
+
+		std::lock_guard<std::mutex> guard(lock);
+		if (written != chunk->size) {
+			error = true;
+		}
+		free_chunks.push_back(chunk);
+		busy--;
+		changed.notify_all();
+	}
+}
+
+uint8_t* thread_writer::buffer() {
+	std::unique_lock<std::mutex> guard(lock);
+	changed.wait(guard, [this]() { return !free_chunks.empty(); });
+	current = free_chunks.front();
+	free_chunks.pop_front();
+	return current->data;
+}
+
+void thread_writer::submit(size_t bytes) {
+	std::lock_guard<std::mutex> guard(lock);
+	current->size = bytes;
+	queued_chunks.push_back(current);
+	current = nullptr;
+	busy++;
+	changed.notify_all();
+}
+
+bool thread_writer::finish() {
+	std::unique_lock<std::mutex> guard(lock);
+	changed.wait(guard, [this]() { return busy == 0; });
+	fflush(fp);
+	return !error;
+}
+
+/**
+ * @brief Switches the stream to O_DIRECT, the partial block written so far, e.g. the header,
+ * is read back so it can be rewritten as part of the first block
+ * 
+ * @param fp the stream to write to
+ * @param chunk_bytes the maximum number of bytes submitted at once
+ * @param depth the number of chunks that may wait to be written
+ */
+direct_writer::direct_writer(FILE* fp, size_t chunk_bytes, unsigned int depth) :
+	fp(fp), fd(fileno(fp)), tail(alignment) {
+	this->chunk_bytes = chunk_bytes;
+	fflush(fp);
+	off_t end = ftello(fp);
+	if (end < 0) {
+		return;
+	}
+	offset = end & ~(off_t)(alignment - 1);
+	carry = end - offset;
+	if (carry && pread(fd, tail.data, carry, offset) != (ssize_t)carry) {
+		return;
+	}
+	flags = fcntl(fd, F_GETFL);
+	if (flags < 0 || fcntl(fd, F_SETFL, flags | O_DIRECT)) {
+		return;
+	}
+	direct = true;
+
+	// Room for the carried partial block in front of the submitted bytes
+	for (unsigned int i = 0; i < std::max(2u, depth); ++i) {
+		chunks.emplace_back(new io_chunk(chunk_bytes + alignment));
+		free_chunks.push_back(chunks.back().get());
+	}
+	worker = std::thread(&direct_writer::run, this);
+}
+
+direct_writer::~direct_writer() {
+	if (!direct) {
+		return;
+	}
+	finish();
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+	changed.notify_all();
+	worker.join();
+}
+
+/**
+ * @brief Writes queued chunks in order at their offsets
+ */
+void direct_writer::run() {
+	while (true) {
+		io_chunk* chunk;
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			changed.wait(guard, [this]() { return !queued_chunks.empty() || stopping; });
+			if (queued_chunks.empty()) {
+				return;
+			}
+			chunk = queued_chunks.front();
+			queued_chunks.pop_front();
+		}
+
+		bool failed = false;
+		{
+			scoped_timer timer("write_io");
+			size_t written = 0;
+			while (written < chunk->size) {
+				ssize_t n = pwrite(fd, chunk->data + written, chunk->size - written, chunk->offset + written);
+				if (n <= 0) {
+					failed = true;
+					break;
+				}
+				written += n;
+			}
+		}
+
+		std::lock_guard<std::mutex> guard(lock);
+		error = error || failed;
+		free_chunks.push_back(chunk);
+		busy--;
+		changed.notify_all();
+	}
+}
+
+uint8_t* direct_writer::buffer() {
+	std::unique_lock<std::mutex> guard(lock);
+	changed.wait(guard, [this]() { return !free_chunks.empty(); });
+	current = free_chunks.front();
+	free_chunks.pop_front();
+	memcpy(current->data, tail.data, carry);
+	return current->data + carry;
+}
+
+void direct_writer::submit(size_t bytes) {
+	size_t total = carry + bytes;
+	size_t aligned = total & ~(alignment - 1);
+	carry = total - aligned;
+	memcpy(tail.data, current->data + aligned, carry);
+
+	std::lock_guard<std::mutex> guard(lock);
+	if (!aligned) {
+		free_chunks.push_back(current);
+	} else {
+		current->size = aligned;
+		current->offset = offset;
+		offset += aligned;
+		queued_chunks.push_back(current);
+		busy++;
+		changed.notify_all();
+	}
+	current = nullptr;
+}
+
+bool direct_writer::finish() {
+	if (!direct || finished) {
+		return !error;
+	}
+	std::unique_lock<std::mutex> guard(lock);
+	changed.wait(guard, [this]() { return busy == 0; });
+	finished = true;
+
+	// Pad the last partial block and cut the padding off again
+	if (carry) {
+		memset(tail.data + carry, 0, alignment - carry);
+		if (pwrite(fd, tail.data, alignment, offset) != (ssize_t)alignment || ftruncate(fd, offset + carry)) {
+			error = true;
+		}
+	}
+	fcntl(fd, F_SETFL, flags);
+	fseeko(fp, offset + carry, SEEK_SET);
+	return !error;
+}
+
+#ifdef ASTERIA_HAVE_IO_URING
+namespace {
+	/**
+	 * @brief Minimal io_uring submission and completion rings on top of the raw system calls
+	 */
+	class io_ring {
+	public:
+		explicit io_ring(unsigned int entries) {
+			io_uring_params params;
+			memset(&params, 0, sizeof(params));
+			fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+			if (fd < 0) {
+				return;
+			}
+
+			sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+			cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+			bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+			if (single_mmap) {
+				sq_size = cq_size = std::max(sq_size, cq_size);
+			}
+
+			sq_ring = mmap(nullptr, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+			cq_ring = single_mmap ? sq_ring : mmap(nullptr, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+			sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+			sqes = (io_uring_sqe*)mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+			if (sq_ring == MAP_FAILED || cq_ring == MAP_FAILED || sqes == MAP_FAILED) {
+				return;
+			}
+
+			char* sq = (char*)sq_ring;
+			sq_tail = (unsigned int*)(sq + params.sq_off.tail);
+			sq_mask = (unsigned int*)(sq + params.sq_off.ring_mask);
+			sq_array = (unsigned int*)(sq + params.sq_off.array);
+			char* cq = (char*)cq_ring;
+			cq_head = (unsigned int*)(cq + params.cq_off.head);
+			cq_tail = (unsigned int*)(cq + params.cq_off.tail);
+			cq_mask = (unsigned int*)(cq + params.cq_off.ring_mask);
+			cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+			ready = true;
+		}
+
+		~io_ring() {
+			if (sqes != nullptr && sqes != MAP_FAILED) {
+				munmap(sqes, sqes_size);
+			}
+			if (cq_ring != nullptr && cq_ring != MAP_FAILED && cq_ring != sq_ring) {
+				munmap(cq_ring, cq_size);
+			}
+			if (sq_ring != nullptr && sq_ring != MAP_FAILED) {
+				munmap(sq_ring, sq_size);
+			}
+			if (fd >= 0) {
+				::close(fd);
+			}
+		}
+
+		bool ok() const { return ready; };
+
+		void prepare(uint8_t opcode, int file, const iovec* vector, uint64_t offset, uint64_t user_data) {
+			unsigned int tail = *sq_tail;
+			unsigned int index = tail & *sq_mask;
+			io_uring_sqe* sqe = &sqes[index];
+			memset(sqe, 0, sizeof(*sqe));
+			sqe->opcode = opcode;
+			sqe->fd = file;
+			sqe->addr = (uint64_t)(uintptr_t)vector;
+			sqe->len = 1;
+			sqe->off = offset;
+			sqe->user_data = user_data;
+			sq_array[index] = index;
+			__atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+			pending++;
+		}
+
+		bool submit() {
+			return enter(0);
+		}
+
+		// Waits for a completion, submitting anything prepared first
+		bool wait(uint64_t& user_data, int32_t& result) {
+			while (true) {
+				unsigned int head = *cq_head;
+				if (head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+					io_uring_cqe* cqe = &cqes[head & *cq_mask];
+					user_data = cqe->user_data;
+					result = cqe->res;
+					__atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+					return true;
+				}
+				if (!enter(1)) {
+					return false;
+				}
+			}
+		}
+
+	private:
+		bool enter(unsigned int wait) {
+			int submitted = (int)syscall(__NR_io_uring_enter, fd, pending, wait, wait ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+			if (submitted < 0) {
+				return errno == EINTR || errno == EAGAIN;
+			}
+			pending -= submitted;
+			return true;
+		}
+
+		int fd = -1;
+		bool ready = false;
+		unsigned int pending = 0;
+		size_t sq_size = 0, cq_size = 0, sqes_size = 0;
+		void* sq_ring = nullptr;
+		void* cq_ring = nullptr;
+		io_uring_sqe* sqes = nullptr;
+		unsigned int *sq_tail = nullptr, *sq_mask = nullptr, *sq_array = nullptr;
+		unsigned int *cq_head = nullptr, *cq_tail = nullptr, *cq_mask = nullptr;
+		io_uring_cqe* cqes = nullptr;
+	};
+
+	/**
+	 * @brief Reads a regular file with several chunk reads in flight through io_uring
+	 */
+	class uring_reader : public async_reader {
+	public:
+		uring_reader(int fd, uint64_t offset, uint64_t end, size_t chunk_bytes, unsigned int depth) :
+			ring(std::max(2u, depth)), fd(fd), next_offset(offset), end(end) {
+			if (!ring.ok()) {
+				return;
+			}
+			slots.resize(std::max(2u, depth));
+			for (size_t i = 0; i < slots.size(); ++i) {
+				slots[i].chunk.reset(new io_chunk(chunk_bytes));
+				submit_slot(i);
+			}
+			ring.submit();
+		}
+
+		~uring_reader() {
+			// The kernel may still write into the buffers, wait for every read first
+			while (!order.empty()) {
+				wait_for(order.front());
+				order.pop_front();
+			}
+		}
+
+		bool ok() const { return ring.ok(); };
+		const char* backend() const override { return "io_uring"; };
+
+		size_t next(const uint8_t*& data) override {
+			if (current >= 0) {
+				submit_slot(current);
+				ring.submit();
+				current = -1;
+			}
+			if (order.empty() || error) {
+				return 0;
+			}
+			size_t index = order.front();
+			order.pop_front();
+			wait_for(index);
+
+			slot& item = slots[index];
+			if (item.result < 0) {
+				std::cerr << "Failed to read: " << strerror(-item.result) << "\n";
+				error = true;
+				return 0;
+			}
+			// Reads of regular files are rarely short, finish them synchronously
+			size_t size = item.result;
+			while (size < item.expected) {
+				ssize_t n = pread(fd, item.chunk->data + size, item.expected - size, item.offset + size);
+				if (n <= 0) {
+					break;
+				}
+				size += n;
+			}
+			current = (int)index;
+			data = item.chunk->data;
+			return size;
+		}
+
+	private:
+		struct slot {
+			std::unique_ptr<io_chunk> chunk;
+			iovec vector;
+			uint64_t offset = 0;
+			size_t expected = 0;
+			bool done = false;
+			int32_t result = 0;
+		};
+
+		void submit_slot(size_t index) {
+			if (next_offset >= end) {
+				return;
+			}
+			slot& item = slots[index];
+			item.offset = next_offset;
+			item.expected = (size_t)std::min<uint64_t>(item.chunk->capacity, end - next_offset);
+			item.vector.iov_base = item.chunk->data;
+			item.vector.iov_len = item.expected;
+			item.done = false;
+			ring.prepare(IORING_OP_READV, fd, &item.vector, item.offset, index);
+			order.push_back(index);
+			next_offset += item.expected;
+		}
+
+		void wait_for(size_t index) {
+			scoped_timer timer("read_io");
+			while (!slots[index].done) {
+				uint64_t user_data;
+				int32_t result;
+				if (!ring.wait(user_data, result)) {
+					slots[index].done = true;
+					slots[index].result = -EIO;
+					break;
+				}
+				slots[user_data].done = true;
+				slots[user_data].result = result;
+			}
+		}
+
+		io_ring ring;
+		int fd;
+		uint64_t next_offset;
+		uint64_t end;
+		std::vector<slot> slots;
+		std::deque<size_t> order;
+		int current = -1;
+	};
+
+	/**
+	 * @brief Writes a regular file with several chunk writes in flight through io_uring
+	 */
+	class uring_writer : public async_writer {
+	public:
+		uring_writer(FILE* fp, size_t chunk_bytes, unsigned int depth) :
+			ring(std::max(2u, depth)), fp(fp), fd(fileno(fp)) {
+			this->chunk_bytes = chunk_bytes;
+			if (!ring.ok()) {
+				return;
+			}
+			// Anything written through the stream so far, e.g. the header, goes first
+			fflush(fp);
+			offset = ftello(fp);
+			slots.resize(std::max(2u, depth));
+			for (size_t i = 0; i < slots.size(); ++i) {
+				slots[i].chunk.reset(new io_chunk(chunk_bytes));
+				free_slots.push_back(i);
+			}
+		}
+
+		~uring_writer() {
+			finish();
+		}
+
+		bool ok() const { return ring.ok(); };
+		const char* backend() const override { return "io_uring"; };
+
+		uint8_t* buffer() override {
+			while (free_slots.empty()) {
+				reap();
+			}
+			current = free_slots.front();
+			free_slots.pop_front();
+			return slots[current].chunk->data;
+		}
+
+		void submit(size_t bytes) override {
+			slot& item = slots[current];
+			item.offset = offset;
+			item.vector.iov_base = item.chunk->data;
+			item.vector.iov_len = bytes;
+			offset += bytes;
+			ring.prepare(IORING_OP_WRITEV, fd, &item.vector, item.offset, current);
+			ring.submit();
+			in_flight++;
+		}
+
+		bool finish() override {
+			while (in_flight) {
+				reap();
+			}
+			// Keep the stream position consistent with what was written
+			if (ring.ok()) {
+				fseeko(fp, offset, SEEK_SET);
+			}
+			return !error;
+		}
+
+	private:
+		struct slot {
+			std::unique_ptr<io_chunk> chunk;
+			iovec vector;
+			uint64_t offset = 0;
+		};
+
+		void reap() {
+			scoped_timer timer("write_io");
+			uint64_t user_data;
+			int32_t result;
+			if (!ring.wait(user_data, result)) {
+				error = true;
+				in_flight = 0;
+				return;
+			}
+			slot& item = slots[user_data];
+			if (result < 0) {
+				std::cerr << "Failed to write: " << strerror(-result) << "\n";
+				error = true;
+			} else {
+				// finish short writes synchronously
+				size_t written = result;
+				while (written < item.vector.iov_len) {
+					ssize_t n = pwrite(fd, (uint8_t*)item.vector.iov_base + written, item.vector.iov_len - written, item.offset + written);
+					if (n <= 0) {
+						error = true;
+						break;
+					}
+					written += n;
+				}
+			}
+			free_slots.push_back(user_data);
+			in_flight--;
+		}
+
+		io_ring ring;
+		FILE* fp;
+		int fd;
+		uint64_t offset = 0;
+		std::vector<slot> slots;
+		std::deque<size_t> free_slots;
+		size_t current = 0;
+		unsigned int in_flight = 0;
+	};
+
+	bool regular_file(FILE* fp, struct stat& info) {
+		return !getenv("ASTERIA_NO_IO_URING") && !fstat(fileno(fp), &info) && S_ISREG(info.st_mode);
+	}
+}
+#endif
+
+/**
+ * @brief Creates the best reader for the stream
+ * 
+ * @param fp the stream to read, positioned at offset
+ * @param offset the position of the first byte to read
+ * @param chunk_bytes the size of a single read
+ * @param depth the number of chunks in flight
+ * @return the reader
+ */
+std::shared_ptr<async_reader> async_reader::create(FILE* fp, uint64_t offset, size_t chunk_bytes, unsigned int depth) {
+#ifdef ASTERIA_HAVE_IO_URING
+	struct stat info;
+	if (regular_file(fp, info)) {
+		std::shared_ptr<uring_reader> reader(new uring_reader(fileno(fp), offset, info.st_size, chunk_bytes, depth));
+		if (reader->ok()) {
+			return reader;
+		}
+	}
+#endif
+	return std::shared_ptr<async_reader>(new thread_reader(fp, chunk_bytes, depth));
+}
+
+/**
+ * @brief Creates the best writer for the stream
+ * 
+ * @param fp the stream to write to, anything already written through it is kept
+ * @param chunk_bytes the size of a single write
+ * @param depth the number of chunks in flight
+ * @param direct whether to bypass the page cache, only for regular files on file systems that support it
+ * @return the writer
+ */
+std::shared_ptr<async_writer> async_writer::create(FILE* fp, size_t chunk_bytes, unsigned int depth, bool direct) {
+	struct stat info;
+	if (direct) {
+		if (!fstat(fileno(fp), &info) && S_ISREG(info.st_mode)) {
+			std::shared_ptr<direct_writer> writer(new direct_writer(fp, chunk_bytes, depth));
+			if (writer->ok()) {
+				return writer;
+			}
+		}
+		std::cerr << "O_DIRECT is not supported for this output, writing through the page cache\n";
+	}
+#ifdef ASTERIA_HAVE_IO_URING
+	if (regular_file(fp, info)) {
+		std::shared_ptr<uring_writer> writer(new uring_writer(fp, chunk_bytes, depth));
+		if (writer->ok()) {
+			return writer;
+		}
+	}
+#endif
+	return std::shared_ptr<async_writer>(new thread_writer(fp, chunk_bytes, depth));
+}
@@ -0,0 +1,106 @@
+#include "crc32c.hpp"
+#include <cstring>
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <nmmintrin.h>
+#define ASTERIA_CRC32C_SSE42
+#endif
+
+/**
+ * @brief The tables of the software CRC: table[k][b] is the CRC of byte b followed by k zero bytes,
+ * so 8 bytes are folded in with 8 independent lookups
+ */
+struct crc32c_tables {
+	uint32_t table[8][256];
+
+	crc32c_tables() {
+		const uint32_t polynomial = 0x82F63B78; // reflected Castagnoli polynomial
+		for (uint32_t byte = 0; byte < 256; ++byte) {
+			uint32_t crc = byte;
+			for (int bit = 0; bit < 8; ++bit) {
+				crc = (crc >> 1) ^ (crc & 1 ? polynomial : 0);
+			}
+			table[0][byte] = crc;
+		}
+		for (uint32_t byte = 0; byte < 256; ++byte) {
+			for (int k = 1; k < 8; ++k) {
+				table[k][byte] = (table[k - 1][byte] >> 8) ^ table[0][table[k - 1][byte] & 0xFF];
+			}
+		}
+	};
+};
+
+static uint32_t update_tables(uint32_t crc, const uint8_t* bytes, size_t size) {
+	static const crc32c_tables tables;
+	const uint32_t (*table)[256] = tables.table;
+	while (size >= 8) {
+		uint32_t low;
+		uint32_t high;
+		memcpy(&low, bytes, 4);
+		memcpy(&high, bytes + 4, 4);
+		low ^= crc;
+		crc = table[7][low & 0xFF] ^ table[6][(low >> 8) & 0xFF] ^ table[5][(low >> 16) & 0xFF] ^ table[4][low >> 24]
+			^ table[3][high & 0xFF] ^ table[2][(high >> 8) & 0xFF] ^ table[1][(high >> 16) & 0xFF] ^ table[0][high >> 24];
+		bytes += 8;
+		size -= 8;
+	}
+	while (size--) {
+		crc = (crc >> 8) ^ table[0][(crc ^ *bytes++) & 0xFF];
+	}
+	return crc;
+}
+
+#ifdef ASTERIA_CRC32C_SSE42
+__attribute__((target("sse4.2")))
+static uint32_t update_sse42(uint32_t crc, const uint8_t* bytes, size_t size) {
+	uint64_t state = crc;
+	while (size >= 8) {
+		uint64_t word;
+		memcpy(&word, bytes, 8);
+		state = _mm_crc32_u64(state, word);
+		bytes += 8;
+		size -= 8;
+	}
+	crc = (uint32_t)state;
+	while (size--) {
+		crc = _mm_crc32_u8(crc, *bytes++);
+	}
+	return crc;
+}
+#endif
+
+/**
+ * @return true when the processor has the crc32 instruction, checked once
+ */
+bool crc32c::hardware() {
+#ifdef ASTERIA_CRC32C_SSE42
+	static const bool supported = __builtin_cpu_supports("sse4.2");
+	return supported;
+#else
+	return false;
+#endif
+}
+
+/**
+ * @brief Adds the next bytes of the stream
+ *
+ * @param data the bytes
+ * @param size the number of bytes
+ */
+void crc32c::update(const void* data, size_t size) {
+#ifdef ASTERIA_CRC32C_SSE42
+	if (hardware()) {
+		state = update_sse42(state, (const uint8_t*)data, size);
+		return;
+	}
+#endif
+	state = update_tables(state, (const uint8_t*)data, size);
+}
+
+/**
+ * @return the CRC32C of a single block of bytes
+ */
+uint32_t crc32c::compute(const void* data, size_t size) {
+	crc32c crc;
+	crc.update(data, size);
+	return crc.value();
+}
@@ -1,4 +1,5 @@
 #include "filterbankCore.hpp"
+#include "stats.hpp"
 
 /**
  * @brief Contains a mapping of the known telescope id's and their names
@@ -31,8 +32,6 @@ std::map<uint16_t, std::string> filterbank::machine_ids = {
  * 
  */
 filterbank::filterbank() {
-	// Make sure that data is allocated
-	data = std::vector<float>(0);
 }
 
 /**
@@ -52,10 +51,36 @@ filterbank filterbank::read(filterbank::ioType inType, std::string input) {
 		case ioType::FILEIO:
 			fb = read_file(input);
 			break;
+		case ioType::SHMIO:
+			fb = open_shm(input);
+			if (!fb.read_data_file()) {
+				throw std::runtime_error(input + " is truncated, its data ends before the " + std::to_string(fb.header["nsamples"].val.i) + " spectra of its header");
+			}
+			fb.close();
+			break;
 		}
 	return fb;
 }
 
+/**
+ * @brief Sets the values that follow from the header and the amount of data
+ * 
+ * @param total_data_size the number of bytes following the header
+ */
+void filterbank::set_derived_values(uint64_t total_data_size) {
+	center_freq = (header["fch1"].val.d + header["nchans"].val.i * header["foff"].val.d / 2.0);
+
+	telescope = telescope_ids[header["telescope_id"].val.i];
+	backend = machine_ids[header["machine_id"].val.i];
+
+	// if nsamples isn't set, get it from the data size
+	if (!header["nsamples"].val.i && bytes_per_sample()) {
+		header["nsamples"].val.i = total_data_size / bytes_per_sample();
+	}
+
+	n_values = (uint64_t)header["nifs"].val.i * header["nchans"].val.i * header["nsamples"].val.i;
+}
+
 /**
  * @brief Writes the current filterbank object to either a file or standard io
  * 
@@ -64,6 +89,23 @@ filterbank filterbank::read(filterbank::ioType inType, std::string input) {
  * @param headerless whether to pass the header
  */
 void filterbank::write(filterbank::ioType outType, std::string filename, bool headerless) {
+	if (!create(outType, filename, headerless)) {
+		return;
+	}
+	write_block(data.data(), header["nsamples"].val.i);
+	close();
+}
+
+/**
+ * @brief Opens the output for streaming and writes the header, the data can then be written with write_block
+ * 
+ * @param outType whether to write to stdio or a file
+ * @param filename the filename to write, standard empty
+ * @param headerless whether to pass the header
+ * @return true on success
+ * @return false if the output could not be opened
+ */
+bool filterbank::create(filterbank::ioType outType, std::string filename, bool headerless) {
 	//TODO: Error handling on IO
 	FILE* fp = nullptr;
 	switch (outType) {
@@ -72,103 +114,282 @@ void filterbank::write(filterbank::ioType outType, std::string filename, bool he
 			break;
 		}
 		case ioType::FILEIO: {
-			fp = fopen(filename.c_str(), "wb");
+			// Readable as well, so O_DIRECT output can read back the partial block of the header
+			fp = fopen(filename.c_str(), "wb+");
+			break;
+		}
+		case ioType::SHMIO: {
+			// Shared memory rings are only read, the shmwrite tool writes them
 			break;
 		}
 	}
 
 	if (fp == NULL) {
 		std::cerr << "Failed to open file for writing: " << filename << std::endl;
-		return;
+		return false;
 	}
+	stream = std::shared_ptr<FILE>(fp, [](FILE* fp) {
+		if (fp == stdout) {
+			fflush(fp);
+		} else {
+			fclose(fp);
+		}
+	});
 
 	if (!headerless) {
-		//Write the actual header
-		write_string(fp, "HEADER_START");
-		for (auto param : header) {
-			//Skip unused headers
-			if (param.second.val.d == 0.0) {
-				continue;
-			}
-			switch (param.second.type) {
-			case INT: {
-				write_value(fp, param.first, param.second.val.i);
-				break;
-			}
-			case DOUBLE: {
-				write_value(fp, param.first, param.second.val.d);
-				break;
-			}
-			case STRING: {
-				write_string(fp, param.first);
-				write_string(fp, param.second.val.s);
-				break;
+		write_header(fp);
+	}
+	return true;
+}
+
+/**
+ * @brief Opens an existing file to write data at an offset, without a header. Several parts of one
+ * file can be written this way at the same time, each from its own filterbank.
+ *
+ * @param filename the file, which is not truncated
+ * @param offset the position in bytes of the first data to write
+ * @return true on success
+ * @return false if the file could not be opened or positioned
+ */
+bool filterbank::create_at(std::string filename, uint64_t offset) {
+	FILE* fp = fopen(filename.c_str(), "rb+");
+	if (fp == NULL) {
+		std::cerr << "Failed to open file for writing: " << filename << std::endl;
+		return false;
+	}
+	stream = std::shared_ptr<FILE>(fp, fclose);
+	if (fseeko(fp, (off_t)offset, SEEK_SET) != 0) {
+		stream.reset();
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Writes a block of spectra to the stream opened by create
+ * 
+ * @param block the samples to write, nifs * nchans values per spectrum
+ * @param nsamples the number of spectra in the block
+ */
+void filterbank::write_block(const float* block, uint32_t nsamples) {
+	if (!stream) {
+		return;
+	}
+	if (!writer) {
+		write_data(stream.get(), block, nsamples);
+		return;
+	}
+
+	// Encode whole spectra into the writer buffers, which are handed off once full
+	scoped_timer timer("write");
+	uint64_t spectrum_bytes = bytes_per_sample();
+	uint32_t spectrum = values_per_sample();
+	uint64_t per_buffer = writer->chunk_size() / spectrum_bytes;
+	stats::count("write", spectrum_bytes * nsamples, (uint64_t)spectrum * nsamples);
+	while (nsamples) {
+		if (!buffer_data) {
+			buffer_data = writer->buffer();
+			buffer_fill = 0;
+		}
+		uint32_t n = (uint32_t)std::min<uint64_t>(nsamples, per_buffer - buffer_fill / spectrum_bytes);
+		encode(block, (uint64_t)n * spectrum, buffer_data + buffer_fill);
+		buffer_fill += n * spectrum_bytes;
+		block += (uint64_t)n * spectrum;
+		nsamples -= n;
+		if (buffer_fill + spectrum_bytes > writer->chunk_size()) {
+			writer->submit(buffer_fill);
+			buffer_data = nullptr;
+		}
+	}
+}
+
+/**
+ * @brief Writes the data of the stream opened by create in the background, write_block
+ * then only encodes the data
+ * 
+ * @param depth the number of buffers that may wait to be written
+ * @param chunk_bytes the size of a single write, rounded down to whole spectra
+ * @param direct whether to write with O_DIRECT, bypassing the page cache
+ * @return true when the writer was started
+ */
+bool filterbank::write_behind(unsigned int depth, size_t chunk_bytes, bool direct) {
+	uint64_t spectrum_bytes = bytes_per_sample();
+	if (!stream || writer || !spectrum_bytes || !valid_sample_format()) {
+		return false;
+	}
+	chunk_bytes = std::max<uint64_t>(1, chunk_bytes / spectrum_bytes) * spectrum_bytes;
+	// The header goes out through the stream before any chunk
+	fflush(stream.get());
+	writer = async_writer::create(stream.get(), chunk_bytes, depth, direct);
+	buffer_data = nullptr;
+	buffer_fill = 0;
+	return true;
+}
+
+/**
+ * @brief Encodes values to the number of bits in the header, clamping to the largest value.
+ * Values of less than 8 bits are packed with the first value in the lowest bits, as sigproc does.
+ * 
+ * @param block the values to encode
+ * @param n_values the number of values
+ * @param out the output, n_values * nbits / 8 bytes
+ */
+void filterbank::encode(const float* block, uint64_t n_values, uint8_t* out) {
+	switch (header["nbits"].val.i) {
+		case 8: {
+			for (uint64_t i = 0; i < n_values; i++) {
+				out[i] = block[i] > 0xff ? 0xff : (uint8_t)block[i];
 			}
+			break;
+		}
+		case 16: {
+			// out is not necessarily aligned to 16 bits
+			for (uint64_t i = 0; i < n_values; i++) {
+				uint16_t value = block[i] > 0xffff ? 0xffff : (uint16_t)block[i];
+				memcpy(out + i * sizeof(uint16_t), &value, sizeof(uint16_t));
 			}
+			break;
 		}
-		write_string(fp, "HEADER_END");
-	}
-
-	// Begin writing the data
-	for (uint32_t sample = 0; sample < header["nsamples"].val.i; ++sample) {
-		for (uint32_t interface = 0; interface < header["nifs"].val.i; ++interface) {
-			// Get the index for the interface
-			unsigned int index = (sample * header["nifs"].val.i * header["nchans"].val.i) + (interface * header["nchans"].val.i);
-			switch (header["nbits"].val.i) {
-				case 8: {
-					std::vector<uint8_t>cwbuf(header["nchans"].val.i);
-					for (unsigned int channel = 0; channel < header["nchans"].val.i; channel++) {
-						// Check if data is bigger than the maximum size of uint8_t
-						if(data[((uint64_t)index) + channel] > 0xff){
-							cwbuf[channel] = 0xff;
-						} else {
-							cwbuf[channel] = (uint8_t)data[((uint64_t)index) + channel];
-						}
-					}
-
-					fwrite(&cwbuf[0], sizeof(uint8_t), cwbuf.size(), fp);
-					break;
-				}
-				case 16: {
-					std::vector<uint16_t>swbuf(header["nchans"].val.i);
-					for (unsigned int channel = 0; channel < header["nchans"].val.i; channel++) {
-						// Check if the data is bigger than maximum size of uint16_t
-						if(data[((uint64_t)index) + channel] > 0xffff){
-							swbuf[channel] = 0xffff;
-						} else {
-							swbuf[channel] = (uint16_t)data[((uint64_t)index) + channel];
-						}
-
-					}
-
-					fwrite(&swbuf[0], sizeof(uint16_t), swbuf.size(), fp);
-					break;
-				}
-				case 32: {
-					fwrite(&data[index], sizeof(uint32_t), data.size() / header["nsamples"].val.i, fp);
-					break;
-				}
-				default:{
-					std::cerr << "Invalid number of output bits: supported formats are 8/16/32 bits";
-					break;
+		case 32: {
+			memcpy(out, block, n_values * sizeof(float));
+			break;
+		}
+		default: {
+			const int nbits = header["nbits"].val.i;
+			const uint32_t per_byte = 8 / nbits;
+			const float maximum = (float)((1 << nbits) - 1);
+			for (uint64_t byte = 0; byte < n_values / per_byte; byte++) {
+				uint8_t packed = 0;
+				for (uint32_t k = 0; k < per_byte; k++) {
+					float value = block[byte * per_byte + k];
+					uint8_t level = value > maximum ? (uint8_t)maximum : (value > 0.0f ? (uint8_t)value : 0);
+					packed |= level << (k * nbits);
 				}
+				out[byte] = packed;
 			}
+			break;
 		}
 	}
-	if(fp != nullptr){
-		fclose(fp);
+}
+
+/**
+ * @brief Releases the stream opened by open or create, it is closed once no copy uses it.
+ * Data still queued for writing is written first.
+ */
+void filterbank::close() {
+	if (writer) {
+		if (buffer_data && buffer_fill) {
+			writer->submit(buffer_fill);
+		}
+		if (!writer->finish()) {
+			std::cerr << "Failed to write all data" << std::endl;
+		}
+		buffer_data = nullptr;
+		writer.reset();
+	}
+	reader.reset();
+	chunk_data = nullptr;
+	chunk_size = chunk_pos = 0;
+	stream.reset();
+	std::vector<char>().swap(lookahead);
+	lookahead_pos = 0;
+}
+
+/**
+ * @brief The number of values in a single spectrum
+ * 
+ * @return uint32_t nifs * nchans
+ */
+uint32_t filterbank::values_per_sample() {
+	return header["nifs"].val.i * header["nchans"].val.i;
+}
+
+/**
+ * @brief The number of bytes a single spectrum takes in the file
+ * 
+ * @return uint64_t nifs * nchans * nbits / 8
+ */
+uint64_t filterbank::bytes_per_sample() {
+	return (uint64_t)values_per_sample() * header["nbits"].val.i / 8;
+}
+
+/**
+ * @brief Whether the data can be read and written: a supported number of bits
+ * and spectra that take a whole number of bytes
+ * 
+ * @return true when valid
+ */
+bool filterbank::valid_sample_format() {
+	return supported_bits(header["nbits"].val.i) && ((uint64_t)values_per_sample() * header["nbits"].val.i) % 8 == 0;
+}
+
+/**
+ * @brief Whether the number of bits per value can be read and written
+ * 
+ * @param nbits the number of bits
+ * @return true for 1, 2, 4, 8, 16 and 32 bits
+ */
+bool filterbank::supported_bits(int32_t nbits) {
+	return nbits == 1 || nbits == 2 || nbits == 4 || nbits == 8 || nbits == 16 || nbits == 32;
+}
+
+/**
+ * @brief Writes the header of the current filterbank object
+ * 
+ * @param fp the file pointer to write to
+ */
+void filterbank::write_header(FILE* fp) {
+	scoped_timer timer("write_header");
+
+	// Serialize into a single buffer so the header costs one write
+	char stack_buffer[header_codec::typical_size];
+	std::vector<char> heap_buffer;
+	char* buffer = stack_buffer;
+	size_t size = header_codec::serialized_size(header);
+	if (size > sizeof(stack_buffer)) {
+		heap_buffer.resize(size);
+		buffer = heap_buffer.data();
 	}
+
+	size = header_codec::serialize(header, buffer, size);
+	fwrite(buffer, sizeof(char), size, fp);
 }
 
 /**
- * @brief Helper method to write a string to a file.
- * this writes the length of the string first, then the actual data.
+ * @brief Writes a block of spectra, encoded to the number of bits in the header.
+ * The spectra are encoded into a reused buffer and written a few MB at a time.
+ * 
+ * @param fp the file pointer to write to
+ * @param block the samples to write, nifs * nchans values per spectrum
+ * @param nsamples the number of spectra in the block
  */
-void filterbank::write_string(FILE* fp, const std::string string) {
-	uint32_t len = string.length();
-	//Write the length of our string
-	fwrite(&len, sizeof(int), 1, fp);
-	//then write the actual string
-	fwrite(string.c_str(), sizeof(char), len, fp);
-	fflush(fp);
-}
\ No newline at end of file
+void filterbank::write_data(FILE* fp, const float* block, uint32_t nsamples) {
+	scoped_timer timer("write");
+	int nbits = header["nbits"].val.i;
+	if (!valid_sample_format()) {
+		std::cerr << "Invalid number of output bits: supported formats are 1/2/4/8/16/32 bits, with whole bytes per spectrum";
+		return;
+	}
+	uint32_t spectrum = values_per_sample();
+	uint64_t spectrum_bytes = bytes_per_sample();
+	if (!spectrum_bytes) {
+		return;
+	}
+	stats::count("write", spectrum_bytes * nsamples, (uint64_t)spectrum * nsamples);
+
+	// Floats are written as they are
+	if (nbits == 32) {
+		fwrite(block, sizeof(float), (uint64_t)spectrum * nsamples, fp);
+		return;
+	}
+
+	uint32_t per_write = (uint32_t)std::min<uint64_t>(nsamples, std::max<uint64_t>(1, (4 << 20) / spectrum_bytes));
+	if (raw.size() < per_write * spectrum_bytes) {
+		raw.resize(per_write * spectrum_bytes);
+	}
+	for (uint32_t sample = 0; sample < nsamples; sample += per_write) {
+		uint32_t n = std::min(per_write, nsamples - sample);
+		encode(block + (uint64_t)sample * spectrum, (uint64_t)n * spectrum, raw.data());
+		fwrite(raw.data(), sizeof(uint8_t), n * spectrum_bytes, fp);
+	}
+}
@@ -1,4 +1,56 @@
 #include "filterbankCore.hpp"
+#include "kernelDispatch.hpp"
+#include "stats.hpp"
+#include <sstream>
+#include <sys/stat.h>
+
+/**
+ * @brief Converts packed values of 1, 2, 4, 8 or 16 bits to floats. Values of less than a byte are
+ * packed with the first value in the lowest bits of each byte.
+ */
+struct decode_kernel {
+	typedef void (*type)(const uint8_t* raw, uint64_t values, float* out, uint32_t nbits);
+
+	template<uint32_t bits>
+	static void run(const uint8_t* raw, uint64_t values, float* out, uint32_t nbits) {
+		const uint32_t n = bits ? bits : nbits;
+		if (n == 16) {
+			const uint16_t* shorts = (const uint16_t*)raw;
+			for (uint64_t i = 0; i < values; i++) {
+				out[i] = (float)shorts[i];
+			}
+		} else if (n == 8) {
+			for (uint64_t i = 0; i < values; i++) {
+				out[i] = (float)raw[i];
+			}
+		} else {
+			const uint32_t per_byte = 8 / n;
+			const uint8_t mask = (1 << n) - 1;
+			for (uint64_t byte = 0; byte < values / per_byte; byte++) {
+				const uint8_t packed = raw[byte];
+				for (uint32_t k = 0; k < per_byte; k++) {
+					out[byte * per_byte + k] = (float)((packed >> (k * n)) & mask);
+				}
+			}
+		}
+	};
+};
+
+/**
+ * @brief Closes a stream once no filterbank refers to it anymore, standard io is only flushed
+ * 
+ * @param fp the stream to close
+ */
+static void close_stream(FILE* fp) {
+	if (fp == nullptr) {
+		return;
+	}
+	if (fp == stdin || fp == stdout) {
+		fflush(fp);
+	} else {
+		fclose(fp);
+	}
+}
 
 /**
  * @brief Reads a file
@@ -7,76 +59,304 @@
  * @return filterbank the filterbank data object
  */
 filterbank filterbank::read_file(std::string filename) {
-	auto fb = filterbank();
-	auto inf = fopen(filename.c_str(), "rb");
+	auto fb = open(ioType::FILEIO, filename);
+	if (!fb.read_data_file()) {
+		throw std::runtime_error(filename + " is truncated, its data ends before the " + std::to_string(fb.header["nsamples"].val.i) + " spectra of its header");
+	}
+	fb.close();
+	return fb;
+}
 
-	if (inf == NULL) {
+/**
+ * @brief Opens a filterbank for streaming, only the header is read.
+ * The data can then be read with read_block.
+ * 
+ * @param inType the input type, file or stdio
+ * @param input the filename, ignored for stdio
+ * @return filterbank the filterbank with its header and an open stream
+ */
+filterbank filterbank::open(filterbank::ioType inType, std::string input) {
+	filterbank fb;
+	FILE* fp = nullptr;
+	switch (inType) {
+		case ioType::STDIO:
+			fp = stdin;
+			break;
+		case ioType::FILEIO:
+			fp = fopen(input.c_str(), "rb");
+			break;
+		case ioType::SHMIO:
+			return open_shm(input);
+	}
+
+	if (fp == NULL) {
 		std::cerr << "Failed to read from file \n";
 	}
+	fb.stream = std::shared_ptr<FILE>(fp, close_stream);
 
-	if (!fb.read_header_file(inf)) {
+	if (!fb.read_header_file(fp)) {
 		throw "Invalid filterbank file";
 	}
-
-	fb.read_data_file(inf);
-
-	fclose(inf);
 	return fb;
 }
 
 /**
- * @brief Reads a filterbank object from file
+ * @brief Reads all remaining data of the open stream into data
  * 
- * @param fp the file pointer
  * @return true when succesfull
  * @return false on failure to read the file or incomplete read
  */
-bool filterbank::read_data_file(FILE* fp) {
-	size_t values_read = 0;
-	uint32_t sample = 0;
-
-	if (fp == NULL) {
+bool filterbank::read_data_file() {
+	if (!stream && !reader) {
 		return false;
 	}
 
-	// Allocate a block of data
-	data = std::vector<float>(n_values);
+	uint32_t spectrum = values_per_sample();
+	if (n_values) {
+		// Not initialized, the pages are first touched when the data is read into them
+		data = sample_buffer(n_values);
+		uint32_t nsamples = header["nsamples"].val.i;
+		return read_block(data.data(), nsamples) == nsamples;
+	}
 
-	// Skip the header
-	fseek(fp, header_size, SEEK_SET);
+	// The size is unknown when reading from a pipe, so read until the end of the stream
+	if (!spectrum) {
+		return false;
+	}
+	const uint32_t block_samples = std::max<uint32_t>(1, (1 << 20) / spectrum);
+	uint64_t total = 0;
+	while (true) {
+		data.resize((total + block_samples) * spectrum);
+		uint32_t samples = read_block(&data[total * spectrum], block_samples);
+		total += samples;
+		if (samples < block_samples) {
+			break;
+		}
+	}
+	data.resize(total * spectrum);
+	header["nsamples"].val.i = total;
+	n_values = total * spectrum;
+	return true;
+}
 
-	std::vector<uint8_t> charblock(n_values);
-	std::vector<uint16_t> shortblock(n_values);
+/**
+ * @brief Reads the next spectra from the open stream and converts them to floats
+ * 
+ * @param block the output, room for nsamples * nifs * nchans values
+ * @param nsamples the number of spectra to read
+ * @return uint32_t the number of spectra read, less than nsamples at the end of the data
+ */
+uint32_t filterbank::read_block(float* block, uint32_t nsamples) {
+	if ((!stream && !reader) || !nsamples) {
+		return 0;
+	}
 
-	/* decide how to read the data based on the number of bits per sample */
-	switch (header["nbits"].val.i) {
-		case 8: { /* read n bytes into character block containing n 1-byte numbers */
-			values_read = fread(&charblock[0], sizeof(uint8_t), charblock.size(), fp);
-			for (uint32_t i = 0; i < n_values; i++) {
-				data[i] = (float)charblock[i];
-			}
-			break;
+	uint64_t spectrum_bytes = bytes_per_sample();
+	uint64_t wanted = spectrum_bytes * nsamples;
+	int nbits = header["nbits"].val.i;
+	if (!valid_sample_format()) {
+		std::cerr << "Invalid number of input bits: supported formats are 1/2/4/8/16/32 bits, with whole bytes per spectrum";
+		return 0;
+	}
+
+	// 32 bit data can be read in place, the others are converted from the chunk of the background
+	// reader they are in, or from the raw buffer when they are spread over chunks
+	const uint8_t* source = nullptr;
+	uint64_t got;
+	{
+		scoped_timer timer("read");
+		if (nbits != 32) {
+			source = peek(wanted);
 		}
-		case 16: { /* read 2*n bytes into short block containing n 2-byte numbers */
-			values_read = fread(&shortblock[0], sizeof(uint16_t), shortblock.size(), fp);
-			for (uint32_t i = 0; i < n_values; i++) {
-				data[i] = (float)shortblock[i];
+		if (source) {
+			got = wanted;
+		} else {
+			uint8_t* target = (uint8_t*)block;
+			if (nbits != 32) {
+				if (raw.size() < wanted) {
+					raw.resize(wanted);
+				}
+				target = raw.data();
+				source = target;
 			}
-			break;
+			got = fill(target, wanted);
 		}
-		case 32: {
-			values_read = fread(&data[0], sizeof(float), n_values, fp);
-			break;
+	}
+
+	data_read += got;
+	if (checking) {
+		scoped_timer timer("checksum");
+		crc.update(source ? source : (const uint8_t*)block, got);
+		stats::count("checksum", got, 0);
+	}
+	if (got < wanted) {
+		// The end of the data, which should not come before the end the header or the size of the file promised
+		uint64_t promised = (uint64_t)header["nsamples"].val.i * spectrum_bytes;
+		short_read |= data_read < promised || data_read < data_size;
+	}
+
+	// A trailing partial spectrum is dropped
+	uint32_t samples = got / spectrum_bytes;
+	uint64_t values = (uint64_t)samples * values_per_sample();
+	stats::count("read", got, values);
+
+	/* decide how to convert the data based on the number of bits per sample */
+	scoped_timer timer("convert");
+	stats::count("convert", 0, values);
+	if (nbits != 32) {
+		// Picked once per stream, and again only if the number of bits changes
+		if (decoder_bits != nbits) {
+			decoder = kernel_table<decode_kernel, 1, 2, 4, 8, 16>::select(nbits);
+			decoder_bits = nbits;
+		}
+		decoder(source, values, block, nbits);
+	}
+	return samples;
+}
+
+/**
+ * @brief Takes the next bytes of the data without copying them, when they are all in the current or
+ * next chunk of the background reader. They stay valid until the next read.
+ * 
+ * @param wanted the number of bytes
+ * @return const uint8_t* the bytes, nullptr when they have to be copied with fill
+ */
+const uint8_t* filterbank::peek(uint64_t wanted) {
+	if (!reader || lookahead_pos < lookahead.size()) {
+		return nullptr;
+	}
+	if (chunk_pos == chunk_size) {
+		chunk_pos = 0;
+		chunk_size = reader->next(chunk_data);
+	}
+	if (chunk_size - chunk_pos < wanted) {
+		return nullptr;
+	}
+	const uint8_t* bytes = chunk_data + chunk_pos;
+	chunk_pos += wanted;
+	return bytes;
+}
+
+/**
+ * @brief Copies the next bytes of the data, from the lookahead first and then from
+ * the background reader or the stream
+ * 
+ * @param target the output
+ * @param wanted the number of bytes to copy
+ * @return uint64_t the number of bytes copied, less than wanted at the end of the data
+ */
+uint64_t filterbank::fill(uint8_t* target, uint64_t wanted) {
+	uint64_t got = 0;
+	if (lookahead_pos < lookahead.size()) {
+		uint64_t n = std::min<uint64_t>(wanted, lookahead.size() - lookahead_pos);
+		memcpy(target, &lookahead[lookahead_pos], n);
+		lookahead_pos += n;
+		got += n;
+		if (lookahead_pos == lookahead.size()) {
+			std::vector<char>().swap(lookahead);
+			lookahead_pos = 0;
 		}
 	}
-	if (values_read != n_values) {
+
+	if (!reader) {
+		if (got < wanted) {
+			got += fread(target + got, sizeof(uint8_t), wanted - got, stream.get());
+		}
+		return got;
+	}
+
+	while (got < wanted) {
+		if (chunk_pos == chunk_size) {
+			chunk_pos = 0;
+			chunk_size = reader->next(chunk_data);
+			if (!chunk_size) {
+				break;
+			}
+		}
+		uint64_t n = std::min<uint64_t>(wanted - got, chunk_size - chunk_pos);
+		memcpy(target + got, chunk_data + chunk_pos, n);
+		chunk_pos += n;
+		got += n;
+	}
+	return got;
+}
+
+/**
+ * @brief Moves the file opened by open to the start of a sample, so reading starts there.
+ * Only regular files can be moved, and only before the first read or prefetch.
+ *
+ * @param sample the first sample to read
+ * @return true when the file is at the sample
+ */
+bool filterbank::seek_sample(uint64_t sample) {
+	if (!stream || reader || stream.get() == stdin || !file_size) {
+		return false;
+	}
+	if (fseeko(stream.get(), (off_t)(header_size + sample * bytes_per_sample()), SEEK_SET) != 0) {
 		return false;
 	}
+	std::vector<char>().swap(lookahead);
+	lookahead_pos = 0;
+	// The data before the sample is not read, so it cannot be checksummed
+	checking = false;
+	sought = true;
+	data_read = sample * bytes_per_sample();
 	return true;
 }
 
 /**
- * @brief Reads the header of a given file
+ * @brief Starts reading the data of the stream opened by open in the background,
+ * so reading overlaps with processing
+ * 
+ * @param depth the number of chunks read ahead
+ * @param chunk_bytes the size of a single read
+ * @return true when the reader was started
+ */
+bool filterbank::prefetch(unsigned int depth, size_t chunk_bytes) {
+	if (!stream || reader) {
+		return false;
+	}
+	// ftello accounts for the bytes already buffered by the stream, i.e. the lookahead
+	off_t offset = ftello(stream.get());
+	reader = async_reader::create(stream.get(), offset < 0 ? 0 : offset, chunk_bytes, depth);
+	chunk_data = nullptr;
+	chunk_size = chunk_pos = 0;
+	return true;
+}
+
+/**
+ * @brief Starts reading the data of the file opened by open in the background while it is still
+ * being written, e.g. during an observation. At the current end of the file reading waits for more
+ * data, until the file has not grown for timeout seconds or the sentinel file exists. The length is
+ * then unknown up front, like for a pipe, unless the header has nsamples.
+ * 
+ * @param timeout the seconds without new data after which the file is complete, 0 to only use the sentinel
+ * @param sentinel a file whose existence marks the file complete, empty to only use the timeout
+ * @param depth the number of chunks read ahead
+ * @param chunk_bytes the most bytes of a single read
+ * @return true when the reader was started, false for pipes or without a way to detect the end
+ */
+bool filterbank::follow(double timeout, const std::string& sentinel, unsigned int depth, size_t chunk_bytes) {
+	if (!stream || reader || stream.get() == stdin || !file_size || (timeout <= 0.0 && sentinel.empty())) {
+		return false;
+	}
+	off_t offset = ftello(stream.get());
+	reader = std::make_shared<follow_reader>(fileno(stream.get()), offset < 0 ? 0 : offset, chunk_bytes, depth, timeout, sentinel);
+	chunk_data = nullptr;
+	chunk_size = chunk_pos = 0;
+
+	// The size of the file so far is not the size of the observation
+	if (!header["nsamples"].present) {
+		header["nsamples"].val.i = 0;
+	}
+	file_size = data_size = 0;
+	set_derived_values(0);
+	return true;
+}
+
+/**
+ * @brief Reads the header of a given file or stream. Bytes read beyond the header
+ * are kept for read_block, so the stream does not have to be seekable.
  * 
  * @param fp the file pointer
  * @return true on success
@@ -87,99 +367,126 @@ bool filterbank::read_header_file(FILE* fp) {
 		return false;
 	}
 
-	uint32_t keylen = 0;
-	auto buffer = read_string(fp, keylen);
-	const std::string initial(buffer);
-	
-	if (initial.compare("HEADER_START")) {
+	scoped_timer timer("read_header");
+	char stack_buffer[header_codec::typical_size];
+	std::vector<char> heap_buffer;
+	char* buffer = stack_buffer;
+	size_t length = fread(buffer, sizeof(char), sizeof(stack_buffer), fp);
+	size_t size = 0;
+
+	header_codec::status result = header_codec::parse(buffer, length, header, size);
+	// Only unusually large headers, e.g. with frequency tables, need more than one read
+	while (result == header_codec::INCOMPLETE && !feof(fp) && !ferror(fp)) {
+		heap_buffer.resize(length * 2);
+		if (buffer == stack_buffer) {
+			memcpy(heap_buffer.data(), stack_buffer, length);
+		}
+		buffer = heap_buffer.data();
+		length += fread(buffer + length, sizeof(char), heap_buffer.size() - length, fp);
+		result = header_codec::parse(buffer, length, header, size);
+	}
+
+	if (result != header_codec::COMPLETE) {
 		std::cerr << "Error, File is not a valid filterbank file";
 		return false;
 	}
-	while (true) {
-		buffer = read_string(fp, keylen);
-		const std::string token(buffer);
-		if (!token.compare("HEADER_END")) {
-			// get size of the header by getting the current position;
-			header_size = ftell(fp);
-			break;
-		}
-		switch (header[token].type) {
-			case INT: {
-				header[token].val.i = read_value<int>(fp);
-				break;
-			}
-			case DOUBLE: {
-				header[token].val.d = read_value<double>(fp);
-				break;
-			}
-			case STRING: {
-				auto value = read_string(fp, keylen);
-				//TODO: Error handling
-				strncpy(header[token].val.s, value, keylen);
-				break;
-			}
-		};
+	header_size = size;
+	crc.update(buffer, size);
+	lookahead.assign(buffer + size, buffer + length);
+	lookahead_pos = 0;
 
+	// get the size of the file from the file system, unknown for pipes
+	struct stat info;
+	if (!fstat(fileno(fp), &info) && S_ISREG(info.st_mode) && (uint64_t)info.st_size >= header_size) {
+		file_size = info.st_size;
+		data_size = file_size - header_size;
 	}
+	set_derived_values(data_size);
+	return true;
+}
 
-	// get the size of the file by looking for the end, then getting the current position;
-	fseek(fp, 0, SEEK_END);
-	file_size = ftell(fp);
-	data_size = file_size - header_size;
-	center_freq = (header["fch1"].val.d + header["nchans"].val.i * header["foff"].val.d / 2.0);
-	n_bytes = header["nbits"].val.i / 8;
-
-	telescope = telescope_ids[header["telescope_id"].val.i];
-	backend = machine_ids[header["machine_id"].val.i];
-
-	// if nsamples isn't set, get it from the data size
-	if (!header["nsamples"].val.i) {
-		header["nsamples"].val.i = data_size / (n_bytes * header["nchans"].val.i * header["nifs"].val.i);
+/**
+ * @brief Checksums the input as it is read: the header, already read by open, and the data from here on.
+ * The CRC is calculated on the raw bytes while they are in cache for decoding, so it costs no extra pass.
+ *
+ * @return true when the input can be checksummed, false once data was read or the input was moved
+ */
+bool filterbank::checksum() {
+	if ((!stream && !reader) || sought || data_read) {
+		return false;
 	}
-
-	n_values = header["nifs"].val.i * header["nchans"].val.i * header["nsamples"].val.i;
+	checking = true;
 	return true;
 }
 
 /**
- * @brief reads the size of a following string
- * 
- * @param fp the file to read from
- * @return uint32_t the size of the following string
+ * @brief The CRC32C of the header and all data of the input. The data not read yet, e.g. beyond the nsamples
+ * of the header, is read and only checksummed.
+ *
+ * @return uint32_t the CRC32C, the same as of the whole file
  */
-uint32_t filterbank::read_key_size(FILE* fp) {
-	uint32_t keylen;
-	fread(&keylen, sizeof(keylen), 1, fp);
-	return keylen;
+uint32_t filterbank::input_crc() {
+	if (!checking) {
+		throw std::runtime_error("The input is not checksummed, checksum is called before reading");
+	}
+	if (stream || reader) {
+		if (raw.size() < (1 << 20)) {
+			raw.resize(1 << 20);
+		}
+		uint64_t got;
+		while ((got = fill(raw.data(), raw.size())) > 0) {
+			scoped_timer timer("checksum");
+			crc.update(raw.data(), got);
+			stats::count("checksum", got, 0);
+			data_read += got;
+		}
+	}
+	return crc.value();
 }
 
 /**
- * @brief reads a string from the file
- * 
- * @param fp the file to read from
- * @param keylen the length of the string
- * @return char* a buffer containing the data
+ * @return true when a read ended before the data the header or the size of the file promised, or the file
+ * ends in the middle of a spectrum
  */
-char* filterbank::read_string(FILE* fp, uint32_t& keylen) {
-	fread(&keylen, sizeof(uint32_t), 1, fp);
-	char* buffer = new char[(((uint64_t)keylen) + 1)]{ '\0' };
-	fread(buffer, sizeof(char), keylen, fp);
-	return buffer;
+bool filterbank::truncated() {
+	uint64_t spectrum_bytes = bytes_per_sample();
+	return short_read || (spectrum_bytes && data_size % spectrum_bytes);
 }
 
 /**
- * @brief reads a value from the file
- * 
- * @tparam T The type of value
- * @param fp The file to write to
- * @return T The data read.
+ * @param input the file
+ * @param crc the stored CRC32C
+ * @return true when name.crc32c exists and starts with a CRC in hexadecimal
  */
-template <typename T >
-T filterbank::read_value(FILE* fp) {
-	T value;
-	fread(&value, sizeof(T), 1, fp);
-	return value;
+bool filterbank::stored_crc(const std::string& input, uint32_t& crc) {
+	std::ifstream file(input + ".crc32c");
+	std::string value;
+	if (!(file >> value) || value.size() != 8) {
+		return false;
+	}
+	char* end = nullptr;
+	unsigned long number = strtoul(value.c_str(), &end, 16);
+	if (*end != '\0') {
+		return false;
+	}
+	crc = (uint32_t)number;
+	return true;
 }
 
-
-
+/**
+ * @param input the file
+ * @param crc the CRC32C of the file
+ * @return true when name.crc32c was written
+ */
+bool filterbank::store_crc(const std::string& input, uint32_t crc) {
+	std::ostringstream line;
+	line << std::hex;
+	line.width(8);
+	line.fill('0');
+	line << crc;
+	size_t slash = input.find_last_of('/');
+	std::ofstream file(input + ".crc32c");
+	file << line.str() << "  " << (slash == std::string::npos ? input : input.substr(slash + 1)) << "\n";
+	file.close();
+	return file.good();
+}
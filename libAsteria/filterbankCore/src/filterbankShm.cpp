@@ -0,0 +1,42 @@
+#include "filterbankCore.hpp"
+#include "shmRing.hpp"
+#include "stats.hpp"
+#include <stdexcept>
+
+/**
+ * @brief Attaches to a shared memory ring and reads its header. The data blocks are read in place
+ * as the writer fills them, like the chunks of a background reader, and end when the writer finishes.
+ *
+ * @param name the name of the ring, with or without the shm: prefix
+ * @return filterbank the filterbank with its header, the data can then be read with read_block
+ */
+filterbank filterbank::open_shm(std::string name) {
+	if (!name.compare(0, 4, "shm:")) {
+		name = name.substr(4);
+	}
+	std::shared_ptr<shm_ring> ring = shm_ring::attach(name);
+
+	filterbank fb;
+	scoped_timer timer("read_header");
+	std::vector<char> bytes = ring->read_header();
+	size_t size = 0;
+	if (header_codec::parse(bytes.data(), bytes.size(), fb.header, size) != header_codec::COMPLETE) {
+		throw std::runtime_error("The header of shared memory ring " + ring->name() + " is not a valid filterbank header");
+	}
+	fb.header_size = size;
+	fb.crc.update(bytes.data(), size);
+	// Like a pipe the length is unknown, unless the header has nsamples
+	fb.set_derived_values(0);
+	fb.reader = std::make_shared<shm_reader>(ring);
+	return fb;
+}
+
+/**
+ * @param input the name of the input
+ */
+filterbank::ioType filterbank::input_type(const std::string& input) {
+	if (input.empty()) {
+		return ioType::STDIO;
+	}
+	return input.compare(0, 4, "shm:") ? ioType::FILEIO : ioType::SHMIO;
+}
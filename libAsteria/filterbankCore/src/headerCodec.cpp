@@ -0,0 +1,236 @@
+#include "headerCodec.hpp"
+#include <cstring>
+
+namespace {
+	/**
+	 * @brief Sigproc keys that are valid but not kept in the header map, with the size of their value
+	 */
+	struct skipped_key {
+		const char* name;
+		uint32_t value_size;
+	};
+
+	const skipped_key skipped_keys[] = {
+		{ "FREQUENCY_START", 0 }, { "FREQUENCY_END", 0 }, { "fchannel", sizeof(double) },
+		{ "npuls", sizeof(int64_t) }, { "signed", sizeof(char) }
+	};
+
+	/**
+	 * @brief Reads a length prefixed string without copying it
+	 * 
+	 * @return the codec status, string and length point into the buffer on success
+	 */
+	header_codec::status read_string(const char* buffer, size_t length, size_t& index, const char*& string, uint32_t& string_length) {
+		if (length - index < sizeof(uint32_t)) {
+			return header_codec::INCOMPLETE;
+		}
+		memcpy(&string_length, buffer + index, sizeof(uint32_t));
+		if (string_length > header_codec::max_string) {
+			return header_codec::INVALID;
+		}
+		index += sizeof(uint32_t);
+		if (length - index < string_length) {
+			return header_codec::INCOMPLETE;
+		}
+		string = buffer + index;
+		index += string_length;
+		return header_codec::COMPLETE;
+	}
+
+	bool equals(const char* string, uint32_t length, const char* literal) {
+		return strlen(literal) == length && !memcmp(string, literal, length);
+	}
+}
+
+/**
+ * @brief Parses a header from the start of a span of bytes into the header map.
+ * Only keys that already exist in the map are stored, so no map node is ever allocated.
+ * 
+ * @param buffer the bytes to parse
+ * @param length the number of bytes available
+ * @param header the header map to fill
+ * @param header_size set to the size of the header including HEADER_END on success
+ * @return header_codec::status COMPLETE, INCOMPLETE when more bytes are needed or INVALID
+ */
+header_codec::status header_codec::parse(const char* buffer, size_t length, std::map<std::string, header_param>& header, size_t& header_size) {
+	size_t index = 0;
+	const char* token;
+	uint32_t token_length;
+
+	status result = read_string(buffer, length, index, token, token_length);
+	if (result != COMPLETE) {
+		return result;
+	}
+	if (!equals(token, token_length, "HEADER_START")) {
+		return INVALID;
+	}
+
+	while (true) {
+		result = read_string(buffer, length, index, token, token_length);
+		if (result != COMPLETE) {
+			return result;
+		}
+		if (equals(token, token_length, "HEADER_END")) {
+			header_size = index;
+			return COMPLETE;
+		}
+
+		// The map is small, a linear scan avoids constructing a key string
+		header_param* param = nullptr;
+		for (auto& entry : header) {
+			if (entry.first.size() == token_length && !memcmp(entry.first.data(), token, token_length)) {
+				param = &entry.second;
+				break;
+			}
+		}
+
+		if (param == nullptr) {
+			const skipped_key* skip = nullptr;
+			for (const skipped_key& key : skipped_keys) {
+				if (equals(token, token_length, key.name)) {
+					skip = &key;
+					break;
+				}
+			}
+			if (skip == nullptr) {
+				return INVALID;
+			}
+			if (length - index < skip->value_size) {
+				return INCOMPLETE;
+			}
+			index += skip->value_size;
+			continue;
+		}
+
+		switch (param->type) {
+			case INT: {
+				if (length - index < sizeof(int32_t)) {
+					return INCOMPLETE;
+				}
+				memcpy(&param->val.i, buffer + index, sizeof(int32_t));
+				index += sizeof(int32_t);
+				break;
+			}
+			case DOUBLE: {
+				if (length - index < sizeof(double)) {
+					return INCOMPLETE;
+				}
+				memcpy(&param->val.d, buffer + index, sizeof(double));
+				index += sizeof(double);
+				break;
+			}
+			case STRING: {
+				const char* value;
+				uint32_t value_length;
+				result = read_string(buffer, length, index, value, value_length);
+				if (result != COMPLETE) {
+					return result;
+				}
+				memset(param->val.s, '\0', sizeof(param->val.s));
+				memcpy(param->val.s, value, value_length);
+				break;
+			}
+		}
+		param->present = true;
+	}
+}
+
+/**
+ * @brief Whether a parameter is written out, either it was read or it was given a value
+ * 
+ * @param param the header parameter
+ * @return true when the parameter should be serialized
+ */
+bool header_codec::is_set(const header_param& param) {
+	if (param.present) {
+		return true;
+	}
+	switch (param.type) {
+		case INT:
+			return param.val.i != 0;
+		case DOUBLE:
+			return param.val.d != 0.0;
+		case STRING:
+			return param.val.s[0] != '\0';
+	}
+	return false;
+}
+
+/**
+ * @brief Calculates the number of bytes serialize() needs
+ * 
+ * @param header the header map to serialize
+ * @return size_t the size of the serialized header in bytes
+ */
+size_t header_codec::serialized_size(const std::map<std::string, header_param>& header) {
+	size_t size = 2 * sizeof(uint32_t) + strlen("HEADER_START") + strlen("HEADER_END");
+	for (auto& param : header) {
+		if (!is_set(param.second)) {
+			continue;
+		}
+		size += sizeof(uint32_t) + param.first.size();
+		switch (param.second.type) {
+			case INT:
+				size += sizeof(int32_t);
+				break;
+			case DOUBLE:
+				size += sizeof(double);
+				break;
+			case STRING:
+				size += sizeof(uint32_t) + strnlen(param.second.val.s, max_string);
+				break;
+		}
+	}
+	return size;
+}
+
+/**
+ * @brief Serializes the header map into a buffer
+ * 
+ * @param header the header map to serialize
+ * @param buffer the buffer to write into
+ * @param capacity the size of the buffer
+ * @return size_t the number of bytes written, 0 if the buffer is too small
+ */
+size_t header_codec::serialize(const std::map<std::string, header_param>& header, char* buffer, size_t capacity) {
+	if (serialized_size(header) > capacity) {
+		return 0;
+	}
+
+	size_t index = put_string(buffer, "HEADER_START", strlen("HEADER_START"));
+	for (auto& param : header) {
+		if (!is_set(param.second)) {
+			continue;
+		}
+		index += put_string(buffer + index, param.first.data(), param.first.size());
+		switch (param.second.type) {
+			case INT: {
+				memcpy(buffer + index, &param.second.val.i, sizeof(int32_t));
+				index += sizeof(int32_t);
+				break;
+			}
+			case DOUBLE: {
+				memcpy(buffer + index, &param.second.val.d, sizeof(double));
+				index += sizeof(double);
+				break;
+			}
+			case STRING: {
+				index += put_string(buffer + index, param.second.val.s, strnlen(param.second.val.s, max_string));
+				break;
+			}
+		}
+	}
+	index += put_string(buffer + index, "HEADER_END", strlen("HEADER_END"));
+	return index;
+}
+
+/**
+ * @brief Writes a length prefixed string
+ * 
+ * @return size_t the number of bytes written
+ */
+size_t header_codec::put_string(char* buffer, const char* string, uint32_t length) {
+	memcpy(buffer, &length, sizeof(uint32_t));
+	memcpy(buffer + sizeof(uint32_t), string, length);
+	return sizeof(uint32_t) + length;
+}
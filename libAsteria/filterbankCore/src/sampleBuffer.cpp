@@ -0,0 +1,155 @@
+#include "sampleBuffer.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <sys/mman.h>
+
+namespace {
+	std::atomic<int> page_policy(sample_buffer::TRANSPARENT_HUGE_PAGES);
+
+	/**
+	 * @brief Allocates uninitialized memory for values, with huge pages when the buffer is large enough
+	 *
+	 * @param[in] bytes the size of the memory
+	 * @param[out] mapped the bytes mapped with huge pages, 0 when the memory is from the heap
+	 */
+	float* allocate(size_t bytes, size_t& mapped) {
+		mapped = 0;
+		const int policy = page_policy.load(std::memory_order_relaxed);
+		const bool huge = bytes >= sample_buffer::huge_page && policy != sample_buffer::SMALL_PAGES;
+#ifdef MAP_HUGETLB
+		if (huge && policy == sample_buffer::EXPLICIT_HUGE_PAGES) {
+			size_t length = (bytes + sample_buffer::huge_page - 1) / sample_buffer::huge_page * sample_buffer::huge_page;
+			void* memory = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+			if (memory != MAP_FAILED) {
+				mapped = length;
+				return (float*)memory;
+			}
+		}
+#endif
+		void* memory = nullptr;
+		if (posix_memalign(&memory, huge ? sample_buffer::huge_page : sample_buffer::alignment, std::max<size_t>(bytes, 1))) {
+			throw std::bad_alloc();
+		}
+#ifdef MADV_HUGEPAGE
+		if (huge) {
+			madvise(memory, bytes / sample_buffer::huge_page * sample_buffer::huge_page, MADV_HUGEPAGE);
+		}
+#endif
+		return (float*)memory;
+	}
+}
+
+/**
+ * @param size the number of values, which are not initialized
+ */
+sample_buffer::sample_buffer(uint64_t size) {
+	resize(size);
+}
+
+/**
+ * @param size the number of values
+ * @param value the value of all of them
+ */
+sample_buffer::sample_buffer(uint64_t size, float value) {
+	assign(size, value);
+}
+
+sample_buffer::~sample_buffer() {
+	release();
+}
+
+sample_buffer::sample_buffer(sample_buffer&& other) noexcept :
+	values(other.values), count(other.count), allocated(other.allocated), mapped(other.mapped) {
+	other.values = nullptr;
+	other.count = 0;
+	other.allocated = 0;
+	other.mapped = 0;
+}
+
+sample_buffer& sample_buffer::operator=(sample_buffer&& other) noexcept {
+	if (this != &other) {
+		release();
+		std::swap(values, other.values);
+		std::swap(count, other.count);
+		std::swap(allocated, other.allocated);
+		std::swap(mapped, other.mapped);
+	}
+	return *this;
+}
+
+void sample_buffer::release() {
+	if (mapped) {
+		munmap(values, mapped);
+	} else {
+		free(values);
+	}
+	values = nullptr;
+	count = 0;
+	allocated = 0;
+	mapped = 0;
+}
+
+/**
+ * @brief Changes the number of values, growing the memory geometrically so that repeated growth,
+ * e.g. while reading a pipe, copies every value only a few times
+ */
+void sample_buffer::resize(uint64_t size) {
+	if (size > allocated) {
+		reserve(std::max(size, allocated + allocated / 2));
+	}
+	count = size;
+}
+
+/**
+ * @brief Makes room for at least size values without changing the size
+ */
+void sample_buffer::reserve(uint64_t size) {
+	if (size <= allocated) {
+		return;
+	}
+	size_t bytes_mapped = 0;
+	float* memory = allocate(size * sizeof(float), bytes_mapped);
+	if (count) {
+		memcpy(memory, values, count * sizeof(float));
+	}
+	uint64_t kept = count;
+	release();
+	values = memory;
+	count = kept;
+	allocated = size;
+	mapped = bytes_mapped;
+}
+
+void sample_buffer::assign(uint64_t size, float value) {
+	resize(size);
+	std::fill(values, values + size, value);
+}
+
+void sample_buffer::set_pages(pages policy) {
+	page_policy.store(policy);
+}
+
+sample_buffer::pages sample_buffer::get_pages() {
+	return (pages)page_policy.load();
+}
+
+/**
+ * @param name small, transparent or huge
+ * @param policy set to the policy of the name
+ * @return false when the name is none of them
+ */
+bool sample_buffer::parse_pages(const std::string& name, pages& policy) {
+	if (name == "small") {
+		policy = SMALL_PAGES;
+	} else if (name == "transparent") {
+		policy = TRANSPARENT_HUGE_PAGES;
+	} else if (name == "huge") {
+		policy = EXPLICIT_HUGE_PAGES;
+	} else {
+		return false;
+	}
+	return true;
+}
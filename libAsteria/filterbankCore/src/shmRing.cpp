@@ -0,0 +1,288 @@
+#include "shmRing.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <new>
+#include <signal.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "The ring counters must be lock free to be shared between processes");
+
+const uint64_t shm_ring::default_header_bytes;
+
+/**
+ * @brief The start of the shared memory, followed by the bytes used per block, the header block and the data blocks
+ */
+struct shm_ring_control {
+	char magic[8];
+	uint32_t version;
+	uint32_t nblocks;
+	uint64_t block_bytes;
+	uint64_t header_capacity;
+	uint64_t header_offset;
+	uint64_t data_offset;
+	int64_t writer_pid;
+	std::atomic<int64_t> reader_pid;
+	std::atomic<uint64_t> header_bytes; // 0 until the header is written
+	std::atomic<uint64_t> written; // blocks handed to the reader
+	std::atomic<uint64_t> released; // blocks the reader is done with
+	std::atomic<uint32_t> finished; // no more blocks follow
+	std::atomic<uint32_t> readers;
+	std::atomic<uint32_t> attached; // a reader attached at some point
+	std::atomic<uint32_t> ready; // the writer completed this control block
+};
+
+namespace {
+	const char ring_magic[8] = { 'A', 'S', 'T', 'S', 'H', 'M', 'R', 'B' };
+	const uint32_t ring_version = 1;
+	const uint64_t ring_alignment = 4096;
+
+	uint64_t aligned(uint64_t offset) {
+		return (offset + ring_alignment - 1) / ring_alignment * ring_alignment;
+	}
+
+	// shm_open names start with a single slash
+	std::string shm_name(const std::string& name) {
+		return (name.empty() || name[0] != '/') ? "/" + name : name;
+	}
+}
+
+shm_ring::shm_ring(const std::string& name, bool writer) : ring_name(shm_name(name)), writer(writer) {
+}
+
+/**
+ * @param name the name of the shared memory, e.g. "asteria" or "/asteria"
+ * @param nblocks the number of data blocks
+ * @param block_bytes the size of a data block
+ * @param header_bytes the room for the header
+ */
+std::shared_ptr<shm_ring> shm_ring::create(const std::string& name, uint32_t nblocks, uint64_t block_bytes, uint64_t header_bytes) {
+	if (nblocks < 2 || !block_bytes || !header_bytes) {
+		throw std::runtime_error("A shared memory ring needs at least two blocks and room for the header");
+	}
+	std::shared_ptr<shm_ring> ring(new shm_ring(name, true));
+	shm_unlink(ring->ring_name.c_str());
+	int fd = shm_open(ring->ring_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+	if (fd < 0) {
+		throw std::runtime_error("Failed to create shared memory " + ring->ring_name + ": " + strerror(errno));
+	}
+	const uint64_t header_offset = aligned(sizeof(shm_ring_control) + nblocks * sizeof(uint64_t));
+	const uint64_t data_offset = aligned(header_offset + header_bytes);
+	const uint64_t size = data_offset + nblocks * block_bytes;
+	if (ftruncate(fd, (off_t)size) != 0) {
+		close(fd);
+		shm_unlink(ring->ring_name.c_str());
+		throw std::runtime_error("Failed to size shared memory " + ring->ring_name + ": " + strerror(errno));
+	}
+	ring->map(fd, size);
+
+	shm_ring_control* control = new (ring->memory) shm_ring_control();
+	memcpy(control->magic, ring_magic, sizeof(ring_magic));
+	control->version = ring_version;
+	control->nblocks = nblocks;
+	control->block_bytes = block_bytes;
+	control->header_capacity = header_bytes;
+	control->header_offset = header_offset;
+	control->data_offset = data_offset;
+	control->writer_pid = getpid();
+	control->reader_pid.store(0);
+	control->header_bytes.store(0);
+	control->written.store(0);
+	control->released.store(0);
+	control->finished.store(0);
+	control->readers.store(0);
+	control->attached.store(0);
+	control->ready.store(1, std::memory_order_release);
+	ring->control = control;
+	ring->used = (uint64_t*)(ring->memory + sizeof(shm_ring_control));
+	return ring;
+}
+
+/**
+ * @param name the name of the shared memory
+ * @param timeout the seconds to wait for the writer to create the ring, forever when negative
+ */
+std::shared_ptr<shm_ring> shm_ring::attach(const std::string& name, double timeout) {
+	std::shared_ptr<shm_ring> ring(new shm_ring(name, false));
+	auto start = std::chrono::steady_clock::now();
+	uint64_t rounds = 0;
+	while (true) {
+		int fd = shm_open(ring->ring_name.c_str(), O_RDWR, 0);
+		struct stat info;
+		if (fd >= 0 && !fstat(fd, &info) && (uint64_t)info.st_size >= sizeof(shm_ring_control)) {
+			ring->map(fd, info.st_size);
+			shm_ring_control* control = (shm_ring_control*)ring->memory;
+			if (control->ready.load(std::memory_order_acquire)) {
+				if (memcmp(control->magic, ring_magic, sizeof(ring_magic)) || control->version != ring_version) {
+					throw std::runtime_error(ring->ring_name + " is not an Asteria shared memory ring");
+				}
+				uint32_t none = 0;
+				if (!control->readers.compare_exchange_strong(none, 1)) {
+					ring->control = nullptr;
+					throw std::runtime_error(ring->ring_name + " already has a reader");
+				}
+				control->reader_pid.store(getpid());
+				control->attached.store(1);
+				ring->control = control;
+				ring->used = (uint64_t*)(ring->memory + sizeof(shm_ring_control));
+				return ring;
+			}
+			munmap(ring->memory, ring->mapped);
+			ring->memory = nullptr;
+		} else if (fd >= 0) {
+			close(fd);
+		}
+		std::chrono::duration<double> waited = std::chrono::steady_clock::now() - start;
+		if (timeout >= 0.0 && waited.count() > timeout) {
+			throw std::runtime_error("No shared memory ring " + ring->ring_name);
+		}
+		ring->wait(rounds);
+	}
+}
+
+/**
+ * @brief Maps the shared memory and closes its descriptor, the mapping keeps it open
+ */
+void shm_ring::map(int fd, uint64_t size) {
+	void* address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (address == MAP_FAILED) {
+		throw std::runtime_error("Failed to map shared memory " + ring_name + ": " + strerror(errno));
+	}
+	memory = (uint8_t*)address;
+	mapped = size;
+}
+
+shm_ring::~shm_ring() {
+	if (control && !writer) {
+		if (holding) {
+			control->released.fetch_add(1, std::memory_order_release);
+		}
+		control->readers.fetch_sub(1);
+	}
+	if (memory) {
+		munmap(memory, mapped);
+	}
+	if (writer) {
+		shm_unlink(ring_name.c_str());
+	}
+}
+
+/**
+ * @brief Sleeps a little, longer the longer a side has been waiting, up to a millisecond
+ */
+void shm_ring::wait(uint64_t& rounds) {
+	if (++rounds < 64) {
+		std::this_thread::yield();
+		return;
+	}
+	std::this_thread::sleep_for(std::chrono::microseconds(std::min<uint64_t>(1000, rounds)));
+	if (!control || rounds % 1024) {
+		return;
+	}
+	// Now and then check that the other side still exists, a side that ended without detaching never returns
+	if (writer && control->readers.load() && kill((pid_t)control->reader_pid.load(), 0) != 0 && errno == ESRCH) {
+		throw std::runtime_error("The reader of " + ring_name + " ended without detaching");
+	}
+	if (!writer && !control->finished.load() && kill((pid_t)control->writer_pid, 0) != 0 && errno == ESRCH) {
+		throw std::runtime_error("The writer of " + ring_name + " ended without finishing the data");
+	}
+}
+
+uint32_t shm_ring::block_count() const {
+	return control->nblocks;
+}
+
+uint64_t shm_ring::block_size() const {
+	return control->block_bytes;
+}
+
+/**
+ * @param header the header bytes, e.g. a sigproc header
+ * @param size the number of bytes
+ */
+void shm_ring::write_header(const char* header, uint64_t size) {
+	if (!size || size > control->header_capacity) {
+		throw std::runtime_error("The header does not fit the header block of " + ring_name);
+	}
+	memcpy(memory + control->header_offset, header, size);
+	control->header_bytes.store(size, std::memory_order_release);
+}
+
+uint8_t* shm_ring::next_free() {
+	const uint64_t written = control->written.load(std::memory_order_relaxed);
+	uint64_t rounds = 0;
+	while (written - control->released.load(std::memory_order_acquire) >= control->nblocks) {
+		wait(rounds);
+	}
+	return memory + control->data_offset + (written % control->nblocks) * control->block_bytes;
+}
+
+/**
+ * @param bytes the bytes of data in the block, at most the block size
+ */
+void shm_ring::submit(uint64_t bytes) {
+	// An empty block would read as the end of the data
+	if (!bytes) {
+		return;
+	}
+	const uint64_t written = control->written.load(std::memory_order_relaxed);
+	used[written % control->nblocks] = std::min(bytes, control->block_bytes);
+	control->written.store(written + 1, std::memory_order_release);
+}
+
+void shm_ring::finish() {
+	control->finished.store(1, std::memory_order_release);
+	uint64_t rounds = 0;
+	while (true) {
+		// Without a reader yet the data still has to be read
+		bool all_read = control->released.load(std::memory_order_acquire) == control->written.load(std::memory_order_relaxed);
+		if (control->attached.load() && (all_read || !control->readers.load())) {
+			return;
+		}
+		wait(rounds);
+	}
+}
+
+std::vector<char> shm_ring::read_header() {
+	uint64_t rounds = 0;
+	uint64_t size;
+	while (!(size = control->header_bytes.load(std::memory_order_acquire))) {
+		if (control->finished.load()) {
+			throw std::runtime_error("The writer of " + ring_name + " finished without a header");
+		}
+		wait(rounds);
+	}
+	const char* header = (const char*)(memory + control->header_offset);
+	return std::vector<char>(header, header + size);
+}
+
+/**
+ * @param data set to the start of the block in the shared memory, valid until the next call
+ */
+uint64_t shm_ring::next_full(const uint8_t*& data) {
+	if (holding) {
+		control->released.fetch_add(1, std::memory_order_release);
+		holding = false;
+	}
+	const uint64_t released = control->released.load(std::memory_order_relaxed);
+	uint64_t rounds = 0;
+	while (control->written.load(std::memory_order_acquire) <= released) {
+		// The end of the data only counts once every block written before it was read
+		if (control->finished.load(std::memory_order_acquire) && control->written.load(std::memory_order_acquire) <= released) {
+			return 0;
+		}
+		wait(rounds);
+	}
+	holding = true;
+	const uint64_t index = released % control->nblocks;
+	data = memory + control->data_offset + index * control->block_bytes;
+	return used[index];
+}
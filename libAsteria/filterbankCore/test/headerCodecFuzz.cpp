@@ -0,0 +1,182 @@
+#include "filterbankCore.hpp"
+#include "headerCodec.hpp"
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <sys/mman.h>
+#include <unistd.h>
+
+static int failures = 0;
+
+static void check(bool condition, const std::string& what) {
+	if (!condition) {
+		std::cerr << "FAILED: " << what << "\n";
+		failures++;
+	}
+}
+
+/**
+ * @brief Memory followed by a page without access: a span is placed so that it ends right before that page,
+ * so that a parse reading a single byte past the span crashes the test instead of going unnoticed
+ */
+class guarded_span {
+public:
+	explicit guarded_span(size_t capacity) {
+		page = (size_t)sysconf(_SC_PAGESIZE);
+		mapped = (capacity + page - 1) / page * page + page;
+		memory = (char*)mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (memory == MAP_FAILED || mprotect(memory + mapped - page, page, PROT_NONE)) {
+			throw std::runtime_error("Failed to map the guarded span");
+		}
+	};
+
+	~guarded_span() {
+		munmap(memory, mapped);
+	};
+
+	const char* place(const char* data, size_t length) {
+		char* start = memory + mapped - page - length;
+		memcpy(start, data, length);
+		return start;
+	};
+
+private:
+	char* memory;
+	size_t page;
+	size_t mapped;
+};
+
+/**
+ * @return the status of parsing length bytes of data placed at the end of the guarded span
+ */
+static header_codec::status parse(guarded_span& span, const std::vector<char>& data, size_t length, size_t& header_size) {
+	std::map<std::string, header_param> header = filterbank().header;
+	header_size = 0;
+	return header_codec::parse(span.place(data.data(), length), length, header, header_size);
+}
+
+/**
+ * @return the offsets of the length prefixes in a valid serialized header
+ */
+static std::vector<size_t> length_offsets(const std::vector<char>& valid) {
+	std::vector<size_t> offsets;
+	std::map<std::string, header_param> header = filterbank().header;
+	size_t index = 0;
+	while (index < valid.size()) {
+		uint32_t length;
+		memcpy(&length, valid.data() + index, sizeof(length));
+		offsets.push_back(index);
+		std::string key(valid.data() + index + sizeof(length), length);
+		index += sizeof(length) + length;
+		if (key == "HEADER_START" || key == "HEADER_END") {
+			continue;
+		}
+		switch (header.at(key).type) {
+			case INT:
+				index += sizeof(int32_t);
+				break;
+			case DOUBLE:
+				index += sizeof(double);
+				break;
+			case STRING:
+				memcpy(&length, valid.data() + index, sizeof(length));
+				offsets.push_back(index);
+				index += sizeof(length) + length;
+				break;
+		}
+	}
+	return offsets;
+}
+
+/**
+ * fuzzes header parsing with truncated, corrupted and random spans, each ending right before a page without
+ * access. Every prefix of a valid header must be INCOMPLETE, a length beyond the longest string INVALID, and
+ * any other span may parse to any status but never past its end.
+ */
+int main(int argc, char* argv[]) {
+	const uint32_t iterations = argc > 1 ? (uint32_t)std::stoul(argv[1]) : 200000;
+	std::mt19937_64 random(20261019);
+
+	std::map<std::string, header_param> header = filterbank().header;
+	header["telescope_id"].val.i = 4;
+	header["machine_id"].present = true;
+	header["nbits"].val.i = 8;
+	header["nchans"].val.i = 1024;
+	header["nifs"].val.i = 1;
+	header["fch1"].val.d = 1500.0;
+	header["foff"].val.d = -0.25;
+	header["tsamp"].val.d = 64.0e-6;
+	header["tstart"].val.d = 56000.0;
+	strcpy(header["source_name"].val.s, "J0534+2200");
+	std::vector<char> valid(header_codec::serialized_size(header));
+	header_codec::serialize(header, valid.data(), valid.size());
+
+	guarded_span span(header_codec::typical_size);
+	size_t header_size;
+
+	for (size_t length = 0; length < valid.size(); ++length) {
+		check(parse(span, valid, length, header_size) == header_codec::INCOMPLETE,
+			"a header cut after " + std::to_string(length) + " bytes is incomplete");
+	}
+	check(parse(span, valid, valid.size(), header_size) == header_codec::COMPLETE && header_size == valid.size(), "the whole header is complete");
+
+	for (size_t offset : length_offsets(valid)) {
+		std::vector<char> corrupt = valid;
+		uint32_t length = header_codec::max_string + 1 + (uint32_t)(random() % 1000000);
+		memcpy(corrupt.data() + offset, &length, sizeof(length));
+		check(parse(span, corrupt, corrupt.size(), header_size) == header_codec::INVALID,
+			"a length of " + std::to_string(length) + " at byte " + std::to_string(offset) + " is invalid");
+	}
+
+	uint32_t statuses[3] = {};
+	for (uint32_t iteration = 0; iteration < iterations; ++iteration) {
+		std::vector<char> data;
+		switch (iteration % 3) {
+			case 0: {
+				// Flipped and overwritten bytes
+				data = valid;
+				for (uint32_t n = 1 + random() % 4; n--;) {
+					data[random() % data.size()] ^= (char)(1 + random() % 255);
+				}
+				break;
+			}
+			case 1: {
+				// A small random length at a random position, the prefixes lose their sync
+				data = valid;
+				uint32_t length = (uint32_t)(random() % (2 * header_codec::max_string));
+				memcpy(data.data() + random() % (data.size() - sizeof(length)), &length, sizeof(length));
+				break;
+			}
+			case 2: {
+				// Random bytes
+				data.resize(1 + random() % (header_codec::typical_size - 1));
+				for (char& byte : data) {
+					byte = (char)random();
+				}
+				break;
+			}
+		}
+		const size_t length = random() % 4 ? data.size() : random() % (data.size() + 1);
+		header_codec::status status = parse(span, data, length, header_size);
+		check(status == header_codec::COMPLETE || status == header_codec::INCOMPLETE || status == header_codec::INVALID,
+			"iteration " + std::to_string(iteration) + " returns a status");
+		check(status != header_codec::COMPLETE || (header_size <= length && header_size > 0),
+			"iteration " + std::to_string(iteration) + " ends within the span");
+		check(iteration % 3 != 2 || status != header_codec::COMPLETE, "iteration " + std::to_string(iteration) + " rejects random bytes");
+		statuses[status]++;
+		if (failures > 20) {
+			break;
+		}
+	}
+
+	if (failures) {
+		std::cerr << failures << " checks failed\n";
+		return 1;
+	}
+	std::cout << "header codec fuzz passed: " << statuses[header_codec::COMPLETE] << " complete, "
+		<< statuses[header_codec::INCOMPLETE] << " incomplete, " << statuses[header_codec::INVALID] << " invalid\n";
+	return 0;
+}
@@ -0,0 +1,153 @@
+#include "filterbankCore.hpp"
+#include "headerCodec.hpp"
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static int failures = 0;
+
+static void check(bool condition, const std::string& what) {
+	if (!condition) {
+		std::cerr << "FAILED: " << what << "\n";
+		failures++;
+	}
+}
+
+/**
+ * @brief Serializes a header, parses it into the keys of a new filterbank and checks that every
+ * parameter comes back with its value and whether it was set
+ *
+ * @param header the header to round trip
+ * @param name the name of the case in failure messages
+ */
+static void round_trip(const std::map<std::string, header_param>& header, const std::string& name) {
+	const size_t size = header_codec::serialized_size(header);
+	std::vector<char> buffer(size);
+	check(header_codec::serialize(header, buffer.data(), size) == size, name + ": serialize writes serialized_size bytes");
+	check(header_codec::serialize(header, buffer.data(), size - 1) == 0, name + ": serialize refuses a buffer one byte short");
+
+	std::map<std::string, header_param> parsed = filterbank().header;
+	size_t header_size = 0;
+	check(header_codec::parse(buffer.data(), size, parsed, header_size) == header_codec::COMPLETE, name + ": parse is complete");
+	check(header_size == size, name + ": parse consumes the whole header");
+
+	for (auto& param : header) {
+		const header_param& result = parsed.at(param.first);
+		const std::string key = name + ": " + param.first;
+		check(result.present == header_codec::is_set(param.second), key + " is present exactly when it was set");
+		if (!result.present) {
+			continue;
+		}
+		switch (param.second.type) {
+			case INT:
+				check(result.val.i == param.second.val.i, key + " keeps its value");
+				break;
+			case DOUBLE:
+				check(!memcmp(&result.val.d, &param.second.val.d, sizeof(double)), key + " keeps its value");
+				break;
+			case STRING:
+				check(!strcmp(result.val.s, param.second.val.s), key + " keeps its value");
+				break;
+		}
+	}
+
+	// A parsed header is written out again byte for byte
+	std::vector<char> again(header_codec::serialized_size(parsed));
+	check(again.size() == size && header_codec::serialize(parsed, again.data(), again.size()) == size
+		&& !memcmp(again.data(), buffer.data(), size), name + ": the parsed header serializes to the same bytes");
+}
+
+/**
+ * @brief Appends a length prefixed string as sigproc writes it
+ */
+static void put_string(std::vector<char>& buffer, const std::string& string) {
+	uint32_t length = (uint32_t)string.size();
+	buffer.insert(buffer.end(), (const char*)&length, (const char*)&length + sizeof(length));
+	buffer.insert(buffer.end(), string.begin(), string.end());
+}
+
+template <typename value_type>
+static void put_value(std::vector<char>& buffer, value_type value) {
+	buffer.insert(buffer.end(), (const char*)&value, (const char*)&value + sizeof(value));
+}
+
+/**
+ * checks that headers survive serialize and parse unchanged: the usual parameters, parameters that were
+ * read with a value of zero, strings up to the longest accepted, and the sigproc keys that are skipped
+ */
+int main() {
+	std::map<std::string, header_param> header = filterbank().header;
+	round_trip(header, "empty header");
+
+	header["telescope_id"].val.i = 4;
+	header["machine_id"].val.i = 10;
+	header["data_type"].val.i = 1;
+	header["nbits"].val.i = 8;
+	header["nchans"].val.i = 1024;
+	header["nifs"].val.i = 1;
+	header["nsamples"].val.i = 468750;
+	header["fch1"].val.d = 1500.0;
+	header["foff"].val.d = -0.25;
+	header["tsamp"].val.d = 64.0e-6;
+	header["tstart"].val.d = 56000.123456789012;
+	header["src_raj"].val.d = 53431.97;
+	header["src_dej"].val.d = -451425.3;
+	strcpy(header["source_name"].val.s, "J0534+2200");
+	strcpy(header["rawdatafile"].val.s, "crab.fil");
+	round_trip(header, "typical header");
+
+	// Zero is a valid telescope, machine and coordinate once it was read
+	header["telescope_id"].val.i = 0;
+	header["telescope_id"].present = true;
+	header["machine_id"].val.i = 0;
+	header["machine_id"].present = true;
+	header["az_start"].val.d = 0.0;
+	header["az_start"].present = true;
+	header["za_start"].val.d = -0.0;
+	header["za_start"].present = true;
+	header["rawdatafile"].val.s[0] = '\0';
+	header["rawdatafile"].present = true;
+	round_trip(header, "present zero values");
+
+	// Unset zero values are left out
+	std::map<std::string, header_param> sparse = filterbank().header;
+	sparse["nchans"].val.i = 1;
+	sparse["ibeam"].val.i = -1;
+	round_trip(sparse, "sparse header");
+	check(header_codec::serialized_size(sparse) == 2 * sizeof(uint32_t) + strlen("HEADER_START") + strlen("HEADER_END")
+		+ 2 * (sizeof(uint32_t) + sizeof(int32_t)) + strlen("nchans") + strlen("ibeam"), "sparse header: only set values are written");
+
+	std::string longest(header_codec::max_string, 'x');
+	strcpy(header["source_name"].val.s, longest.c_str());
+	round_trip(header, "longest string");
+
+	// Keys sigproc writes that are not kept are skipped with their values
+	std::vector<char> skipped;
+	put_string(skipped, "HEADER_START");
+	put_string(skipped, "nchans");
+	put_value<int32_t>(skipped, 3);
+	put_string(skipped, "FREQUENCY_START");
+	put_string(skipped, "fchannel");
+	put_value<double>(skipped, 1400.0);
+	put_string(skipped, "FREQUENCY_END");
+	put_string(skipped, "npuls");
+	put_value<int64_t>(skipped, 12);
+	put_string(skipped, "signed");
+	put_value<char>(skipped, 1);
+	put_string(skipped, "nbits");
+	put_value<int32_t>(skipped, 32);
+	put_string(skipped, "HEADER_END");
+	std::map<std::string, header_param> parsed = filterbank().header;
+	size_t header_size = 0;
+	check(header_codec::parse(skipped.data(), skipped.size(), parsed, header_size) == header_codec::COMPLETE
+		&& header_size == skipped.size(), "skipped keys: parse is complete");
+	check(parsed["nchans"].val.i == 3 && parsed["nbits"].val.i == 32, "skipped keys: the keys around them are read");
+
+	if (failures) {
+		std::cerr << failures << " checks failed\n";
+		return 1;
+	}
+	std::cout << "header codec round trip passed\n";
+	return 0;
+}
@@ -0,0 +1,76 @@
+#ifndef BLOCK_H
+#define BLOCK_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "sampleBuffer.hpp"
+
+/**
+ * @brief A block of consecutive spectra passed between pipeline stages by pointer.
+ * The layout is the same as filterbank::data: sample major, then IF, then channel.
+ * The values are not initialized, every stage writes all values of the blocks it makes.
+ */
+struct block {
+	sample_buffer data;
+	uint32_t nsamples = 0; // number of spectra in the block
+	uint64_t first_sample = 0; // index of the first spectrum in the stream
+
+	// blocks are made by block_pool::acquire
+	explicit block(uint64_t capacity) { data.reserve(capacity); };
+};
+
+/**
+ * @brief Hands a block back to the block pool instead of freeing it
+ */
+struct block_recycler {
+	void operator()(block* item) const;
+};
+
+typedef std::unique_ptr<block, block_recycler> block_ptr;
+
+/**
+ * @brief Recycles the blocks of all pipelines, so that once the queues are full a pipeline runs without
+ * heap allocations. Blocks come in size classes of whole 64 KB. Every thread keeps a few free blocks of
+ * its own and shares the rest: the source takes blocks the sink gave back, through the shared list.
+ * With --stats the most blocks and bytes the pool held, and its heap allocations, are reported.
+ */
+class block_pool {
+public:
+	// A block of nsamples spectra, recycled when one of its size class is free
+	static block_ptr acquire(uint32_t nsamples, uint32_t values_per_sample);
+	static void release(block* item);
+	// Frees the shared free blocks and those the calling thread keeps, e.g. between files with different block sizes
+	static void trim();
+};
+
+/**
+ * @brief Bounded queue handing blocks from one pipeline thread to the next.
+ * Bounding the queue keeps memory use constant when a downstream stage is slower.
+ */
+class block_queue {
+public:
+	explicit block_queue(size_t capacity) : capacity(std::max<size_t>(capacity, 1)), items(this->capacity) {};
+
+	bool push(block_ptr item);
+	bool pop(block_ptr& item);
+	void close();
+	void abort();
+
+private:
+	// a ring of capacity slots, so passing blocks does not allocate
+	size_t capacity;
+	bool closed = false;
+	bool aborted = false;
+	std::vector<block_ptr> items;
+	size_t head = 0;
+	size_t count = 0;
+	std::mutex lock;
+	std::condition_variable not_empty;
+	std::condition_variable not_full;
+};
+
+#endif // !BLOCK_H
@@ -0,0 +1,76 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <cstdint>
+#include "kernelDispatch.hpp"
+
+/**
+ * @brief Adds n consecutive spectra of values floats to total. Every value is summed in sample order, so
+ * all instantiations give the same result. With a small constant n the spectra are added value by value in
+ * registers, the generic kernel adds one spectrum at a time.
+ */
+struct sum_samples_kernel {
+	typedef void (*type)(const float* in, uint64_t values, float* total, uint32_t n);
+
+	template<uint32_t samples>
+	static void run(const float* in, uint64_t values, float* total, uint32_t n) {
+		if (samples) {
+			for (uint64_t value = 0; value < values; ++value) {
+				float sum = total[value];
+				for (uint32_t sample = 0; sample < samples; ++sample) {
+					sum += in[sample * values + value];
+				}
+				total[value] = sum;
+			}
+			return;
+		}
+		for (uint32_t sample = 0; sample < n; ++sample) {
+			const float* spectrum = in + sample * values;
+			for (uint64_t value = 0; value < values; ++value) {
+				total[value] += spectrum[value];
+			}
+		}
+	};
+};
+
+/**
+ * @brief Averages every n adjacent values into one, for groups of n values
+ */
+struct average_channels_kernel {
+	typedef void (*type)(const float* in, uint64_t groups, float* out, uint32_t n);
+
+	template<uint32_t channels>
+	static void run(const float* in, uint64_t groups, float* out, uint32_t n) {
+		const uint32_t count = channels ? channels : n;
+		for (uint64_t group = 0; group < groups; ++group) {
+			const float* values = in + group * count;
+			float sum = 0;
+			for (uint32_t j = 0; j < count; ++j) {
+				sum += values[j];
+			}
+			out[group] = sum / count;
+		}
+	};
+};
+
+/**
+ * @brief Adds n channel time series to out, channel by channel in order for every sample, so
+ * out is read and written once for every n channels instead of for every channel
+ */
+struct add_channels_kernel {
+	typedef void (*type)(const float* const* in, uint32_t nsamples, float* out, uint32_t n);
+
+	template<uint32_t channels>
+	static void run(const float* const* in, uint32_t nsamples, float* out, uint32_t n) {
+		const uint32_t count = channels ? channels : n;
+		for (uint32_t sample = 0; sample < nsamples; ++sample) {
+			float sum = out[sample];
+			for (uint32_t channel = 0; channel < count; ++channel) {
+				sum += in[channel][sample];
+			}
+			out[sample] = sum;
+		}
+	};
+};
+
+#endif // !KERNELS_H
@@ -0,0 +1,118 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Threads that run the ranges of parallel_for. They are started by the first parallel_for that
+ * needs them and wait for the next one, so a stage that splits every block over its threads does not
+ * start threads per block. A pool runs one parallel_for at a time, the calling thread takes part in it.
+ */
+class worker_pool {
+public:
+	typedef void (*invoker)(void* work, uint64_t begin, uint64_t end);
+
+	explicit worker_pool(uint32_t n_threads = 1) : n_threads(std::max(1u, n_threads)) {};
+	~worker_pool();
+	worker_pool(const worker_pool&) = delete;
+	worker_pool& operator=(const worker_pool&) = delete;
+
+	uint32_t size() const { return n_threads; };
+	void run(uint64_t n, uint64_t per_range, invoker invoke, void* work);
+
+private:
+	void take_ranges();
+	void wait_for_work();
+
+	uint32_t n_threads;
+	std::vector<std::thread> threads;
+	std::mutex lock;
+	std::condition_variable started;
+	std::condition_variable finished;
+	bool stopping = false;
+	uint64_t generation = 0;
+
+	// the current parallel_for: the ranges are handed out by the next index
+	invoker invoke = nullptr;
+	void* work = nullptr;
+	uint64_t n = 0;
+	uint64_t per_range = 0;
+	uint64_t n_ranges = 0;
+	std::atomic<uint64_t> next_range{0};
+	uint32_t busy = 0; // workers that did not finish the current parallel_for
+	std::exception_ptr failure;
+};
+
+/**
+ * @brief Runs work(begin, end) on consecutive ranges of [0, n) using up to the threads of the pool.
+ * Ranges get at least min_per_thread items. The first exception thrown by work is thrown again on
+ * the calling thread once all ranges that were started have ended, ranges not started yet are skipped.
+ */
+template <typename function>
+void parallel_for(worker_pool& pool, uint64_t n, uint64_t min_per_thread, function work) {
+	uint64_t n_ranges = std::max<uint64_t>(1, std::min<uint64_t>(pool.size(), n / std::max<uint64_t>(1, min_per_thread)));
+	if (n_ranges == 1) {
+		work(0, n);
+		return;
+	}
+	pool.run(n, (n + n_ranges - 1) / n_ranges, [](void* work, uint64_t begin, uint64_t end) {
+		(*(function*)work)(begin, end);
+	}, &work);
+}
+
+/**
+ * @brief Runs work(thread, item) for every item of [0, n) on up to n_threads threads started for the call,
+ * the calling thread being one of them. A thread takes the next item when it is done with its last, so
+ * items of uneven cost, e.g. whole files, balance out. thread, below n_threads, indexes state a thread
+ * reuses between its items. When work throws, failed(item, message) is called under a lock and the
+ * other items still run.
+ */
+template <typename function, typename handler>
+void for_each_item(uint64_t n, uint32_t n_threads, function work, handler failed) {
+	std::atomic<uint64_t> next(0);
+	std::mutex lock;
+	auto worker = [&](uint32_t thread) {
+		for (uint64_t item = next++; item < n; item = next++) {
+			std::string failure;
+			bool ok = true;
+			try {
+				work(thread, item);
+			} catch (const std::exception& ex) {
+				failure = ex.what();
+				ok = false;
+			} catch (const char* msg) {
+				failure = msg;
+				ok = false;
+			}
+			if (!ok) {
+				std::lock_guard<std::mutex> guard(lock);
+				failed(item, failure);
+			}
+		}
+	};
+	std::vector<std::thread> threads;
+	for (uint32_t thread = 1; thread < std::min<uint64_t>(n_threads, n); ++thread) {
+		threads.emplace_back(worker, thread);
+	}
+	worker(0);
+	for (auto& thread : threads) {
+		thread.join();
+	}
+}
+
+/**
+ * @brief The number of threads to use when 0 is asked for: all cores
+ */
+inline uint32_t default_threads(uint32_t n_threads) {
+	return n_threads ? n_threads : std::max(1u, std::thread::hardware_concurrency());
+}
+
+#endif // !PARALLEL_H
@@ -0,0 +1,39 @@
+#ifndef PHASEMODEL_H
+#define PHASEMODEL_H
+
+#include <string>
+#include <vector>
+
+/**
+ * @brief The rotational phase of a pulsar as a function of time, either from a constant period
+ * or from a TEMPO polyco file (a set of polynomials that each cover a span of minutes)
+ */
+class phase_model {
+public:
+	static phase_model constant(double period, double epoch);
+	static phase_model read_polyco(const std::string& filename);
+
+	// Phase in turns and frequency in Hz at a number of seconds after an MJD. Keeping the two apart
+	// keeps the precision of the seconds, only the fractional part of the phase is exact.
+	void evaluate(double mjd, double seconds, double& phase, double& frequency) const;
+	double period_at(double mjd, double seconds = 0.0) const;
+	// Throws when a polyco set does not cover every time from first to last seconds after the MJD
+	void check_coverage(double mjd, double first, double last) const;
+
+private:
+	struct polyco_set {
+		double tmid = 0.0; // MJD
+		double rphase = 0.0; // fractional part of the reference phase
+		double f0 = 0.0; // Hz
+		double span = 0.0; // minutes
+		std::vector<double> coefficients;
+	};
+
+	const polyco_set& set_at(double mjd, double seconds) const;
+
+	double period = 0.0;
+	double epoch = 0.0;
+	std::vector<polyco_set> sets;
+};
+
+#endif // !PHASEMODEL_H
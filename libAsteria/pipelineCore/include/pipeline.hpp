@@ -0,0 +1,38 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "stage.hpp"
+
+/**
+ * @brief Chains a source, any number of stages and a sink in one process.
+ * Every element runs on its own thread, connected by bounded queues, so the
+ * stages overlap on different cores and blocks are only ever passed by pointer.
+ */
+class pipeline {
+public:
+	pipeline() {};
+
+	void set_source(std::unique_ptr<source> input);
+	void add_stage(std::unique_ptr<stage> transform);
+	void set_sink(std::unique_ptr<sink> output);
+
+	std::map<std::string, header_param> configure();
+	void run(bool threaded = true);
+
+	// number of blocks that may wait between two stages
+	size_t queue_depth = 4;
+
+private:
+	void run_sequential();
+	void run_threaded();
+
+	std::unique_ptr<source> input;
+	std::vector<std::unique_ptr<stage>> stages;
+	std::unique_ptr<sink> output;
+	bool configured = false;
+};
+
+#endif // !PIPELINE_H
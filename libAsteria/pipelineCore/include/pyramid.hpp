@@ -0,0 +1,134 @@
+#ifndef PYRAMID_H
+#define PYRAMID_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "stage.hpp"
+
+/**
+ * @brief Mean, minimum and maximum of the values a pyramid cell covers
+ */
+struct pyramid_cell {
+	float mean;
+	float min;
+	float max;
+};
+
+/**
+ * @brief A level of a pyramid, its cells are stored sample major, then IF, then channel, like spectra
+ */
+struct pyramid_level {
+	uint64_t nsamples = 0; // rows of cells
+	uint32_t nchans = 0; // cells per IF in a row
+	uint32_t time_factor = 0; // input samples per cell
+	uint32_t channel_factor = 0; // input channels per cell
+	uint32_t reserved = 0;
+	uint64_t offset = 0; // of the first cell from the start of the file, in bytes
+};
+
+/**
+ * @brief The header at the start of a pyramid file, followed by n_levels level descriptions
+ */
+struct pyramid_header {
+	char magic[8];
+	uint32_t version = 1;
+	uint32_t n_levels = 0;
+	uint64_t nsamples = 0; // of the input
+	uint32_t nifs = 0;
+	uint32_t nchans = 0;
+	double tsamp = 0.0;
+	double tstart = 0.0;
+	double fch1 = 0.0;
+	double foff = 0.0;
+};
+
+/**
+ * @brief Cells of a range of samples and channels from one level of a pyramid
+ */
+struct pyramid_tile {
+	uint32_t level = 0;
+	uint32_t time_factor = 0; // input samples per cell
+	uint32_t channel_factor = 0; // input channels per cell
+	uint64_t first_sample = 0; // input sample of the first row
+	uint32_t first_channel = 0; // input channel of the first column
+	uint32_t nsamples = 0; // rows
+	uint32_t nifs = 0;
+	uint32_t nchans = 0; // columns per IF
+	std::vector<pyramid_cell> cells; // row major, then IF, then channel
+};
+
+/**
+ * @brief Builds a pyramid of successively decimated copies of the data in one pass. The first level
+ * combines time_factor samples and channel_factor channels per cell, every next level combines two
+ * rows and two columns of the level before, until a level has a single row or max_levels is reached.
+ * Every level is written to its own temporary file as it grows, and copied behind the header when the
+ * stream ends, so the input does not need to have a known length.
+ */
+class pyramid_sink : public sink {
+public:
+	static const char magic[8];
+
+	pyramid_sink(const std::string& filename, uint32_t time_factor = 64, uint32_t channel_factor = 4, uint32_t max_levels = 20);
+	~pyramid_sink();
+
+	void configure(std::map<std::string, header_param>& header) override;
+	void consume(const block& input) override;
+	void finish() override;
+
+private:
+	/**
+	 * @brief The cells of the row a level is building, weighted by the number of input values in them
+	 */
+	struct level_builder {
+		pyramid_level level;
+		uint32_t rows = 0; // rows of the level below in the current row
+		std::vector<double> sums;
+		std::vector<double> weights;
+		std::vector<pyramid_cell> row;
+		FILE* data = nullptr;
+	};
+
+	void add_row(uint32_t index, const std::vector<pyramid_cell>& cells, const std::vector<double>& weights);
+	void complete_row(uint32_t index);
+
+	std::string filename;
+	uint32_t time_factor;
+	uint32_t channel_factor;
+	uint32_t max_levels;
+	pyramid_header header;
+	std::vector<level_builder> levels;
+	// per input channel, the cell it belongs to in the first level
+	std::vector<uint32_t> first_cells;
+	// per cell of the first level, the number of channels in it
+	std::vector<double> row_weights;
+};
+
+/**
+ * @brief Reads tiles from a pyramid file, which is mapped into memory so only the cells of a tile are read
+ */
+class pyramid_reader {
+public:
+	explicit pyramid_reader(const std::string& filename);
+	~pyramid_reader();
+	pyramid_reader(const pyramid_reader&) = delete;
+	pyramid_reader& operator=(const pyramid_reader&) = delete;
+
+	const pyramid_header& header() const { return *file_header; };
+	const pyramid_level& level(uint32_t index) const { return levels[index]; };
+	uint32_t level_count() const { return file_header->n_levels; };
+
+	// The level with the coarsest cells that are no coarser than asked for, the finest level otherwise
+	uint32_t nearest_level(uint32_t time_factor, uint32_t channel_factor) const;
+	// The cells covering a range of input samples and channels, from the nearest level to the factors
+	pyramid_tile tile(uint64_t first_sample, uint64_t nsamples, uint32_t first_channel, uint32_t nchans, uint32_t time_factor, uint32_t channel_factor) const;
+
+private:
+	const uint8_t* data = nullptr;
+	uint64_t size = 0;
+	const pyramid_header* file_header = nullptr;
+	const pyramid_level* levels = nullptr;
+};
+
+#endif // !PYRAMID_H
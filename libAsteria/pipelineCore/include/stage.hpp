@@ -0,0 +1,50 @@
+#ifndef STAGE_H
+#define STAGE_H
+
+#include <functional>
+#include <map>
+#include <string>
+#include "block.hpp"
+#include "headerParam.hpp"
+
+typedef std::function<void(block_ptr)> emitter;
+
+/**
+ * @brief Produces the blocks at the start of a pipeline
+ */
+class source {
+public:
+	virtual ~source() {};
+	// the header describing the blocks this source produces
+	virtual std::map<std::string, header_param>& header() = 0;
+	// the next block, nullptr at the end of the data
+	virtual block_ptr next() = 0;
+};
+
+/**
+ * @brief Transforms blocks, e.g. decimation, masking or dedispersion
+ */
+class stage {
+public:
+	virtual ~stage() {};
+	virtual const char* name() const = 0;
+	// called once before any block, adjusts the header to describe the output of the stage
+	virtual void configure(std::map<std::string, header_param>& header) = 0;
+	// processes one block and emits zero or more blocks, stages may keep data between calls
+	virtual void process(block_ptr input, const emitter& emit) = 0;
+	// called after the last block to emit any data the stage still holds
+	virtual void flush(const emitter& /*emit*/) {}
+};
+
+/**
+ * @brief Consumes the blocks at the end of a pipeline
+ */
+class sink {
+public:
+	virtual ~sink() {};
+	virtual void configure(std::map<std::string, header_param>& header) = 0;
+	virtual void consume(const block& input) = 0;
+	virtual void finish() {};
+};
+
+#endif // !STAGE_H
@@ -0,0 +1,421 @@
+#ifndef STAGES_H
+#define STAGES_H
+
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "filterbankCore.hpp"
+#include "phaseModel.hpp"
+#include "stage.hpp"
+#include "parallel.hpp"
+
+/**
+ * @brief Reads blocks of spectra from a filterbank file or stdin, or a range of samples of a file
+ */
+class filterbank_source : public source {
+public:
+	filterbank_source(filterbank::ioType inputType, std::string input = "", uint32_t block_samples = 0,
+		uint64_t first_sample = 0, uint64_t nsamples = 0);
+
+	// Reads the input while it is still being written, instead of up to its current end
+	void follow(double timeout, const std::string& sentinel = "");
+	// Adds the IFs of every spectrum as it is decoded, e.g. two polarizations into total intensity
+	void sum_ifs();
+	// Checks the whole input at its end: that it is not truncated, and against the CRC32C stored next to it
+	void verify();
+
+	std::map<std::string, header_param>& header() override { return summing ? summed_header : fb.header; };
+	block_ptr next() override;
+
+	filterbank fb;
+
+private:
+	uint32_t read_summed(float* out, uint32_t nsamples);
+	void check_input();
+
+	std::string input;
+	bool verifying = false;
+	uint32_t block_samples;
+	uint64_t samples_read = 0;
+
+	// with sum_ifs, spectra are decoded into scratch a few at a time and their IFs added into the block
+	bool summing = false;
+	std::map<std::string, header_param> summed_header;
+	sample_buffer scratch;
+};
+
+/**
+ * @brief Writes blocks of spectra to a filterbank file or stdout
+ */
+class filterbank_sink : public sink {
+public:
+	filterbank_sink(filterbank::ioType outputType, std::string filename = "", bool headerless = false, int32_t nbits = 0, bool direct = false);
+
+	// Writes the data into an existing file at a byte offset instead, without a header
+	void write_at(uint64_t offset);
+
+	void configure(std::map<std::string, header_param>& header) override;
+	void consume(const block& input) override;
+	void finish() override;
+
+private:
+	filterbank fb;
+	filterbank::ioType outputType;
+	std::string filename;
+	bool headerless;
+	int32_t nbits;
+	bool direct;
+	bool at_offset = false;
+	uint64_t offset = 0;
+};
+
+/**
+ * @brief Reads the sub-bands of one observation, split over several files, as one filterbank. The files are
+ * ordered by frequency and must have adjacent channels of the same width, the same IFs, sample time and
+ * start time. A few spectra of every file are decoded at a time and their channels copied into place in
+ * the block, so memory use does not depend on the length of the files. The output ends with the shortest file.
+ */
+class splice_source : public source {
+public:
+	splice_source(const std::vector<std::string>& inputs, uint32_t block_samples = 0);
+
+	std::map<std::string, header_param>& header() override { return output_header; };
+	block_ptr next() override;
+
+private:
+	std::vector<filterbank> inputs;
+	std::map<std::string, header_param> output_header;
+	uint32_t block_samples;
+	uint64_t samples_read = 0;
+	sample_buffer scratch;
+};
+
+/**
+ * @brief Reads the files of a long observation, split in time, as one filterbank. The files are ordered by
+ * start time and must have the same channels, IFs and sample time, and every file must start where the
+ * previous one ends. Only one file is open at a time.
+ */
+class concat_source : public source {
+public:
+	concat_source(const std::vector<std::string>& inputs, uint32_t block_samples = 0);
+
+	std::map<std::string, header_param>& header() override { return output_header; };
+	block_ptr next() override;
+
+private:
+	std::vector<std::string> inputs;
+	std::vector<uint64_t> lengths; // spectra per file
+	std::map<std::string, header_param> output_header;
+	uint32_t block_samples;
+	uint64_t samples_read = 0;
+
+	// the file being read
+	size_t current = 0;
+	filterbank fb;
+	bool open = false;
+	uint64_t remaining = 0;
+};
+
+/**
+ * @brief Adds n_samples_to_combine consecutive samples and averages n_channels_to_combine adjacent channels
+ */
+class decimate_stage : public stage {
+public:
+	decimate_stage(uint32_t n_samples_to_combine, uint32_t n_channels_to_combine);
+
+	const char* name() const override { return "decimate"; };
+	void configure(std::map<std::string, header_param>& header) override;
+	void process(block_ptr input, const emitter& emit) override;
+
+private:
+	uint32_t n_samples_to_combine;
+	uint32_t n_channels_to_combine;
+	uint32_t nifs = 0;
+	uint32_t nchans = 0;
+	uint32_t n_channels_out = 0;
+	uint64_t samples_out = 0;
+
+	// running sum of the current output sample per input channel
+	std::vector<float> total;
+	uint32_t n_summed = 0;
+
+	// kernels for the factors, picked in configure
+	void (*add_samples)(const float* in, uint64_t values, float* total, uint32_t n) = nullptr;
+	void (*average_channels)(const float* in, uint64_t groups, float* out, uint32_t n) = nullptr;
+};
+
+/**
+ * @brief Sets the channels listed in a file, or given directly, to zero
+ */
+class mask_stage : public stage {
+public:
+	explicit mask_stage(const std::vector<uint32_t>& channels);
+	static std::vector<uint32_t> read_channel_list(const std::string& filename);
+
+	const char* name() const override { return "mask"; };
+	void configure(std::map<std::string, header_param>& header) override;
+	void process(block_ptr input, const emitter& emit) override;
+
+private:
+	std::vector<uint32_t> channels; // zero based
+	uint32_t nifs = 0;
+	uint32_t nchans = 0;
+};
+
+/**
+ * @brief Settings of the RFI excision stage, thresholds of 0 switch a test off
+ */
+struct rfi_options {
+	std::vector<uint32_t> channels; // zero based channels that are always masked
+	double kurtosis = 0.0; // flag channels whose spectral kurtosis is this many robust sigmas from the median of the block
+	double zap = 0.0; // flag spectra whose normalized channel average is this many robust sigmas from the median of the block
+	double clip = 0.0; // replace single values that are this many sigmas from the mean of their channel
+	bool zero = false; // replace flagged data by zero instead of the channel mean
+	uint32_t threads = 0; // 0 for all cores
+};
+
+/**
+ * @brief Streaming RFI excision. Every block gets per channel Welford statistics and spectral kurtosis,
+ * outlying channels and spectra are replaced by the mean of the channel, or by zero.
+ */
+class rfi_stage : public stage {
+public:
+	explicit rfi_stage(const rfi_options& options);
+
+	const char* name() const override { return "rfi"; };
+	void configure(std::map<std::string, header_param>& header) override;
+	void process(block_ptr input, const emitter& emit) override;
+
+private:
+	void block_statistics(const block& input);
+	void flag_channels(uint32_t nsamples);
+	void flag_spectra(const block& input);
+
+	rfi_options options;
+	uint32_t nifs = 0;
+	uint32_t nchans = 0;
+	uint64_t values = 0;
+	worker_pool pool;
+
+	// per (IF, channel)
+	std::vector<uint8_t> static_mask;
+	std::vector<uint8_t> bad;
+	std::vector<double> mean;
+	std::vector<double> m2;
+	std::vector<double> kurtosis;
+	std::vector<double> clean_mean; // running mean over the blocks in which the channel was not flagged
+	std::vector<uint64_t> clean_blocks;
+	std::vector<float> replacement;
+	std::vector<double> inverse_sigma;
+	std::vector<float> limit; // largest deviation from the mean of a single value
+	// per spectrum of the current block
+	std::vector<double> deviation;
+	std::vector<uint8_t> bad_spectra;
+	// the values the median of a block is taken of, kept to not allocate per block
+	std::vector<double> scratch;
+};
+
+/**
+ * @brief Zero-DM filter: subtracts the mean over the channels from every spectrum of every IF,
+ * removing signals that are not dispersed (sigproc -rmean)
+ */
+class zero_dm_stage : public stage {
+public:
+	explicit zero_dm_stage(uint32_t threads = 0);
+
+	const char* name() const override { return "zerodm"; };
+	void configure(std::map<std::string, header_param>& header) override;
+	void process(block_ptr input, const emitter& emit) override;
+
+private:
+	worker_pool pool;
+	uint32_t nifs = 0;
+	uint32_t nchans = 0;
+};
+
+/**
+ * @brief Subtracts a baseline from every (IF, channel).
+ * Without a window the baseline is the mean of all data so far. With a window the data is cut in
+ * chunks of window / baseline_chunks samples, and the baseline of a chunk is the mean or median of the
+ * means or medians of the last baseline_chunks chunks, which costs O(1) per sample. Chunks are emitted
+ * once complete, so the output lags the input by up to one chunk.
+ */
+class baseline_stage : public stage {
+public:
+	enum mode {
+		MEAN = 0,
+		MEDIAN = 1
+	};
+	static const uint32_t baseline_chunks = 15;
+
+	baseline_stage(mode type, uint32_t window = 0, uint32_t threads = 0);
+	// A running median over about seconds of data, a running mean of all data so far when tsamp is unknown
+	static std::unique_ptr<stage> running_median(double seconds, double tsamp, uint32_t threads = 0);
+
+	const char* name() const override { return "baseline"; };
+	void configure(std::map<std::string, header_param>& header) override;
+	void process(block_ptr input, const emitter& emit) override;
+	void flush(const emitter& emit) override;
+
+private:
+	void subtract_running_mean(block& input);
+	void finish_chunk(uint32_t nsamples);
+
+	mode type;
+	uint32_t window;
+	worker_pool pool;
+	uint64_t values = 0;
+
+	// without a window: the number of samples and the running mean per (IF, channel)
+	uint64_t count = 0;
+	std::vector<double> running_mean;
+
+	// with a window: the pending chunk and the statistic of the last chunks per (IF, channel)
+	uint32_t chunk_samples = 0;
+	block_ptr pending;
+	uint32_t n_pending = 0;
+	std::vector<float> chunk_statistics; // baseline_chunks rows of values
+	uint32_t n_chunks = 0;
+	std::vector<float> baseline;
+	std::vector<double> chunk_sum; // sum of the pending chunk for a running mean
+};
+
+/**
+ * @brief Incoherent dedispersion at a single dispersion measure into one or more sub-bands
+ */
+class dedisperse_stage : public stage {
+public:
+	dedisperse_stage(double dispersion_measure, uint32_t n_bands = 1, double reference_frequency = 0.0);
+
+	const char* name() const override { return "dedisperse"; };
+	void configure(std::map<std::string, header_param>& header) override;
+	void process(block_ptr input, const emitter& emit) override;
+	// The same as process for a block the stage only reads, e.g. one block dedispersed at several DMs
+	void dedisperse(const block& input, const emitter& emit);
+
+	static std::vector<uint32_t> channel_delays(std::map<std::string, header_param>& header, double dispersion_measure, double reference_frequency = 0.0);
+	// The same delays, calculated once for all stages with the same channels, sample time and dm, e.g. for all beams
+	static std::shared_ptr<const std::vector<uint32_t>> shared_delays(std::map<std::string, header_param>& header, double dispersion_measure, double reference_frequency = 0.0);
+
+private:
+	double dispersion_measure;
+	uint32_t n_bands;
+	double reference_frequency;
+
+	uint32_t nifs = 0;
+	uint32_t nchans = 0;
+	uint32_t max_delay = 0;
+	uint64_t samples_out = 0;
+	std::shared_ptr<const std::vector<uint32_t>> delays; // per channel, in samples
+
+	// the last max_delay samples of every (IF, channel), channel major
+	std::vector<float> carry;
+	uint32_t n_carried = 0;
+	std::vector<float> series;
+	std::vector<float> bands;
+
+	// kernel adding channels_per_pass channels of a band at once, picked in configure
+	static const uint32_t max_channels_per_pass = 8;
+	uint32_t channels_per_pass = 1;
+	void (*add_channels)(const float* const* in, uint32_t nsamples, float* out, uint32_t n) = nullptr;
+};
+
+/**
+ * @brief Normalizes every channel with a running mean and standard deviation and requantizes it to nbits.
+ * Values beyond clip standard deviations are clipped. The scaling of every block can be recorded in a
+ * text file, from which the input is restored per channel as offset + level * scale.
+ */
+class requantize_stage : public stage {
+public:
+	requantize_stage(int32_t nbits, double clip = 3.0, uint64_t window = 0, const std::string& record_file = "");
+
+	const char* name() const override { return "requantize"; };
+	void configure(std::map<std::string, header_param>& header) override;
+	void process(block_ptr input, const emitter& emit) override;
+
+private:
+	void update_statistics(const block& input);
+
+	int32_t nbits;
+	double clip;
+	uint64_t window; // the number of samples the running statistics remember, 0 for all
+	std::string record_file;
+	std::ofstream record;
+
+	uint64_t values = 0;
+	// running statistics per (IF, channel)
+	uint64_t count = 0;
+	std::vector<double> mean;
+	std::vector<double> m2;
+	// statistics of the current block
+	std::vector<double> block_mean;
+	std::vector<double> block_m2;
+	std::vector<float> offset;
+	std::vector<float> scale;
+	std::vector<float> inverse; // 1 / scale
+};
+
+/**
+ * @brief Settings of the folding stage
+ */
+struct fold_options {
+	double period = 0.0; // seconds, 0 for the period in the header
+	std::string polyco_file; // TEMPO polyco file, used instead of the period when given
+	uint32_t nbins = 0; // phase bins, 0 for up to 256 bins of at least one sample
+	uint32_t n_bands = 1; // output sub-bands, the number of channels to keep every channel
+	double subint = 0.0; // seconds per sub-integration, 0 for one profile of all data
+	double dispersion_measure = 0.0; // channels are aligned at this dm before folding
+	uint32_t threads = 0; // 0 for all cores
+};
+
+/**
+ * @brief Folds spectra or time series at the pulsar period into phase bins per sub-band and sub-integration.
+ * Every thread folds a range of samples into its own partial profile, the partial profiles are added
+ * when a sub-integration ends. The output is folded data (data_type 3): every sub-integration is
+ * emitted as a block of nbins spectra, holding the sum over its channels of the mean per bin.
+ */
+class fold_stage : public stage {
+public:
+	explicit fold_stage(const fold_options& options);
+
+	const char* name() const override { return "fold"; };
+	void configure(std::map<std::string, header_param>& header) override;
+	void process(block_ptr input, const emitter& emit) override;
+	void flush(const emitter& emit) override;
+
+private:
+	void fold(const block& input, uint32_t begin, uint32_t end);
+	void reduce();
+	void emit_profile(const emitter& emit);
+
+	fold_options options;
+	phase_model model;
+	double tstart = 0.0;
+	double tsamp = 0.0;
+	uint32_t nifs = 0;
+	uint32_t nchans = 0;
+	uint64_t values = 0;
+	uint32_t nbins = 0;
+	worker_pool pool;
+	uint64_t subint_samples = 0; // 0 for a single sub-integration
+	uint64_t n_subints = 0;
+	std::vector<uint32_t> delays; // per channel, in samples
+	uint32_t max_delay = 0;
+
+	// phase bin of every sample of the current range, starting max_delay samples before it
+	std::vector<uint32_t> bins;
+	// per thread: the sums per (bin, IF, channel) and the hits per bin, per (bin, channel) when the channels are shifted
+	std::vector<std::vector<float>> partial_sums;
+	std::vector<std::vector<uint32_t>> partial_hits;
+	uint64_t partial_samples = 0;
+	// the current sub-integration
+	std::vector<double> sums;
+	std::vector<uint64_t> hits; // per (bin, channel)
+	uint64_t subint_folded = 0;
+};
+
+std::unique_ptr<stage> make_stage(const std::string& specification);
+std::vector<std::unique_ptr<stage>> make_stages(const std::string& chain);
+
+#endif // !STAGES_H
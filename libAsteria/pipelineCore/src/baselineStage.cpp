@@ -0,0 +1,217 @@
+#include "stages.hpp"
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+/**
+ * @param threads the number of threads to use, 0 for all cores
+ */
+zero_dm_stage::zero_dm_stage(uint32_t threads) : pool(default_threads(threads)) {
+}
+
+/**
+ * @brief The output is centred on zero, so it is written as floats
+ */
+void zero_dm_stage::configure(std::map<std::string, header_param>& header) {
+	nifs = header["nifs"].val.i;
+	nchans = header["nchans"].val.i;
+	header["nbits"].val.i = 32;
+}
+
+/**
+ * @brief Subtracts the mean of the channels from every spectrum, the spectra are split over the threads
+ */
+void zero_dm_stage::process(block_ptr input, const emitter& emit) {
+	const uint64_t rows = (uint64_t)input->nsamples * nifs;
+	float* data = input->data.data();
+	const uint32_t n = nchans;
+	parallel_for(pool, rows, 64, [data, n](uint64_t begin, uint64_t end) {
+		for (uint64_t row = begin; row < end; ++row) {
+			float* spectrum = data + row * n;
+			double sum = 0.0;
+			for (uint32_t channel = 0; channel < n; ++channel) {
+				sum += spectrum[channel];
+			}
+			const float mean = (float)(sum / n);
+			for (uint32_t channel = 0; channel < n; ++channel) {
+				spectrum[channel] -= mean;
+			}
+		}
+	});
+	emit(std::move(input));
+}
+
+const uint32_t baseline_stage::baseline_chunks;
+
+/**
+ * @param type whether the baseline is a running mean or median
+ * @param window the number of samples in the baseline, 0 for a mean over all data so far
+ * @param threads the number of threads to use, 0 for all cores
+ */
+baseline_stage::baseline_stage(mode type, uint32_t window, uint32_t threads) :
+	type(type), window(window), pool(default_threads(threads)) {
+}
+
+/**
+ * @param seconds the length of the window
+ * @param tsamp the sampling time of the input in seconds, 0 when unknown
+ * @param threads the number of threads to use, 0 for all cores
+ */
+std::unique_ptr<stage> baseline_stage::running_median(double seconds, double tsamp, uint32_t threads) {
+	const uint32_t window = tsamp > 0.0 ? (uint32_t)std::max(1.0, std::round(seconds / tsamp)) : 0;
+	return std::unique_ptr<stage>(new baseline_stage(window ? MEDIAN : MEAN, window, threads));
+}
+
+/**
+ * @brief Sets up the running statistics, the output is centred on zero so it is written as floats
+ */
+void baseline_stage::configure(std::map<std::string, header_param>& header) {
+	if (type == MEDIAN && !window) {
+		throw std::runtime_error("A running median baseline needs a window");
+	}
+	values = (uint64_t)header["nifs"].val.i * header["nchans"].val.i;
+	count = 0;
+	running_mean.assign(window ? 0 : values, 0.0);
+	chunk_samples = std::max(1u, window / baseline_chunks);
+	pending.reset();
+	n_pending = 0;
+	chunk_statistics.assign(window ? (uint64_t)baseline_chunks * values : 0, 0.0f);
+	n_chunks = 0;
+	baseline.assign(window ? values : 0, 0.0f);
+	chunk_sum.assign(window && type == MEAN ? values : 0, 0.0);
+	header["nbits"].val.i = 32;
+}
+
+/**
+ * @brief Subtracts the mean of every (IF, channel) over all samples up to and including the current one
+ */
+void baseline_stage::subtract_running_mean(block& input) {
+	const uint32_t nsamples = input.nsamples;
+	float* data = input.data.data();
+	parallel_for(pool, values, 256, [&](uint64_t begin, uint64_t end) {
+		for (uint32_t sample = 0; sample < nsamples; ++sample) {
+			float* spectrum = data + sample * values;
+			const double weight = 1.0 / (count + sample + 1);
+			for (uint64_t value = begin; value < end; ++value) {
+				running_mean[value] += (spectrum[value] - running_mean[value]) * weight;
+				spectrum[value] -= (float)running_mean[value];
+			}
+		}
+	});
+	count += nsamples;
+}
+
+/**
+ * @brief Adds the statistic of the chunk in pending to the last chunks and subtracts the new baseline from it
+ *
+ * @param nsamples the number of samples in the chunk
+ */
+void baseline_stage::finish_chunk(uint32_t nsamples) {
+	float* data = pending->data.data();
+	float* statistic = &chunk_statistics[(uint64_t)(n_chunks % baseline_chunks) * values];
+	n_chunks++;
+	const uint32_t n_rows = std::min(n_chunks, baseline_chunks);
+
+	parallel_for(pool, values, 256, [&](uint64_t begin, uint64_t end) {
+		// The columns of a median are gathered in scratch of the thread, which is kept for the next chunk
+		static thread_local std::vector<float> column;
+		static thread_local std::vector<float> columns;
+		column.resize(baseline_chunks);
+		if (type == MEAN) {
+			std::fill(chunk_sum.begin() + begin, chunk_sum.begin() + end, 0.0);
+			for (uint32_t sample = 0; sample < nsamples; ++sample) {
+				const float* spectrum = data + sample * values;
+				for (uint64_t value = begin; value < end; ++value) {
+					chunk_sum[value] += spectrum[value];
+				}
+			}
+			for (uint64_t value = begin; value < end; ++value) {
+				statistic[value] = (float)(chunk_sum[value] / nsamples);
+			}
+		} else {
+			// Gather tiles of channels at once, reading whole rows of the tile per sample
+			const uint64_t tile = 32;
+			columns.resize(tile * nsamples);
+			for (uint64_t first = begin; first < end; first += tile) {
+				const uint64_t width = std::min(tile, end - first);
+				for (uint32_t sample = 0; sample < nsamples; ++sample) {
+					const float* row = data + sample * values + first;
+					for (uint64_t value = 0; value < width; ++value) {
+						columns[value * nsamples + sample] = row[value];
+					}
+				}
+				for (uint64_t value = 0; value < width; ++value) {
+					auto column_begin = columns.begin() + value * nsamples;
+					std::nth_element(column_begin, column_begin + nsamples / 2, column_begin + nsamples);
+					statistic[first + value] = column_begin[nsamples / 2];
+				}
+			}
+		}
+
+		// The baseline combines the statistics of the last chunks in the same way
+		for (uint64_t value = begin; value < end; ++value) {
+			if (type == MEAN) {
+				double sum = 0.0;
+				for (uint32_t row = 0; row < n_rows; ++row) {
+					sum += chunk_statistics[row * values + value];
+				}
+				baseline[value] = (float)(sum / n_rows);
+			} else {
+				for (uint32_t row = 0; row < n_rows; ++row) {
+					column[row] = chunk_statistics[row * values + value];
+				}
+				std::nth_element(column.begin(), column.begin() + n_rows / 2, column.begin() + n_rows);
+				baseline[value] = column[n_rows / 2];
+			}
+		}
+
+		for (uint32_t sample = 0; sample < nsamples; ++sample) {
+			float* spectrum = data + sample * values;
+			for (uint64_t value = begin; value < end; ++value) {
+				spectrum[value] -= baseline[value];
+			}
+		}
+	});
+}
+
+/**
+ * @brief Subtracts the baseline from every complete chunk, samples that do not complete a chunk
+ * are kept for the next block
+ */
+void baseline_stage::process(block_ptr input, const emitter& emit) {
+	if (!window) {
+		subtract_running_mean(*input);
+		emit(std::move(input));
+		return;
+	}
+
+	uint32_t taken = 0;
+	while (taken < input->nsamples) {
+		if (!pending) {
+			pending = block_pool::acquire(chunk_samples, values);
+			pending->first_sample = input->first_sample + taken;
+			n_pending = 0;
+		}
+		uint32_t n = std::min(chunk_samples - n_pending, input->nsamples - taken);
+		memcpy(&pending->data[(uint64_t)n_pending * values], &input->data[(uint64_t)taken * values], (uint64_t)n * values * sizeof(float));
+		n_pending += n;
+		taken += n;
+		if (n_pending == chunk_samples) {
+			finish_chunk(chunk_samples);
+			emit(std::move(pending));
+		}
+	}
+}
+
+/**
+ * @brief Emits the last, incomplete chunk
+ */
+void baseline_stage::flush(const emitter& emit) {
+	if (pending && n_pending) {
+		finish_chunk(n_pending);
+		pending->nsamples = n_pending;
+		pending->data.resize((uint64_t)n_pending * values);
+		emit(std::move(pending));
+	}
+	pending.reset();
+}
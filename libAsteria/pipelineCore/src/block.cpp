@@ -0,0 +1,188 @@
+#include "block.hpp"
+#include "stats.hpp"
+#include <map>
+
+namespace {
+	const uint64_t class_values = (64 << 10) / sizeof(float);
+	// Free blocks a thread keeps for itself before sharing them
+	const size_t thread_kept = 4;
+
+	std::mutex pool_lock;
+	std::map<uint64_t, std::vector<block*>> shared_blocks;
+	uint64_t pool_blocks = 0;
+	uint64_t pool_bytes = 0;
+	uint64_t pool_allocations = 0;
+
+	void share(block* item) {
+		std::lock_guard<std::mutex> guard(pool_lock);
+		shared_blocks[item->data.capacity()].push_back(item);
+	}
+
+	/**
+	 * @brief The free blocks of a thread, shared when the thread ends. A thread only keeps blocks of the
+	 * size it last acquired, blocks it only passes on, e.g. from the source to a sink, are shared at once.
+	 */
+	struct thread_blocks {
+		std::vector<block*> items;
+		uint64_t capacity = 0;
+
+		thread_blocks() { items.reserve(thread_kept); };
+		~thread_blocks() {
+			for (block* item : items) {
+				share(item);
+			}
+		};
+	};
+
+	thread_local thread_blocks kept;
+}
+
+void block_recycler::operator()(block* item) const {
+	block_pool::release(item);
+}
+
+/**
+ * @brief Gets a block from the free blocks of the calling thread, the shared free blocks or the heap,
+ * in that order. Only the size of the block is set, its values are not initialized.
+ *
+ * @param nsamples the number of spectra
+ * @param values_per_sample the number of values per spectrum
+ */
+block_ptr block_pool::acquire(uint32_t nsamples, uint32_t values_per_sample) {
+	const uint64_t values = (uint64_t)nsamples * values_per_sample;
+	const uint64_t capacity = std::max<uint64_t>(1, (values + class_values - 1) / class_values) * class_values;
+	std::vector<block*>& mine = kept.items;
+	if (kept.capacity != capacity) {
+		// Blocks of the size the thread used before are shared, where trim can free them
+		for (block* item : mine) {
+			share(item);
+		}
+		mine.clear();
+		kept.capacity = capacity;
+	}
+
+	block* item = nullptr;
+	for (size_t index = mine.size(); index-- > 0;) {
+		if (mine[index]->data.capacity() == capacity) {
+			item = mine[index];
+			mine.erase(mine.begin() + index);
+			break;
+		}
+	}
+	if (!item) {
+		std::lock_guard<std::mutex> guard(pool_lock);
+		auto found = shared_blocks.find(capacity);
+		if (found != shared_blocks.end() && !found->second.empty()) {
+			item = found->second.back();
+			found->second.pop_back();
+		}
+	}
+	if (!item) {
+		item = new block(capacity);
+		std::lock_guard<std::mutex> guard(pool_lock);
+		pool_blocks++;
+		pool_bytes += capacity * sizeof(float);
+		pool_allocations++;
+		stats::peak("pool blocks", pool_blocks);
+		stats::peak("pool bytes", pool_bytes);
+		stats::peak("pool allocations", pool_allocations);
+	}
+	item->nsamples = nsamples;
+	item->first_sample = 0;
+	item->data.resize(values);
+	return block_ptr(item);
+}
+
+/**
+ * @brief Keeps a block that is no longer used for the next acquire
+ */
+void block_pool::release(block* item) {
+	if (!item) {
+		return;
+	}
+	if (item->data.capacity() == kept.capacity && kept.items.size() < thread_kept) {
+		kept.items.push_back(item);
+		return;
+	}
+	share(item);
+}
+
+/**
+ * @brief Frees the free blocks, so that size classes no pipeline uses any more do not hold memory. Blocks
+ * other threads keep for themselves are shared when they acquire another size or end, and freed by the next trim.
+ */
+void block_pool::trim() {
+	std::lock_guard<std::mutex> guard(pool_lock);
+	for (block* item : kept.items) {
+		shared_blocks[item->data.capacity()].push_back(item);
+	}
+	kept.items.clear();
+	for (auto& size_class : shared_blocks) {
+		for (block* item : size_class.second) {
+			pool_blocks--;
+			pool_bytes -= item->data.capacity() * sizeof(float);
+			delete item;
+		}
+	}
+	shared_blocks.clear();
+}
+
+/**
+ * @brief Adds a block, waiting while the queue is full
+ * 
+ * @param item the block to add
+ * @return false if the queue was aborted and the block was dropped
+ */
+bool block_queue::push(block_ptr item) {
+	std::unique_lock<std::mutex> guard(lock);
+	not_full.wait(guard, [this]() { return count < capacity || aborted; });
+	if (aborted) {
+		return false;
+	}
+	items[(head + count) % capacity] = std::move(item);
+	count++;
+	not_empty.notify_one();
+	return true;
+}
+
+/**
+ * @brief Takes the oldest block, waiting while the queue is empty
+ * 
+ * @param item set to the block taken
+ * @return false once the queue is closed and empty, or aborted
+ */
+bool block_queue::pop(block_ptr& item) {
+	std::unique_lock<std::mutex> guard(lock);
+	not_empty.wait(guard, [this]() { return count || closed || aborted; });
+	if (aborted || !count) {
+		return false;
+	}
+	item = std::move(items[head]);
+	head = (head + 1) % capacity;
+	count--;
+	not_full.notify_one();
+	return true;
+}
+
+/**
+ * @brief Marks the end of the stream, blocks already queued can still be taken
+ */
+void block_queue::close() {
+	std::lock_guard<std::mutex> guard(lock);
+	closed = true;
+	not_empty.notify_all();
+}
+
+/**
+ * @brief Stops both ends of the queue, used when a stage fails
+ */
+void block_queue::abort() {
+	std::lock_guard<std::mutex> guard(lock);
+	aborted = true;
+	for (block_ptr& item : items) {
+		item.reset();
+	}
+	count = 0;
+	not_empty.notify_all();
+	not_full.notify_all();
+}
@@ -0,0 +1,253 @@
+#include "stages.hpp"
+#include "stats.hpp"
+#include <cmath>
+#include <numeric>
+#include <stdexcept>
+
+/**
+ * @brief Opens every sub-band and checks that they form one band
+ *
+ * @param names the files of the sub-bands, in any order
+ * @param block_samples spectra per block, 0 for blocks of about 4 MB
+ */
+splice_source::splice_source(const std::vector<std::string>& names, uint32_t block_samples) : block_samples(block_samples) {
+	if (names.empty()) {
+		throw std::runtime_error("No sub-band files to splice");
+	}
+	std::vector<filterbank> opened;
+	for (const std::string& name : names) {
+		opened.push_back(filterbank::open(filterbank::ioType::FILEIO, name));
+		if (!opened.back().values_per_sample()) {
+			throw std::runtime_error(name + " has no channels or IFs");
+		}
+	}
+
+	// Adjacent sub-bands follow each other in the direction of the channel offset
+	const double foff = opened[0].header["foff"].val.d;
+	if (foff == 0.0) {
+		throw std::runtime_error(names[0] + " has no channel offset (foff)");
+	}
+	std::vector<size_t> order(names.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+		return opened[a].header["fch1"].val.d * foff < opened[b].header["fch1"].val.d * foff;
+	});
+
+	const std::string& first = names[order[0]];
+	std::map<std::string, header_param>& reference = opened[order[0]].header;
+	const int32_t nifs = reference["nifs"].val.i;
+	const double tsamp = reference["tsamp"].val.d;
+	const double tstart = reference["tstart"].val.d;
+	int32_t nchans = 0;
+	int32_t nbits = 0;
+	int32_t nsamples = reference["nsamples"].val.i;
+	double next_fch1 = reference["fch1"].val.d;
+	for (size_t index : order) {
+		std::map<std::string, header_param>& header = opened[index].header;
+		const std::string& name = names[index];
+		if (header["nifs"].val.i != nifs) {
+			throw std::runtime_error(name + " has " + std::to_string(header["nifs"].val.i) + " IFs, " + first + " has " + std::to_string(nifs));
+		}
+		if (std::fabs(header["foff"].val.d - foff) > 1.0e-6 * std::fabs(foff)) {
+			throw std::runtime_error(name + " has channels of " + std::to_string(header["foff"].val.d) + " MHz, " + first + " of " + std::to_string(foff) + " MHz");
+		}
+		if (std::fabs(header["tsamp"].val.d - tsamp) > 1.0e-9 * tsamp) {
+			throw std::runtime_error(name + " has a different sample time than " + first);
+		}
+		if (std::fabs(header["tstart"].val.d - tstart) * 86400.0 > tsamp / 2.0) {
+			throw std::runtime_error(name + " starts " + std::to_string((header["tstart"].val.d - tstart) * 86400.0 / tsamp) + " samples after " + first);
+		}
+		if (std::fabs(header["fch1"].val.d - next_fch1) > 0.01 * std::fabs(foff)) {
+			throw std::runtime_error(name + " starts at " + std::to_string(header["fch1"].val.d) + " MHz, the sub-band before it ends at " + std::to_string(next_fch1) + " MHz");
+		}
+		next_fch1 = header["fch1"].val.d + header["nchans"].val.i * foff;
+		nchans += header["nchans"].val.i;
+		nbits = std::max(nbits, header["nbits"].val.i);
+		nsamples = std::min(nsamples, header["nsamples"].val.i);
+	}
+
+	output_header = reference;
+	output_header["nchans"].val.i = nchans;
+	output_header["nbits"].val.i = nbits;
+	output_header["nsamples"].val.i = nsamples;
+	for (size_t index : order) {
+		inputs.push_back(std::move(opened[index]));
+	}
+	if (!this->block_samples) {
+		this->block_samples = std::max<uint32_t>(1, (1 << 20) / (uint32_t)(nifs * nchans));
+	}
+}
+
+/**
+ * @brief Reads the next block, a few spectra of every sub-band at a time
+ *
+ * @return block_ptr the block, nullptr after the end of the shortest sub-band
+ */
+block_ptr splice_source::next() {
+	if (!samples_read) {
+		for (filterbank& fb : inputs) {
+			fb.prefetch();
+		}
+	}
+	const uint64_t nsamples = output_header["nsamples"].val.i;
+	if (samples_read >= nsamples) {
+		return nullptr;
+	}
+	const uint32_t nifs = output_header["nifs"].val.i;
+	const uint32_t total_channels = output_header["nchans"].val.i;
+	const uint32_t values = nifs * total_channels;
+	uint32_t n = (uint32_t)std::min<uint64_t>(block_samples, nsamples - samples_read);
+	block_ptr item = block_pool::acquire(n, values);
+
+	uint32_t first_channel = 0;
+	for (filterbank& fb : inputs) {
+		const uint32_t nchans = fb.header["nchans"].val.i;
+		const uint32_t file_values = nifs * nchans;
+		// About 64 KB of decoded spectra, which stay in the L2 cache while they are copied into place
+		const uint32_t step = std::max<uint32_t>(1, (16 << 10) / file_values);
+		if (scratch.size() < (uint64_t)step * file_values) {
+			scratch.resize((uint64_t)step * file_values);
+		}
+		uint32_t done = 0;
+		while (done < n) {
+			const uint32_t wanted = std::min(step, n - done);
+			const uint32_t got = fb.read_block(scratch.data(), wanted);
+			scoped_timer timer("splice");
+			for (uint32_t sample = 0; sample < got; ++sample) {
+				for (uint32_t ifs = 0; ifs < nifs; ++ifs) {
+					const float* in = scratch.data() + (uint64_t)sample * file_values + (uint64_t)ifs * nchans;
+					float* out = item->data.data() + (uint64_t)(done + sample) * values + (uint64_t)ifs * total_channels + first_channel;
+					std::copy(in, in + nchans, out);
+				}
+			}
+			done += got;
+			if (got < wanted) {
+				// A sub-band ended early, the spectra the others have beyond it are dropped
+				n = done;
+				break;
+			}
+		}
+		first_channel += nchans;
+	}
+	if (!n) {
+		return nullptr;
+	}
+	stats::count("splice", 0, (uint64_t)n * values);
+	item->data.resize((uint64_t)n * values);
+	item->nsamples = n;
+	item->first_sample = samples_read;
+	samples_read += n;
+	return item;
+}
+
+/**
+ * @brief Reads the header of every file and checks that they follow each other in time
+ *
+ * @param names the files, in any order
+ * @param block_samples spectra per block, 0 for blocks of about 4 MB
+ */
+concat_source::concat_source(const std::vector<std::string>& names, uint32_t block_samples) : block_samples(block_samples) {
+	if (names.empty()) {
+		throw std::runtime_error("No files to concatenate");
+	}
+	// Only the headers are read here, the files are opened again one at a time
+	std::vector<std::map<std::string, header_param>> headers;
+	for (const std::string& name : names) {
+		filterbank file = filterbank::open(filterbank::ioType::FILEIO, name);
+		if (!file.values_per_sample()) {
+			throw std::runtime_error(name + " has no channels or IFs");
+		}
+		headers.push_back(file.header);
+		file.close();
+	}
+	std::vector<size_t> order(names.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+		return headers[a]["tstart"].val.d < headers[b]["tstart"].val.d;
+	});
+
+	std::map<std::string, header_param>& reference = headers[order[0]];
+	const double tsamp = reference["tsamp"].val.d;
+	const double foff = reference["foff"].val.d;
+	int32_t nbits = 0;
+	uint64_t nsamples = 0;
+	double next_tstart = reference["tstart"].val.d;
+	std::string previous;
+	for (size_t index : order) {
+		std::map<std::string, header_param>& header = headers[index];
+		const std::string& name = names[index];
+		if (header["nchans"].val.i != reference["nchans"].val.i || header["nifs"].val.i != reference["nifs"].val.i
+			|| std::fabs(header["foff"].val.d - foff) > 1.0e-6 * std::fabs(foff)
+			|| std::fabs(header["fch1"].val.d - reference["fch1"].val.d) > 0.01 * std::fabs(foff)) {
+			throw std::runtime_error(name + " has other channels or IFs than " + names[order[0]]);
+		}
+		if (std::fabs(header["tsamp"].val.d - tsamp) > 1.0e-9 * tsamp) {
+			throw std::runtime_error(name + " has a different sample time than " + names[order[0]]);
+		}
+		// The start times may differ by the rounding of a sample
+		const double gap = (header["tstart"].val.d - next_tstart) * 86400.0 / tsamp;
+		if (!previous.empty() && std::fabs(gap) > 0.5) {
+			throw std::runtime_error(name + " starts " + std::to_string(gap) + " samples after the end of " + previous);
+		}
+		next_tstart = header["tstart"].val.d + header["nsamples"].val.i * tsamp / 86400.0;
+		previous = name;
+		inputs.push_back(name);
+		lengths.push_back(header["nsamples"].val.i);
+		nsamples += header["nsamples"].val.i;
+		nbits = std::max(nbits, header["nbits"].val.i);
+	}
+	// The header counts the samples in 32 bits
+	if (nsamples > INT32_MAX) {
+		throw std::runtime_error("The inputs hold " + std::to_string(nsamples) + " samples together, more than a header can count");
+	}
+
+	output_header = reference;
+	output_header["nbits"].val.i = nbits;
+	output_header["nsamples"].val.i = (int32_t)nsamples;
+	const uint32_t values = output_header["nifs"].val.i * output_header["nchans"].val.i;
+	if (!this->block_samples) {
+		this->block_samples = std::max<uint32_t>(1, (1 << 20) / values);
+	}
+}
+
+/**
+ * @brief Reads the next block, which continues into the next file at the end of a file
+ *
+ * @return block_ptr the block, nullptr at the end of the last file
+ */
+block_ptr concat_source::next() {
+	const uint32_t values = output_header["nifs"].val.i * output_header["nchans"].val.i;
+	block_ptr item;
+	uint32_t n = 0;
+	while (current < inputs.size() && n < block_samples) {
+		if (!open) {
+			fb = filterbank::open(filterbank::ioType::FILEIO, inputs[current]);
+			fb.prefetch();
+			remaining = lengths[current];
+			open = true;
+		}
+		if (!item) {
+			item = block_pool::acquire(block_samples, values);
+		}
+		const uint32_t wanted = (uint32_t)std::min<uint64_t>(block_samples - n, remaining);
+		const uint32_t got = wanted ? fb.read_block(item->data.data() + (uint64_t)n * values, wanted) : 0;
+		if (got < wanted) {
+			throw std::runtime_error(inputs[current] + " ended " + std::to_string(remaining - got) + " samples early, it was truncated while being read");
+		}
+		n += got;
+		remaining -= got;
+		if (!remaining) {
+			fb.close();
+			open = false;
+			current++;
+		}
+	}
+	if (!n) {
+		return nullptr;
+	}
+	item->data.resize((uint64_t)n * values);
+	item->nsamples = n;
+	item->first_sample = samples_read;
+	samples_read += n;
+	return item;
+}
@@ -0,0 +1,83 @@
+#include "stages.hpp"
+#include "kernels.hpp"
+#include <stdexcept>
+
+/**
+ * @param n_samples_to_combine number of samples to add into one sample, 0 or 1 to keep all samples
+ * @param n_channels_to_combine number of channels to average into one channel, 0 for all channels
+ */
+decimate_stage::decimate_stage(uint32_t n_samples_to_combine, uint32_t n_channels_to_combine) :
+	n_samples_to_combine(std::max(1u, n_samples_to_combine)), n_channels_to_combine(n_channels_to_combine) {
+}
+
+/**
+ * @brief Checks the decimation factors and updates the header for the reduced resolution
+ */
+void decimate_stage::configure(std::map<std::string, header_param>& header) {
+	nifs = header["nifs"].val.i;
+	nchans = header["nchans"].val.i;
+	uint32_t nsamples = header["nsamples"].val.i;
+
+	if (nsamples % n_samples_to_combine) {
+		throw std::runtime_error("File does not contain a multiple of: " + std::to_string(n_samples_to_combine) + " samples.");
+	}
+	//If no decimation factor is given all channels will be decimated.
+	if (!n_channels_to_combine) {
+		n_channels_to_combine = nchans;
+	}
+	if (!nchans || nchans % n_channels_to_combine) {
+		throw std::runtime_error("File does not contain a multiple of: " + std::to_string(n_channels_to_combine) + " channels.");
+	}
+
+	n_channels_out = nchans / n_channels_to_combine;
+	total.assign((uint64_t)nifs * nchans, 0.0f);
+	n_summed = 0;
+	add_samples = kernel_table<sum_samples_kernel, 2, 3, 4, 5, 8, 16>::select(n_samples_to_combine);
+	average_channels = kernel_table<average_channels_kernel, 1, 2, 4, 8, 16>::select(n_channels_to_combine);
+
+	// if we decrease the amount of samples, the time between samples increase
+	header["nsamples"].val.i = nsamples / n_samples_to_combine;
+	header["tsamp"].val.d = header["tsamp"].val.d * n_samples_to_combine;
+	// the output channels are centred on the channels they combine
+	header["fch1"].val.d += header["foff"].val.d * (n_channels_to_combine - 1) / 2.0;
+	header["foff"].val.d *= n_channels_to_combine;
+	header["nchans"].val.i = n_channels_out;
+}
+
+/**
+ * @brief Sums samples and averages channels. Samples that do not complete an
+ * output sample are kept for the next block.
+ */
+void decimate_stage::process(block_ptr input, const emitter& emit) {
+	uint64_t values_in = (uint64_t)nifs * nchans;
+	uint64_t values_out = (uint64_t)nifs * n_channels_out;
+	uint32_t n_out = (n_summed + input->nsamples) / n_samples_to_combine;
+
+	block_ptr output = block_pool::acquire(n_out, values_out);
+	output->first_sample = samples_out;
+	uint32_t produced = 0;
+
+	uint32_t sample = 0;
+	while (sample < input->nsamples) {
+		// A whole output sample at once, samples split over blocks are summed by the generic kernel
+		uint32_t n = std::min(n_samples_to_combine - n_summed, input->nsamples - sample);
+		sum_samples_kernel::type sum = (n == n_samples_to_combine) ? add_samples : &sum_samples_kernel::run<0>;
+		sum(&input->data[(uint64_t)sample * values_in], values_in, total.data(), n);
+		sample += n;
+		n_summed += n;
+		if (n_summed < n_samples_to_combine) {
+			continue;
+		}
+
+		// The channels of every IF are contiguous, so the IFs are just more groups of channels
+		average_channels(total.data(), values_out, &output->data[(uint64_t)produced * values_out], n_channels_to_combine);
+		std::fill(total.begin(), total.end(), 0.0f);
+		n_summed = 0;
+		produced++;
+	}
+
+	samples_out += n_out;
+	if (n_out) {
+		emit(std::move(output));
+	}
+}
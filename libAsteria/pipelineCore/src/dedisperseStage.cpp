@@ -0,0 +1,161 @@
+#include "stages.hpp"
+#include "kernels.hpp"
+#include <cmath>
+#include <mutex>
+#include <stdexcept>
+#include <tuple>
+
+/**
+ * @param dispersion_measure the dm to dedisperse at
+ * @param n_bands the number of output sub-bands
+ * @param reference_frequency frequency the delays are relative to in MHz, 0 for the highest frequency
+ */
+dedisperse_stage::dedisperse_stage(double dispersion_measure, uint32_t n_bands, double reference_frequency) :
+	dispersion_measure(dispersion_measure), n_bands(n_bands), reference_frequency(reference_frequency) {
+}
+
+/**
+ * @brief Calculates the dispersion delay of every channel in samples
+ * 
+ * @param header the header describing the channels
+ * @param dispersion_measure the dm in pc/cc
+ * @param reference_frequency frequency the delays are relative to in MHz, 0 for the highest frequency
+ * @return the delay of every channel, rounded to whole samples
+ */
+std::vector<uint32_t> dedisperse_stage::channel_delays(std::map<std::string, header_param>& header, double dispersion_measure, double reference_frequency) {
+	uint32_t nchans = header["nchans"].val.i;
+	double fch1 = header["fch1"].val.d;
+	double foff = header["foff"].val.d;
+	double tsamp = header["tsamp"].val.d;
+	if (!reference_frequency) {
+		reference_frequency = std::max(fch1, fch1 + (nchans - 1) * foff);
+	}
+
+	std::vector<uint32_t> delays(nchans);
+	for (uint32_t channel = 0; channel < nchans; ++channel) {
+		double freq = fch1 + channel * foff;
+		double delay = 4.148808e3 * dispersion_measure * (1.0 / (freq * freq) - 1.0 / (reference_frequency * reference_frequency));
+		delays[channel] = (uint32_t)std::max(0.0, std::round(delay / tsamp));
+	}
+	return delays;
+}
+
+/**
+ * @brief Looks up the delays of channel_delays in a table of the delays in use, so that stages working on
+ * data with the same channels, e.g. the beams of a multibeam receiver, share them. A table is freed once
+ * no stage uses it anymore.
+ */
+std::shared_ptr<const std::vector<uint32_t>> dedisperse_stage::shared_delays(std::map<std::string, header_param>& header, double dispersion_measure, double reference_frequency) {
+	typedef std::tuple<int32_t, double, double, double, double, double> plan_key;
+	static std::mutex lock;
+	static std::map<plan_key, std::weak_ptr<const std::vector<uint32_t>>> plans;
+
+	plan_key key(header["nchans"].val.i, header["fch1"].val.d, header["foff"].val.d, header["tsamp"].val.d, dispersion_measure, reference_frequency);
+	std::lock_guard<std::mutex> guard(lock);
+	std::shared_ptr<const std::vector<uint32_t>> delays = plans[key].lock();
+	if (!delays) {
+		delays = std::make_shared<const std::vector<uint32_t>>(channel_delays(header, dispersion_measure, reference_frequency));
+		plans[key] = delays;
+	}
+	return delays;
+}
+
+/**
+ * @brief Calculates the delays and turns the header into that of a time series or sub-bands
+ */
+void dedisperse_stage::configure(std::map<std::string, header_param>& header) {
+	nifs = header["nifs"].val.i;
+	nchans = header["nchans"].val.i;
+	if (!n_bands || !nchans || nchans % n_bands) {
+		throw std::runtime_error("Number of channels is not a multiple of " + std::to_string(n_bands) + " sub-bands");
+	}
+	if (header["tsamp"].val.d <= 0.0 || (dispersion_measure && !header["fch1"].val.d)) {
+		throw std::runtime_error("Dedispersion needs tsamp and fch1 in the header");
+	}
+
+	delays = shared_delays(header, dispersion_measure, reference_frequency);
+	max_delay = *std::max_element(delays->begin(), delays->end());
+	carry.assign((uint64_t)nifs * nchans * max_delay, 0.0f);
+	n_carried = 0;
+
+	uint32_t channels_per_band = nchans / n_bands;
+	// As many channels of a band per pass over the output as divide the band, up to max_channels_per_pass
+	channels_per_pass = max_channels_per_pass;
+	while (channels_per_band % channels_per_pass) {
+		channels_per_pass /= 2;
+	}
+	add_channels = kernel_table<add_channels_kernel, 1, 2, 4, 8>::select(channels_per_pass);
+
+	uint32_t nsamples = header["nsamples"].val.i;
+	header["nsamples"].val.i = nsamples > max_delay ? nsamples - max_delay : 0;
+	header["fch1"].val.d += header["foff"].val.d * (channels_per_band - 1) / 2.0;
+	header["foff"].val.d *= channels_per_band;
+	header["nchans"].val.i = n_bands;
+	header["data_type"].val.i = (n_bands == 1) ? 2 : 1;
+	header["refdm"].val.d = dispersion_measure;
+	header["refdm"].present = true;
+	header["nbits"].val.i = 32;
+}
+
+/**
+ * @brief Dedisperses the block, see dedisperse
+ */
+void dedisperse_stage::process(block_ptr input, const emitter& emit) {
+	dedisperse(*input, emit);
+}
+
+/**
+ * @brief Adds every channel, shifted by its delay, into its sub-band. The last
+ * max_delay samples are kept as they need the next block to complete.
+ */
+void dedisperse_stage::dedisperse(const block& input, const emitter& emit) {
+	uint64_t rows = (uint64_t)nifs * nchans;
+	uint32_t total = n_carried + input.nsamples;
+	uint32_t n_out = total > max_delay ? total - max_delay : 0;
+	uint32_t channels_per_band = nchans / n_bands;
+
+	// Build channel major time series so the shifted additions are contiguous
+	series.resize(rows * total);
+	for (uint64_t row = 0; row < rows; ++row) {
+		std::copy(&carry[row * max_delay], &carry[row * max_delay] + n_carried, &series[row * total]);
+	}
+	for (uint32_t sample = 0; sample < input.nsamples; ++sample) {
+		const float* spectrum = &input.data[sample * rows];
+		for (uint64_t row = 0; row < rows; ++row) {
+			series[row * total + n_carried + sample] = spectrum[row];
+		}
+	}
+
+	bands.assign((uint64_t)nifs * n_bands * n_out, 0.0f);
+	const float* in[max_channels_per_pass];
+	for (uint32_t interface = 0; interface < nifs; ++interface) {
+		for (uint32_t channel = 0; channel < nchans; channel += channels_per_pass) {
+			for (uint32_t k = 0; k < channels_per_pass; ++k) {
+				in[k] = &series[(interface * nchans + channel + k) * (uint64_t)total + (*delays)[channel + k]];
+			}
+			float* out = &bands[(interface * n_bands + channel / channels_per_band) * (uint64_t)n_out];
+			add_channels(in, n_out, out, channels_per_pass);
+		}
+	}
+
+	// Keep the samples that still need later data
+	n_carried = total - n_out;
+	for (uint64_t row = 0; row < rows; ++row) {
+		std::copy(&series[row * total + n_out], &series[row * total + total], &carry[row * max_delay]);
+	}
+
+	if (!n_out) {
+		return;
+	}
+	uint64_t values_out = (uint64_t)nifs * n_bands;
+	block_ptr output = block_pool::acquire(n_out, values_out);
+	output->first_sample = samples_out;
+	samples_out += n_out;
+	for (uint64_t row = 0; row < values_out; ++row) {
+		const float* in = &bands[row * n_out];
+		for (uint32_t sample = 0; sample < n_out; ++sample) {
+			output->data[sample * values_out + row] = in[sample];
+		}
+	}
+	emit(std::move(output));
+}
@@ -0,0 +1,232 @@
+#include "stages.hpp"
+#include "stats.hpp"
+#include <iostream>
+#include <stdexcept>
+
+/**
+ * @brief Opens the input and reads its header. For a range of samples the header describes the range,
+ * so the stages see it as a shorter file starting later.
+ * 
+ * @param inputType file or stdio
+ * @param input the filename, ignored for stdio
+ * @param block_samples spectra per block, 0 for blocks of about 4 MB
+ * @param first_sample the first sample to read, only for files
+ * @param nsamples the number of samples to read, 0 for all
+ */
+filterbank_source::filterbank_source(filterbank::ioType inputType, std::string input, uint32_t block_samples, uint64_t first_sample, uint64_t nsamples) :
+	fb(filterbank::open(inputType, input)), input(input), block_samples(block_samples) {
+	if (!fb.values_per_sample()) {
+		throw std::runtime_error("Input has no channels or IFs");
+	}
+	if (first_sample || nsamples) {
+		uint64_t total = fb.header["nsamples"].val.i;
+		if (first_sample >= total || !fb.seek_sample(first_sample)) {
+			throw std::runtime_error("Cannot read from sample " + std::to_string(first_sample) + " of " + input);
+		}
+		fb.header["nsamples"].val.i = (int32_t)(nsamples ? std::min(nsamples, total - first_sample) : total - first_sample);
+		fb.header["tstart"].val.d += first_sample * fb.header["tsamp"].val.d / 86400.0;
+	}
+	if (!this->block_samples) {
+		this->block_samples = std::max<uint32_t>(1, (1 << 20) / fb.values_per_sample());
+	}
+}
+
+/**
+ * @brief Reads the input while it is still being written, see filterbank::follow. Call before the pipeline runs.
+ *
+ * @param timeout the seconds without new data after which the input is complete, 0 to only use the sentinel
+ * @param sentinel a file whose existence marks the input complete
+ */
+void filterbank_source::follow(double timeout, const std::string& sentinel) {
+	if (!fb.follow(timeout, sentinel)) {
+		throw std::runtime_error("Only a regular file can be followed, until a timeout or a sentinel file");
+	}
+}
+
+/**
+ * @brief Sums the IFs while reading, so the pipeline gets one IF. Fused into the decoding, the spectra are added
+ * while they are still in cache instead of in a separate pass over every block. Call before the pipeline runs,
+ * and after follow.
+ */
+void filterbank_source::sum_ifs() {
+	if (summing || fb.header["nifs"].val.i < 2) {
+		return;
+	}
+	summing = true;
+	summed_header = fb.header;
+	summed_header["nifs"].val.i = 1;
+	// The blocks of the source keep about the same size
+	block_samples *= fb.header["nifs"].val.i;
+}
+
+/**
+ * @brief Verifies the input in the same pass as the processing: the CRC32C of the input is calculated while it
+ * is read, and at the end compared with the CRC stored in the sidecar file name.crc32c. Without a sidecar
+ * the CRC is stored in one, which is reported, so the next read verifies it. Call before the pipeline runs,
+ * and after follow.
+ */
+void filterbank_source::verify() {
+	if (samples_read || !fb.checksum()) {
+		throw std::runtime_error("Only a whole input can be verified, not a range of samples");
+	}
+	verifying = true;
+}
+
+/**
+ * @brief Checks the input after its last block, a truncated input or one that does not match its stored CRC
+ * is an error. The CRC of an input without a sidecar, or one that cannot have one, is printed to compare it
+ * by hand; a sidecar that cannot be written, e.g. on a read-only archive, only gets a warning.
+ */
+void filterbank_source::check_input() {
+	verifying = false;
+	const std::string name = input.empty() ? "The input" : input;
+	if (fb.truncated()) {
+		throw std::runtime_error(name + " is truncated, its data ends before its header or size said it would");
+	}
+	const uint32_t crc = fb.input_crc();
+	char value[16];
+	snprintf(value, sizeof(value), "%08x", crc);
+	if (filterbank::input_type(input) != filterbank::ioType::FILEIO) {
+		std::cerr << name << ": CRC32C " << value << "\n";
+		return;
+	}
+	uint32_t stored = 0;
+	if (!filterbank::stored_crc(input, stored)) {
+		// A first read is not a verification, it only stores the CRC the next read is checked against
+		if (filterbank::store_crc(input, crc)) {
+			std::cerr << name << ": no stored checksum, wrote CRC32C " << value << " to " << input << ".crc32c\n";
+		} else {
+			std::cerr << name << ": no stored checksum, CRC32C " << value << ", " << input << ".crc32c could not be written\n";
+		}
+	} else if (stored != crc) {
+		char values[64];
+		snprintf(values, sizeof(values), "CRC32C %08x, %08x stored", crc, stored);
+		throw std::runtime_error(name + " does not match its checksum: " + values);
+	}
+}
+
+/**
+ * @brief Reads nsamples spectra and adds their IFs, decoding a few spectra at a time
+ *
+ * @param out room for nsamples * nchans values
+ * @return the number of spectra read, less than nsamples at the end of the data
+ */
+uint32_t filterbank_source::read_summed(float* out, uint32_t nsamples) {
+	const uint32_t nifs = fb.header["nifs"].val.i;
+	const uint32_t nchans = fb.header["nchans"].val.i;
+	const uint32_t values = nifs * nchans;
+	// About 64 KB of decoded spectra, which stay in the L2 cache while they are added
+	const uint32_t step = std::max<uint32_t>(1, (16 << 10) / values);
+	if (scratch.size() < (uint64_t)step * values) {
+		scratch.resize((uint64_t)step * values);
+	}
+
+	uint32_t n = 0;
+	while (n < nsamples) {
+		const uint32_t wanted = std::min(step, nsamples - n);
+		uint32_t got = fb.read_block(scratch.data(), wanted);
+		scoped_timer timer("sumifs");
+		for (uint32_t sample = 0; sample < got; ++sample) {
+			const float* in = scratch.data() + (uint64_t)sample * values;
+			float* sum = out + (uint64_t)(n + sample) * nchans;
+			std::copy(in, in + nchans, sum);
+			for (uint32_t ifs = 1; ifs < nifs; ++ifs) {
+				const float* spectrum = in + (uint64_t)ifs * nchans;
+				for (uint32_t channel = 0; channel < nchans; ++channel) {
+					sum[channel] += spectrum[channel];
+				}
+			}
+		}
+		stats::count("sumifs", 0, (uint64_t)got * values);
+		n += got;
+		if (got < wanted) {
+			break;
+		}
+	}
+	return n;
+}
+
+/**
+ * @brief Reads the next block, the header nsamples limits how much is read when it is set
+ * 
+ * @return block_ptr the block, nullptr at the end of the data
+ */
+block_ptr filterbank_source::next() {
+	// Read the next blocks while the current one is processed, unless the input is followed
+	if (!samples_read) {
+		fb.prefetch();
+	}
+	uint32_t wanted = block_samples;
+	uint64_t nsamples = fb.header["nsamples"].val.i;
+	if (nsamples) {
+		if (samples_read >= nsamples) {
+			if (verifying) {
+				check_input();
+			}
+			return nullptr;
+		}
+		wanted = (uint32_t)std::min<uint64_t>(wanted, nsamples - samples_read);
+	}
+
+	const uint32_t values = summing ? summed_header["nchans"].val.i : fb.values_per_sample();
+	block_ptr item = block_pool::acquire(wanted, values);
+	uint32_t n = summing ? read_summed(item->data.data(), wanted) : fb.read_block(item->data.data(), wanted);
+	if (!n) {
+		if (verifying) {
+			check_input();
+		}
+		return nullptr;
+	}
+	if (n < wanted) {
+		item->data.resize((uint64_t)n * values);
+	}
+	item->nsamples = n;
+	item->first_sample = samples_read;
+	samples_read += n;
+	return item;
+}
+
+/**
+ * @param outputType file or stdio
+ * @param filename the filename, ignored for stdio
+ * @param headerless whether to leave out the header
+ * @param nbits the number of output bits, 0 to keep the bits of the incoming header
+ * @param direct whether to write the file with O_DIRECT
+ */
+filterbank_sink::filterbank_sink(filterbank::ioType outputType, std::string filename, bool headerless, int32_t nbits, bool direct) :
+	outputType(outputType), filename(filename), headerless(headerless), nbits(nbits), direct(direct) {
+}
+
+/**
+ * @param offset the position in bytes of the first sample in the file, which must exist
+ */
+void filterbank_sink::write_at(uint64_t offset) {
+	at_offset = true;
+	this->offset = offset;
+}
+
+/**
+ * @brief Opens the output and writes the header
+ */
+void filterbank_sink::configure(std::map<std::string, header_param>& header) {
+	if (nbits) {
+		header["nbits"].val.i = nbits;
+	}
+	fb.header = header;
+	if (!fb.valid_sample_format()) {
+		throw std::runtime_error("Cannot write " + std::to_string(fb.header["nbits"].val.i) + " bit values: supported formats are 1/2/4/8/16/32 bits, with whole bytes per spectrum");
+	}
+	if (at_offset ? !fb.create_at(filename, offset) : !fb.create(outputType, filename, headerless)) {
+		throw std::runtime_error("Failed to open file for writing: " + filename);
+	}
+	// O_DIRECT truncates the file to the end of its data, which would cut off parts written behind it
+	fb.write_behind(4, 4 << 20, direct && !at_offset);
+}
+
+void filterbank_sink::consume(const block& input) {
+	fb.write_block(input.data.data(), input.nsamples);
+}
+
+void filterbank_sink::finish() {
+	fb.close();
+}
@@ -0,0 +1,230 @@
+#include "stages.hpp"
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+	// Partial profiles are added to the sub-integration at least this often, which keeps their float sums accurate
+	const uint64_t reduce_samples = 1 << 16;
+	// Every thread folds at least this many samples
+	const uint64_t min_fold_samples = 1024;
+}
+
+/**
+ * @param options the period or polyco file, the bins, sub-bands and sub-integrations
+ */
+fold_stage::fold_stage(const fold_options& options) : options(options), pool(default_threads(options.threads)) {
+}
+
+/**
+ * @brief Sets up the phase model and the profiles, and turns the header into that of folded data
+ */
+void fold_stage::configure(std::map<std::string, header_param>& header) {
+	nifs = header["nifs"].val.i;
+	nchans = header["nchans"].val.i;
+	values = (uint64_t)nifs * nchans;
+	tsamp = header["tsamp"].val.d;
+	tstart = header["tstart"].val.d;
+	if (!(tsamp > 0.0)) {
+		throw std::runtime_error("Folding needs tsamp in the header");
+	}
+	if (!options.n_bands || !nchans || nchans % options.n_bands) {
+		throw std::runtime_error("Number of channels is not a multiple of " + std::to_string(options.n_bands) + " sub-bands");
+	}
+	if (options.dispersion_measure && !header["fch1"].val.d) {
+		throw std::runtime_error("Folding at a dm needs fch1 in the header");
+	}
+
+	if (!options.polyco_file.empty()) {
+		model = phase_model::read_polyco(options.polyco_file);
+	} else {
+		double period = options.period ? options.period : header["period"].val.d;
+		if (!(period > 0.0)) {
+			throw std::runtime_error("No folding period given and none in the header");
+		}
+		model = phase_model::constant(period, tstart);
+	}
+	double period = model.period_at(tstart);
+	nbins = options.nbins;
+	if (!nbins) {
+		nbins = (uint32_t)std::max(1.0, std::min(256.0, std::floor(period / tsamp)));
+	}
+	subint_samples = options.subint > 0.0 ? (uint64_t)std::max(1.0, std::round(options.subint / tsamp)) : 0;
+
+	if (options.dispersion_measure) {
+		delays = dedisperse_stage::channel_delays(header, options.dispersion_measure);
+	} else {
+		delays.assign(nchans, 0);
+	}
+	max_delay = *std::max_element(delays.begin(), delays.end());
+	// A gap in the polycos fails here instead of after part of the data was folded
+	uint64_t nsamples = (uint32_t)header["nsamples"].val.i;
+	if (nsamples) {
+		model.check_coverage(tstart, -(double)max_delay * tsamp, (double)(nsamples - 1) * tsamp);
+	}
+
+	partial_sums.clear();
+	partial_hits.clear();
+	partial_samples = 0;
+	sums.assign((uint64_t)nbins * values, 0.0);
+	hits.assign((uint64_t)nbins * nchans, 0);
+	subint_folded = 0;
+	n_subints = 0;
+
+	uint64_t profiles = subint_samples ? (nsamples + subint_samples - 1) / subint_samples : 1;
+	uint32_t channels_per_band = nchans / options.n_bands;
+	header["nsamples"].val.i = nsamples ? (int32_t)(profiles * nbins) : 0;
+	header["fch1"].val.d += header["foff"].val.d * (channels_per_band - 1) / 2.0;
+	header["foff"].val.d *= channels_per_band;
+	header["nchans"].val.i = options.n_bands;
+	header["data_type"].val.i = 3;
+	header["nbins"].val.i = nbins;
+	header["nbins"].present = true;
+	header["period"].val.d = period;
+	header["period"].present = true;
+	header["tsamp"].val.d = period / nbins;
+	header["refdm"].val.d = options.dispersion_measure;
+	header["refdm"].present = true;
+	header["nbits"].val.i = 32;
+}
+
+/**
+ * @brief Folds samples begin to end of the block into the partial profiles. The phase bin of every
+ * sample is calculated once, a channel uses the bin of the sample its delay earlier.
+ */
+void fold_stage::fold(const block& input, uint32_t begin, uint32_t end) {
+	const uint32_t count = end - begin;
+	const int64_t first = (int64_t)(input.first_sample + begin) - max_delay;
+	bins.resize((uint64_t)count + max_delay);
+	parallel_for(pool, bins.size(), 4096, [&](uint64_t from, uint64_t to) {
+		for (uint64_t index = from; index < to; ++index) {
+			double phase, frequency;
+			model.evaluate(tstart, (double)(first + (int64_t)index) * tsamp, phase, frequency);
+			uint32_t bin = (uint32_t)((phase - std::floor(phase)) * nbins);
+			bins[index] = std::min(bin, nbins - 1);
+		}
+	});
+
+	// Every part of the samples gets its own partial profile, so the threads never share a bin
+	const uint64_t n_parts = std::max<uint64_t>(1, std::min<uint64_t>(pool.size(), count / min_fold_samples));
+	const uint64_t per_part = (count + n_parts - 1) / n_parts;
+	const uint64_t hit_columns = max_delay ? nchans : 1;
+	while (partial_sums.size() < n_parts) {
+		partial_sums.emplace_back((uint64_t)nbins * values, 0.0f);
+		partial_hits.emplace_back((uint64_t)nbins * hit_columns, 0);
+	}
+
+	parallel_for(pool, n_parts, 1, [&](uint64_t part_begin, uint64_t part_end) {
+		for (uint64_t part = part_begin; part < part_end; ++part) {
+			float* profile = partial_sums[part].data();
+			uint32_t* part_hits = partial_hits[part].data();
+			const uint64_t last = std::min<uint64_t>(count, (part + 1) * per_part);
+			for (uint64_t sample = part * per_part; sample < last; ++sample) {
+				const float* spectrum = &input.data[(begin + sample) * values];
+				if (!max_delay) {
+					const uint32_t bin = bins[sample];
+					float* row = profile + (uint64_t)bin * values;
+					for (uint64_t value = 0; value < values; ++value) {
+						row[value] += spectrum[value];
+					}
+					part_hits[bin]++;
+					continue;
+				}
+				for (uint32_t channel = 0; channel < nchans; ++channel) {
+					const uint32_t bin = bins[sample + max_delay - delays[channel]];
+					part_hits[(uint64_t)bin * nchans + channel]++;
+					for (uint32_t interface = 0; interface < nifs; ++interface) {
+						profile[((uint64_t)bin * nifs + interface) * nchans + channel] += spectrum[(uint64_t)interface * nchans + channel];
+					}
+				}
+			}
+		}
+	});
+	partial_samples += count;
+}
+
+/**
+ * @brief Adds the partial profiles of the threads to the sub-integration and clears them
+ */
+void fold_stage::reduce() {
+	if (!partial_samples) {
+		return;
+	}
+	parallel_for(pool, (uint64_t)nbins * values, 1 << 16, [&](uint64_t begin, uint64_t end) {
+		for (auto& partial : partial_sums) {
+			for (uint64_t index = begin; index < end; ++index) {
+				sums[index] += partial[index];
+				partial[index] = 0.0f;
+			}
+		}
+	});
+	for (auto& partial : partial_hits) {
+		for (uint32_t bin = 0; bin < nbins; ++bin) {
+			for (uint32_t channel = 0; channel < nchans; ++channel) {
+				hits[(uint64_t)bin * nchans + channel] += max_delay ? partial[(uint64_t)bin * nchans + channel] : partial[bin];
+			}
+		}
+		std::fill(partial.begin(), partial.end(), 0);
+	}
+	partial_samples = 0;
+}
+
+/**
+ * @brief Emits the profile of the current sub-integration, the mean of every bin summed over the channels of a sub-band
+ */
+void fold_stage::emit_profile(const emitter& emit) {
+	if (!subint_folded) {
+		return;
+	}
+	reduce();
+
+	const uint32_t channels_per_band = nchans / options.n_bands;
+	block_ptr profile = block_pool::acquire(nbins, nifs * options.n_bands);
+	// Blocks are not initialized, the bins are summed over the channels of a band
+	std::fill(profile->data.begin(), profile->data.end(), 0.0f);
+	profile->first_sample = n_subints * nbins;
+	for (uint32_t bin = 0; bin < nbins; ++bin) {
+		for (uint32_t interface = 0; interface < nifs; ++interface) {
+			const double* row = &sums[((uint64_t)bin * nifs + interface) * nchans];
+			const uint64_t* row_hits = &hits[(uint64_t)bin * nchans];
+			float* out = &profile->data[((uint64_t)bin * nifs + interface) * options.n_bands];
+			for (uint32_t channel = 0; channel < nchans; ++channel) {
+				if (row_hits[channel]) {
+					out[channel / channels_per_band] += (float)(row[channel] / row_hits[channel]);
+				}
+			}
+		}
+	}
+	std::fill(sums.begin(), sums.end(), 0.0);
+	std::fill(hits.begin(), hits.end(), 0);
+	subint_folded = 0;
+	n_subints++;
+	emit(std::move(profile));
+}
+
+/**
+ * @brief Folds the block, emitting a profile whenever a sub-integration is complete
+ */
+void fold_stage::process(block_ptr input, const emitter& emit) {
+	uint32_t begin = 0;
+	while (begin < input->nsamples) {
+		uint32_t end = input->nsamples;
+		if (subint_samples) {
+			end = (uint32_t)std::min<uint64_t>(end, begin + subint_samples - subint_folded);
+		}
+		fold(*input, begin, end);
+		subint_folded += end - begin;
+		if (subint_samples && subint_folded == subint_samples) {
+			emit_profile(emit);
+		} else if (partial_samples >= reduce_samples) {
+			reduce();
+		}
+		begin = end;
+	}
+}
+
+/**
+ * @brief Emits the last, possibly incomplete, sub-integration
+ */
+void fold_stage::flush(const emitter& emit) {
+	emit_profile(emit);
+}
@@ -0,0 +1,61 @@
+#include "stages.hpp"
+#include <fstream>
+#include <stdexcept>
+
+/**
+ * @param channels the zero based channels to mask
+ */
+mask_stage::mask_stage(const std::vector<uint32_t>& channels) : channels(channels) {
+}
+
+/**
+ * @brief Reads a list of channels to ignore, as used by the sigproc -i option.
+ * Channel numbers are whitespace separated and start at 1.
+ * 
+ * @param filename the file to read
+ * @return the zero based channel numbers
+ */
+std::vector<uint32_t> mask_stage::read_channel_list(const std::string& filename) {
+	std::ifstream infile(filename);
+	if (!infile.good()) {
+		throw std::runtime_error("Failed to read channel list: " + filename);
+	}
+	std::vector<uint32_t> channels;
+	int64_t channel;
+	while (infile >> channel) {
+		if (channel < 1) {
+			throw std::runtime_error("Invalid channel number in " + filename + ": " + std::to_string(channel));
+		}
+		channels.push_back((uint32_t)(channel - 1));
+	}
+	if (!infile.eof()) {
+		throw std::runtime_error("Invalid channel list: " + filename);
+	}
+	return channels;
+}
+
+void mask_stage::configure(std::map<std::string, header_param>& header) {
+	nifs = header["nifs"].val.i;
+	nchans = header["nchans"].val.i;
+	for (uint32_t channel : channels) {
+		if (channel >= nchans) {
+			throw std::runtime_error("Masked channel " + std::to_string(channel + 1) + " does not exist");
+		}
+	}
+}
+
+/**
+ * @brief Zeroes the masked channels of every IF in place
+ */
+void mask_stage::process(block_ptr input, const emitter& emit) {
+	uint64_t values = (uint64_t)nifs * nchans;
+	for (uint32_t sample = 0; sample < input->nsamples; ++sample) {
+		float* spectrum = &input->data[sample * values];
+		for (uint32_t interface = 0; interface < nifs; ++interface) {
+			for (uint32_t channel : channels) {
+				spectrum[interface * nchans + channel] = 0.0f;
+			}
+		}
+	}
+	emit(std::move(input));
+}
@@ -0,0 +1,92 @@
+#include "parallel.hpp"
+
+worker_pool::~worker_pool() {
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+	started.notify_all();
+	for (auto& thread : threads) {
+		thread.join();
+	}
+}
+
+/**
+ * @brief Runs invoke(work, begin, end) on the ranges of per_range items of [0, n) on the workers and the
+ * calling thread, and waits until every worker is done with them
+ *
+ * @param n the number of items
+ * @param per_range the items per range, the last range may have less
+ * @param invoke calls work on a range
+ * @param work the function of parallel_for
+ */
+void worker_pool::run(uint64_t n, uint64_t per_range, invoker invoke, void* work) {
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		while (threads.size() + 1 < n_threads) {
+			threads.emplace_back(&worker_pool::wait_for_work, this);
+		}
+		this->invoke = invoke;
+		this->work = work;
+		this->n = n;
+		this->per_range = per_range;
+		n_ranges = (n + per_range - 1) / per_range;
+		next_range = 0;
+		failure = nullptr;
+		busy = (uint32_t)threads.size();
+		generation++;
+	}
+	started.notify_all();
+	take_ranges();
+
+	std::exception_ptr error;
+	{
+		std::unique_lock<std::mutex> guard(lock);
+		finished.wait(guard, [this]() { return !busy; });
+		error = failure;
+		failure = nullptr;
+	}
+	if (error) {
+		std::rethrow_exception(error);
+	}
+}
+
+/**
+ * @brief Runs ranges of the current parallel_for until none are left
+ */
+void worker_pool::take_ranges() {
+	for (uint64_t range = next_range++; range < n_ranges; range = next_range++) {
+		uint64_t begin = range * per_range;
+		try {
+			invoke(work, begin, std::min(n, begin + per_range));
+		} catch (...) {
+			std::lock_guard<std::mutex> guard(lock);
+			if (!failure) {
+				failure = std::current_exception();
+			}
+			next_range = n_ranges;
+		}
+	}
+}
+
+/**
+ * @brief The loop of a worker: takes part in every parallel_for until the pool is destroyed
+ */
+void worker_pool::wait_for_work() {
+	uint64_t seen = 0;
+	while (true) {
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			started.wait(guard, [&]() { return stopping || generation != seen; });
+			if (stopping) {
+				return;
+			}
+			seen = generation;
+		}
+		take_ranges();
+		std::lock_guard<std::mutex> guard(lock);
+		if (!--busy) {
+			finished.notify_one();
+		}
+	}
+}
@@ -0,0 +1,177 @@
+#include "phaseModel.hpp"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+	/**
+	 * @brief Parses a number that may use the Fortran D exponent, e.g. 1.234D-05
+	 */
+	double fortran_double(std::string value) {
+		std::replace(value.begin(), value.end(), 'D', 'E');
+		std::replace(value.begin(), value.end(), 'd', 'e');
+		size_t end = 0;
+		double number = 0.0;
+		try {
+			number = std::stod(value, &end);
+		} catch (const std::exception&) {
+			end = 0;
+		}
+		if (!end || end != value.size()) {
+			throw std::runtime_error("Invalid number in polyco file: " + value);
+		}
+		return number;
+	}
+}
+
+/**
+ * @param period the period in seconds
+ * @param epoch the MJD at which the phase is 0
+ */
+phase_model phase_model::constant(double period, double epoch) {
+	if (!(period > 0.0)) {
+		throw std::runtime_error("The folding period must be positive");
+	}
+	phase_model model;
+	model.period = period;
+	model.epoch = epoch;
+	return model;
+}
+
+/**
+ * @brief Reads the polynomial sets of a TEMPO polyco file. Every set is two header lines
+ * (name, date, utc, tmid, dm, ... and rphase, f0, observatory, span, ncoeff, ...) followed by
+ * ncoeff coefficients, three per line.
+ */
+phase_model phase_model::read_polyco(const std::string& filename) {
+	std::ifstream file(filename);
+	if (!file.good()) {
+		throw std::runtime_error("Failed to open polyco file: " + filename);
+	}
+
+	phase_model model;
+	std::string line;
+	while (std::getline(file, line)) {
+		std::istringstream first(line);
+		std::string name, date, utc, tmid;
+		if (!(first >> name)) {
+			continue;
+		}
+		if (!(first >> date >> utc >> tmid)) {
+			throw std::runtime_error("Invalid polyco set header in " + filename + ": " + line);
+		}
+
+		polyco_set set;
+		set.tmid = fortran_double(tmid);
+		std::string rphase, f0, observatory, span, ncoeff;
+		if (!std::getline(file, line) || !(std::istringstream(line) >> rphase >> f0 >> observatory >> span >> ncoeff)) {
+			throw std::runtime_error("Invalid polyco set header in " + filename + " after MJD " + tmid);
+		}
+		// The reference phase can be around 1e10 turns, only its fraction matters
+		double reference = fortran_double(rphase);
+		set.rphase = reference - std::floor(reference);
+		set.f0 = fortran_double(f0);
+		set.span = fortran_double(span);
+		int32_t n = (int32_t)fortran_double(ncoeff);
+		if (n < 1 || !(set.f0 > 0.0) || !(set.span > 0.0)) {
+			throw std::runtime_error("Invalid polyco set in " + filename + " at MJD " + tmid);
+		}
+
+		std::string coefficient;
+		while ((int32_t)set.coefficients.size() < n && file >> coefficient) {
+			set.coefficients.push_back(fortran_double(coefficient));
+		}
+		if ((int32_t)set.coefficients.size() < n) {
+			throw std::runtime_error("Missing polyco coefficients in " + filename + " at MJD " + tmid);
+		}
+		std::getline(file, line);
+		model.sets.push_back(set);
+	}
+	if (model.sets.empty()) {
+		throw std::runtime_error("No polyco sets in " + filename);
+	}
+	std::sort(model.sets.begin(), model.sets.end(), [](const polyco_set& a, const polyco_set& b) { return a.tmid < b.tmid; });
+	return model;
+}
+
+/**
+ * @brief The set whose midpoint is closest to the time, it has to cover the time
+ */
+const phase_model::polyco_set& phase_model::set_at(double mjd, double seconds) const {
+	const polyco_set* best = nullptr;
+	double best_distance = 0.0;
+	for (const polyco_set& set : sets) {
+		double distance = std::fabs((mjd - set.tmid) * 1440.0 + seconds / 60.0);
+		if (!best || distance < best_distance) {
+			best = &set;
+			best_distance = distance;
+		}
+	}
+	// Allow a little extrapolation, the polynomials are usually fitted a bit beyond their span
+	if (best_distance > 0.5 * best->span + 1.0) {
+		throw std::runtime_error("No polyco set covers MJD " + std::to_string(mjd + seconds / 86400.0));
+	}
+	return *best;
+}
+
+/**
+ * @param mjd the reference MJD, e.g. the start of the observation
+ * @param seconds the time after mjd in seconds
+ * @param phase the phase in turns
+ * @param frequency the apparent spin frequency in Hz
+ */
+void phase_model::evaluate(double mjd, double seconds, double& phase, double& frequency) const {
+	if (sets.empty()) {
+		double t = (mjd - epoch) * 86400.0 + seconds;
+		phase = t / period;
+		frequency = 1.0 / period;
+		return;
+	}
+
+	// phase = rphase + dt * 60 * f0 + c1 + c2 * dt + c3 * dt^2 + ..., dt in minutes from tmid
+	const polyco_set& set = set_at(mjd, seconds);
+	double dt = (mjd - set.tmid) * 1440.0 + seconds / 60.0;
+	double polynomial = 0.0;
+	double derivative = 0.0;
+	for (size_t i = set.coefficients.size(); i-- > 0;) {
+		if (i) {
+			derivative = derivative * dt + i * set.coefficients[i];
+		}
+		polynomial = polynomial * dt + set.coefficients[i];
+	}
+	phase = set.rphase + dt * 60.0 * set.f0 + polynomial;
+	frequency = set.f0 + derivative / 60.0;
+}
+
+/**
+ * @return the apparent period in seconds at the time
+ */
+double phase_model::period_at(double mjd, double seconds) const {
+	double phase, frequency;
+	evaluate(mjd, seconds, phase, frequency);
+	return 1.0 / frequency;
+}
+
+/**
+ * @brief Throws when a time in the range is not covered by a polyco set. The set used for a time changes
+ * halfway between the midpoints of two sets, the ends of the range and those points are the farthest from it.
+ *
+ * @param mjd the reference MJD, e.g. the start of the observation
+ * @param first the first time after mjd in seconds
+ * @param last the last time after mjd in seconds
+ */
+void phase_model::check_coverage(double mjd, double first, double last) const {
+	if (sets.empty()) {
+		return;
+	}
+	set_at(mjd, first);
+	set_at(mjd, last);
+	for (size_t i = 1; i < sets.size(); ++i) {
+		double boundary = ((sets[i - 1].tmid + sets[i].tmid) / 2.0 - mjd) * 86400.0;
+		if (boundary > first && boundary < last) {
+			set_at(mjd, boundary);
+		}
+	}
+}
@@ -0,0 +1,163 @@
+#include "pipeline.hpp"
+#include "stats.hpp"
+#include <exception>
+#include <stdexcept>
+#include <thread>
+
+/**
+ * @brief Sets the element producing the blocks
+ */
+void pipeline::set_source(std::unique_ptr<source> input) {
+	this->input = std::move(input);
+	configured = false;
+}
+
+/**
+ * @brief Appends a stage, stages process blocks in the order they were added
+ */
+void pipeline::add_stage(std::unique_ptr<stage> transform) {
+	stages.push_back(std::move(transform));
+	configured = false;
+}
+
+/**
+ * @brief Sets the element consuming the blocks
+ */
+void pipeline::set_sink(std::unique_ptr<sink> output) {
+	this->output = std::move(output);
+	configured = false;
+}
+
+/**
+ * @brief Passes the header of the source through every stage and into the sink
+ * 
+ * @return the header of the data that reaches the sink
+ */
+std::map<std::string, header_param> pipeline::configure() {
+	if (!input || !output) {
+		throw std::runtime_error("A pipeline needs a source and a sink");
+	}
+	std::map<std::string, header_param> header = input->header();
+	for (auto& transform : stages) {
+		transform->configure(header);
+	}
+	output->configure(header);
+	configured = true;
+	return header;
+}
+
+/**
+ * @brief Runs the pipeline until the source is exhausted
+ * 
+ * @param threaded whether every element gets its own thread, or everything runs on the calling thread
+ */
+void pipeline::run(bool threaded) {
+	if (!configured) {
+		configure();
+	}
+	if (threaded) {
+		run_threaded();
+	} else {
+		run_sequential();
+	}
+	output->finish();
+}
+
+/**
+ * @brief Pushes every block through all stages depth first on the calling thread
+ */
+void pipeline::run_sequential() {
+	std::vector<emitter> emitters(stages.size() + 1);
+	emitters[stages.size()] = [this](block_ptr item) {
+		output->consume(*item);
+	};
+	for (size_t i = stages.size(); i-- > 0;) {
+		emitter& next = emitters[i + 1];
+		stage* transform = stages[i].get();
+		emitters[i] = [transform, &next](block_ptr item) {
+			transform->process(std::move(item), next);
+		};
+	}
+
+	while (block_ptr item = input->next()) {
+		emitters[0](std::move(item));
+	}
+	for (size_t i = 0; i < stages.size(); ++i) {
+		stages[i]->flush(emitters[i + 1]);
+	}
+}
+
+/**
+ * @brief Runs the source, every stage and the sink on their own thread
+ */
+void pipeline::run_threaded() {
+	std::vector<std::unique_ptr<block_queue>> queues;
+	for (size_t i = 0; i <= stages.size(); ++i) {
+		queues.emplace_back(new block_queue(queue_depth));
+	}
+
+	std::exception_ptr failure;
+	std::mutex failure_lock;
+	auto fail = [&]() {
+		std::lock_guard<std::mutex> guard(failure_lock);
+		if (!failure) {
+			failure = std::current_exception();
+		}
+		for (auto& queue : queues) {
+			queue->abort();
+		}
+	};
+
+	std::vector<std::thread> threads;
+	threads.emplace_back([&]() {
+		try {
+			while (block_ptr item = input->next()) {
+				if (!queues[0]->push(std::move(item))) {
+					break;
+				}
+			}
+			queues[0]->close();
+		} catch (...) {
+			fail();
+		}
+	});
+
+	for (size_t i = 0; i < stages.size(); ++i) {
+		threads.emplace_back([&, i]() {
+			try {
+				block_queue& in = *queues[i];
+				block_queue& out = *queues[i + 1];
+				emitter emit = [&out](block_ptr item) {
+					out.push(std::move(item));
+				};
+				block_ptr item;
+				while (in.pop(item)) {
+					scoped_timer timer(stages[i]->name());
+					stats::count(stages[i]->name(), 0, item->data.size());
+					stages[i]->process(std::move(item), emit);
+				}
+				stages[i]->flush(emit);
+				out.close();
+			} catch (...) {
+				fail();
+			}
+		});
+	}
+
+	// The sink runs on the calling thread
+	try {
+		block_ptr item;
+		while (queues[stages.size()]->pop(item)) {
+			output->consume(*item);
+		}
+	} catch (...) {
+		fail();
+	}
+
+	for (auto& thread : threads) {
+		thread.join();
+	}
+	if (failure) {
+		std::rethrow_exception(failure);
+	}
+}
@@ -0,0 +1,329 @@
+#include "pyramid.hpp"
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "stats.hpp"
+
+namespace {
+	// Levels start on page boundaries, so every level can be mapped on its own as well
+	const uint64_t level_alignment = 4096;
+
+	uint64_t aligned(uint64_t offset) {
+		return (offset + level_alignment - 1) / level_alignment * level_alignment;
+	}
+}
+
+const char pyramid_sink::magic[8] = {'A', 'S', 'T', 'P', 'Y', 'R', 'M', 'D'};
+
+/**
+ * @param filename the pyramid file to write
+ * @param time_factor samples per cell of the first level
+ * @param channel_factor channels per cell of the first level
+ * @param max_levels the most levels to build
+ */
+pyramid_sink::pyramid_sink(const std::string& filename, uint32_t time_factor, uint32_t channel_factor, uint32_t max_levels) :
+	filename(filename), time_factor(time_factor), channel_factor(channel_factor), max_levels(max_levels) {
+	if (filename.empty()) {
+		throw std::runtime_error("A pyramid needs an output file");
+	}
+	if (!time_factor || !channel_factor || !max_levels) {
+		throw std::runtime_error("The pyramid factors and number of levels must be at least 1");
+	}
+	std::memcpy(header.magic, magic, sizeof(magic));
+}
+
+pyramid_sink::~pyramid_sink() {
+	for (level_builder& builder : levels) {
+		if (builder.data) {
+			fclose(builder.data);
+		}
+	}
+}
+
+/**
+ * @brief Lays out the levels and opens a temporary file for each of them
+ */
+void pyramid_sink::configure(std::map<std::string, header_param>& input_header) {
+	header.nifs = (uint32_t)input_header["nifs"].val.i;
+	header.nchans = (uint32_t)input_header["nchans"].val.i;
+	header.tsamp = input_header["tsamp"].val.d;
+	header.tstart = input_header["tstart"].val.d;
+	header.fch1 = input_header["fch1"].val.d;
+	header.foff = input_header["foff"].val.d;
+	if (!header.nifs || !header.nchans) {
+		throw std::runtime_error("A pyramid needs data with channels and IFs");
+	}
+
+	levels.resize(max_levels);
+	for (uint32_t index = 0; index < max_levels; ++index) {
+		pyramid_level& level = levels[index].level;
+		if (!index) {
+			level.time_factor = time_factor;
+			level.channel_factor = std::min(channel_factor, header.nchans);
+			level.nchans = (header.nchans + level.channel_factor - 1) / level.channel_factor;
+		} else {
+			const pyramid_level& below = levels[index - 1].level;
+			if (below.time_factor > std::numeric_limits<uint32_t>::max() / 2) {
+				levels.resize(index);
+				break;
+			}
+			level.time_factor = 2 * below.time_factor;
+			level.channel_factor = below.nchans > 1 ? 2 * below.channel_factor : below.channel_factor;
+			level.nchans = (below.nchans + 1) / 2;
+		}
+		const uint64_t cells = (uint64_t)header.nifs * level.nchans;
+		levels[index].sums.assign(cells, 0.0);
+		levels[index].weights.assign(cells, 0.0);
+		levels[index].row.assign(cells, pyramid_cell{0.0f, std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest()});
+		levels[index].data = tmpfile();
+		if (!levels[index].data) {
+			throw std::runtime_error("Failed to create a temporary file for pyramid level " + std::to_string(index));
+		}
+	}
+
+	first_cells.resize(header.nchans);
+	row_weights.assign(levels[0].level.nchans, 0.0);
+	for (uint32_t channel = 0; channel < header.nchans; ++channel) {
+		first_cells[channel] = channel / levels[0].level.channel_factor;
+		row_weights[first_cells[channel]] += 1.0;
+	}
+}
+
+/**
+ * @brief Adds the spectra of a block to the first level
+ */
+void pyramid_sink::consume(const block& input) {
+	scoped_timer timer("pyramid");
+	level_builder& first = levels[0];
+	const uint32_t nchans = header.nchans;
+	const uint32_t cells = first.level.nchans;
+	const float* values = input.data.data();
+	for (uint32_t sample = 0; sample < input.nsamples; ++sample) {
+		for (uint32_t ifs = 0; ifs < header.nifs; ++ifs) {
+			double* sums = &first.sums[(uint64_t)ifs * cells];
+			pyramid_cell* row = &first.row[(uint64_t)ifs * cells];
+			for (uint32_t channel = 0; channel < nchans; ++channel) {
+				const float value = values[channel];
+				pyramid_cell& cell = row[first_cells[channel]];
+				sums[first_cells[channel]] += value;
+				cell.min = std::min(cell.min, value);
+				cell.max = std::max(cell.max, value);
+			}
+			double* weights = &first.weights[(uint64_t)ifs * cells];
+			for (uint32_t cell = 0; cell < cells; ++cell) {
+				weights[cell] += row_weights[cell];
+			}
+			values += nchans;
+		}
+		if (++first.rows == first.level.time_factor) {
+			complete_row(0);
+		}
+	}
+	header.nsamples += input.nsamples;
+	stats::count("pyramid", input.data.size() * sizeof(float), input.nsamples);
+}
+
+/**
+ * @brief Adds a completed row of the level below to a level, two rows and two columns per cell
+ *
+ * @param index the level
+ * @param cells the row of the level below
+ * @param weights the number of input values in every cell of the row
+ */
+void pyramid_sink::add_row(uint32_t index, const std::vector<pyramid_cell>& cells, const std::vector<double>& weights) {
+	level_builder& builder = levels[index];
+	const uint32_t below = levels[index - 1].level.nchans;
+	const uint32_t shift = below > 1 ? 1 : 0;
+	for (uint32_t ifs = 0; ifs < header.nifs; ++ifs) {
+		for (uint32_t column = 0; column < below; ++column) {
+			const uint64_t source = (uint64_t)ifs * below + column;
+			const uint64_t target = (uint64_t)ifs * builder.level.nchans + (column >> shift);
+			builder.sums[target] += cells[source].mean * weights[source];
+			builder.weights[target] += weights[source];
+			builder.row[target].min = std::min(builder.row[target].min, cells[source].min);
+			builder.row[target].max = std::max(builder.row[target].max, cells[source].max);
+		}
+	}
+	if (++builder.rows == 2) {
+		complete_row(index);
+	}
+}
+
+/**
+ * @brief Writes the current row of a level, passes it on to the next level and starts a new row
+ */
+void pyramid_sink::complete_row(uint32_t index) {
+	level_builder& builder = levels[index];
+	for (uint64_t cell = 0; cell < builder.row.size(); ++cell) {
+		builder.row[cell].mean = builder.weights[cell] > 0.0 ? (float)(builder.sums[cell] / builder.weights[cell]) : 0.0f;
+	}
+	if (fwrite(builder.row.data(), sizeof(pyramid_cell), builder.row.size(), builder.data) != builder.row.size()) {
+		throw std::runtime_error("Failed to write pyramid level " + std::to_string(index));
+	}
+	builder.level.nsamples++;
+	if (index + 1 < levels.size()) {
+		// Completing rows only ever moves up the levels, so this row stays as it is until it is reset
+		add_row(index + 1, builder.row, builder.weights);
+	}
+	std::fill(builder.sums.begin(), builder.sums.end(), 0.0);
+	std::fill(builder.weights.begin(), builder.weights.end(), 0.0);
+	std::fill(builder.row.begin(), builder.row.end(), pyramid_cell{0.0f, std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest()});
+	builder.rows = 0;
+}
+
+/**
+ * @brief Completes the partial rows, and writes the header and the levels up to the first with a single row
+ */
+void pyramid_sink::finish() {
+	scoped_timer timer("pyramid_write");
+	for (uint32_t index = 0; index < levels.size(); ++index) {
+		if (levels[index].rows) {
+			complete_row(index);
+		}
+	}
+	uint32_t n_levels = 0;
+	while (n_levels < levels.size() && levels[n_levels].level.nsamples) {
+		n_levels++;
+		if (levels[n_levels - 1].level.nsamples == 1) {
+			break;
+		}
+	}
+	header.n_levels = n_levels;
+
+	uint64_t offset = aligned(sizeof(pyramid_header) + n_levels * sizeof(pyramid_level));
+	std::vector<pyramid_level> table(n_levels);
+	for (uint32_t index = 0; index < n_levels; ++index) {
+		table[index] = levels[index].level;
+		table[index].offset = offset;
+		offset = aligned(offset + table[index].nsamples * header.nifs * table[index].nchans * sizeof(pyramid_cell));
+	}
+
+	FILE* out = fopen(filename.c_str(), "wb");
+	if (!out) {
+		throw std::runtime_error("Failed to open file for writing: " + filename);
+	}
+	bool ok = fwrite(&header, sizeof(header), 1, out) == 1 &&
+		(!n_levels || fwrite(table.data(), sizeof(pyramid_level), n_levels, out) == n_levels);
+	std::vector<uint8_t> chunk(4 << 20);
+	for (uint32_t index = 0; index < n_levels && ok; ++index) {
+		ok = fseeko(out, (off_t)table[index].offset, SEEK_SET) == 0;
+		FILE* data = levels[index].data;
+		rewind(data);
+		size_t n;
+		while (ok && (n = fread(chunk.data(), 1, chunk.size(), data)) > 0) {
+			ok = fwrite(chunk.data(), 1, n, out) == n;
+		}
+		ok = ok && !ferror(data);
+	}
+	ok = ok && fclose(out) == 0;
+	if (!ok) {
+		throw std::runtime_error("Failed to write pyramid to " + filename);
+	}
+}
+
+/**
+ * @brief Maps a pyramid file and checks that all its levels are in the file
+ */
+pyramid_reader::pyramid_reader(const std::string& filename) {
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0) {
+		throw std::runtime_error("Failed to open pyramid " + filename);
+	}
+	struct stat info;
+	if (fstat(fd, &info) != 0 || (uint64_t)info.st_size < sizeof(pyramid_header)) {
+		::close(fd);
+		throw std::runtime_error("Not a pyramid file: " + filename);
+	}
+	size = (uint64_t)info.st_size;
+	void* mapped = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (mapped == MAP_FAILED) {
+		throw std::runtime_error("Failed to map pyramid " + filename);
+	}
+	data = (const uint8_t*)mapped;
+	file_header = (const pyramid_header*)data;
+	levels = (const pyramid_level*)(data + sizeof(pyramid_header));
+
+	bool valid = std::memcmp(file_header->magic, pyramid_sink::magic, sizeof(pyramid_sink::magic)) == 0 && file_header->version == 1 &&
+		sizeof(pyramid_header) + (uint64_t)file_header->n_levels * sizeof(pyramid_level) <= size;
+	for (uint32_t index = 0; valid && index < file_header->n_levels; ++index) {
+		const pyramid_level& level = levels[index];
+		valid = level.time_factor && level.channel_factor && level.offset <= size &&
+			level.nsamples * file_header->nifs * level.nchans <= (size - level.offset) / sizeof(pyramid_cell);
+	}
+	if (!valid) {
+		munmap((void*)data, size);
+		throw std::runtime_error("Not a valid pyramid file: " + filename);
+	}
+}
+
+pyramid_reader::~pyramid_reader() {
+	munmap((void*)data, size);
+}
+
+/**
+ * @param time_factor the input samples per cell wanted
+ * @param channel_factor the input channels per cell wanted
+ */
+uint32_t pyramid_reader::nearest_level(uint32_t time_factor, uint32_t channel_factor) const {
+	uint32_t nearest = 0;
+	for (uint32_t index = 0; index < level_count(); ++index) {
+		if (levels[index].time_factor <= time_factor && levels[index].channel_factor <= channel_factor) {
+			nearest = index;
+		}
+	}
+	return nearest;
+}
+
+/**
+ * @brief Copies the cells of the nearest level that overlap a range of input samples and channels.
+ * Only the pages of those cells are read from the file.
+ *
+ * @param first_sample the first input sample
+ * @param nsamples the number of input samples
+ * @param first_channel the first input channel
+ * @param nchans the number of input channels
+ * @param time_factor the input samples per cell wanted
+ * @param channel_factor the input channels per cell wanted
+ */
+pyramid_tile pyramid_reader::tile(uint64_t first_sample, uint64_t nsamples, uint32_t first_channel, uint32_t nchans, uint32_t time_factor, uint32_t channel_factor) const {
+	if (!level_count()) {
+		throw std::runtime_error("The pyramid has no levels");
+	}
+	if (!nsamples || !nchans || first_channel >= file_header->nchans) {
+		throw std::runtime_error("The tile is empty or outside the channels of the pyramid");
+	}
+	pyramid_tile result;
+	result.level = nearest_level(time_factor, channel_factor);
+	const pyramid_level& level = levels[result.level];
+	const uint64_t first_row = std::min(first_sample / level.time_factor, level.nsamples);
+	const uint64_t last_row = std::min((first_sample + nsamples + level.time_factor - 1) / level.time_factor, level.nsamples);
+	const uint32_t first_column = first_channel / level.channel_factor;
+	const uint64_t end_channel = std::min<uint64_t>((uint64_t)first_channel + nchans, file_header->nchans);
+	const uint32_t last_column = (uint32_t)((end_channel + level.channel_factor - 1) / level.channel_factor);
+
+	result.time_factor = level.time_factor;
+	result.channel_factor = level.channel_factor;
+	result.first_sample = first_row * level.time_factor;
+	result.first_channel = first_column * level.channel_factor;
+	result.nsamples = (uint32_t)(last_row - first_row);
+	result.nifs = file_header->nifs;
+	result.nchans = last_column - first_column;
+	result.cells.resize((uint64_t)result.nsamples * result.nifs * result.nchans);
+
+	const pyramid_cell* cells = (const pyramid_cell*)(data + level.offset);
+	pyramid_cell* target = result.cells.data();
+	for (uint64_t row = first_row; row < last_row; ++row) {
+		for (uint32_t ifs = 0; ifs < result.nifs; ++ifs) {
+			const pyramid_cell* source = cells + (row * result.nifs + ifs) * level.nchans + first_column;
+			std::copy(source, source + result.nchans, target);
+			target += result.nchans;
+		}
+	}
+	return result;
+}
@@ -0,0 +1,127 @@
+#include "stages.hpp"
+#include <cmath>
+#include <iomanip>
+#include <stdexcept>
+
+/**
+ * @param nbits the number of output bits, 1, 2, 4, 8 or 16
+ * @param clip the number of standard deviations around the mean that is kept
+ * @param window the number of samples the running statistics remember, 0 for the whole observation
+ * @param record_file the file to record the scaling of every block in, empty for none
+ */
+requantize_stage::requantize_stage(int32_t nbits, double clip, uint64_t window, const std::string& record_file) :
+	nbits(nbits), clip(clip), window(window), record_file(record_file) {
+}
+
+/**
+ * @brief Checks the options, sets the output bits and starts the scaling record
+ */
+void requantize_stage::configure(std::map<std::string, header_param>& header) {
+	if (!filterbank::supported_bits(nbits) || nbits == 32) {
+		throw std::runtime_error("Invalid number of requantized bits: supported formats are 1/2/4/8/16 bits");
+	}
+	if (!(clip > 0.0)) {
+		throw std::runtime_error("The clipping level must be positive");
+	}
+
+	values = (uint64_t)header["nifs"].val.i * header["nchans"].val.i;
+	count = 0;
+	mean.assign(values, 0.0);
+	m2.assign(values, 0.0);
+	block_mean.assign(values, 0.0);
+	block_m2.assign(values, 0.0);
+	offset.assign(values, 0.0f);
+	scale.assign(values, 1.0f);
+	inverse.assign(values, 1.0f);
+	header["nbits"].val.i = nbits;
+
+	if (!record_file.empty()) {
+		record.open(record_file);
+		if (!record.good()) {
+			throw std::runtime_error("Failed to open scaling record: " + record_file);
+		}
+		record << "# requantize nbits " << nbits << " clip " << clip << " nifs " << header["nifs"].val.i
+			<< " nchans " << header["nchans"].val.i << "\n"
+			<< "# per block: first_sample nsamples, then a line of offsets and a line of scales per (IF, channel)\n"
+			<< "# value = offset + level * scale\n";
+		record << std::setprecision(9);
+	}
+}
+
+/**
+ * @brief Adds the block to the running mean and variance of every (IF, channel).
+ * The block is reduced with Welford's method and merged with the running values, which
+ * remember at most window samples.
+ */
+void requantize_stage::update_statistics(const block& input) {
+	std::fill(block_mean.begin(), block_mean.end(), 0.0);
+	std::fill(block_m2.begin(), block_m2.end(), 0.0);
+	for (uint32_t sample = 0; sample < input.nsamples; ++sample) {
+		const float* spectrum = &input.data[sample * values];
+		double weight = 1.0 / (sample + 1);
+		for (uint64_t value = 0; value < values; ++value) {
+			double delta = spectrum[value] - block_mean[value];
+			block_mean[value] += delta * weight;
+			block_m2[value] += delta * (spectrum[value] - block_mean[value]);
+		}
+	}
+
+	double kept = (double)count;
+	if (window && count > window) {
+		kept = (double)window;
+	}
+	double total = kept + input.nsamples;
+	for (uint64_t value = 0; value < values; ++value) {
+		double delta = block_mean[value] - mean[value];
+		double old_m2 = count ? m2[value] * kept / count : 0.0;
+		m2[value] = old_m2 + block_m2[value] + delta * delta * kept * input.nsamples / total;
+		mean[value] += delta * input.nsamples / total;
+	}
+	count = (uint64_t)total;
+}
+
+/**
+ * @brief Maps mean - clip * sigma .. mean + clip * sigma of every (IF, channel) onto the output levels
+ */
+void requantize_stage::process(block_ptr input, const emitter& emit) {
+	if (!input->nsamples) {
+		emit(std::move(input));
+		return;
+	}
+	update_statistics(*input);
+
+	const float levels = (float)((1u << nbits) - 1);
+	for (uint64_t value = 0; value < values; ++value) {
+		double sigma = count > 1 ? std::sqrt(m2[value] / (count - 1)) : 0.0;
+		if (!(sigma > 0.0)) {
+			sigma = 1.0;
+		}
+		offset[value] = (float)(mean[value] - clip * sigma);
+		scale[value] = (float)(2.0 * clip * sigma / levels);
+		inverse[value] = 1.0f / scale[value];
+	}
+
+	for (uint32_t sample = 0; sample < input->nsamples; ++sample) {
+		float* spectrum = &input->data[sample * values];
+		for (uint64_t value = 0; value < values; ++value) {
+			float level = std::floor((spectrum[value] - offset[value]) * inverse[value] + 0.5f);
+			spectrum[value] = std::min(levels, std::max(0.0f, level));
+		}
+	}
+
+	if (record.is_open()) {
+		record << input->first_sample << " " << input->nsamples << "\n";
+		for (uint64_t value = 0; value < values; ++value) {
+			record << (value ? " " : "") << offset[value];
+		}
+		record << "\n";
+		for (uint64_t value = 0; value < values; ++value) {
+			record << (value ? " " : "") << scale[value];
+		}
+		record << "\n";
+		if (!record.good()) {
+			throw std::runtime_error("Failed to write scaling record: " + record_file);
+		}
+	}
+	emit(std::move(input));
+}
@@ -0,0 +1,203 @@
+#include "stages.hpp"
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+	/**
+	 * @brief The median and the standard deviation estimated from the median absolute deviation
+	 */
+	void robust_statistics(std::vector<double>& values, double& median, double& sigma) {
+		median = sigma = 0.0;
+		if (values.empty()) {
+			return;
+		}
+		size_t middle = values.size() / 2;
+		std::nth_element(values.begin(), values.begin() + middle, values.end());
+		median = values[middle];
+		for (double& value : values) {
+			value = std::fabs(value - median);
+		}
+		std::nth_element(values.begin(), values.begin() + middle, values.end());
+		sigma = 1.4826 * values[middle];
+	}
+}
+
+/**
+ * @param options the masks, thresholds and replacement to use
+ */
+rfi_stage::rfi_stage(const rfi_options& options) : options(options), pool(default_threads(options.threads)) {
+}
+
+void rfi_stage::configure(std::map<std::string, header_param>& header) {
+	nifs = header["nifs"].val.i;
+	nchans = header["nchans"].val.i;
+	values = (uint64_t)nifs * nchans;
+
+	static_mask.assign(values, 0);
+	for (uint32_t channel : options.channels) {
+		if (channel >= nchans) {
+			throw std::runtime_error("Masked channel " + std::to_string(channel + 1) + " does not exist");
+		}
+		for (uint32_t interface = 0; interface < nifs; ++interface) {
+			static_mask[(uint64_t)interface * nchans + channel] = 1;
+		}
+	}
+	bad.assign(values, 0);
+	mean.assign(values, 0.0);
+	m2.assign(values, 0.0);
+	kurtosis.assign(values, 0.0);
+	clean_mean.assign(values, 0.0);
+	clean_blocks.assign(values, 0);
+	replacement.assign(values, 0.0f);
+	inverse_sigma.assign(values, 0.0);
+	limit.assign(values, INFINITY);
+	scratch.reserve(values);
+}
+
+/**
+ * @brief Welford mean and variance and the spectral kurtosis of every (IF, channel) over the block,
+ * with the channels split over the threads
+ */
+void rfi_stage::block_statistics(const block& input) {
+	const uint32_t nsamples = input.nsamples;
+	parallel_for(pool, values, 256, [&](uint64_t begin, uint64_t end) {
+		std::fill(mean.begin() + begin, mean.begin() + end, 0.0);
+		std::fill(m2.begin() + begin, m2.begin() + end, 0.0);
+		for (uint32_t sample = 0; sample < nsamples; ++sample) {
+			const float* spectrum = &input.data[sample * values];
+			double weight = 1.0 / (sample + 1);
+			for (uint64_t value = begin; value < end; ++value) {
+				double delta = spectrum[value] - mean[value];
+				mean[value] += delta * weight;
+				m2[value] += delta * (spectrum[value] - mean[value]);
+			}
+		}
+		// SK = (M + 1) / (M - 1) * (M * S2 / S1^2 - 1), written in terms of the Welford sums
+		for (uint64_t value = begin; value < end; ++value) {
+			kurtosis[value] = (nsamples > 1 && mean[value] != 0.0) ?
+				(nsamples + 1.0) / (nsamples - 1.0) * m2[value] / (nsamples * mean[value] * mean[value]) : NAN;
+		}
+	});
+}
+
+/**
+ * @brief Flags the channels whose spectral kurtosis is an outlier among the channels of this block.
+ * Impulsive RFI raises the kurtosis, persistent narrow band signals lower it.
+ */
+void rfi_stage::flag_channels(uint32_t nsamples) {
+	bad = static_mask;
+	if (!options.kurtosis || nsamples < 2) {
+		return;
+	}
+
+	scratch.clear();
+	for (uint64_t value = 0; value < values; ++value) {
+		if (!bad[value] && std::isfinite(kurtosis[value])) {
+			scratch.push_back(kurtosis[value]);
+		}
+	}
+	double median, sigma;
+	robust_statistics(scratch, median, sigma);
+	if (!(sigma > 0.0)) {
+		return;
+	}
+	for (uint64_t value = 0; value < values; ++value) {
+		if (std::isfinite(kurtosis[value]) && std::fabs(kurtosis[value] - median) > options.kurtosis * sigma) {
+			bad[value] = 1;
+		}
+	}
+}
+
+/**
+ * @brief Flags the spectra whose average over the good channels, normalized per channel, is an outlier
+ * among the spectra of this block. This catches broad band bursts that last a few samples.
+ */
+void rfi_stage::flag_spectra(const block& input) {
+	bad_spectra.assign(input.nsamples, 0);
+	if (!options.zap || input.nsamples < 2) {
+		return;
+	}
+
+	uint64_t n_good = 0;
+	for (uint64_t value = 0; value < values; ++value) {
+		double variance = m2[value] / (input.nsamples - 1);
+		inverse_sigma[value] = 0.0;
+		if (!bad[value] && variance > 0.0) {
+			inverse_sigma[value] = 1.0 / std::sqrt(variance);
+			n_good++;
+		}
+	}
+	if (!n_good) {
+		return;
+	}
+
+	deviation.assign(input.nsamples, 0.0);
+	double norm = 1.0 / std::sqrt((double)n_good);
+	parallel_for(pool, input.nsamples, 64, [&](uint64_t begin, uint64_t end) {
+		for (uint64_t sample = begin; sample < end; ++sample) {
+			const float* spectrum = &input.data[sample * values];
+			double sum = 0.0;
+			for (uint64_t value = 0; value < values; ++value) {
+				sum += (spectrum[value] - mean[value]) * inverse_sigma[value];
+			}
+			deviation[sample] = sum * norm;
+		}
+	});
+
+	scratch.assign(deviation.begin(), deviation.end());
+	double median, sigma;
+	robust_statistics(scratch, median, sigma);
+	if (!(sigma > 0.0)) {
+		return;
+	}
+	for (uint32_t sample = 0; sample < input.nsamples; ++sample) {
+		bad_spectra[sample] = std::fabs(deviation[sample] - median) > options.zap * sigma;
+	}
+}
+
+/**
+ * @brief Flags and replaces the bad data of the block in place
+ */
+void rfi_stage::process(block_ptr input, const emitter& emit) {
+	if (!input->nsamples) {
+		emit(std::move(input));
+		return;
+	}
+	block_statistics(*input);
+	flag_channels(input->nsamples);
+	flag_spectra(*input);
+
+	// Flagged data is replaced by the mean of the channel while it was clean
+	for (uint64_t value = 0; value < values; ++value) {
+		if (!bad[value]) {
+			clean_blocks[value]++;
+			clean_mean[value] += (mean[value] - clean_mean[value]) / clean_blocks[value];
+		}
+		if (options.zero) {
+			replacement[value] = 0.0f;
+		} else {
+			replacement[value] = (float)(clean_blocks[value] ? clean_mean[value] : mean[value]);
+		}
+	}
+
+	const uint32_t nsamples = input->nsamples;
+	float* data = input->data.data();
+	parallel_for(pool, values, 256, [&](uint64_t begin, uint64_t end) {
+		for (uint64_t value = begin; value < end; ++value) {
+			limit[value] = (options.clip && nsamples > 1) ? (float)(options.clip * std::sqrt(m2[value] / (nsamples - 1))) : INFINITY;
+		}
+		for (uint32_t sample = 0; sample < nsamples; ++sample) {
+			float* spectrum = &data[sample * values];
+			if (bad_spectra[sample]) {
+				std::copy(replacement.begin() + begin, replacement.begin() + end, spectrum + begin);
+				continue;
+			}
+			for (uint64_t value = begin; value < end; ++value) {
+				if (bad[value] || std::fabs(spectrum[value] - (float)mean[value]) > limit[value]) {
+					spectrum[value] = replacement[value];
+				}
+			}
+		}
+	});
+	emit(std::move(input));
+}
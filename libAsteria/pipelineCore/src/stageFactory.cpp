@@ -0,0 +1,228 @@
+#include "stages.hpp"
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+	/**
+	 * @brief Gets the value following an option, e.g. the 4 in -t 4
+	 */
+	const std::string& option_value(const std::vector<std::string>& tokens, size_t& index) {
+		if (index + 1 >= tokens.size()) {
+			throw std::runtime_error("Missing value for " + tokens[index] + " in stage " + tokens[0]);
+		}
+		return tokens[++index];
+	}
+
+	uint32_t to_unsigned(const std::string& value) {
+		size_t end = 0;
+		long long number = -1;
+		try {
+			number = std::stoll(value, &end);
+		} catch (const std::exception&) {
+		}
+		if (number < 0 || end != value.size()) {
+			throw std::runtime_error("Invalid non negative number: " + value);
+		}
+		return (uint32_t)number;
+	}
+
+	double to_double(const std::string& value) {
+		size_t end = 0;
+		double number = 0;
+		try {
+			number = std::stod(value, &end);
+		} catch (const std::exception&) {
+			end = 0;
+		}
+		if (end != value.size() || value.empty()) {
+			throw std::runtime_error("Invalid number: " + value);
+		}
+		return number;
+	}
+}
+
+/**
+ * @brief Creates a stage from a specification that uses the options of the matching tool, e.g.
+ * "decimate -t 4 -c 2", "mask -i ignore.txt", "rfi -k 3 -z 5", "dedisperse -d 56.7 -b 4"
+ * "requantize -n 4 -s 2.5" or "fold -p 33.1 -n 64 -t 10"
+ * 
+ * @param specification the stage name followed by its options
+ * @return the stage
+ */
+std::unique_ptr<stage> make_stage(const std::string& specification) {
+	std::istringstream stream(specification);
+	std::vector<std::string> tokens;
+	std::string token;
+	while (stream >> token) {
+		tokens.push_back(token);
+	}
+	if (tokens.empty()) {
+		throw std::runtime_error("Empty stage in pipeline");
+	}
+
+	const std::string& name = tokens[0];
+	if (name == "decimate") {
+		uint32_t samples = 1;
+		uint32_t channels = 0;
+		for (size_t i = 1; i < tokens.size(); ++i) {
+			if (tokens[i] == "-t") {
+				samples = to_unsigned(option_value(tokens, i));
+			} else if (tokens[i] == "-c") {
+				channels = to_unsigned(option_value(tokens, i));
+			} else {
+				throw std::runtime_error("Unknown option for decimate: " + tokens[i]);
+			}
+		}
+		return std::unique_ptr<stage>(new decimate_stage(samples, channels));
+	}
+	if (name == "mask") {
+		std::vector<uint32_t> channels;
+		for (size_t i = 1; i < tokens.size(); ++i) {
+			if (tokens[i] == "-i") {
+				std::vector<uint32_t> listed = mask_stage::read_channel_list(option_value(tokens, i));
+				channels.insert(channels.end(), listed.begin(), listed.end());
+			} else {
+				throw std::runtime_error("Unknown option for mask: " + tokens[i]);
+			}
+		}
+		return std::unique_ptr<stage>(new mask_stage(channels));
+	}
+	if (name == "dedisperse") {
+		double dm = 0.0;
+		uint32_t bands = 1;
+		double reference = 0.0;
+		for (size_t i = 1; i < tokens.size(); ++i) {
+			if (tokens[i] == "-d") {
+				dm = to_double(option_value(tokens, i));
+			} else if (tokens[i] == "-b") {
+				bands = to_unsigned(option_value(tokens, i));
+			} else if (tokens[i] == "-f") {
+				reference = to_double(option_value(tokens, i));
+			} else {
+				throw std::runtime_error("Unknown option for dedisperse: " + tokens[i]);
+			}
+		}
+		return std::unique_ptr<stage>(new dedisperse_stage(dm, bands, reference));
+	}
+	if (name == "rfi") {
+		rfi_options options;
+		for (size_t i = 1; i < tokens.size(); ++i) {
+			if (tokens[i] == "-i") {
+				std::vector<uint32_t> listed = mask_stage::read_channel_list(option_value(tokens, i));
+				options.channels.insert(options.channels.end(), listed.begin(), listed.end());
+			} else if (tokens[i] == "-k") {
+				options.kurtosis = to_double(option_value(tokens, i));
+			} else if (tokens[i] == "-z") {
+				options.zap = to_double(option_value(tokens, i));
+			} else if (tokens[i] == "-c") {
+				options.clip = to_double(option_value(tokens, i));
+			} else if (tokens[i] == "-Z") {
+				options.zero = true;
+			} else if (tokens[i] == "-j") {
+				options.threads = to_unsigned(option_value(tokens, i));
+			} else {
+				throw std::runtime_error("Unknown option for rfi: " + tokens[i]);
+			}
+		}
+		return std::unique_ptr<stage>(new rfi_stage(options));
+	}
+	if (name == "zerodm") {
+		uint32_t threads = 0;
+		for (size_t i = 1; i < tokens.size(); ++i) {
+			if (tokens[i] == "-j") {
+				threads = to_unsigned(option_value(tokens, i));
+			} else {
+				throw std::runtime_error("Unknown option for zerodm: " + tokens[i]);
+			}
+		}
+		return std::unique_ptr<stage>(new zero_dm_stage(threads));
+	}
+	if (name == "baseline") {
+		baseline_stage::mode type = baseline_stage::MEAN;
+		uint32_t window = 0;
+		uint32_t threads = 0;
+		for (size_t i = 1; i < tokens.size(); ++i) {
+			if (tokens[i] == "-m") {
+				const std::string& value = option_value(tokens, i);
+				if (value == "mean") {
+					type = baseline_stage::MEAN;
+				} else if (value == "median") {
+					type = baseline_stage::MEDIAN;
+				} else {
+					throw std::runtime_error("Unknown baseline mode: " + value);
+				}
+			} else if (tokens[i] == "-w") {
+				window = to_unsigned(option_value(tokens, i));
+			} else if (tokens[i] == "-j") {
+				threads = to_unsigned(option_value(tokens, i));
+			} else {
+				throw std::runtime_error("Unknown option for baseline: " + tokens[i]);
+			}
+		}
+		return std::unique_ptr<stage>(new baseline_stage(type, window, threads));
+	}
+	if (name == "requantize") {
+		uint32_t bits = 8;
+		double clip = 3.0;
+		uint32_t window = 0;
+		std::string record_file;
+		for (size_t i = 1; i < tokens.size(); ++i) {
+			if (tokens[i] == "-n") {
+				bits = to_unsigned(option_value(tokens, i));
+			} else if (tokens[i] == "-s") {
+				clip = to_double(option_value(tokens, i));
+			} else if (tokens[i] == "-w") {
+				window = to_unsigned(option_value(tokens, i));
+			} else if (tokens[i] == "-r") {
+				record_file = option_value(tokens, i);
+			} else {
+				throw std::runtime_error("Unknown option for requantize: " + tokens[i]);
+			}
+		}
+		return std::unique_ptr<stage>(new requantize_stage(bits, clip, window, record_file));
+	}
+	if (name == "fold") {
+		fold_options options;
+		for (size_t i = 1; i < tokens.size(); ++i) {
+			if (tokens[i] == "-p") {
+				options.period = to_double(option_value(tokens, i)) * 1.0e-3;
+			} else if (tokens[i] == "-P") {
+				options.polyco_file = option_value(tokens, i);
+			} else if (tokens[i] == "-n") {
+				options.nbins = to_unsigned(option_value(tokens, i));
+			} else if (tokens[i] == "-b") {
+				options.n_bands = to_unsigned(option_value(tokens, i));
+			} else if (tokens[i] == "-t") {
+				options.subint = to_double(option_value(tokens, i));
+			} else if (tokens[i] == "-d") {
+				options.dispersion_measure = to_double(option_value(tokens, i));
+			} else if (tokens[i] == "-j") {
+				options.threads = to_unsigned(option_value(tokens, i));
+			} else {
+				throw std::runtime_error("Unknown option for fold: " + tokens[i]);
+			}
+		}
+		return std::unique_ptr<stage>(new fold_stage(options));
+	}
+	throw std::runtime_error("Unknown stage: " + name);
+}
+
+/**
+ * @brief Creates the stages of a chain separated by |, e.g. "decimate -t 2 | dedisperse -d 30"
+ * 
+ * @param chain the chain of stage specifications
+ * @return the stages in order
+ */
+std::vector<std::unique_ptr<stage>> make_stages(const std::string& chain) {
+	std::vector<std::unique_ptr<stage>> stages;
+	size_t start = 0;
+	while (start <= chain.size()) {
+		size_t end = chain.find('|', start);
+		if (end == std::string::npos) {
+			end = chain.size();
+		}
+		stages.push_back(make_stage(chain.substr(start, end - start)));
+		start = end + 1;
+	}
+	return stages;
+}
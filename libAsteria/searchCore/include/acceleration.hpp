@@ -0,0 +1,40 @@
+#ifndef ACCELERATION_H
+#define ACCELERATION_H
+
+#include <complex>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "fft.hpp"
+
+/**
+ * @brief Matched filters for the Fourier response of a signal whose frequency drifts linearly by z bins
+ * over the observation, for z from -zmax to zmax in steps of z_step. The filters are stored transformed,
+ * ready for overlap-save correlation with segments of fft_length bins of a spectrum, of which valid
+ * bins are complete. A set is read only, get() keeps one per zmax, and with it per FFT length, for the
+ * whole process.
+ */
+class acceleration_templates {
+public:
+	static const uint32_t z_step = 2;
+	// Bins the response is kept beyond the drift of the signal on either side
+	static const int32_t response_margin = 8;
+
+	explicit acceleration_templates(uint32_t zmax);
+	static std::shared_ptr<const acceleration_templates> get(uint32_t zmax);
+	// The response at integer bin offsets -half_width .. half_width from the mean frequency
+	static std::vector<std::complex<float>> response(double z, int32_t half_width);
+
+	double z_of(uint32_t row) const { return ((double)row - zmax / z_step) * z_step; };
+
+	uint32_t zmax;
+	int32_t half_width = 0;
+	uint32_t n_z = 0;
+	uint64_t fft_length = 0;
+	uint64_t valid = 0;
+	std::shared_ptr<const fft_plan> plan; // complex transforms of fft_length values
+	// n_z rows of fft_length values: the conjugate transform of the normalized response, divided by fft_length
+	std::vector<std::complex<float>> filters;
+};
+
+#endif // !ACCELERATION_H
@@ -0,0 +1,35 @@
+#ifndef FFT_H
+#define FFT_H
+
+#include <complex>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/**
+ * @brief Precomputed tables for the forward FFT of real data of a power of two length.
+ * A plan is read only once created, so one plan can be shared by any number of threads,
+ * each bringing its own buffers. get() keeps one plan per length for the whole process.
+ */
+class fft_plan {
+public:
+	explicit fft_plan(uint64_t n);
+	static std::shared_ptr<const fft_plan> get(uint64_t n);
+	static uint64_t next_power_of_two(uint64_t n);
+
+	// Transforms n real values into n / 2 + 1 complex amplitudes, the input is used as scratch space
+	void real_forward(float* data, std::complex<float>* spectrum) const;
+	// In place forward transform of n / 2 complex values
+	void complex_forward(std::complex<float>* data) const;
+
+	uint64_t size() const { return n; };
+
+private:
+	uint64_t n;
+	uint64_t half;
+	std::vector<uint32_t> swaps; // pairs of indices below half that are each other's bit reversal
+	std::vector<std::complex<float>> stage_twiddles; // exp(-2 pi i k / length) for every stage length, consecutively
+	std::vector<std::complex<float>> real_twiddles; // exp(-2 pi i k / n) for k below half
+};
+
+#endif // !FFT_H
@@ -0,0 +1,85 @@
+#ifndef PERIODICITY_H
+#define PERIODICITY_H
+
+#include <complex>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "acceleration.hpp"
+#include "fft.hpp"
+
+/**
+ * @brief Settings of the periodicity search
+ */
+struct periodicity_options {
+	uint32_t harmonics = 16; // the most harmonics summed, a power of two up to 32
+	double threshold = 6.0; // minimum significance of a candidate in gaussian sigmas
+	double min_frequency = 0.1; // Hz
+	double max_frequency = 0.0; // Hz, 0 for the Nyquist frequency
+	uint32_t max_candidates = 100; // per time series, 0 for all
+	bool whiten = true; // normalize the spectrum by its local median instead of its global median
+	uint32_t zmax = 0; // largest frequency drift in bins of the acceleration search, 0 for no acceleration search
+};
+
+/**
+ * @brief A peak in the power spectrum, or in one of its harmonic sums
+ */
+struct periodicity_candidate {
+	double dm = 0.0;
+	double frequency = 0.0; // of the fundamental, in Hz
+	double fdot = 0.0; // frequency derivative of the fundamental, in Hz/s
+	double acceleration = 0.0; // line of sight acceleration, in m/s^2
+	double power = 0.0; // the sum of the normalized powers of the harmonics
+	double sigma = 0.0; // gaussian equivalent significance of the power, for a single bin
+	uint32_t harmonics = 1;
+	uint64_t bin = 0; // frequency bin of the highest summed harmonic
+	uint32_t trial = 0; // index of the time series the candidate was found in
+	uint32_t members = 1; // the number of detections merged into this one by sifting
+	double dm_low = 0.0; // the range of dms of the merged detections
+	double dm_high = 0.0;
+};
+
+/**
+ * @brief FFT periodicity search of a time series: the power spectrum is normalized by its running median,
+ * which removes red noise, and then summed incoherently over 1, 2, 4, ... harmonics. Local maxima of every
+ * sum above the threshold become candidates. With a zmax the spectrum is instead correlated with the
+ * response of signals whose frequency drifts, and the harmonics are summed over frequency and drift.
+ * An instance keeps its buffers between searches and shares the FFT plans and templates with all other
+ * instances, so every thread should use its own instance.
+ */
+class periodicity_search {
+public:
+	explicit periodicity_search(const periodicity_options& options);
+
+	// Searches a time series, padded with its mean to a power of two, the candidates are sorted by significance
+	std::vector<periodicity_candidate> search(const float* series, uint64_t nsamples, double tsamp, double dm = 0.0);
+	// The normalized powers of the last search, from 0 to the Nyquist frequency
+	const std::vector<float>& spectrum() const { return powers; };
+
+	static double equivalent_sigma(double power, uint32_t harmonics);
+
+private:
+	void power_spectrum(const float* series, uint64_t nsamples);
+	void normalize();
+	void find_peaks(uint32_t harmonics, double length, double dm, std::vector<periodicity_candidate>& candidates);
+	double threshold_power(uint32_t harmonics) const;
+	void accelerated_search(double length, double dm, std::vector<periodicity_candidate>& candidates);
+	void correlate(uint64_t first, uint64_t count, uint32_t first_row, uint32_t n_rows, std::vector<float>& plane);
+
+	periodicity_options options;
+	std::shared_ptr<const fft_plan> plan;
+	std::vector<float> padded;
+	std::vector<std::complex<float>> amplitudes;
+	std::vector<float> powers;
+	std::vector<float> summed;
+	std::vector<float> scratch;
+
+	// acceleration search: the templates, a segment of the spectrum and the powers per harmonic fraction
+	std::shared_ptr<const acceleration_templates> templates;
+	std::vector<std::complex<float>> segment;
+	std::vector<std::complex<float>> product;
+	std::vector<std::vector<float>> planes;
+	std::vector<float> plane_sums;
+};
+
+#endif // !PERIODICITY_H
@@ -0,0 +1,52 @@
+#ifndef SIFT_H
+#define SIFT_H
+
+#include <cstdint>
+#include <vector>
+#include "periodicity.hpp"
+
+/**
+ * @brief A single pulse detection, e.g. a boxcar peak in a dedispersed time series
+ */
+struct single_pulse_candidate {
+	double dm = 0.0;
+	double time = 0.0; // seconds from the start of the observation
+	double width = 0.0; // seconds
+	double sigma = 0.0;
+	uint64_t sample = 0;
+	uint32_t members = 1; // the number of detections merged into this one
+	double dm_low = 0.0; // the range of dms of the merged detections
+	double dm_high = 0.0;
+};
+
+/**
+ * @brief Linking lengths of the sifting, 0 for a value derived from the detections
+ */
+struct sift_options {
+	double dm_tolerance = 0.0; // pc/cc, def 1.5 times the median step between the dm trials
+	double time_tolerance = 0.0; // seconds, def 2 times the median pulse width
+	double width_factor = 2.0; // pulse widths within this factor are linked
+	double frequency_tolerance = 1.5; // Fourier bins
+	uint32_t max_harmonic = 16; // candidates at n / m times a stronger one, n and m up to this, are harmonics
+	bool merge_harmonics = true;
+};
+
+/**
+ * @brief Groups detections of the same event and keeps the strongest detection of every group.
+ * Detections are linked when they are within the linking length in every dimension, and groups are
+ * everything that is linked directly or through other detections (friends of friends). Detections are
+ * found through a grid of cells the size of the linking lengths: all detections in a cell are linked,
+ * and only the neighbouring cells need to be compared.
+ */
+class candidate_sifter {
+public:
+	// Labels the groups of points given as dims coordinates each, already divided by their linking lengths
+	static std::vector<uint32_t> cluster(const std::vector<double>& coordinates, uint32_t dims);
+
+	static std::vector<single_pulse_candidate> sift(const std::vector<single_pulse_candidate>& detections, sift_options options);
+	static std::vector<periodicity_candidate> sift(const std::vector<periodicity_candidate>& detections, sift_options options);
+
+	static double dm_step(std::vector<double> dms);
+};
+
+#endif // !SIFT_H
@@ -0,0 +1,254 @@
+#include "acceleration.hpp"
+#include "periodicity.hpp"
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include "stats.hpp"
+
+namespace {
+	const double speed_of_light = 299792458.0;
+	// Blocks of the acceleration search span this many correlation segments of the highest harmonic
+	const uint64_t segments_per_block = 8;
+
+	/**
+	 * @brief Rounds numerator / denominator to the nearest integer, halves away from zero
+	 */
+	inline int64_t rounded_ratio(int64_t numerator, int64_t denominator) {
+		return numerator >= 0 ? (numerator + denominator / 2) / denominator : -((-numerator + denominator / 2) / denominator);
+	}
+}
+
+/**
+ * @param zmax the largest drift in bins, rounded up to a multiple of z_step
+ */
+acceleration_templates::acceleration_templates(uint32_t zmax) : zmax((zmax + z_step - 1) / z_step * z_step) {
+	half_width = (int32_t)(this->zmax / 2) + response_margin;
+	n_z = 2 * (this->zmax / z_step) + 1;
+	const uint64_t width = 2 * (uint64_t)half_width + 1;
+	fft_length = fft_plan::next_power_of_two(4 * width);
+	valid = fft_length - width + 1;
+	// A real plan of twice the length transforms fft_length complex values
+	plan = fft_plan::get(2 * fft_length);
+
+	filters.assign((uint64_t)n_z * fft_length, std::complex<float>(0.0f, 0.0f));
+	for (uint32_t row = 0; row < n_z; ++row) {
+		std::vector<std::complex<float>> kernel = response(z_of(row), half_width);
+		double norm = 0.0;
+		for (const std::complex<float>& value : kernel) {
+			norm += std::norm(value);
+		}
+		const float scale = (float)(1.0 / std::sqrt(norm));
+		std::complex<float>* filter = &filters[(uint64_t)row * fft_length];
+		for (uint64_t index = 0; index < width; ++index) {
+			filter[index] = kernel[index] * scale;
+		}
+		plan->complex_forward(filter);
+		for (uint64_t index = 0; index < fft_length; ++index) {
+			filter[index] = std::conj(filter[index]) / (float)fft_length;
+		}
+	}
+}
+
+/**
+ * @brief The shared templates for a zmax, created on first use
+ */
+std::shared_ptr<const acceleration_templates> acceleration_templates::get(uint32_t zmax) {
+	static std::mutex lock;
+	static std::map<uint32_t, std::shared_ptr<const acceleration_templates>> sets;
+	std::lock_guard<std::mutex> guard(lock);
+	auto found = sets.find(zmax);
+	if (found != sets.end()) {
+		return found->second;
+	}
+	scoped_timer timer("templates");
+	std::shared_ptr<const acceleration_templates> set(new acceleration_templates(zmax));
+	sets[zmax] = set;
+	return set;
+}
+
+/**
+ * @brief The Fourier response R(q) = integral over t in [0, 1] of exp(2 pi i ((-z / 2 - q) t + z t^2 / 2)),
+ * of a signal whose frequency drifts from z / 2 bins below to z / 2 bins above its mean. The integral is
+ * taken for all q at once as the FFT of the finely sampled chirp.
+ *
+ * @param z the drift in bins over the observation
+ * @param half_width the largest offset q from the mean frequency
+ * @return the response at q = -half_width .. half_width
+ */
+std::vector<std::complex<float>> acceleration_templates::response(double z, int32_t half_width) {
+	const uint64_t width = 2 * (uint64_t)half_width + 1;
+	const uint64_t n = fft_plan::next_power_of_two(16 * width);
+	const double two_pi = 2.0 * std::acos(-1.0);
+	std::vector<std::complex<float>> chirp(n);
+	for (uint64_t k = 0; k < n; ++k) {
+		double t = (k + 0.5) / n;
+		double phase = two_pi * (-0.5 * z * t + 0.5 * z * t * t);
+		chirp[k] = std::complex<float>((float)std::cos(phase), (float)std::sin(phase));
+	}
+	fft_plan::get(2 * n)->complex_forward(chirp.data());
+
+	// Sampling at the middle of the n intervals shifts the phase of bin q by -pi q / n
+	std::vector<std::complex<float>> result(width);
+	for (int32_t q = -half_width; q <= half_width; ++q) {
+		double shift = -two_pi * 0.5 * q / n;
+		std::complex<double> value(chirp[(uint64_t)((q + (int64_t)n) % (int64_t)n)]);
+		value *= std::complex<double>(std::cos(shift), std::sin(shift)) / (double)n;
+		result[q + half_width] = std::complex<float>(value);
+	}
+	return result;
+}
+
+/**
+ * @brief Correlates the normalized spectrum with the templates of a range of rows by overlap-save: every
+ * segment of the spectrum is transformed once and multiplied with each template, the inverse transform
+ * gives valid correlated bins per segment.
+ *
+ * @param first the first output bin
+ * @param count the number of output bins
+ * @param first_row the first template row
+ * @param n_rows the number of template rows
+ * @param plane set to n_rows rows of count powers
+ */
+void periodicity_search::correlate(uint64_t first, uint64_t count, uint32_t first_row, uint32_t n_rows, std::vector<float>& plane) {
+	const uint64_t length = templates->fft_length;
+	const int64_t n_bins = (int64_t)amplitudes.size();
+	plane.resize((uint64_t)n_rows * count);
+	segment.resize(length);
+	product.resize(length);
+
+	for (uint64_t out = first; out < first + count; out += templates->valid) {
+		const int64_t start = (int64_t)out - templates->half_width;
+		for (uint64_t index = 0; index < length; ++index) {
+			int64_t bin = start + (int64_t)index;
+			segment[index] = (bin >= 0 && bin < n_bins) ? amplitudes[bin] : std::complex<float>(0.0f, 0.0f);
+		}
+		templates->plan->complex_forward(segment.data());
+
+		const uint64_t n_out = std::min(templates->valid, first + count - out);
+		for (uint32_t row = 0; row < n_rows; ++row) {
+			const std::complex<float>* filter = &templates->filters[(uint64_t)(first_row + row) * length];
+			const float* a = reinterpret_cast<const float*>(segment.data());
+			const float* b = reinterpret_cast<const float*>(filter);
+			float* c = reinterpret_cast<float*>(product.data());
+			// The inverse transform is the conjugate of the forward transform of the conjugate, and only
+			// powers are kept, so the product is conjugated and transformed forward
+			for (uint64_t index = 0; index < length; ++index) {
+				float re = a[2 * index] * b[2 * index] - a[2 * index + 1] * b[2 * index + 1];
+				float im = a[2 * index] * b[2 * index + 1] + a[2 * index + 1] * b[2 * index];
+				c[2 * index] = re;
+				c[2 * index + 1] = -im;
+			}
+			templates->plan->complex_forward(product.data());
+			float* powers_out = &plane[(uint64_t)row * count + (out - first)];
+			for (uint64_t index = 0; index < n_out; ++index) {
+				powers_out[index] = c[2 * index] * c[2 * index] + c[2 * index + 1] * c[2 * index + 1];
+			}
+		}
+	}
+}
+
+/**
+ * @brief Searches the frequency and drift plane block by block, so memory does not grow with the length of
+ * the spectrum. A block covers a range of bins of the highest harmonic, harmonic j of h is read from the
+ * plane of fraction j / h of the bins and drift, which is correlated for every block separately.
+ *
+ * @param length the length of the transformed series in seconds
+ */
+void periodicity_search::accelerated_search(double length, double dm, std::vector<periodicity_candidate>& candidates) {
+	scoped_timer timer("accelerate");
+	if (!templates || templates->zmax != (options.zmax + acceleration_templates::z_step - 1) / acceleration_templates::z_step * acceleration_templates::z_step) {
+		templates = acceleration_templates::get(options.zmax);
+	}
+	amplitudes[0] = std::complex<float>(0.0f, 0.0f);
+
+	const uint32_t most = options.harmonics;
+	const uint32_t n_z = templates->n_z;
+	const int64_t centre = n_z / 2;
+	const uint64_t n_bins = amplitudes.size();
+	const uint64_t block = templates->valid * segments_per_block;
+	std::vector<double> thresholds(most + 1, 0.0);
+	for (uint32_t harmonics = 1; harmonics <= most; harmonics <<= 1) {
+		thresholds[harmonics] = threshold_power(harmonics);
+	}
+
+	planes.resize(most + 1);
+	std::vector<uint64_t> plane_first(most + 1);
+	std::vector<int64_t> plane_rows(most + 1);
+	std::vector<uint32_t> columns;
+	std::vector<uint32_t> rows(n_z);
+	std::vector<float> best;
+	std::vector<uint32_t> best_row;
+
+	for (uint64_t block_first = 1; block_first < n_bins; block_first += block) {
+		const uint64_t count = std::min(block, n_bins - block_first);
+		// Fraction j / most of the bins and drifts of the block
+		for (uint32_t j = 1; j <= most; ++j) {
+			uint64_t lo = (block_first * j + most / 2) / most;
+			uint64_t hi = ((block_first + count - 1) * j + most / 2) / most;
+			int64_t half_rows = rounded_ratio(centre * j, most);
+			plane_first[j] = lo;
+			plane_rows[j] = half_rows;
+			correlate(lo, hi - lo + 1, (uint32_t)(centre - half_rows), (uint32_t)(2 * half_rows + 1), planes[j]);
+		}
+
+		plane_sums = planes[most];
+		for (uint32_t harmonics = 1; harmonics <= most; harmonics <<= 1) {
+			// Going from h / 2 to h harmonics adds the odd harmonics j of h
+			for (uint32_t j = 1; harmonics > 1 && j < harmonics; j += 2) {
+				const uint32_t fraction = j * (most / harmonics);
+				const uint64_t width = ((block_first + count - 1) * fraction + most / 2) / most - plane_first[fraction] + 1;
+				columns.resize(count);
+				for (uint64_t index = 0; index < count; ++index) {
+					columns[index] = (uint32_t)(((block_first + index) * j + harmonics / 2) / harmonics - plane_first[fraction]);
+				}
+				for (uint32_t row = 0; row < n_z; ++row) {
+					rows[row] = (uint32_t)(rounded_ratio(((int64_t)row - centre) * j, harmonics) + plane_rows[fraction]);
+				}
+				for (uint32_t row = 0; row < n_z; ++row) {
+					const float* source = &planes[fraction][rows[row] * width];
+					float* target = &plane_sums[(uint64_t)row * count];
+					for (uint64_t index = 0; index < count; ++index) {
+						target[index] += source[columns[index]];
+					}
+				}
+			}
+
+			// The best drift of every bin, candidates are local maxima over the bins
+			best.assign(count, 0.0f);
+			best_row.assign(count, 0);
+			for (uint32_t row = 0; row < n_z; ++row) {
+				const float* sums = &plane_sums[(uint64_t)row * count];
+				for (uint64_t index = 0; index < count; ++index) {
+					if (sums[index] > best[index]) {
+						best[index] = sums[index];
+						best_row[index] = row;
+					}
+				}
+			}
+			double low = std::max(1.0, options.min_frequency * length * harmonics);
+			double high = options.max_frequency > 0.0 ? options.max_frequency * length * harmonics : (double)n_bins;
+			for (uint64_t index = 0; index < count; ++index) {
+				const uint64_t bin = block_first + index;
+				const float power = best[index];
+				if (power < thresholds[harmonics] || bin < low || bin > high ||
+					(index && power < best[index - 1]) || (index + 1 < count && power <= best[index + 1])) {
+					continue;
+				}
+				periodicity_candidate candidate;
+				candidate.dm = dm;
+				candidate.frequency = bin / (length * harmonics);
+				double z = templates->z_of(best_row[index]) / harmonics;
+				candidate.fdot = z / (length * length);
+				candidate.acceleration = candidate.fdot * speed_of_light / candidate.frequency;
+				candidate.power = power;
+				candidate.sigma = equivalent_sigma(power, harmonics);
+				candidate.harmonics = harmonics;
+				candidate.bin = bin;
+				candidates.push_back(candidate);
+			}
+		}
+	}
+	stats::count("accelerate", 0, n_bins);
+}
@@ -0,0 +1,133 @@
+#include "fft.hpp"
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+
+namespace {
+	/**
+	 * @brief a * b without the NaN and infinity handling of std::complex, which does not vectorize
+	 */
+	inline void multiply(float ar, float ai, float br, float bi, float& re, float& im) {
+		re = ar * br - ai * bi;
+		im = ar * bi + ai * br;
+	}
+}
+
+/**
+ * @param n the number of real values to transform, a power of two of at least 4
+ */
+fft_plan::fft_plan(uint64_t n) : n(n), half(n / 2) {
+	if (n < 4 || (n & (n - 1)) || n > ((uint64_t)1 << 32)) {
+		throw std::runtime_error("FFT length must be a power of two between 4 and 2^32: " + std::to_string(n));
+	}
+
+	uint32_t bits = 0;
+	while (((uint64_t)1 << bits) < half) {
+		bits++;
+	}
+	for (uint64_t index = 0; index < half; ++index) {
+		uint64_t reverse = 0;
+		for (uint32_t bit = 0; bit < bits; ++bit) {
+			reverse |= ((index >> bit) & 1) << (bits - 1 - bit);
+		}
+		if (reverse > index) {
+			swaps.push_back((uint32_t)index);
+			swaps.push_back((uint32_t)reverse);
+		}
+	}
+
+	// The twiddles are calculated in double precision, rounding only once
+	const double two_pi = 2.0 * std::acos(-1.0);
+	stage_twiddles.reserve(half);
+	for (uint64_t length = 2; length <= half; length <<= 1) {
+		for (uint64_t k = 0; k < length / 2; ++k) {
+			double angle = -two_pi * k / length;
+			stage_twiddles.emplace_back((float)std::cos(angle), (float)std::sin(angle));
+		}
+	}
+	real_twiddles.resize(half);
+	for (uint64_t k = 0; k < half; ++k) {
+		double angle = -two_pi * k / n;
+		real_twiddles[k] = std::complex<float>((float)std::cos(angle), (float)std::sin(angle));
+	}
+}
+
+/**
+ * @brief The shared plan for a length, created on first use
+ */
+std::shared_ptr<const fft_plan> fft_plan::get(uint64_t n) {
+	static std::mutex lock;
+	static std::map<uint64_t, std::shared_ptr<const fft_plan>> plans;
+	std::lock_guard<std::mutex> guard(lock);
+	auto found = plans.find(n);
+	if (found != plans.end()) {
+		return found->second;
+	}
+	std::shared_ptr<const fft_plan> plan(new fft_plan(n));
+	plans[n] = plan;
+	return plan;
+}
+
+uint64_t fft_plan::next_power_of_two(uint64_t n) {
+	uint64_t power = 4;
+	while (power < n) {
+		power <<= 1;
+	}
+	return power;
+}
+
+/**
+ * @brief Iterative radix 2 decimation in time: bit reversal, then butterflies of doubling length
+ */
+void fft_plan::complex_forward(std::complex<float>* data) const {
+	for (size_t index = 0; index < swaps.size(); index += 2) {
+		std::swap(data[swaps[index]], data[swaps[index + 1]]);
+	}
+
+	float* values = reinterpret_cast<float*>(data);
+	const float* twiddles = reinterpret_cast<const float*>(stage_twiddles.data());
+	for (uint64_t length = 2; length <= half; length <<= 1) {
+		const uint64_t span = length / 2;
+		for (uint64_t start = 0; start < half; start += length) {
+			float* a = values + 2 * start;
+			float* b = values + 2 * (start + span);
+			for (uint64_t k = 0; k < span; ++k) {
+				float re, im;
+				multiply(b[2 * k], b[2 * k + 1], twiddles[2 * k], twiddles[2 * k + 1], re, im);
+				b[2 * k] = a[2 * k] - re;
+				b[2 * k + 1] = a[2 * k + 1] - im;
+				a[2 * k] += re;
+				a[2 * k + 1] += im;
+			}
+		}
+		twiddles += 2 * span;
+	}
+}
+
+/**
+ * @brief Transforms the even and odd values as the real and imaginary parts of a half length
+ * complex transform, then separates the two
+ *
+ * @param data n real values, overwritten
+ * @param spectrum n / 2 + 1 complex amplitudes, from 0 to the Nyquist frequency
+ */
+void fft_plan::real_forward(float* data, std::complex<float>* spectrum) const {
+	std::complex<float>* packed = reinterpret_cast<std::complex<float>*>(data);
+	complex_forward(packed);
+
+	spectrum[0] = std::complex<float>(packed[0].real() + packed[0].imag(), 0.0f);
+	spectrum[half] = std::complex<float>(packed[0].real() - packed[0].imag(), 0.0f);
+	for (uint64_t k = 1; k < half; ++k) {
+		const std::complex<float> z = packed[k];
+		const std::complex<float> mirror = packed[half - k];
+		// even = (z + conj(mirror)) / 2, odd = (z - conj(mirror)) / 2i
+		float even_re = 0.5f * (z.real() + mirror.real());
+		float even_im = 0.5f * (z.imag() - mirror.imag());
+		float odd_re = 0.5f * (z.imag() + mirror.imag());
+		float odd_im = -0.5f * (z.real() - mirror.real());
+		float re, im;
+		multiply(real_twiddles[k].real(), real_twiddles[k].imag(), odd_re, odd_im, re, im);
+		spectrum[k] = std::complex<float>(even_re + re, even_im + im);
+	}
+}
@@ -0,0 +1,247 @@
+#include "periodicity.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include "stats.hpp"
+
+namespace {
+	// Running median blocks grow with frequency, red noise changes fastest at low frequencies
+	const uint64_t min_block = 64;
+	const uint64_t max_block = 8192;
+
+	const double log_sqrt_two_pi = 0.5 * std::log(2.0 * std::acos(-1.0));
+
+	/**
+	 * @brief The log of the probability that a standard normal value exceeds z
+	 */
+	double log_normal_tail(double z) {
+		if (z < 30.0) {
+			return std::log(0.5 * std::erfc(z / std::sqrt(2.0)));
+		}
+		// erfc underflows, use the asymptotic series
+		double inverse = 1.0 / (z * z);
+		return -0.5 * z * z - std::log(z) - log_sqrt_two_pi + std::log(1.0 - inverse + 3.0 * inverse * inverse);
+	}
+}
+
+/**
+ * @param options the harmonics, threshold, frequency range and number of candidates
+ */
+periodicity_search::periodicity_search(const periodicity_options& options) : options(options) {
+	if (!options.harmonics || options.harmonics > 32 || (options.harmonics & (options.harmonics - 1))) {
+		throw std::runtime_error("The number of harmonics must be 1, 2, 4, 8, 16 or 32");
+	}
+}
+
+/**
+ * @brief Converts the summed normalized power of a number of harmonics into the significance a gaussian
+ * variable with the same chance of being exceeded would have. The sum of h normalized powers of noise
+ * follows a gamma distribution with P(sum > S) = exp(-S) * sum_{k < h} S^k / k!.
+ */
+double periodicity_search::equivalent_sigma(double power, uint32_t harmonics) {
+	if (!(power > 0.0)) {
+		return 0.0;
+	}
+	double log_power = std::log(power);
+	double largest = 0.0;
+	std::vector<double> terms(harmonics);
+	for (uint32_t k = 0; k < harmonics; ++k) {
+		terms[k] = k * log_power - std::lgamma(k + 1.0);
+		largest = k ? std::max(largest, terms[k]) : terms[k];
+	}
+	double sum = 0.0;
+	for (double term : terms) {
+		sum += std::exp(term - largest);
+	}
+	double log_probability = -power + largest + std::log(sum);
+	if (log_probability >= std::log(0.5)) {
+		return 0.0;
+	}
+
+	// Newton iterations on log Q(z) = log p, starting from the leading term of the asymptotic series
+	double z = std::sqrt(-2.0 * log_probability);
+	for (uint32_t iteration = 0; iteration < 50; ++iteration) {
+		double log_tail = log_normal_tail(z);
+		double slope = -std::exp(-0.5 * z * z - log_sqrt_two_pi - log_tail);
+		double step = (log_tail - log_probability) / slope;
+		z -= step;
+		if (z < 0.0) {
+			z = 0.0;
+		}
+		if (std::fabs(step) < 1e-9) {
+			break;
+		}
+	}
+	return z;
+}
+
+/**
+ * @brief Removes the mean, pads the series to a power of two and calculates its powers
+ */
+void periodicity_search::power_spectrum(const float* series, uint64_t nsamples) {
+	scoped_timer timer("fft");
+	uint64_t n = fft_plan::next_power_of_two(nsamples);
+	if (!plan || plan->size() != n) {
+		plan = fft_plan::get(n);
+	}
+
+	double sum = 0.0;
+	for (uint64_t sample = 0; sample < nsamples; ++sample) {
+		sum += series[sample];
+	}
+	const float mean = nsamples ? (float)(sum / nsamples) : 0.0f;
+	padded.resize(n);
+	for (uint64_t sample = 0; sample < nsamples; ++sample) {
+		padded[sample] = series[sample] - mean;
+	}
+	std::fill(padded.begin() + nsamples, padded.end(), 0.0f);
+
+	amplitudes.resize(n / 2 + 1);
+	plan->real_forward(padded.data(), amplitudes.data());
+	powers.resize(n / 2 + 1);
+	for (uint64_t bin = 0; bin < powers.size(); ++bin) {
+		powers[bin] = std::norm(amplitudes[bin]);
+	}
+	powers[0] = 0.0f;
+	stats::count("fft", 0, nsamples);
+}
+
+/**
+ * @brief Divides the powers by their local mean, estimated as the median / ln 2 of blocks that grow with
+ * frequency and interpolated linearly between the block centres. Without whitening a single block is used.
+ * The acceleration search correlates the amplitudes, so these are normalized as well.
+ */
+void periodicity_search::normalize() {
+	scoped_timer timer("whiten");
+	const uint64_t n_bins = powers.size();
+	std::vector<double> centres;
+	std::vector<double> means;
+	uint64_t start = 1;
+	while (start < n_bins) {
+		uint64_t width = options.whiten ? std::min(max_block, std::max(min_block, start / 4)) : n_bins;
+		uint64_t end = std::min(n_bins, start + width);
+		scratch.assign(powers.begin() + start, powers.begin() + end);
+		std::nth_element(scratch.begin(), scratch.begin() + scratch.size() / 2, scratch.end());
+		centres.push_back(0.5 * (start + end - 1));
+		means.push_back(std::max<double>(scratch[scratch.size() / 2], 1e-30) / std::log(2.0));
+		start = end;
+	}
+
+	size_t block = 0;
+	for (uint64_t bin = 1; bin < n_bins; ++bin) {
+		while (block + 1 < centres.size() && centres[block + 1] <= bin) {
+			block++;
+		}
+		double mean = means[block];
+		if (block + 1 < centres.size() && bin > centres[block]) {
+			double fraction = (bin - centres[block]) / (centres[block + 1] - centres[block]);
+			mean += fraction * (means[block + 1] - means[block]);
+		}
+		powers[bin] = (float)(powers[bin] / mean);
+		if (options.zmax) {
+			amplitudes[bin] *= (float)(1.0 / std::sqrt(mean));
+		}
+	}
+}
+
+/**
+ * @brief The summed power of a number of harmonics at which the significance reaches the threshold.
+ * The significance only grows with the power, so peaks are compared against this power first.
+ */
+double periodicity_search::threshold_power(uint32_t harmonics) const {
+	double high = harmonics;
+	while (equivalent_sigma(high, harmonics) < options.threshold) {
+		high += 1.0;
+	}
+	double low = high - 1.0;
+	for (uint32_t iteration = 0; iteration < 30; ++iteration) {
+		double middle = 0.5 * (low + high);
+		if (equivalent_sigma(middle, harmonics) < options.threshold) {
+			low = middle;
+		} else {
+			high = middle;
+		}
+	}
+	return high;
+}
+
+/**
+ * @brief Adds the local maxima of the current harmonic sum that exceed the threshold
+ *
+ * @param harmonics the number of harmonics in summed
+ * @param length the length of the transformed series in seconds
+ */
+void periodicity_search::find_peaks(uint32_t harmonics, double length, double dm, std::vector<periodicity_candidate>& candidates) {
+	const uint64_t n_bins = summed.size();
+	// summed[i] holds harmonics of a fundamental at bin i / harmonics
+	uint64_t first = std::max<uint64_t>(1, (uint64_t)std::ceil(options.min_frequency * length * harmonics));
+	uint64_t last = n_bins - 1;
+	if (options.max_frequency > 0.0) {
+		last = std::min<uint64_t>(last, (uint64_t)std::floor(options.max_frequency * length * harmonics));
+	}
+
+	const double minimum = threshold_power(harmonics);
+	for (uint64_t bin = first; bin <= last && bin < n_bins; ++bin) {
+		float power = summed[bin];
+		if (power < minimum || power < summed[bin - 1] || (bin + 1 < n_bins && power <= summed[bin + 1])) {
+			continue;
+		}
+		periodicity_candidate candidate;
+		candidate.dm = dm;
+		candidate.frequency = bin / (length * harmonics);
+		candidate.power = power;
+		candidate.sigma = equivalent_sigma(power, harmonics);
+		candidate.harmonics = harmonics;
+		candidate.bin = bin;
+		candidates.push_back(candidate);
+	}
+}
+
+/**
+ * @param series the time series
+ * @param nsamples the number of samples in the series
+ * @param tsamp the sampling time in seconds
+ * @param dm the dispersion measure of the series, copied into the candidates
+ */
+std::vector<periodicity_candidate> periodicity_search::search(const float* series, uint64_t nsamples, double tsamp, double dm) {
+	std::vector<periodicity_candidate> candidates;
+	if (nsamples < 4 || !(tsamp > 0.0)) {
+		return candidates;
+	}
+	power_spectrum(series, nsamples);
+	normalize();
+
+	const double length = padded.size() * tsamp;
+	if (options.zmax) {
+		accelerated_search(length, dm, candidates);
+	} else {
+		scoped_timer timer("harmonics");
+		const uint64_t n_bins = powers.size();
+		summed = powers;
+		find_peaks(1, length, dm, candidates);
+		// Going from h to 2h harmonics adds the odd harmonics j of 2h, at bin round(i * j / 2h)
+		for (uint32_t harmonics = 2; harmonics <= options.harmonics; harmonics <<= 1) {
+			const uint32_t half = harmonics / 2;
+			uint32_t shift = 0;
+			while ((1u << shift) < harmonics) {
+				shift++;
+			}
+			for (uint64_t bin = 1; bin < n_bins; ++bin) {
+				float sum = 0.0f;
+				for (uint32_t harmonic = 1; harmonic < harmonics; harmonic += 2) {
+					sum += powers[(bin * harmonic + half) >> shift];
+				}
+				summed[bin] += sum;
+			}
+			find_peaks(harmonics, length, dm, candidates);
+		}
+	}
+
+	std::sort(candidates.begin(), candidates.end(), [](const periodicity_candidate& a, const periodicity_candidate& b) {
+		return a.sigma > b.sigma;
+	});
+	if (options.max_candidates && candidates.size() > options.max_candidates) {
+		candidates.resize(options.max_candidates);
+	}
+	return candidates;
+}
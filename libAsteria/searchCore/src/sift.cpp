@@ -0,0 +1,377 @@
+#include "sift.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <stdexcept>
+#include "stats.hpp"
+
+namespace {
+	/**
+	 * @brief Disjoint sets with path halving, every set is represented by its smallest member
+	 */
+	struct disjoint_sets {
+		std::vector<uint32_t> parent;
+
+		explicit disjoint_sets(uint32_t n) : parent(n) {
+			for (uint32_t index = 0; index < n; ++index) {
+				parent[index] = index;
+			}
+		}
+
+		uint32_t find(uint32_t index) {
+			while (parent[index] != index) {
+				parent[index] = parent[parent[index]];
+				index = parent[index];
+			}
+			return index;
+		}
+
+		void join(uint32_t a, uint32_t b) {
+			a = find(a);
+			b = find(b);
+			if (a < b) {
+				parent[b] = a;
+			} else if (b < a) {
+				parent[a] = b;
+			}
+		}
+	};
+
+	double median(std::vector<double> values) {
+		if (values.empty()) {
+			return 0.0;
+		}
+		std::nth_element(values.begin(), values.begin() + values.size() / 2, values.end());
+		return values[values.size() / 2];
+	}
+
+	uint32_t greatest_common_divisor(uint32_t a, uint32_t b) {
+		while (b) {
+			uint32_t rest = a % b;
+			a = b;
+			b = rest;
+		}
+		return a;
+	}
+
+	/**
+	 * @brief Keeps the strongest detection of every group, with the number of detections and their dms
+	 *
+	 * @param labels the group of every detection, numbered from 0
+	 * @return one detection per group, sorted by significance
+	 */
+	template <typename candidate>
+	std::vector<candidate> strongest(const std::vector<candidate>& detections, const std::vector<uint32_t>& labels) {
+		uint32_t n_groups = 0;
+		for (uint32_t label : labels) {
+			n_groups = std::max(n_groups, label + 1);
+		}
+		std::vector<uint32_t> best(n_groups, std::numeric_limits<uint32_t>::max());
+		std::vector<uint32_t> members(n_groups, 0);
+		std::vector<double> lows(n_groups);
+		std::vector<double> highs(n_groups);
+		for (uint32_t index = 0; index < detections.size(); ++index) {
+			const candidate& detection = detections[index];
+			const uint32_t label = labels[index];
+			if (!members[label]) {
+				best[label] = index;
+				lows[label] = highs[label] = detection.dm;
+			} else {
+				if (detection.sigma > detections[best[label]].sigma) {
+					best[label] = index;
+				}
+				lows[label] = std::min(lows[label], detection.dm);
+				highs[label] = std::max(highs[label], detection.dm);
+			}
+			members[label] += detection.members;
+		}
+
+		// Ranking small pairs rather than whole candidates, ties keep the order of the groups
+		std::vector<std::pair<double, uint32_t>> ranking(n_groups);
+		for (uint32_t label = 0; label < n_groups; ++label) {
+			ranking[label] = std::make_pair(-detections[best[label]].sigma, label);
+		}
+		std::sort(ranking.begin(), ranking.end());
+		std::vector<candidate> groups;
+		groups.reserve(n_groups);
+		for (const auto& entry : ranking) {
+			const uint32_t label = entry.second;
+			groups.push_back(detections[best[label]]);
+			groups.back().members = members[label];
+			groups.back().dm_low = lows[label];
+			groups.back().dm_high = highs[label];
+		}
+		return groups;
+	}
+}
+
+/**
+ * @brief The typical step between dm trials, the median difference of the sorted distinct dms
+ *
+ * @return the step, 0 with fewer than two distinct dms
+ */
+double candidate_sifter::dm_step(std::vector<double> dms) {
+	// Detections usually come trial by trial, dropping repeats first leaves little to sort
+	dms.erase(std::unique(dms.begin(), dms.end()), dms.end());
+	std::sort(dms.begin(), dms.end());
+	dms.erase(std::unique(dms.begin(), dms.end()), dms.end());
+	std::vector<double> steps;
+	for (size_t index = 1; index < dms.size(); ++index) {
+		steps.push_back(dms[index] - dms[index - 1]);
+	}
+	return median(steps);
+}
+
+/**
+ * @brief Friends of friends clustering on a grid. Points are sorted by the cell they are in, the points of
+ * a cell are all within one of each other in every coordinate and form one group, so the groups are
+ * joined per cell rather than per point. Each pair of
+ * neighbouring cells is compared once, and only until a linked pair is found or the cells are already
+ * in the same group.
+ *
+ * @param coordinates dims coordinates per point, divided by the linking length of their dimension
+ * @param dims the number of coordinates per point, 1 to 3
+ * @return the group of every point, numbered from 0 in the order of their cells
+ */
+std::vector<uint32_t> candidate_sifter::cluster(const std::vector<double>& coordinates, uint32_t dims) {
+	if (dims < 1 || dims > 3 || coordinates.size() % dims) {
+		throw std::runtime_error("Clustering needs 1 to 3 coordinates per point");
+	}
+	const uint64_t n_points = coordinates.size() / dims;
+	if (n_points >= std::numeric_limits<uint32_t>::max()) {
+		throw std::runtime_error("Too many points to cluster");
+	}
+	std::vector<uint32_t> labels(n_points);
+	if (!n_points) {
+		return labels;
+	}
+
+	// Cells are numbered in mixed radix, with a margin of one cell so that neighbours never wrap around
+	std::vector<int64_t> lowest(dims, std::numeric_limits<int64_t>::max());
+	std::vector<int64_t> highest(dims, std::numeric_limits<int64_t>::min());
+	for (uint64_t point = 0; point < n_points; ++point) {
+		for (uint32_t dim = 0; dim < dims; ++dim) {
+			double value = std::floor(coordinates[point * dims + dim]);
+			if (!(std::fabs(value) < 1e15)) {
+				throw std::runtime_error("Coordinates to cluster must be finite and at most 1e15 linking lengths");
+			}
+			lowest[dim] = std::min(lowest[dim], (int64_t)value);
+			highest[dim] = std::max(highest[dim], (int64_t)value);
+		}
+	}
+	std::vector<uint64_t> strides(dims);
+	double cells = 1.0;
+	for (uint32_t dim = dims; dim-- > 0;) {
+		strides[dim] = (uint64_t)cells;
+		cells *= (double)(highest[dim] - lowest[dim] + 3);
+	}
+	if (cells > 9.0e15) {
+		throw std::runtime_error("The points span too many linking lengths to cluster");
+	}
+
+	std::vector<std::pair<uint64_t, uint32_t>> order(n_points);
+	for (uint64_t point = 0; point < n_points; ++point) {
+		uint64_t key = 0;
+		for (uint32_t dim = 0; dim < dims; ++dim) {
+			key += (uint64_t)((int64_t)std::floor(coordinates[point * dims + dim]) - lowest[dim] + 1) * strides[dim];
+		}
+		order[point] = std::make_pair(key, (uint32_t)point);
+	}
+	std::sort(order.begin(), order.end());
+
+	// The first entry in order of every occupied cell and its key, and one past the last cell
+	std::vector<uint64_t> starts;
+	std::vector<uint64_t> keys;
+	for (uint64_t index = 0; index < n_points; ++index) {
+		if (!index || order[index].first != order[index - 1].first) {
+			starts.push_back(index);
+			keys.push_back(order[index].first);
+		}
+	}
+	const uint32_t n_cells = (uint32_t)keys.size();
+	starts.push_back(n_points);
+
+	// The points of a cell are one group, so the sets are of cells
+	disjoint_sets sets(n_cells);
+
+	// Half of the neighbouring cells, the other half sees this cell as its neighbour. These offsets are all
+	// positive, so the neighbours of the sorted cells are found in one merging pass per offset.
+	std::vector<uint64_t> offsets;
+	uint32_t n_offsets = 1;
+	for (uint32_t dim = 0; dim < dims; ++dim) {
+		n_offsets *= 3;
+	}
+	for (uint32_t combination = n_offsets / 2 + 1; combination < n_offsets; ++combination) {
+		int64_t offset = 0;
+		uint32_t rest = combination;
+		for (uint32_t dim = dims; dim-- > 0;) {
+			offset += ((int64_t)(rest % 3) - 1) * (int64_t)strides[dim];
+			rest /= 3;
+		}
+		offsets.push_back((uint64_t)offset);
+	}
+
+	for (uint64_t offset : offsets) {
+		uint32_t other = 0;
+		for (uint32_t cell = 0; cell < n_cells; ++cell) {
+			const uint64_t target = keys[cell] + offset;
+			while (other < n_cells && keys[other] < target) {
+				other++;
+			}
+			if (other == n_cells) {
+				break;
+			}
+			if (keys[other] != target) {
+				continue;
+			}
+			if (sets.find(cell) == sets.find(other)) {
+				continue;
+			}
+			bool linked = false;
+			for (uint64_t a = starts[cell]; a < starts[cell + 1] && !linked; ++a) {
+				const double* first = &coordinates[(uint64_t)order[a].second * dims];
+				for (uint64_t b = starts[other]; b < starts[other + 1] && !linked; ++b) {
+					const double* second = &coordinates[(uint64_t)order[b].second * dims];
+					linked = true;
+					for (uint32_t dim = 0; dim < dims; ++dim) {
+						linked = linked && std::fabs(first[dim] - second[dim]) <= 1.0;
+					}
+				}
+			}
+			if (linked) {
+				sets.join(cell, other);
+			}
+		}
+	}
+
+	// Roots are the first cell of their group, so they are numbered before any other cell of the group
+	std::vector<uint32_t> numbers(n_cells, 0);
+	uint32_t n_groups = 0;
+	for (uint32_t cell = 0; cell < n_cells; ++cell) {
+		uint32_t root = sets.find(cell);
+		if (root == cell) {
+			numbers[cell] = n_groups++;
+		}
+		for (uint64_t index = starts[cell]; index < starts[cell + 1]; ++index) {
+			labels[order[index].second] = numbers[root];
+		}
+	}
+	stats::count("sift", 0, n_points);
+	return labels;
+}
+
+/**
+ * @brief Groups single pulses in dm, time and the logarithm of the width, and keeps the strongest pulse
+ * of every group
+ */
+std::vector<single_pulse_candidate> candidate_sifter::sift(const std::vector<single_pulse_candidate>& detections, sift_options options) {
+	scoped_timer timer("sift");
+	if (detections.empty()) {
+		return detections;
+	}
+	std::vector<double> values;
+	if (!(options.dm_tolerance > 0.0)) {
+		values.resize(detections.size());
+		for (size_t index = 0; index < detections.size(); ++index) {
+			values[index] = detections[index].dm;
+		}
+		double step = dm_step(values);
+		options.dm_tolerance = step > 0.0 ? 1.5 * step : 1.0;
+	}
+	if (!(options.time_tolerance > 0.0)) {
+		values.resize(detections.size());
+		for (size_t index = 0; index < detections.size(); ++index) {
+			values[index] = detections[index].width;
+		}
+		double width = median(values);
+		// Without widths the pulses are taken to be a millisecond wide
+		options.time_tolerance = width > 0.0 ? 2.0 * width : 2e-3;
+	}
+	const double width_scale = options.width_factor > 1.0 ? 1.0 / std::log(options.width_factor) : 0.0;
+
+	std::vector<double> coordinates(3 * detections.size());
+	for (size_t index = 0; index < detections.size(); ++index) {
+		const single_pulse_candidate& detection = detections[index];
+		coordinates[3 * index] = detection.dm / options.dm_tolerance;
+		coordinates[3 * index + 1] = detection.time / options.time_tolerance;
+		coordinates[3 * index + 2] = detection.width > 0.0 ? std::log(detection.width) * width_scale : 0.0;
+	}
+	return strongest(detections, cluster(coordinates, 3));
+}
+
+/**
+ * @brief Groups periodicity candidates in dm and frequency, keeps the strongest of every group, and then
+ * merges groups at a harmonic ratio n / m of the frequency of a stronger group at a similar dm into it
+ */
+std::vector<periodicity_candidate> candidate_sifter::sift(const std::vector<periodicity_candidate>& detections, sift_options options) {
+	scoped_timer timer("sift");
+	if (detections.empty()) {
+		return detections;
+	}
+	std::vector<double> values;
+	if (!(options.dm_tolerance > 0.0)) {
+		values.resize(detections.size());
+		for (size_t index = 0; index < detections.size(); ++index) {
+			values[index] = detections[index].dm;
+		}
+		double step = dm_step(values);
+		options.dm_tolerance = step > 0.0 ? 1.5 * step : 1.0;
+	}
+	// The frequency resolution is the inverse of the transformed length, which the bins give back
+	values.clear();
+	for (const periodicity_candidate& detection : detections) {
+		if (detection.frequency > 0.0 && detection.bin) {
+			values.push_back(detection.bin / (detection.harmonics * detection.frequency));
+		}
+	}
+	double length = median(values);
+	if (!(length > 0.0) || !(options.frequency_tolerance > 0.0)) {
+		throw std::runtime_error("Sifting needs candidates with frequency bins and a positive frequency tolerance");
+	}
+	const double frequency_tolerance = options.frequency_tolerance / length;
+
+	std::vector<double> coordinates(2 * detections.size());
+	for (size_t index = 0; index < detections.size(); ++index) {
+		coordinates[2 * index] = detections[index].dm / options.dm_tolerance;
+		coordinates[2 * index + 1] = detections[index].frequency / frequency_tolerance;
+	}
+	std::vector<periodicity_candidate> groups = strongest(detections, cluster(coordinates, 2));
+	if (!options.merge_harmonics || options.max_harmonic < 2) {
+		return groups;
+	}
+
+	// Strongest first, a group is a harmonic when a kept group lies at m / n of its frequency
+	std::vector<std::pair<uint32_t, uint32_t>> ratios;
+	for (uint32_t n = 1; n <= options.max_harmonic; ++n) {
+		for (uint32_t m = 1; m <= options.max_harmonic; ++m) {
+			if (n != m && greatest_common_divisor(n, m) == 1) {
+				ratios.push_back(std::make_pair(n, m));
+			}
+		}
+	}
+	std::vector<periodicity_candidate> kept;
+	std::multimap<double, size_t> by_frequency;
+	for (const periodicity_candidate& group : groups) {
+		size_t fundamental = kept.size();
+		for (size_t ratio = 0; ratio < ratios.size() && fundamental == kept.size(); ++ratio) {
+			const double scale = (double)ratios[ratio].second / ratios[ratio].first;
+			const double target = group.frequency * scale;
+			const double window = frequency_tolerance * (1.0 + scale);
+			for (auto found = by_frequency.lower_bound(target - window); found != by_frequency.end() && found->first <= target + window; ++found) {
+				const periodicity_candidate& other = kept[found->second];
+				if (group.dm >= other.dm_low - options.dm_tolerance && group.dm <= other.dm_high + options.dm_tolerance) {
+					fundamental = found->second;
+					break;
+				}
+			}
+		}
+		if (fundamental < kept.size()) {
+			kept[fundamental].members += group.members;
+		} else {
+			by_frequency.insert(std::make_pair(group.frequency, kept.size()));
+			kept.push_back(group);
+		}
+	}
+	return kept;
+}
@@ -0,0 +1,94 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Collects per stage timings, byte and sample counters, high-water marks and the peak resident set size.
+ * Everything is a no-op until enable() is called, so instrumented code only pays for a branch. Timings and
+ * counters are added to records of the calling thread, which report() merges, so that timers in hot loops
+ * neither contend on a lock nor look up the stage by its name.
+ */
+class stats {
+public:
+	struct stage_record {
+		uint64_t calls = 0;
+		double seconds = 0.0;
+		uint64_t bytes = 0;
+		uint64_t samples = 0;
+		uint64_t peak_rss_kb = 0;
+	};
+
+	static void enable(bool json = false);
+	static inline bool enabled() { return active; };
+
+	static void add_time(const char* stage, double seconds);
+	static inline void count(const char* stage, uint64_t bytes, uint64_t samples = 0) {
+		if (active) {
+			add_count(stage, bytes, samples);
+		}
+	};
+
+	// Raises a high-water mark, e.g. the most memory a pool held, reported with its largest value
+	static inline void peak(const char* name, uint64_t value) {
+		if (active) {
+			set_peak(name, value);
+		}
+	};
+
+	static uint64_t peak_rss_kb();
+	static void report(std::ostream& out = std::cerr);
+
+	static bool parse_argument(const std::string& argument);
+
+private:
+	struct thread_records;
+
+	static void add_count(const char* stage, uint64_t bytes, uint64_t samples);
+	static void set_peak(const char* name, uint64_t value);
+	static thread_records& local();
+	static void merge(const thread_records& records, std::map<std::string, stage_record>& into);
+
+	static bool active;
+	static bool json_output;
+	static std::chrono::steady_clock::time_point started;
+	static std::mutex lock;
+	// The records of threads that have exited, and the threads that are still running
+	static std::map<std::string, stage_record> stages;
+	static std::vector<thread_records*> threads;
+	static std::map<std::string, uint64_t> peaks;
+};
+
+/**
+ * @brief Adds the time between construction and destruction to a stage
+ */
+class scoped_timer {
+public:
+	explicit scoped_timer(const char* stage) : stage(stats::enabled() ? stage : nullptr) {
+		if (this->stage) {
+			start = std::chrono::steady_clock::now();
+		}
+	};
+
+	~scoped_timer() {
+		if (stage) {
+			std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+			stats::add_time(stage, elapsed.count());
+		}
+	};
+
+	scoped_timer(const scoped_timer&) = delete;
+	scoped_timer& operator=(const scoped_timer&) = delete;
+
+private:
+	const char* stage;
+	std::chrono::steady_clock::time_point start;
+};
+
+#endif // !STATS_H
@@ -0,0 +1,227 @@
+#include "stats.hpp"
+#include <algorithm>
+#include <iomanip>
+#include <sys/resource.h>
+
+bool stats::active = false;
+bool stats::json_output = false;
+std::chrono::steady_clock::time_point stats::started;
+std::mutex stats::lock;
+std::map<std::string, stats::stage_record> stats::stages;
+std::vector<stats::thread_records*> stats::threads;
+std::map<std::string, uint64_t> stats::peaks;
+
+/**
+ * @brief The records of one thread, found by the address of the stage name as stages are named by literals.
+ * Its lock is only contended while report() merges the records.
+ */
+struct stats::thread_records {
+	std::mutex lock;
+	std::vector<std::pair<const char*, stage_record>> stages;
+	// The peak resident set size takes a system call, it is sampled every few milliseconds
+	uint64_t rss_kb = 0;
+	std::chrono::steady_clock::time_point rss_sampled;
+
+	thread_records() {
+		std::lock_guard<std::mutex> guard(stats::lock);
+		threads.push_back(this);
+	};
+
+	~thread_records() {
+		std::lock_guard<std::mutex> guard(stats::lock);
+		merge(*this, stats::stages);
+		threads.erase(std::find(threads.begin(), threads.end(), this));
+	};
+
+	stage_record& find(const char* stage) {
+		for (auto& entry : stages) {
+			if (entry.first == stage) {
+				return entry.second;
+			}
+		}
+		stages.emplace_back(stage, stage_record());
+		return stages.back().second;
+	};
+};
+
+/**
+ * @brief Starts collecting statistics, should be called before any worker threads are started
+ * 
+ * @param json whether report() writes json instead of a table
+ */
+void stats::enable(bool json) {
+	active = true;
+	json_output = json;
+	started = std::chrono::steady_clock::now();
+}
+
+/**
+ * @brief Handles the --stats and --stats=json command line arguments
+ * 
+ * @param argument the argument to check
+ * @return true if the argument was a stats argument
+ */
+bool stats::parse_argument(const std::string& argument) {
+	if (!argument.compare("--stats") || !argument.compare("-stats") || !argument.compare("--stats=text")) {
+		enable(false);
+		return true;
+	}
+	if (!argument.compare("--stats=json") || !argument.compare("-stats=json")) {
+		enable(true);
+		return true;
+	}
+	return false;
+}
+
+/**
+ * @return the records of the calling thread, created on its first call
+ */
+stats::thread_records& stats::local() {
+	thread_local thread_records records;
+	return records;
+}
+
+/**
+ * @brief Adds the records of a thread to the records of all threads by the name of the stage
+ * 
+ * @param records the records of the thread, locked by the caller or no longer used by it
+ * @param into the records by stage name
+ */
+void stats::merge(const thread_records& records, std::map<std::string, stage_record>& into) {
+	for (auto& entry : records.stages) {
+		stage_record& record = into[entry.first];
+		record.calls += entry.second.calls;
+		record.seconds += entry.second.seconds;
+		record.bytes += entry.second.bytes;
+		record.samples += entry.second.samples;
+		record.peak_rss_kb = std::max(record.peak_rss_kb, entry.second.peak_rss_kb);
+	}
+}
+
+/**
+ * @brief Adds a call and its duration to a stage, and samples the peak resident set size
+ * 
+ * @param stage the name of the stage, a string literal
+ * @param seconds the duration of the call
+ */
+void stats::add_time(const char* stage, double seconds) {
+	thread_records& records = local();
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if (!records.rss_kb || now - records.rss_sampled > std::chrono::milliseconds(10)) {
+		records.rss_kb = peak_rss_kb();
+		records.rss_sampled = now;
+	}
+	std::lock_guard<std::mutex> guard(records.lock);
+	stage_record& record = records.find(stage);
+	record.calls++;
+	record.seconds += seconds;
+	record.peak_rss_kb = std::max(record.peak_rss_kb, records.rss_kb);
+}
+
+/**
+ * @brief Adds processed bytes and samples to a stage
+ * 
+ * @param stage the name of the stage, a string literal
+ * @param bytes the number of bytes processed
+ * @param samples the number of samples processed
+ */
+void stats::add_count(const char* stage, uint64_t bytes, uint64_t samples) {
+	thread_records& records = local();
+	std::lock_guard<std::mutex> guard(records.lock);
+	stage_record& record = records.find(stage);
+	record.bytes += bytes;
+	record.samples += samples;
+}
+
+/**
+ * @brief Raises a high-water mark to value when it is lower
+ * 
+ * @param name the name of the mark
+ * @param value the current value
+ */
+void stats::set_peak(const char* name, uint64_t value) {
+	std::lock_guard<std::mutex> guard(lock);
+	uint64_t& mark = peaks[name];
+	mark = std::max(mark, value);
+}
+
+/**
+ * @brief Gets the peak resident set size of the process so far
+ * 
+ * @return uint64_t the peak resident set size in kilobytes
+ */
+uint64_t stats::peak_rss_kb() {
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage)) {
+		return 0;
+	}
+	return (uint64_t)usage.ru_maxrss;
+}
+
+/**
+ * @brief Writes the per stage breakdown, as a table or as json
+ * 
+ * @param out the stream to write to, standard error as stdout usually carries data
+ */
+void stats::report(std::ostream& out) {
+	if (!active) {
+		return;
+	}
+	std::chrono::duration<double> wall = std::chrono::steady_clock::now() - started;
+	std::lock_guard<std::mutex> guard(lock);
+	std::map<std::string, stage_record> merged = stages;
+	for (thread_records* records : threads) {
+		std::lock_guard<std::mutex> thread_guard(records->lock);
+		merge(*records, merged);
+	}
+
+	if (json_output) {
+		out << "{\"wall_seconds\": " << wall.count() << ", \"peak_rss_kb\": " << peak_rss_kb() << ", \"stages\": [";
+		bool first = true;
+		for (auto& stage : merged) {
+			out << (first ? "" : ", ") << "{\"name\": \"" << stage.first << "\""
+				<< ", \"calls\": " << stage.second.calls
+				<< ", \"seconds\": " << stage.second.seconds
+				<< ", \"bytes\": " << stage.second.bytes
+				<< ", \"samples\": " << stage.second.samples
+				<< ", \"peak_rss_kb\": " << stage.second.peak_rss_kb << "}";
+			first = false;
+		}
+		out << "], \"peaks\": {";
+		first = true;
+		for (auto& mark : peaks) {
+			out << (first ? "" : ", ") << "\"" << mark.first << "\": " << mark.second;
+			first = false;
+		}
+		out << "}}" << std::endl;
+		return;
+	}
+
+	std::ios_base::fmtflags flags = out.flags();
+	out << std::left << std::setw(20) << "stage" << std::right
+		<< std::setw(10) << "calls" << std::setw(12) << "time (s)" << std::setw(8) << "%"
+		<< std::setw(14) << "MB" << std::setw(12) << "MB/s"
+		<< std::setw(14) << "Msamples" << std::setw(12) << "Ms/s"
+		<< std::setw(16) << "peak rss (MB)" << "\n";
+	out << std::fixed;
+	for (auto& stage : merged) {
+		const stage_record& record = stage.second;
+		double mb = record.bytes / 1.0e6;
+		double msamples = record.samples / 1.0e6;
+		out << std::left << std::setw(20) << stage.first << std::right
+			<< std::setw(10) << record.calls
+			<< std::setw(12) << std::setprecision(4) << record.seconds
+			<< std::setw(8) << std::setprecision(1) << (wall.count() > 0 ? 100.0 * record.seconds / wall.count() : 0.0)
+			<< std::setw(14) << std::setprecision(2) << mb
+			<< std::setw(12) << (record.seconds > 0 ? mb / record.seconds : 0.0)
+			<< std::setw(14) << msamples
+			<< std::setw(12) << (record.seconds > 0 ? msamples / record.seconds : 0.0)
+			<< std::setw(16) << record.peak_rss_kb / 1024.0 << "\n";
+	}
+	for (auto& mark : peaks) {
+		out << std::left << std::setw(20) << mark.first << std::right << std::setw(22) << mark.second << "   high-water mark\n";
+	}
+	out << std::left << std::setw(20) << "total" << std::right << std::setw(22) << std::setprecision(4) << wall.count()
+		<< "   peak rss " << std::setprecision(2) << peak_rss_kb() / 1024.0 << " MB" << std::endl;
+	out.flags(flags);
+}
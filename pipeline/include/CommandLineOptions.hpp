@@ -0,0 +1,60 @@
+#ifndef _COMMAND_LINE_OPTIONS_HPP__
+#define _COMMAND_LINE_OPTIONS_HPP__
+
+#include <algorithm>
+#include <string.h>
+#include <iostream>
+#include <boost/program_options.hpp>
+
+namespace po = boost::program_options;
+
+class CommandLineOptions {
+public:
+    enum statusReturn_e {
+        OPTS_SUCCESS,
+        OPTS_HELP,
+        ERROR_IN_COMMAND_LINE,
+        ERROR_UNHANDLED_EXCEPTION
+    };
+    CommandLineOptions();
+    statusReturn_e parse(int argc, char* argv[]);
+
+    const std::string & getInputFile() const { return myInputFile; };
+    const std::string & getOutputFile() const { return myOutputFile; };
+    const std::string & getChain() const { return myChain; };
+    int getInputType() { return inputType; };
+    int getOutputType() { return outputType; };
+    int32_t getNumberOfBits() { return num_bits; };
+    bool getHeaderlessFlag() { return myHeaderlessFlag; };
+    bool getDirectFlag() { return myDirectFlag; };
+    bool getSequentialFlag() { return mySequentialFlag; };
+    bool getSumIfsFlag() { return mySumIfsFlag; };
+    const std::string & getStatsFormat() const { return myStatsFormat; };
+    bool followEnabled() { return follow_timeout >= 0.0 || !mySentinel.empty(); };
+    double getFollowTimeout() { return std::max(0.0, follow_timeout); };
+    const std::string & getSentinel() const { return mySentinel; };
+    bool getVerifyFlag() { return myVerifyFlag; };
+
+protected:
+    void setup();
+
+private:
+    po::options_description myOptions;
+    po::positional_options_description myPositionalOptions;
+    std::string myInputFile;
+    std::string myOutputFile;
+    std::string myChain;
+    int inputType;
+    int outputType;
+    int32_t num_bits;
+    bool myHeaderlessFlag;
+    bool myDirectFlag;
+    bool mySequentialFlag;
+    bool mySumIfsFlag;
+    std::string myStatsFormat;
+    double follow_timeout;
+    std::string mySentinel;
+    bool myVerifyFlag;
+};
+
+#endif // _COMMAND_LINE_OPTIONS_HPP__
@@ -0,0 +1,12 @@
+#ifndef PIPELINE_TOOL_H
+#define PIPELINE_TOOL_H
+
+#include <iostream>
+#include <string>
+#include "filterbankCore.hpp"
+#include "pipeline.hpp"
+#include "stages.hpp"
+#include "stats.hpp"
+#include "CommandLineOptions.hpp"
+
+#endif // !PIPELINE_TOOL_H
@@ -0,0 +1,111 @@
+#include "CommandLineOptions.hpp"
+
+CommandLineOptions::CommandLineOptions():
+    myOptions(),
+    myPositionalOptions(),
+    myInputFile(),
+    myOutputFile(),
+    myChain(),
+    inputType(0),
+    outputType(0),
+    num_bits(0),
+    myHeaderlessFlag(false),
+    myDirectFlag(false),
+    mySequentialFlag(false),
+    mySumIfsFlag(false),
+    myStatsFormat(),
+    follow_timeout(-1.0),
+    mySentinel(),
+    myVerifyFlag(false)
+{
+    setup();
+}
+
+void CommandLineOptions::setup() {
+    po::options_description options("pipeline - run a chain of stages on filterbank data in a single process\n\n\
+usage: pipeline {filename} -p \"stage -{options} | stage -{options} ...\" -{options}\n\n\
+stages:\n\
+  decimate -t numsamps -c numchans   add samples, average channels (def -c all)\n\
+  mask -i filename                   zero the channels listed in the file (numbered from 1)\n\
+  rfi -i filename -k sigma -z sigma -c sigma -Z -j numthreads\n\
+                                     flag channels by spectral kurtosis (-k), spectra by their\n\
+                                     channel average (-z) and single values (-c), replacing them\n\
+                                     by the channel mean or zero (-Z), -i masks channels always\n\
+  zerodm -j numthreads               subtract the mean of the channels from every spectrum\n\
+  baseline -m mean|median -w numsamps -j numthreads\n\
+                                     subtract a running baseline from every channel (def -m mean,\n\
+                                     -w all samples so far, a median needs -w)\n\
+  dedisperse -d dm -b numbands -f reffreq\n\
+                                     dedisperse into sub-bands (def -b 1, -f highest frequency)\n\
+  requantize -n numbits -s sigma -w numsamps -r filename\n\
+                                     normalize every channel and requantize (def -n 8, -s 3,\n\
+                                     -w all samples), -r records the scaling per block\n\
+  fold -p period -P polyco -n numbins -b numbands -t subint -d dm -j numthreads\n\
+                                     fold at the period in ms or a polyco file into sub-bands and\n\
+                                     sub-integrations of subint s (def -p header period, -b 1,\n\
+                                     -t all data, -d 0)\n\noptions");
+    options.add_options()
+        ("help,h", "produce this help message")
+        ("filename", po::value<std::string>(&myInputFile)->value_name("FILE"), "filterbank data file, or shm:name to read a shared memory ring (def=stdin)")
+        ("pipeline,p", po::value<std::string>(&myChain)->required()->value_name("CHAIN"), "stages separated by |")
+        (",o", po::value<std::string>(&myOutputFile)->value_name("FILE"), "filterbank output file (def=stdout)")
+        (",n", po::value<int32_t>(&num_bits)->value_name("numbits"), "specify output number of bits (def=output of the last stage)")
+        ("headerless", po::bool_switch(&myHeaderlessFlag), "do not broadcast resulting header (def=broadcast)")
+        ("direct", po::bool_switch(&myDirectFlag), "write the output file with O_DIRECT, bypassing the page cache")
+        ("sequential", po::bool_switch(&mySequentialFlag), "run all stages on one thread (def=one thread per stage)")
+        ("sumifs", po::bool_switch(&mySumIfsFlag), "sum the IFs, e.g. polarizations, as the input is read (def=keep them)")
+        ("stats", po::value<std::string>(&myStatsFormat)->implicit_value("text")->value_name("json"), "print a per stage timing breakdown to stderr, as a table or json (def=off)")
+        ("follow", po::value<double>(&follow_timeout)->implicit_value(10.0)->value_name("seconds"), "read the input file while it is still being written, until it has not grown for seconds (def=10, 0 to wait for --sentinel)")
+        ("sentinel", po::value<std::string>(&mySentinel)->value_name("FILE"), "read the input file while it is still being written, until FILE exists")
+        ("verify", po::bool_switch(&myVerifyFlag), "check while reading that the input is not truncated and matches the CRC32C in FILE.crc32c, which is written when missing if it can be, the CRC32C is printed otherwise");
+
+    myOptions.add(options);
+    myPositionalOptions.add("filename", 1);
+}
+
+CommandLineOptions::statusReturn_e CommandLineOptions::parse(int argc, char* argv[]) {
+    statusReturn_e ret = OPTS_SUCCESS;
+
+    po::variables_map vm;
+
+    try {
+        po::store(po::command_line_parser(argc, argv)
+                    .options(myOptions)
+                    .positional(myPositionalOptions).run(),
+                vm);
+
+        if (vm.count("help")) {
+            std::cout << myOptions << std::endl;
+            return OPTS_HELP;
+        }
+        if (vm.count("filename")) {
+            // a file, or shm:name for a shared memory ring
+            inputType = vm["filename"].as<std::string>().compare(0, 4, "shm:") ? 1 : 2;
+        }
+        if (vm.count("-o")) {
+            outputType = 1;
+        }
+
+        po::notify(vm);
+
+        if (vm.count("stats") && myStatsFormat.compare("text") && myStatsFormat.compare("json")) {
+            std::cerr << "--stats only accepts text or json" << std::endl;
+            return ERROR_IN_COMMAND_LINE;
+        }
+        if (followEnabled() && inputType != 1) {
+            std::cerr << "--follow and --sentinel need an input file" << std::endl;
+            return ERROR_IN_COMMAND_LINE;
+        }
+        if (vm.count("follow") && follow_timeout <= 0.0 && mySentinel.empty()) {
+            std::cerr << "--follow=0 needs a --sentinel to end" << std::endl;
+            return ERROR_IN_COMMAND_LINE;
+        }
+
+    } catch (const po::error &ex) {
+        std::cerr << ex.what() << std::endl;
+        std::cout << myOptions << std::endl;
+        return ERROR_IN_COMMAND_LINE;
+    }
+
+    return ret;
+}
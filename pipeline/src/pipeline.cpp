@@ -0,0 +1,52 @@
+#include "pipeline.h"
+
+/**
+ * runs a chain of stages, e.g. "decimate -c 2 | dedisperse -d 30", on a
+ * filterbank file without encoding, piping and decoding between the stages
+ * 
+ * @param[in] argc the number of arguments provided to the program
+ * @param[in] argv the arguments provided to the program
+ */
+int main(int argc, char* argv[]) {
+	CommandLineOptions opts;
+	CommandLineOptions::statusReturn_e argumentStatus = opts.parse(argc, argv);
+	if (argumentStatus == CommandLineOptions::OPTS_HELP) {
+		exit(0);
+	} else if (argumentStatus != CommandLineOptions::OPTS_SUCCESS) {
+		exit(-1);
+	}
+
+	if (!opts.getStatsFormat().empty()) {
+		stats::enable(!opts.getStatsFormat().compare("json"));
+	}
+
+	try {
+		pipeline chain;
+		std::unique_ptr<filterbank_source> input(new filterbank_source((filterbank::ioType)opts.getInputType(), opts.getInputFile()));
+		if (opts.followEnabled()) {
+			input->follow(opts.getFollowTimeout(), opts.getSentinel());
+		}
+		if (opts.getSumIfsFlag()) {
+			input->sum_ifs();
+		}
+		if (opts.getVerifyFlag()) {
+			input->verify();
+		}
+		chain.set_source(std::move(input));
+		for (auto& transform : make_stages(opts.getChain())) {
+			chain.add_stage(std::move(transform));
+		}
+		chain.set_sink(std::unique_ptr<sink>(new filterbank_sink((filterbank::ioType)opts.getOutputType(),
+			opts.getOutputFile(), opts.getHeaderlessFlag(), opts.getNumberOfBits(), opts.getDirectFlag())));
+		chain.run(!opts.getSequentialFlag());
+	} catch (const std::exception& ex) {
+		std::cerr << ex.what() << "\n";
+		exit(-3);
+	} catch (const char* msg) {
+		std::cerr << msg << "\n";
+		exit(-3);
+	}
+
+	stats::report();
+	return 0;
+}
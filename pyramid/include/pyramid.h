@@ -0,0 +1,32 @@
+#ifndef PYRAMID_TOOL_H
+#define PYRAMID_TOOL_H
+
+#include <iostream>
+#include "filterbankCore.hpp"
+#include "pipeline.hpp"
+#include "pyramid.hpp"
+#include "stages.hpp"
+#include "stats.hpp"
+
+struct pyramid_tool_options {
+	std::string input; // filterbank data to build from, empty for stdin
+	std::string output; // def input.pyr
+	std::string query; // pyramid file to read a tile from
+	uint32_t time_factor = 64;
+	uint32_t channel_factor = 4;
+	uint32_t max_levels = 20;
+	// the tile, in input samples and channels, 0 samples or channels for all of them
+	uint64_t first_sample = 0;
+	uint64_t nsamples = 0;
+	uint32_t first_channel = 0;
+	uint32_t nchans = 0;
+	uint32_t tile_time_factor = 1;
+	uint32_t tile_channel_factor = 1;
+};
+
+bool parse_arguments(int32_t argc, char* argv[], pyramid_tool_options& opts);
+void write_levels(std::ostream& out, const pyramid_reader& reader);
+void write_tile(std::ostream& out, const pyramid_tile& tile);
+
+void pyramid_help();
+#endif // !PYRAMID_TOOL_H
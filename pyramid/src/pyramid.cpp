@@ -0,0 +1,188 @@
+#include "pyramid.h"
+#include <iomanip>
+#include <unistd.h>
+
+/**
+ * builds a pyramid of successively decimated levels of filterbank data in one pass, holding the
+ * mean, minimum and maximum of every cell, or reads a tile back from one. A tile comes from the
+ * level nearest to the resolution asked for, so browsing a large file at any zoom only reads the
+ * cells on screen.
+ *
+ * @param[in] argc the number of arguments provided to the program
+ * @param[in] argv the arguments provided to the program
+ */
+int32_t main(int32_t argc, char* argv[]) {
+	// Without arguments and without piped input there is nothing to do
+	if (argc < 2 && isatty(fileno(stdin))) {
+		pyramid_help();
+		exit(0);
+	}
+
+	pyramid_tool_options opts;
+	if (!parse_arguments(argc, argv, opts)) {
+		pyramid_help();
+		exit(-1);
+	}
+
+	try {
+		if (!opts.query.empty()) {
+			pyramid_reader reader(opts.query);
+			if (!opts.nsamples && !opts.nchans && opts.tile_time_factor == 1 && opts.tile_channel_factor == 1) {
+				write_levels(std::cout, reader);
+			} else {
+				uint64_t nsamples = opts.nsamples ? opts.nsamples : reader.header().nsamples;
+				uint32_t nchans = opts.nchans ? opts.nchans : reader.header().nchans;
+				write_tile(std::cout, reader.tile(opts.first_sample, nsamples, opts.first_channel, nchans,
+					opts.tile_time_factor, opts.tile_channel_factor));
+			}
+		} else {
+			if (opts.output.empty()) {
+				if (opts.input.empty()) {
+					throw std::runtime_error("A pyramid of stdin needs an output file name");
+				}
+				opts.output = opts.input + ".pyr";
+			}
+			pipeline chain;
+			chain.set_source(std::unique_ptr<source>(new filterbank_source(
+				filterbank::input_type(opts.input), opts.input)));
+			chain.set_sink(std::unique_ptr<sink>(new pyramid_sink(opts.output, opts.time_factor, opts.channel_factor, opts.max_levels)));
+			chain.run();
+		}
+	} catch (const std::exception& ex) {
+		std::cerr << ex.what() << "\n";
+		exit(-3);
+	} catch (const char* msg) {
+		std::cerr << msg << "\n";
+		exit(-3);
+	}
+
+	stats::report();
+	return 0;
+}
+
+/**
+ * Parses the sigproc style arguments of pyramid
+ *
+ * @param[in] argc the number of arguments provided to the program
+ * @param[in] argv the arguments provided to the program
+ * @param[out] opts the parsed options
+ * @return false when an argument is invalid or not supported
+ */
+bool parse_arguments(int32_t argc, char* argv[], pyramid_tool_options& opts) {
+	for (int32_t i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (stats::parse_argument(argv[i])) {
+			continue;
+		}
+		if (arg.size() < 2 || arg[0] != '-') {
+			if (!opts.input.empty()) {
+				std::cerr << "Only one input file can be given: " << arg << "\n";
+				return false;
+			}
+			opts.input = arg;
+			continue;
+		}
+
+		// All options take a value
+		if (i + 1 >= argc) {
+			std::cerr << "Missing value for " << arg << "\n";
+			return false;
+		}
+		const char* value = argv[++i];
+		char* end = nullptr;
+		double number = strtod(value, &end);
+		bool is_number = end != value && *end == '\0';
+		if (arg == "-o") {
+			opts.output = value;
+		} else if (arg == "-q") {
+			opts.query = value;
+		} else if (!is_number) {
+			std::cerr << "Invalid value for " << arg << ": " << value << "\n";
+			return false;
+		} else if (arg == "-t" && number >= 1) {
+			opts.time_factor = (uint32_t)number;
+		} else if (arg == "-c" && number >= 1) {
+			opts.channel_factor = (uint32_t)number;
+		} else if (arg == "-l" && number >= 1) {
+			opts.max_levels = (uint32_t)number;
+		} else if (arg == "-s" && number >= 0) {
+			opts.first_sample = (uint64_t)number;
+		} else if (arg == "-n" && number >= 0) {
+			opts.nsamples = (uint64_t)number;
+		} else if (arg == "-f" && number >= 0) {
+			opts.first_channel = (uint32_t)number;
+		} else if (arg == "-m" && number >= 0) {
+			opts.nchans = (uint32_t)number;
+		} else if (arg == "-r" && number >= 1) {
+			opts.tile_time_factor = (uint32_t)number;
+		} else if (arg == "-R" && number >= 1) {
+			opts.tile_channel_factor = (uint32_t)number;
+		} else {
+			std::cerr << "Unsupported option or value: " << arg << " " << value << "\n";
+			return false;
+		}
+	}
+	if (!opts.query.empty() && !opts.input.empty()) {
+		std::cerr << "Give either data to build a pyramid from or a pyramid to query\n";
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Writes the layout of a pyramid, one line per level
+ */
+void write_levels(std::ostream& out, const pyramid_reader& reader) {
+	const pyramid_header& header = reader.header();
+	out << "# nsamples " << header.nsamples << " nifs " << header.nifs << " nchans " << header.nchans
+		<< " tsamp " << header.tsamp << " fch1 " << header.fch1 << " foff " << header.foff << "\n";
+	out << "# level  time_factor  channel_factor      nsamples    nchans\n";
+	for (uint32_t index = 0; index < reader.level_count(); ++index) {
+		const pyramid_level& level = reader.level(index);
+		out << std::setw(7) << index << " " << std::setw(12) << level.time_factor << " "
+			<< std::setw(15) << level.channel_factor << " " << std::setw(13) << level.nsamples << " "
+			<< std::setw(9) << level.nchans << "\n";
+	}
+}
+
+/**
+ * Writes a tile as text, a line per cell with its first input sample, IF and first input channel
+ */
+void write_tile(std::ostream& out, const pyramid_tile& tile) {
+	out << "# level " << tile.level << " time_factor " << tile.time_factor << " channel_factor " << tile.channel_factor
+		<< " rows " << tile.nsamples << " columns " << tile.nchans << "\n";
+	out << "# sample if channel mean min max\n";
+	const pyramid_cell* cell = tile.cells.data();
+	for (uint32_t row = 0; row < tile.nsamples; ++row) {
+		for (uint32_t ifs = 0; ifs < tile.nifs; ++ifs) {
+			for (uint32_t column = 0; column < tile.nchans; ++column, ++cell) {
+				out << tile.first_sample + (uint64_t)row * tile.time_factor << " " << ifs << " "
+					<< tile.first_channel + column * tile.channel_factor << " "
+					<< cell->mean << " " << cell->min << " " << cell->max << "\n";
+			}
+		}
+	}
+}
+
+void pyramid_help() /*includefile*/
+{
+	std::cout << std::endl;
+	std::cout << ("pyramid - build a multi-resolution pyramid of filterbank data, or read a tile from one") << std::endl << std::endl;
+	std::cout << ("usage: pyramid {filename} -{options}") << std::endl;
+	std::cout << ("       pyramid -q pyramid -{tile options}") << std::endl << std::endl;
+	std::cout << ("options:") << std::endl << std::endl;
+	std::cout << ("   filename - full name of the raw data file to be read (def=stdin)") << std::endl;
+	std::cout << ("-t numsamps - samples per cell of the finest level (def=64)") << std::endl;
+	std::cout << ("-c numchans - channels per cell of the finest level (def=4)") << std::endl;
+	std::cout << ("-l levels   - most levels, each level halves the time and frequency resolution (def=20)") << std::endl;
+	std::cout << ("-o filename - output file name (def=filename.pyr)") << std::endl << std::endl;
+	std::cout << ("tile options:") << std::endl << std::endl;
+	std::cout << ("-q pyramid  - pyramid to read, without a tile its levels are listed") << std::endl;
+	std::cout << ("-s sample   - first sample of the tile (def=0)") << std::endl;
+	std::cout << ("-n numsamps - samples in the tile (def=all)") << std::endl;
+	std::cout << ("-f channel  - first channel of the tile (def=0)") << std::endl;
+	std::cout << ("-m numchans - channels in the tile (def=all)") << std::endl;
+	std::cout << ("-r numsamps - samples per cell wanted, the nearest finer level is used (def=1)") << std::endl;
+	std::cout << ("-R numchans - channels per cell wanted, the nearest finer level is used (def=1)") << std::endl;
+	std::cout << ("--stats[=json] - print a per stage timing breakdown to stderr (def=off)") << std::endl << std::endl;
+}
@@ -0,0 +1,80 @@
+#ifndef ASTERIA_PYTHON_H
+#define ASTERIA_PYTHON_H
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "filterbankCore.hpp"
+#include "pipeline.hpp"
+#include "stages.hpp"
+
+/**
+ * @brief asteria.Filterbank, a filterbank with its spectra in memory, or opened lazily for reading block by block.
+ * The spectra are shared through the buffer protocol as float32 values of shape (nsamples, nifs, nchans).
+ */
+struct filterbank_object {
+	PyObject_HEAD
+	filterbank* fb;
+	uint64_t nsamples; // spectra in data, or in the file when opened lazily
+	uint64_t first_sample; // index of the first spectrum in the file, for blocks
+	uint64_t samples_read; // spectra of a lazily opened file read so far
+	bool lazy;
+	bool busy; // a call without the GIL is reading the file
+	Py_ssize_t shape[3];
+	Py_ssize_t strides[3];
+};
+
+/**
+ * @brief The iterator returned by Filterbank.blocks, reads the next block on every step
+ */
+struct block_iterator_object {
+	PyObject_HEAD
+	filterbank_object* parent;
+	uint32_t block_samples;
+};
+
+/**
+ * @brief Feeds the spectra of a Filterbank to a pipeline, copied block by block from memory or read from its file
+ */
+class object_source : public source {
+public:
+	object_source(filterbank& fb, bool lazy, uint64_t first_sample);
+
+	std::map<std::string, header_param>& header() override { return output_header; };
+	block_ptr next() override;
+
+	uint64_t samples() const { return position - first_sample; };
+
+private:
+	filterbank& fb;
+	bool lazy;
+	std::map<std::string, header_param> output_header;
+	uint32_t values;
+	uint32_t block_samples;
+	uint64_t first_sample;
+	uint64_t position;
+	uint64_t nsamples;
+};
+
+/**
+ * @brief Collects the output of a pipeline in the data of a filterbank
+ */
+class object_sink : public sink {
+public:
+	explicit object_sink(filterbank& out) : out(out) {};
+
+	void configure(std::map<std::string, header_param>& header) override;
+	void consume(const block& input) override;
+	void finish() override;
+
+private:
+	filterbank& out;
+	uint64_t total = 0;
+};
+
+PyObject* wrap(std::unique_ptr<filterbank> fb, uint64_t first_sample, bool lazy);
+PyObject* run_stages(filterbank_object* object, std::vector<std::unique_ptr<stage>> stages);
+
+#endif // !ASTERIA_PYTHON_H
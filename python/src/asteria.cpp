@@ -0,0 +1,569 @@
+#include "asteria.h"
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+/**
+ * asteria - Python bindings to filterbank data and the pipeline stages.
+ *
+ *	fb = asteria.read("obs.fil")
+ *	spectra = numpy.asarray(fb)  # (nsamples, nifs, nchans) float32, no copy
+ *	series = fb.dedisperse(56.7)
+ *	for block in asteria.open("obs.fil").blocks(4096):
+ *		...
+ *
+ * The spectra live in the memory the C++ code reads into, so a notebook and the kernels share one
+ * copy. Reading and the stages run without the GIL, other Python threads keep running meanwhile.
+ */
+
+namespace {
+	// Created from their specs when the module is imported
+	PyTypeObject* filterbank_type = NULL;
+	PyTypeObject* block_iterator_type = NULL;
+
+	/**
+	 * Runs work without the GIL and turns the exceptions of the library into Python exceptions
+	 *
+	 * @return false when an exception was set
+	 */
+	template<typename work>
+	bool without_gil(work body) {
+		std::string error;
+		bool out_of_memory = false;
+		Py_BEGIN_ALLOW_THREADS
+		try {
+			body();
+		} catch (const std::bad_alloc&) {
+			out_of_memory = true;
+		} catch (const std::exception& ex) {
+			error = ex.what();
+		} catch (const char* msg) {
+			error = msg;
+		}
+		Py_END_ALLOW_THREADS
+		if (out_of_memory) {
+			PyErr_NoMemory();
+			return false;
+		}
+		if (!error.empty()) {
+			PyErr_SetString(PyExc_RuntimeError, error.c_str());
+			return false;
+		}
+		return true;
+	}
+
+	// The stream of a lazily opened file can only be read by one call at a time
+	bool claim(filterbank_object* object) {
+		if (object->busy) {
+			PyErr_SetString(PyExc_RuntimeError, "The Filterbank is being read by another thread");
+			return false;
+		}
+		object->busy = true;
+		return true;
+	}
+}
+
+/**
+ * @param fb the filterbank to read
+ * @param lazy whether to read from the open stream of fb instead of its data
+ * @param first_sample the index of the first spectrum
+ */
+object_source::object_source(filterbank& fb, bool lazy, uint64_t first_sample) :
+	fb(fb), lazy(lazy), output_header(fb.header), first_sample(first_sample), position(first_sample) {
+	values = fb.values_per_sample();
+	if (!values) {
+		throw std::runtime_error("The Filterbank has no channels or IFs");
+	}
+	block_samples = std::max<uint32_t>(1, (1 << 20) / values);
+	// A lazily opened file knows how many spectra are left only from its header, 0 when unknown
+	if (lazy) {
+		uint64_t total = fb.header["nsamples"].val.i;
+		nsamples = total > first_sample ? total : 0;
+	} else {
+		nsamples = fb.data.size() / values;
+	}
+	output_header["nsamples"].val.i = (int32_t)(nsamples ? nsamples - first_sample : 0);
+}
+
+block_ptr object_source::next() {
+	if (lazy) {
+		block_ptr item = block_pool::acquire(block_samples, values);
+		uint32_t n = fb.read_block(item->data.data(), block_samples);
+		if (!n) {
+			return nullptr;
+		}
+		if (n < block_samples) {
+			item->data.resize((uint64_t)n * values);
+		}
+		item->nsamples = n;
+		item->first_sample = position - first_sample;
+		position += n;
+		return item;
+	}
+
+	if (position >= nsamples) {
+		return nullptr;
+	}
+	uint32_t n = (uint32_t)std::min<uint64_t>(block_samples, nsamples - position);
+	block_ptr item = block_pool::acquire(n, values);
+	memcpy(item->data.data(), fb.data.data() + position * values, (uint64_t)n * values * sizeof(float));
+	item->nsamples = n;
+	item->first_sample = position - first_sample;
+	position += n;
+	return item;
+}
+
+void object_sink::configure(std::map<std::string, header_param>& header) {
+	out.header = header;
+}
+
+void object_sink::consume(const block& input) {
+	uint64_t size = out.data.size();
+	out.data.resize(size + input.data.size());
+	memcpy(out.data.data() + size, input.data.data(), input.data.size() * sizeof(float));
+	total += input.nsamples;
+}
+
+void object_sink::finish() {
+	out.header["nsamples"].val.i = (int32_t)total;
+}
+
+/**
+ * Makes a Filterbank object owning fb
+ *
+ * @param fb the filterbank, with its spectra in data unless lazy
+ * @param first_sample the index of the first spectrum in the file
+ * @param lazy whether fb is open for reading block by block
+ * @return PyObject* the new object, NULL with an exception set on failure
+ */
+PyObject* wrap(std::unique_ptr<filterbank> fb, uint64_t first_sample, bool lazy) {
+	filterbank_object* object = PyObject_New(filterbank_object, filterbank_type);
+	if (!object) {
+		return NULL;
+	}
+	const uint32_t values = fb->values_per_sample();
+	object->nsamples = lazy ? (uint64_t)fb->header["nsamples"].val.i : (values ? fb->data.size() / values : 0);
+	if (!lazy) {
+		fb->header["nsamples"].val.i = (int32_t)object->nsamples;
+	}
+	object->first_sample = first_sample;
+	object->samples_read = 0;
+	object->lazy = lazy;
+	object->busy = false;
+	object->shape[0] = (Py_ssize_t)object->nsamples;
+	object->shape[1] = fb->header["nifs"].val.i;
+	object->shape[2] = fb->header["nchans"].val.i;
+	object->strides[2] = sizeof(float);
+	object->strides[1] = object->shape[2] * object->strides[2];
+	object->strides[0] = object->shape[1] * object->strides[1];
+	object->fb = fb.release();
+	return (PyObject*)object;
+}
+
+/**
+ * Runs the stages on the spectra of a Filterbank, without the GIL, and returns the output as a new Filterbank.
+ * A lazily opened file is read from where its reading stopped to its end.
+ */
+PyObject* run_stages(filterbank_object* object, std::vector<std::unique_ptr<stage>> stages) {
+	if (!claim(object)) {
+		return NULL;
+	}
+	std::unique_ptr<filterbank> out(new filterbank());
+	filterbank* fb = object->fb;
+	const bool lazy = object->lazy;
+	const uint64_t first_sample = lazy ? object->samples_read : 0;
+	uint64_t samples = 0;
+	bool ok = without_gil([&]() {
+		pipeline chain;
+		object_source* input = new object_source(*fb, lazy, first_sample);
+		chain.set_source(std::unique_ptr<source>(input));
+		for (auto& transform : stages) {
+			chain.add_stage(std::move(transform));
+		}
+		chain.set_sink(std::unique_ptr<sink>(new object_sink(*out)));
+		chain.run();
+		samples = input->samples();
+	});
+	object->busy = false;
+	if (lazy) {
+		object->samples_read += samples;
+	}
+	if (!ok) {
+		return NULL;
+	}
+	return wrap(std::move(out), 0, false);
+}
+
+namespace {
+	// Instances of heap types hold a reference to their type
+	void filterbank_dealloc(PyObject* self) {
+		PyTypeObject* type = Py_TYPE(self);
+		delete ((filterbank_object*)self)->fb;
+		PyObject_Del(self);
+		Py_DECREF(type);
+	}
+
+	/**
+	 * Shares the spectra as a writable float32 buffer of shape (nsamples, nifs, nchans)
+	 */
+	int filterbank_getbuffer(PyObject* self, Py_buffer* view, int flags) {
+		filterbank_object* object = (filterbank_object*)self;
+		if (object->lazy) {
+			view->obj = NULL;
+			PyErr_SetString(PyExc_BufferError, "A Filterbank from open() has no spectra in memory, read its blocks");
+			return -1;
+		}
+		view->buf = object->fb->data.data();
+		view->obj = self;
+		Py_INCREF(self);
+		view->len = object->shape[0] * object->strides[0];
+		view->readonly = 0;
+		view->itemsize = sizeof(float);
+		view->format = (flags & PyBUF_FORMAT) ? (char*)"f" : NULL;
+		view->ndim = (flags & PyBUF_ND) ? 3 : 1;
+		view->shape = (flags & PyBUF_ND) ? object->shape : NULL;
+		view->strides = ((flags & PyBUF_STRIDES) == PyBUF_STRIDES) ? object->strides : NULL;
+		view->suboffsets = NULL;
+		view->internal = NULL;
+		return 0;
+	}
+
+	PyObject* filterbank_repr(PyObject* self) {
+		filterbank_object* object = (filterbank_object*)self;
+		std::string text = "<asteria.Filterbank nsamples=" + std::to_string(object->nsamples)
+			+ " nifs=" + std::to_string(object->shape[1]) + " nchans=" + std::to_string(object->shape[2])
+			+ " tsamp=" + std::to_string(object->fb->header["tsamp"].val.d) + (object->lazy ? " lazy>" : ">");
+		return PyUnicode_FromString(text.c_str());
+	}
+
+	PyObject* filterbank_read_block(PyObject* self, PyObject* args) {
+		filterbank_object* object = (filterbank_object*)self;
+		unsigned int nsamples = 0;
+		if (!PyArg_ParseTuple(args, "I", &nsamples)) {
+			return NULL;
+		}
+		if (!object->lazy) {
+			PyErr_SetString(PyExc_TypeError, "read_block reads a Filterbank from open(), slice the buffer of one from read()");
+			return NULL;
+		}
+		if (!nsamples || !claim(object)) {
+			return nsamples ? NULL : (PyErr_SetString(PyExc_ValueError, "A block needs at least one sample"), (PyObject*)NULL);
+		}
+
+		filterbank* fb = object->fb;
+		std::unique_ptr<filterbank> part(new filterbank());
+		part->header = fb->header;
+		uint32_t n = 0;
+		bool ok = without_gil([&]() {
+			const uint64_t values = fb->values_per_sample();
+			part->data.resize(nsamples * values);
+			n = fb->read_block(part->data.data(), nsamples);
+			part->data.resize(n * values);
+		});
+		object->busy = false;
+		if (!ok) {
+			return NULL;
+		}
+		if (!n) {
+			Py_RETURN_NONE;
+		}
+		uint64_t first_sample = object->samples_read;
+		object->samples_read += n;
+		return wrap(std::move(part), first_sample, false);
+	}
+
+	PyObject* filterbank_blocks(PyObject* self, PyObject* args, PyObject* kwargs) {
+		filterbank_object* object = (filterbank_object*)self;
+		static const char* keywords[] = { "nsamples", NULL };
+		unsigned int nsamples = 0;
+		if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|I", (char**)keywords, &nsamples)) {
+			return NULL;
+		}
+		if (!object->lazy) {
+			PyErr_SetString(PyExc_TypeError, "blocks reads a Filterbank from open(), slice the buffer of one from read()");
+			return NULL;
+		}
+		block_iterator_object* iterator = PyObject_New(block_iterator_object, block_iterator_type);
+		if (!iterator) {
+			return NULL;
+		}
+		Py_INCREF(self);
+		iterator->parent = object;
+		iterator->block_samples = nsamples ? nsamples : std::max<uint32_t>(1, (1 << 20) / std::max<uint32_t>(1, object->fb->values_per_sample()));
+		return (PyObject*)iterator;
+	}
+
+	PyObject* filterbank_decimate(PyObject* self, PyObject* args, PyObject* kwargs) {
+		static const char* keywords[] = { "time", "chans", NULL };
+		unsigned int time = 1;
+		unsigned int chans = 1;
+		if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|II", (char**)keywords, &time, &chans)) {
+			return NULL;
+		}
+		if (!time || !chans) {
+			PyErr_SetString(PyExc_ValueError, "The decimation factors must be at least 1");
+			return NULL;
+		}
+		std::vector<std::unique_ptr<stage>> stages;
+		stages.emplace_back(new decimate_stage(time, chans));
+		return run_stages((filterbank_object*)self, std::move(stages));
+	}
+
+	PyObject* filterbank_dedisperse(PyObject* self, PyObject* args, PyObject* kwargs) {
+		static const char* keywords[] = { "dm", "bands", "reference", NULL };
+		double dm = 0.0;
+		unsigned int bands = 1;
+		double reference = 0.0;
+		if (!PyArg_ParseTupleAndKeywords(args, kwargs, "d|Id", (char**)keywords, &dm, &bands, &reference)) {
+			return NULL;
+		}
+		if (!bands) {
+			PyErr_SetString(PyExc_ValueError, "Dedispersion needs at least one band");
+			return NULL;
+		}
+		std::vector<std::unique_ptr<stage>> stages;
+		stages.emplace_back(new dedisperse_stage(dm, bands, reference));
+		return run_stages((filterbank_object*)self, std::move(stages));
+	}
+
+	PyObject* filterbank_pipeline(PyObject* self, PyObject* args) {
+		const char* chain = nullptr;
+		if (!PyArg_ParseTuple(args, "s", &chain)) {
+			return NULL;
+		}
+		std::vector<std::unique_ptr<stage>> stages;
+		try {
+			stages = make_stages(chain);
+		} catch (const std::exception& ex) {
+			PyErr_SetString(PyExc_ValueError, ex.what());
+			return NULL;
+		}
+		return run_stages((filterbank_object*)self, std::move(stages));
+	}
+
+	PyObject* filterbank_write(PyObject* self, PyObject* args) {
+		filterbank_object* object = (filterbank_object*)self;
+		const char* path = nullptr;
+		if (!PyArg_ParseTuple(args, "s", &path)) {
+			return NULL;
+		}
+		if (object->lazy) {
+			PyErr_SetString(PyExc_TypeError, "Only a Filterbank with its spectra in memory can be written");
+			return NULL;
+		}
+		std::string filename(path);
+		filterbank* fb = object->fb;
+		if (!without_gil([&]() { fb->write(filterbank::ioType::FILEIO, filename); })) {
+			return NULL;
+		}
+		Py_RETURN_NONE;
+	}
+
+	// The header parameters that are set, as Python values
+	PyObject* filterbank_header(PyObject* self, void*) {
+		filterbank_object* object = (filterbank_object*)self;
+		PyObject* header = PyDict_New();
+		if (!header) {
+			return NULL;
+		}
+		for (auto& param : object->fb->header) {
+			if (!header_codec::is_set(param.second)) {
+				continue;
+			}
+			PyObject* value = NULL;
+			switch (param.second.type) {
+				case INT:
+					value = PyLong_FromLong(param.second.val.i);
+					break;
+				case DOUBLE:
+					value = PyFloat_FromDouble(param.second.val.d);
+					break;
+				case STRING:
+					value = PyUnicode_DecodeLatin1(param.second.val.s, strlen(param.second.val.s), NULL);
+					break;
+			}
+			if (!value || PyDict_SetItemString(header, param.first.c_str(), value)) {
+				Py_XDECREF(value);
+				Py_DECREF(header);
+				return NULL;
+			}
+			Py_DECREF(value);
+		}
+		return header;
+	}
+
+	PyObject* filterbank_nsamples(PyObject* self, void*) {
+		return PyLong_FromUnsignedLongLong(((filterbank_object*)self)->nsamples);
+	}
+
+	PyObject* filterbank_first_sample(PyObject* self, void*) {
+		return PyLong_FromUnsignedLongLong(((filterbank_object*)self)->first_sample);
+	}
+
+	PyObject* filterbank_shape(PyObject* self, void*) {
+		filterbank_object* object = (filterbank_object*)self;
+		return Py_BuildValue("(nnn)", object->shape[0], object->shape[1], object->shape[2]);
+	}
+
+	// A header parameter by name, the name is the closure
+	PyObject* filterbank_param(PyObject* self, void* closure) {
+		header_param& param = ((filterbank_object*)self)->fb->header[(const char*)closure];
+		return param.type == DOUBLE ? PyFloat_FromDouble(param.val.d) : PyLong_FromLong(param.val.i);
+	}
+
+	void block_iterator_dealloc(PyObject* self) {
+		PyTypeObject* type = Py_TYPE(self);
+		Py_XDECREF(((block_iterator_object*)self)->parent);
+		PyObject_Del(self);
+		Py_DECREF(type);
+	}
+
+	PyObject* block_iterator_next(PyObject* self) {
+		block_iterator_object* iterator = (block_iterator_object*)self;
+		PyObject* args = Py_BuildValue("(I)", iterator->block_samples);
+		if (!args) {
+			return NULL;
+		}
+		PyObject* item = filterbank_read_block((PyObject*)iterator->parent, args);
+		Py_DECREF(args);
+		// None ends the iteration, returning NULL without an exception raises StopIteration
+		if (item == Py_None) {
+			Py_DECREF(item);
+			return NULL;
+		}
+		return item;
+	}
+
+	PyObject* module_read(PyObject*, PyObject* args) {
+		const char* path = nullptr;
+		if (!PyArg_ParseTuple(args, "s", &path)) {
+			return NULL;
+		}
+		std::string input(path);
+		std::unique_ptr<filterbank> fb(new filterbank());
+		if (!without_gil([&]() { *fb = filterbank::read(filterbank::input_type(input), input); })) {
+			return NULL;
+		}
+		return wrap(std::move(fb), 0, false);
+	}
+
+	PyObject* module_open(PyObject*, PyObject* args) {
+		const char* path = nullptr;
+		if (!PyArg_ParseTuple(args, "s", &path)) {
+			return NULL;
+		}
+		std::string input(path);
+		std::unique_ptr<filterbank> fb(new filterbank());
+		if (!without_gil([&]() {
+			*fb = filterbank::open(filterbank::input_type(input), input);
+			// Read the next blocks while Python works on the current one
+			fb->prefetch();
+		})) {
+			return NULL;
+		}
+		return wrap(std::move(fb), 0, true);
+	}
+
+	PyMethodDef filterbank_methods[] = {
+		{ "read_block", (PyCFunction)filterbank_read_block, METH_VARARGS,
+			"read_block(nsamples) -> Filterbank of the next spectra of a file from open(), None at its end" },
+		{ "blocks", (PyCFunction)(void(*)(void))filterbank_blocks, METH_VARARGS | METH_KEYWORDS,
+			"blocks(nsamples=about 4 MB) -> iterator over the remaining spectra of a file from open()" },
+		{ "decimate", (PyCFunction)(void(*)(void))filterbank_decimate, METH_VARARGS | METH_KEYWORDS,
+			"decimate(time=1, chans=1) -> Filterbank adding time samples and averaging channels" },
+		{ "dedisperse", (PyCFunction)(void(*)(void))filterbank_dedisperse, METH_VARARGS | METH_KEYWORDS,
+			"dedisperse(dm, bands=1, reference=0.0) -> Filterbank of the time series of every band at the dm" },
+		{ "pipeline", (PyCFunction)filterbank_pipeline, METH_VARARGS,
+			"pipeline(chain) -> Filterbank after the stages, e.g. \"rfi -z 3 | decimate -t 4\" as for the pipeline tool" },
+		{ "write", (PyCFunction)filterbank_write, METH_VARARGS,
+			"write(path) writes the spectra to a filterbank file with the nbits of the header" },
+		{ NULL, NULL, 0, NULL }
+	};
+
+	PyGetSetDef filterbank_getset[] = {
+		{ (char*)"header", filterbank_header, NULL, (char*)"the header parameters that are set", NULL },
+		{ (char*)"nsamples", filterbank_nsamples, NULL, (char*)"number of spectra, 0 when unknown for a file from open()", NULL },
+		{ (char*)"first_sample", filterbank_first_sample, NULL, (char*)"index of the first spectrum of a block in its file", NULL },
+		{ (char*)"shape", filterbank_shape, NULL, (char*)"(nsamples, nifs, nchans) of the buffer", NULL },
+		{ (char*)"nchans", filterbank_param, NULL, (char*)"number of channels", (void*)"nchans" },
+		{ (char*)"nifs", filterbank_param, NULL, (char*)"number of IFs", (void*)"nifs" },
+		{ (char*)"nbits", filterbank_param, NULL, (char*)"number of bits per value in the file", (void*)"nbits" },
+		{ (char*)"tsamp", filterbank_param, NULL, (char*)"time between spectra in s", (void*)"tsamp" },
+		{ (char*)"tstart", filterbank_param, NULL, (char*)"time of the first spectrum in MJD", (void*)"tstart" },
+		{ (char*)"fch1", filterbank_param, NULL, (char*)"frequency of the first channel in MHz", (void*)"fch1" },
+		{ (char*)"foff", filterbank_param, NULL, (char*)"channel bandwidth in MHz", (void*)"foff" },
+		{ NULL, NULL, NULL, NULL, NULL }
+	};
+
+	PyType_Slot filterbank_slots[] = {
+		{ Py_tp_dealloc, (void*)filterbank_dealloc },
+		{ Py_tp_repr, (void*)filterbank_repr },
+		{ Py_tp_doc, (void*)"Filterbank data, numpy.asarray(fb) is a (nsamples, nifs, nchans) float32 view of its spectra" },
+		{ Py_tp_methods, (void*)filterbank_methods },
+		{ Py_tp_getset, (void*)filterbank_getset },
+		{ Py_bf_getbuffer, (void*)filterbank_getbuffer },
+		{ 0, NULL }
+	};
+
+	PyType_Spec filterbank_spec = {
+		"asteria.Filterbank", sizeof(filterbank_object), 0, Py_TPFLAGS_DEFAULT, filterbank_slots
+	};
+
+	PyType_Slot block_iterator_slots[] = {
+		{ Py_tp_dealloc, (void*)block_iterator_dealloc },
+		{ Py_tp_iter, (void*)PyObject_SelfIter },
+		{ Py_tp_iternext, (void*)block_iterator_next },
+		{ 0, NULL }
+	};
+
+	PyType_Spec block_iterator_spec = {
+		"asteria.BlockIterator", sizeof(block_iterator_object), 0, Py_TPFLAGS_DEFAULT, block_iterator_slots
+	};
+
+	/**
+	 * Creates a type from its spec. Its objects are only made by the module, Python code cannot
+	 * create one whose filterbank is not set.
+	 *
+	 * @return PyTypeObject* the new type, NULL with an exception set on failure
+	 */
+	PyTypeObject* make_type(PyType_Spec* spec) {
+		PyTypeObject* type = (PyTypeObject*)PyType_FromSpec(spec);
+		if (type) {
+			type->tp_new = NULL;
+		}
+		return type;
+	}
+
+	PyMethodDef module_methods[] = {
+		{ "read", module_read, METH_VARARGS, "read(path) -> Filterbank with all spectra in memory, path may be shm:name" },
+		{ "open", module_open, METH_VARARGS, "open(path) -> Filterbank with only the header read, for reading block by block" },
+		{ NULL, NULL, 0, NULL }
+	};
+
+	PyModuleDef module_definition = {
+		PyModuleDef_HEAD_INIT, "asteria",
+		"Filterbank data and pipeline stages of Asteria, the spectra shared with numpy through the buffer protocol",
+		-1, module_methods, NULL, NULL, NULL, NULL
+	};
+}
+
+PyMODINIT_FUNC PyInit_asteria() {
+	if (!filterbank_type && !(filterbank_type = make_type(&filterbank_spec))) {
+		return NULL;
+	}
+	if (!block_iterator_type && !(block_iterator_type = make_type(&block_iterator_spec))) {
+		return NULL;
+	}
+
+	PyObject* module = PyModule_Create(&module_definition);
+	if (!module) {
+		return NULL;
+	}
+	Py_INCREF(filterbank_type);
+	if (PyModule_AddObject(module, "Filterbank", (PyObject*)filterbank_type) < 0) {
+		Py_DECREF(filterbank_type);
+		Py_DECREF(module);
+		return NULL;
+	}
+	return module;
+}
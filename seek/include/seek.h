@@ -0,0 +1,35 @@
+#ifndef SEEK_H
+#define SEEK_H
+
+#include <string>
+#include <vector>
+#include "filterbankCore.hpp"
+#include "parallel.hpp"
+#include "periodicity.hpp"
+#include "sift.hpp"
+#include "stats.hpp"
+
+struct seek_options {
+	std::vector<std::string> inputs; // one time series per DM trial, empty for stdin
+	std::string output; // empty for stdout
+	uint32_t threads = 0; // 0 for all cores
+	periodicity_options search;
+	bool sift = true; // merge the detections of one signal across trials and harmonics
+	sift_options sifting;
+};
+
+/**
+ * @brief A time series read into memory
+ */
+struct time_series {
+	std::vector<float> data;
+	double tsamp = 0.0;
+	double dm = 0.0;
+};
+
+bool parse_arguments(int32_t argc, char* argv[], seek_options& opts);
+time_series read_time_series(const std::string& input);
+void write_candidates(std::ostream& out, const std::vector<periodicity_candidate>& candidates, const seek_options& opts);
+
+void seek_help();
+#endif // !SEEK_H
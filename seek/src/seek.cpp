@@ -0,0 +1,243 @@
+#include "seek.h"
+#include <iomanip>
+#include <thread>
+#include <unistd.h>
+
+/**
+ * searches dedispersed time series for periodic signals, optionally accelerated. Every input is
+ * one DM trial, the trials are searched in parallel, each thread reusing its buffers and sharing
+ * the FFT plans and templates. The candidates of all trials are sifted, so that every signal is
+ * reported once rather than at every nearby DM, frequency and harmonic, and written as one list
+ * ranked by significance.
+ *
+ * @param[in] argc the number of arguments provided to the program
+ * @param[in] argv the arguments provided to the program
+ */
+int32_t main(int32_t argc, char* argv[]) {
+	// Without arguments and without piped input there is nothing to do
+	if (argc < 2 && isatty(fileno(stdin))) {
+		seek_help();
+		exit(0);
+	}
+
+	seek_options opts;
+	if (!parse_arguments(argc, argv, opts)) {
+		seek_help();
+		exit(-1);
+	}
+	if (opts.inputs.empty()) {
+		opts.inputs.push_back("");
+	}
+
+	std::vector<periodicity_candidate> candidates;
+	try {
+		// Validates the options before any thread starts
+		periodicity_search check(opts.search);
+
+		uint32_t n_threads = opts.threads ? opts.threads : std::max(1u, std::thread::hardware_concurrency());
+		n_threads = std::min<uint32_t>(n_threads, (uint32_t)opts.inputs.size());
+		std::vector<std::vector<periodicity_candidate>> found(opts.inputs.size());
+		std::vector<periodicity_search> searches(n_threads, check);
+		std::string failure;
+		for_each_item(opts.inputs.size(), n_threads, [&](uint32_t thread, uint64_t trial) {
+			time_series series = read_time_series(opts.inputs[trial]);
+			found[trial] = searches[thread].search(series.data.data(), series.data.size(), series.tsamp, series.dm);
+			for (periodicity_candidate& candidate : found[trial]) {
+				candidate.trial = (uint32_t)trial;
+			}
+		}, [&](uint64_t, const std::string& message) {
+			failure = message;
+		});
+		if (!failure.empty()) {
+			throw std::runtime_error(failure);
+		}
+
+		for (auto& trial : found) {
+			candidates.insert(candidates.end(), trial.begin(), trial.end());
+		}
+		if (opts.sift) {
+			candidates = candidate_sifter::sift(candidates, opts.sifting);
+		} else {
+			for (periodicity_candidate& candidate : candidates) {
+				candidate.dm_low = candidate.dm_high = candidate.dm;
+			}
+			std::stable_sort(candidates.begin(), candidates.end(), [](const periodicity_candidate& a, const periodicity_candidate& b) {
+				return a.sigma > b.sigma;
+			});
+		}
+
+		if (opts.output.empty()) {
+			write_candidates(std::cout, candidates, opts);
+		} else {
+			std::ofstream file(opts.output);
+			write_candidates(file, candidates, opts);
+			if (!file.good()) {
+				throw std::runtime_error("Failed to write candidates to " + opts.output);
+			}
+		}
+	} catch (const std::exception& ex) {
+		std::cerr << ex.what() << "\n";
+		exit(-3);
+	} catch (const char* msg) {
+		std::cerr << msg << "\n";
+		exit(-3);
+	}
+
+	stats::report();
+	return 0;
+}
+
+/**
+ * Parses the sigproc style arguments of seek
+ *
+ * @param[in] argc the number of arguments provided to the program
+ * @param[in] argv the arguments provided to the program
+ * @param[out] opts the parsed options
+ * @return false when an argument is invalid or not supported
+ */
+bool parse_arguments(int32_t argc, char* argv[], seek_options& opts) {
+	for (int32_t i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (stats::parse_argument(argv[i])) {
+			continue;
+		}
+		if (arg.size() < 2 || arg[0] != '-') {
+			opts.inputs.push_back(arg);
+			continue;
+		}
+		if (arg == "-nowhiten") {
+			opts.search.whiten = false;
+			continue;
+		}
+		if (arg == "-nosift") {
+			opts.sift = false;
+			continue;
+		}
+		if (arg == "-noharm") {
+			opts.sifting.merge_harmonics = false;
+			continue;
+		}
+
+		// All other options take a value
+		if (i + 1 >= argc) {
+			std::cerr << "Missing value for " << arg << "\n";
+			return false;
+		}
+		const char* value = argv[++i];
+		char* end = nullptr;
+		double number = strtod(value, &end);
+		bool is_number = end != value && *end == '\0';
+		if (arg == "-o") {
+			opts.output = value;
+		} else if (!is_number) {
+			std::cerr << "Invalid value for " << arg << ": " << value << "\n";
+			return false;
+		} else if (arg == "-H" && number >= 1) {
+			opts.search.harmonics = (uint32_t)number;
+		} else if (arg == "-s" && number > 0) {
+			opts.search.threshold = number;
+		} else if (arg == "-f" && number >= 0) {
+			opts.search.min_frequency = number;
+		} else if (arg == "-F" && number >= 0) {
+			opts.search.max_frequency = number;
+		} else if (arg == "-c" && number >= 0) {
+			opts.search.max_candidates = (uint32_t)number;
+		} else if (arg == "-j" && number >= 0) {
+			opts.threads = (uint32_t)number;
+		} else if (arg == "-z" && number >= 0) {
+			opts.search.zmax = (uint32_t)number;
+		} else if (arg == "-D" && number >= 0) {
+			opts.sifting.dm_tolerance = number;
+		} else if (arg == "-r" && number > 0) {
+			opts.sifting.frequency_tolerance = number;
+		} else {
+			std::cerr << "Unsupported option or value: " << arg << " " << value << "\n";
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Reads a whole time series, the IFs and channels (sub-bands) of every sample are added
+ *
+ * @param[in] input the file name, empty for stdin
+ * @return the series with its sampling time and dm
+ */
+time_series read_time_series(const std::string& input) {
+	scoped_timer timer("read");
+	filterbank fb = filterbank::open(filterbank::input_type(input), input);
+	time_series series;
+	series.tsamp = fb.header["tsamp"].val.d;
+	series.dm = fb.header["refdm"].val.d;
+	const uint32_t values = fb.values_per_sample();
+	if (!values) {
+		throw std::runtime_error("Time series has no channels or IFs: " + input);
+	}
+
+	const uint32_t block_samples = std::max<uint32_t>(1, (1 << 20) / values);
+	std::vector<float> block((uint64_t)block_samples * values);
+	if (fb.header["nsamples"].val.i > 0) {
+		series.data.reserve(fb.header["nsamples"].val.i);
+	}
+	uint32_t n;
+	while ((n = fb.read_block(block.data(), block_samples)) > 0) {
+		for (uint32_t sample = 0; sample < n; ++sample) {
+			float sum = 0.0f;
+			for (uint32_t value = 0; value < values; ++value) {
+				sum += block[(uint64_t)sample * values + value];
+			}
+			series.data.push_back(sum);
+		}
+	}
+	fb.close();
+	return series;
+}
+
+/**
+ * Writes the candidates as a table, one line per candidate in rank order, with the number of detections
+ * merged into it and their DM range
+ */
+void write_candidates(std::ostream& out, const std::vector<periodicity_candidate>& candidates, const seek_options& opts) {
+	out << "# rank    sigma      power harm       period_ms     frequency_hz       fdot_hz/s   accel_m/s2        dm    dm_low   dm_high members  file\n";
+	for (size_t rank = 0; rank < candidates.size(); ++rank) {
+		const periodicity_candidate& candidate = candidates[rank];
+		const std::string& input = opts.inputs[candidate.trial];
+		out << std::setw(6) << rank + 1 << " "
+			<< std::fixed << std::setprecision(2) << std::setw(8) << candidate.sigma << " "
+			<< std::setw(10) << candidate.power << " "
+			<< std::setw(4) << candidate.harmonics << " "
+			<< std::setprecision(9) << std::setw(15) << 1.0e3 / candidate.frequency << " "
+			<< std::setw(16) << candidate.frequency << " "
+			<< std::scientific << std::setprecision(6) << std::setw(15) << candidate.fdot << " "
+			<< std::fixed << std::setprecision(3) << std::setw(12) << candidate.acceleration << " "
+			<< std::setprecision(3) << std::setw(9) << candidate.dm << " "
+			<< std::setw(9) << candidate.dm_low << " "
+			<< std::setw(9) << candidate.dm_high << " "
+			<< std::setw(7) << candidate.members << "  "
+			<< (input.empty() ? "stdin" : input) << "\n";
+	}
+}
+
+void seek_help() /*includefile*/
+{
+	std::cout << std::endl;
+	std::cout << ("seek - search dedispersed time series for periodic signals") << std::endl << std::endl;
+	std::cout << ("usage: seek {filenames} -{options}") << std::endl << std::endl;
+	std::cout << ("options:") << std::endl << std::endl;
+	std::cout << ("  filenames - time series to search, one per DM trial (def=stdin)") << std::endl;
+	std::cout << ("-H numharms - sum up to numharms harmonics: 1, 2, 4, 8, 16 or 32 (def=16)") << std::endl;
+	std::cout << ("-s sigma    - report candidates above this gaussian significance (def=6)") << std::endl;
+	std::cout << ("-f minfreq  - lowest frequency to search in Hz (def=0.1)") << std::endl;
+	std::cout << ("-F maxfreq  - highest frequency to search in Hz (def=Nyquist)") << std::endl;
+	std::cout << ("-c numcands - keep at most numcands candidates per time series, 0 for all (def=100)") << std::endl;
+	std::cout << ("-z zmax     - acceleration search over frequency drifts up to zmax bins (def=0, none)") << std::endl;
+	std::cout << ("-j threads  - number of time series searched at once (def=all cores)") << std::endl;
+	std::cout << ("-o filename - output file name for the candidates (def=stdout)") << std::endl;
+	std::cout << ("-D dmtol    - DM distance within which detections are merged (def=1.5 DM steps)") << std::endl;
+	std::cout << ("-r bins     - frequency distance in Fourier bins within which detections are merged (def=1.5)") << std::endl;
+	std::cout << ("-nowhiten   - normalize by the median of the whole spectrum instead of the running median") << std::endl;
+	std::cout << ("-noharm     - do not merge candidates at harmonic ratios of a stronger candidate") << std::endl;
+	std::cout << ("-nosift     - report every detection of every trial instead of one per signal") << std::endl;
+	std::cout << ("--stats[=json] - print a per stage timing breakdown to stderr (def=off)") << std::endl << std::endl;
+}
@@ -0,0 +1,21 @@
+#ifndef SHMWRITE_TOOL_H
+#define SHMWRITE_TOOL_H
+
+#include <iostream>
+#include "filterbankCore.hpp"
+#include "shmRing.hpp"
+#include "stats.hpp"
+
+struct shmwrite_options {
+	std::string input; // filterbank data to write, empty for stdin
+	std::string key = "asteria"; // name of the ring, read as shm:key
+	uint32_t nblocks = 8;
+	uint64_t block_bytes = 0; // 0 for about 4 MB of whole spectra
+	bool real_time = false; // hand out the data no faster than it was observed
+};
+
+bool parse_arguments(int32_t argc, char* argv[], shmwrite_options& opts);
+void write_ring(FILE* fp, const shmwrite_options& opts);
+
+void shmwrite_help();
+#endif // !SHMWRITE_TOOL_H
@@ -0,0 +1,182 @@
+#include "shmwrite.h"
+#include <chrono>
+#include <thread>
+#include <unistd.h>
+
+/**
+ * writes filterbank data into a shared memory ring, as a live backend would, for the tools to read
+ * it as shm:key. The header goes into the header block and the data into the data blocks as they
+ * become free, optionally paced to the sample time of the data.
+ *
+ * @param[in] argc the number of arguments provided to the program
+ * @param[in] argv the arguments provided to the program
+ */
+int32_t main(int32_t argc, char* argv[]) {
+	// Without arguments and without piped input there is nothing to do
+	if (argc < 2 && isatty(fileno(stdin))) {
+		shmwrite_help();
+		exit(0);
+	}
+
+	shmwrite_options opts;
+	if (!parse_arguments(argc, argv, opts)) {
+		shmwrite_help();
+		exit(-1);
+	}
+
+	try {
+		FILE* fp = opts.input.empty() ? stdin : fopen(opts.input.c_str(), "rb");
+		if (!fp) {
+			throw std::runtime_error("Failed to open " + opts.input);
+		}
+		write_ring(fp, opts);
+		if (fp != stdin) {
+			fclose(fp);
+		}
+	} catch (const std::exception& ex) {
+		std::cerr << ex.what() << "\n";
+		exit(-3);
+	} catch (const char* msg) {
+		std::cerr << msg << "\n";
+		exit(-3);
+	}
+
+	stats::report();
+	return 0;
+}
+
+/**
+ * Parses the sigproc style arguments of shmwrite
+ *
+ * @param[in] argc the number of arguments provided to the program
+ * @param[in] argv the arguments provided to the program
+ * @param[out] opts the parsed options
+ * @return false when an argument is invalid or not supported
+ */
+bool parse_arguments(int32_t argc, char* argv[], shmwrite_options& opts) {
+	for (int32_t i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (stats::parse_argument(argv[i])) {
+			continue;
+		}
+		if (arg.size() < 2 || arg[0] != '-') {
+			if (!opts.input.empty()) {
+				std::cerr << "Only one input file can be given: " << arg << "\n";
+				return false;
+			}
+			opts.input = arg;
+			continue;
+		}
+		if (arg == "-r") {
+			opts.real_time = true;
+			continue;
+		}
+
+		// The other options take a value
+		if (i + 1 >= argc) {
+			std::cerr << "Missing value for " << arg << "\n";
+			return false;
+		}
+		const char* value = argv[++i];
+		char* end = nullptr;
+		double number = strtod(value, &end);
+		bool is_number = end != value && *end == '\0';
+		if (arg == "-k") {
+			opts.key = value;
+		} else if (!is_number) {
+			std::cerr << "Invalid value for " << arg << ": " << value << "\n";
+			return false;
+		} else if (arg == "-n" && number >= 2) {
+			opts.nblocks = (uint32_t)number;
+		} else if (arg == "-b" && number >= 1) {
+			opts.block_bytes = (uint64_t)number;
+		} else {
+			std::cerr << "Unsupported option or value: " << arg << " " << value << "\n";
+			return false;
+		}
+	}
+	if (!opts.key.compare(0, 4, "shm:")) {
+		opts.key = opts.key.substr(4);
+	}
+	return true;
+}
+
+/**
+ * Creates the ring, writes the header of the input into it and then its data, a block at a time,
+ * and waits for the reader to take the last block
+ *
+ * @param fp the input, positioned at the start of the header
+ * @param opts the options
+ */
+void write_ring(FILE* fp, const shmwrite_options& opts) {
+	// Read until the whole header is in, like filterbank::open, the bytes after it are the first data
+	filterbank fb;
+	std::vector<char> buffer(header_codec::typical_size);
+	size_t length = fread(buffer.data(), sizeof(char), buffer.size(), fp);
+	size_t header_size = 0;
+	header_codec::status result = header_codec::parse(buffer.data(), length, fb.header, header_size);
+	while (result == header_codec::INCOMPLETE && !feof(fp) && !ferror(fp)) {
+		buffer.resize(length * 2);
+		length += fread(buffer.data() + length, sizeof(char), buffer.size() - length, fp);
+		result = header_codec::parse(buffer.data(), length, fb.header, header_size);
+	}
+	if (result != header_codec::COMPLETE) {
+		throw std::runtime_error("The input is not a valid filterbank file");
+	}
+	if (!fb.valid_sample_format()) {
+		throw std::runtime_error("The input does not have a supported number of bits or whole bytes per sample");
+	}
+
+	// Blocks of whole spectra let the reader decode them in place
+	const uint64_t sample_bytes = fb.bytes_per_sample();
+	uint64_t block_bytes = opts.block_bytes;
+	if (!block_bytes) {
+		block_bytes = std::max<uint64_t>(1, (4 << 20) / sample_bytes) * sample_bytes;
+	}
+	std::shared_ptr<shm_ring> ring = shm_ring::create(opts.key, opts.nblocks,
+		block_bytes, std::max<uint64_t>(shm_ring::default_header_bytes, header_size));
+	ring->write_header(buffer.data(), header_size);
+
+	const double tsamp = fb.header["tsamp"].val.d;
+	const auto start = std::chrono::steady_clock::now();
+	uint64_t pending = length - header_size;
+	uint64_t written = 0;
+	while (true) {
+		uint8_t* block = ring->next_free();
+		uint64_t bytes = std::min(pending, block_bytes);
+		memcpy(block, buffer.data() + length - pending, bytes);
+		pending -= bytes;
+		{
+			scoped_timer timer("read");
+			bytes += fread(block + bytes, sizeof(char), block_bytes - bytes, fp);
+		}
+		if (!bytes) {
+			break;
+		}
+		// Like a backend the data becomes available no earlier than its last sample was observed
+		if (opts.real_time && tsamp > 0.0) {
+			std::chrono::duration<double> due((double)((written + bytes) / sample_bytes) * tsamp);
+			std::this_thread::sleep_until(start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(due));
+		}
+		ring->submit(bytes);
+		written += bytes;
+		stats::count("write", bytes, bytes / sample_bytes);
+	}
+
+	scoped_timer timer("wait for reader");
+	ring->finish();
+}
+
+void shmwrite_help() /*includefile*/
+{
+	std::cout << std::endl;
+	std::cout << ("shmwrite - write filterbank data into a shared memory ring, to be read as shm:key") << std::endl << std::endl;
+	std::cout << ("usage: shmwrite {filename} -{options}") << std::endl << std::endl;
+	std::cout << ("options:") << std::endl << std::endl;
+	std::cout << ("   filename - full name of the raw data file to be read (def=stdin)") << std::endl;
+	std::cout << ("-k key      - name of the shared memory ring (def=asteria)") << std::endl;
+	std::cout << ("-n numblks  - number of data blocks in the ring, at least 2 (def=8)") << std::endl;
+	std::cout << ("-b numbytes - bytes per data block (def=about 4 MB of whole samples)") << std::endl;
+	std::cout << ("-r          - write the data in real time, paced by the sample time (def=as fast as read)") << std::endl;
+	std::cout << ("--stats[=json] - print a per stage timing breakdown to stderr (def=off)") << std::endl << std::endl;
+}
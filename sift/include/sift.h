@@ -0,0 +1,22 @@
+#ifndef SIFT_TOOL_H
+#define SIFT_TOOL_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include "sift.hpp"
+#include "stats.hpp"
+
+struct sift_tool_options {
+	std::vector<std::string> inputs; // single pulse lists, empty for stdin
+	std::string output; // empty for stdout
+	double threshold = 0.0; // lowest significance read
+	sift_options sifting;
+};
+
+bool parse_arguments(int32_t argc, char* argv[], sift_tool_options& opts);
+void read_pulses(std::istream& in, const std::string& input, double threshold, std::vector<single_pulse_candidate>& pulses);
+void write_pulses(std::ostream& out, const std::vector<single_pulse_candidate>& pulses);
+
+void sift_help();
+#endif // !SIFT_TOOL_H
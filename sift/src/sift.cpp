@@ -0,0 +1,194 @@
+#include "sift.h"
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <unistd.h>
+
+/**
+ * sifts single pulse candidates: the pulses of all lists, e.g. one list per DM trial, are grouped
+ * in DM, time and width, and the strongest pulse of every group is written with the number of
+ * pulses and the DM range of the group, ranked by significance. Lists have a line per pulse with
+ * the DM, significance, time in seconds, sample and boxcar width in samples, lines starting with
+ * # are comments.
+ *
+ * @param[in] argc the number of arguments provided to the program
+ * @param[in] argv the arguments provided to the program
+ */
+int32_t main(int32_t argc, char* argv[]) {
+	// Without arguments and without piped input there is nothing to do
+	if (argc < 2 && isatty(fileno(stdin))) {
+		sift_help();
+		exit(0);
+	}
+
+	sift_tool_options opts;
+	if (!parse_arguments(argc, argv, opts)) {
+		sift_help();
+		exit(-1);
+	}
+	if (opts.inputs.empty()) {
+		opts.inputs.push_back("");
+	}
+
+	try {
+		std::vector<single_pulse_candidate> pulses;
+		{
+			scoped_timer timer("read");
+			for (const std::string& input : opts.inputs) {
+				if (input.empty()) {
+					read_pulses(std::cin, "stdin", opts.threshold, pulses);
+					continue;
+				}
+				std::ifstream file(input);
+				if (!file.is_open()) {
+					throw std::runtime_error("Failed to open " + input);
+				}
+				read_pulses(file, input, opts.threshold, pulses);
+			}
+		}
+
+		std::vector<single_pulse_candidate> events = candidate_sifter::sift(pulses, opts.sifting);
+
+		scoped_timer timer("write");
+		if (opts.output.empty()) {
+			write_pulses(std::cout, events);
+		} else {
+			std::ofstream file(opts.output);
+			write_pulses(file, events);
+			if (!file.good()) {
+				throw std::runtime_error("Failed to write pulses to " + opts.output);
+			}
+		}
+	} catch (const std::exception& ex) {
+		std::cerr << ex.what() << "\n";
+		exit(-3);
+	} catch (const char* msg) {
+		std::cerr << msg << "\n";
+		exit(-3);
+	}
+
+	stats::report();
+	return 0;
+}
+
+/**
+ * Parses the sigproc style arguments of sift
+ *
+ * @param[in] argc the number of arguments provided to the program
+ * @param[in] argv the arguments provided to the program
+ * @param[out] opts the parsed options
+ * @return false when an argument is invalid or not supported
+ */
+bool parse_arguments(int32_t argc, char* argv[], sift_tool_options& opts) {
+	for (int32_t i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (stats::parse_argument(argv[i])) {
+			continue;
+		}
+		if (arg.size() < 2 || arg[0] != '-') {
+			opts.inputs.push_back(arg);
+			continue;
+		}
+
+		// All options take a value
+		if (i + 1 >= argc) {
+			std::cerr << "Missing value for " << arg << "\n";
+			return false;
+		}
+		const char* value = argv[++i];
+		char* end = nullptr;
+		double number = strtod(value, &end);
+		bool is_number = end != value && *end == '\0';
+		if (arg == "-o") {
+			opts.output = value;
+		} else if (!is_number) {
+			std::cerr << "Invalid value for " << arg << ": " << value << "\n";
+			return false;
+		} else if (arg == "-s" && number >= 0) {
+			opts.threshold = number;
+		} else if (arg == "-d" && number >= 0) {
+			opts.sifting.dm_tolerance = number;
+		} else if (arg == "-t" && number >= 0) {
+			opts.sifting.time_tolerance = number * 1.0e-3;
+		} else if (arg == "-w" && number >= 1) {
+			opts.sifting.width_factor = number;
+		} else {
+			std::cerr << "Unsupported option or value: " << arg << " " << value << "\n";
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Reads a single pulse list. The width in seconds is the boxcar width times the sampling time, which is
+ * the time over the sample of the pulse, or of the last pulse with a sample for pulses at sample 0.
+ *
+ * @param[in] in the list
+ * @param[in] input the name of the list, for errors
+ * @param[in] threshold pulses below this significance are skipped
+ * @param[out] pulses the pulses are appended to this
+ */
+void read_pulses(std::istream& in, const std::string& input, double threshold, std::vector<single_pulse_candidate>& pulses) {
+	std::string line;
+	uint64_t number = 0;
+	double tsamp = 0.0;
+	while (std::getline(in, line)) {
+		number++;
+		size_t first = line.find_first_not_of(" \t\r");
+		if (first == std::string::npos || line[first] == '#') {
+			continue;
+		}
+		std::istringstream fields(line);
+		single_pulse_candidate pulse;
+		double boxcar = 0.0;
+		if (!(fields >> pulse.dm >> pulse.sigma >> pulse.time >> pulse.sample >> boxcar)) {
+			throw std::runtime_error("Invalid pulse on line " + std::to_string(number) + " of " + input);
+		}
+		if (pulse.sample) {
+			tsamp = pulse.time / pulse.sample;
+		}
+		if (pulse.sigma < threshold) {
+			continue;
+		}
+		pulse.width = boxcar * tsamp;
+		pulse.dm_low = pulse.dm_high = pulse.dm;
+		pulses.push_back(pulse);
+	}
+	stats::count("read", 0, number);
+}
+
+/**
+ * Writes the sifted pulses in the format they were read, with the number of pulses and DM range of every group
+ */
+void write_pulses(std::ostream& out, const std::vector<single_pulse_candidate>& pulses) {
+	out << "# DM      Sigma      Time (s)     Sample    Downfact   Members    DM_low   DM_high\n";
+	for (const single_pulse_candidate& pulse : pulses) {
+		double tsamp = pulse.sample ? pulse.time / pulse.sample : 0.0;
+		uint64_t boxcar = tsamp > 0.0 ? (uint64_t)std::llround(pulse.width / tsamp) : 0;
+		out << std::fixed << std::setprecision(2) << std::setw(7) << pulse.dm << " "
+			<< std::setw(7) << pulse.sigma << " "
+			<< std::setprecision(6) << std::setw(13) << pulse.time << " "
+			<< std::setw(10) << pulse.sample << "     "
+			<< std::setw(3) << boxcar << " "
+			<< std::setw(9) << pulse.members << " "
+			<< std::setprecision(2) << std::setw(9) << pulse.dm_low << " "
+			<< std::setw(9) << pulse.dm_high << "\n";
+	}
+}
+
+void sift_help() /*includefile*/
+{
+	std::cout << std::endl;
+	std::cout << ("sift - merge the single pulse candidates of one event into one ranked candidate") << std::endl << std::endl;
+	std::cout << ("usage: sift {filenames} -{options}") << std::endl << std::endl;
+	std::cout << ("options:") << std::endl << std::endl;
+	std::cout << ("  filenames - single pulse lists: DM, sigma, time (s), sample, boxcar width per line (def=stdin)") << std::endl;
+	std::cout << ("-s sigma    - ignore pulses below this significance (def=0)") << std::endl;
+	std::cout << ("-d dmtol    - DM distance within which pulses are merged (def=1.5 DM steps)") << std::endl;
+	std::cout << ("-t ms       - time distance within which pulses are merged (def=2 median widths)") << std::endl;
+	std::cout << ("-w factor   - widths within this factor of each other are merged (def=2)") << std::endl;
+	std::cout << ("-o filename - output file name for the sifted pulses (def=stdout)") << std::endl;
+	std::cout << ("--stats[=json] - print a per stage timing breakdown to stderr (def=off)") << std::endl << std::endl;
+}
@@ -0,0 +1,21 @@
+#ifndef SPLICE_TOOL_H
+#define SPLICE_TOOL_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include "filterbankCore.hpp"
+#include "pipeline.hpp"
+#include "stages.hpp"
+#include "stats.hpp"
+
+struct splice_options {
+	std::vector<std::string> inputs; // the sub-band files, or the files split in time for concat
+	std::string output; // empty for stdout
+	bool headerless = false;
+};
+
+bool parse_arguments(int32_t argc, char* argv[], splice_options& opts);
+
+void splice_help();
+#endif // !SPLICE_TOOL_H
@@ -0,0 +1,120 @@
+#include "splice.h"
+
+namespace {
+	// What differs between the two modes of the tool
+	struct combine_mode {
+		const char* name;
+		const char* summary;
+		const char* filenames;
+		const char* verb;
+		const char* none_given;
+	};
+
+#ifdef SPLICE_IN_TIME
+	const combine_mode mode = { "concat", "concatenate the files of an observation split in time into one file",
+		"the files, in any order: they are ordered by start time and must follow each other", "concatenated", "No files given" };
+#else
+	const combine_mode mode = { "splice", "splice the sub-bands of an observation in separate files into one file with all channels",
+		"the sub-band files, in any order: they are ordered by frequency and must be adjacent", "spliced", "No sub-band files given" };
+#endif
+}
+
+/**
+ * splices the sub-bands of one observation, written to separate files by the backend, into one file
+ * with all channels. The files may be given in any order; their channels must be adjacent and of the
+ * same width, and their IFs, sample time and start time the same.
+ *
+ * Built as concat (with SPLICE_IN_TIME) it concatenates the files of a long observation, split in time
+ * by the backend, into one file instead. The files are ordered by start time, every file must start
+ * where the previous one ends, and their channels, IFs and sample time must be the same.
+ *
+ * Either way the data is streamed block by block, so memory use does not depend on the size of the files.
+ *
+ * @param[in] argc the number of arguments provided to the program
+ * @param[in] argv the arguments provided to the program
+ */
+int32_t main(int32_t argc, char* argv[]) {
+	if (argc < 2) {
+		splice_help();
+		exit(0);
+	}
+
+	splice_options opts;
+	if (!parse_arguments(argc, argv, opts)) {
+		splice_help();
+		exit(-1);
+	}
+
+	try {
+		pipeline chain;
+#ifdef SPLICE_IN_TIME
+		chain.set_source(std::unique_ptr<source>(new concat_source(opts.inputs)));
+#else
+		chain.set_source(std::unique_ptr<source>(new splice_source(opts.inputs)));
+#endif
+		chain.set_sink(std::unique_ptr<sink>(new filterbank_sink(
+			opts.output.empty() ? filterbank::ioType::STDIO : filterbank::ioType::FILEIO, opts.output, opts.headerless)));
+		chain.run();
+	} catch (const std::exception& ex) {
+		std::cerr << ex.what() << "\n";
+		exit(-3);
+	} catch (const char* msg) {
+		std::cerr << msg << "\n";
+		exit(-3);
+	}
+
+	stats::report();
+	return 0;
+}
+
+/**
+ * Parses the sigproc style arguments of splice and concat
+ *
+ * @param[in] argc the number of arguments provided to the program
+ * @param[in] argv the arguments provided to the program
+ * @param[out] opts the parsed options
+ * @return false when an argument is invalid or not supported
+ */
+bool parse_arguments(int32_t argc, char* argv[], splice_options& opts) {
+	for (int32_t i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (stats::parse_argument(argv[i])) {
+			continue;
+		}
+		if (arg.size() < 2 || arg[0] != '-') {
+			opts.inputs.push_back(arg);
+			continue;
+		}
+		if (arg == "-headerless") {
+			opts.headerless = true;
+		} else if (arg == "-o" && i + 1 < argc) {
+			opts.output = argv[++i];
+		} else {
+			std::cerr << "Unsupported option: " << arg << "\n";
+			return false;
+		}
+	}
+	if (opts.inputs.empty()) {
+		std::cerr << mode.none_given << "\n";
+		return false;
+	}
+	for (const std::string& input : opts.inputs) {
+		if (filterbank::input_type(input) != filterbank::ioType::FILEIO) {
+			std::cerr << "Only files can be " << mode.verb << ": " << input << "\n";
+			return false;
+		}
+	}
+	return true;
+}
+
+void splice_help() /*includefile*/
+{
+	std::cout << std::endl;
+	std::cout << mode.name << " - " << mode.summary << std::endl << std::endl;
+	std::cout << "usage: " << mode.name << " {filenames} -{options}" << std::endl << std::endl;
+	std::cout << ("options:") << std::endl << std::endl;
+	std::cout << "  filenames - " << mode.filenames << std::endl;
+	std::cout << ("-o filename - output file name (def=stdout)") << std::endl;
+	std::cout << ("-headerless - write out data without any header info") << std::endl;
+	std::cout << ("--stats[=json] - print a per stage timing breakdown to stderr (def=off)") << std::endl << std::endl;
+}
@@ -0,0 +1,88 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <string>
+#include <vector>
+#include "filterbankCore.hpp"
+#include "periodicity.hpp"
+#include "pipeline.hpp"
+#include "sift.hpp"
+#include "stages.hpp"
+#include "stats.hpp"
+
+struct sweep_options {
+	std::string input; // the filterbank file, read once per group of DM trials
+	std::string output; // empty for stdout
+	double dm_start = 0.0; // -dmstart, the first DM trial
+	double dm_end = -1.0; // -dmend, the last DM trial at most
+	double dm_step = 0.0; // -dmstep
+	bool sum_ifs = false; // -sumifs
+	bool baseline = true; // -nobaseline switches it off
+	uint32_t threads = 0; // DM trials searched at once per process, 0 for all cores
+	periodicity_options search;
+	bool sift = true; // merge the detections of one signal across trials and harmonics
+	sift_options sifting;
+
+	// sharding: the coordinator splits the DM trials into shards, workers search one shard each
+	uint32_t shards = 1; // -shards
+	int32_t shard = -1; // -shard, the shard a worker searches, -1 for the coordinator
+	std::string work_directory; // -workdir, where the workers leave their candidates, shared by all nodes
+	std::string launch; // -launch, command prefix starting a worker, e.g. on another node
+	bool merge_only = false; // -merge, the workers were started by other means, only merge their candidates
+	std::vector<std::string> worker_arguments; // the arguments the workers are started with as well
+};
+
+/**
+ * @brief Collects a dedispersed time series in memory, the IFs and sub-bands of every sample are added
+ */
+class series_sink : public sink {
+public:
+	explicit series_sink(std::vector<float>& series) : series(series) {};
+
+	void configure(std::map<std::string, header_param>& header) override;
+	void consume(const block& input) override;
+
+private:
+	std::vector<float>& series;
+	uint32_t values = 0;
+};
+
+/**
+ * @brief Dedisperses every block at the DMs of several trials into a time series each, so that the input
+ * is read and its baseline subtracted once for all of them
+ */
+class trials_sink : public sink {
+public:
+	trials_sink(const std::vector<double>& dms, uint32_t threads);
+
+	void configure(std::map<std::string, header_param>& header) override;
+	void consume(const block& input) override;
+	void finish() override;
+	const std::vector<float>& series(size_t trial) const { return all_series[trial]; };
+
+private:
+	std::vector<double> dms;
+	std::vector<std::vector<float>> all_series;
+	std::vector<std::unique_ptr<dedisperse_stage>> stages;
+	std::vector<std::unique_ptr<series_sink>> sinks;
+	std::vector<emitter> emitters;
+	worker_pool pool;
+};
+
+bool parse_arguments(int32_t argc, char* argv[], sweep_options& opts);
+std::vector<double> dm_trials(const sweep_options& opts);
+std::pair<size_t, size_t> shard_trials(size_t n_trials, uint32_t shards, uint32_t shard);
+std::string plan_signature(const sweep_options& opts);
+std::string absolute_path(const std::string& path);
+
+std::vector<periodicity_candidate> search_trials(const sweep_options& opts, const std::vector<double>& dms, size_t first, size_t last);
+
+std::string shard_file(const sweep_options& opts, uint32_t shard);
+void write_shard(const sweep_options& opts, const std::vector<periodicity_candidate>& candidates);
+bool read_shard(const sweep_options& opts, uint32_t shard, std::vector<periodicity_candidate>& candidates);
+std::vector<periodicity_candidate> run_shards(const sweep_options& opts);
+
+void write_candidates(std::ostream& out, const std::vector<periodicity_candidate>& candidates);
+
+void sweep_help();
+#endif // !SWEEP_H
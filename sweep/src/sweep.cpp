@@ -0,0 +1,683 @@
+#include "sweep.h"
+#include <cerrno>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/**
+ * sweeps a filterbank file over a range of DM trials: every trial is dedispersed into a time series
+ * and searched for periodic signals, and the candidates of all trials are sifted into one list ranked
+ * by significance. With -shards the trials are split into contiguous DM ranges, one per worker process.
+ * The workers leave their detections in a work directory, which on a shared filesystem can be on any
+ * node, and the coordinator merges them in trial order and sifts them, so that the output is the same
+ * for any number of shards.
+ *
+ * @param[in] argc the number of arguments provided to the program
+ * @param[in] argv the arguments provided to the program
+ */
+int32_t main(int32_t argc, char* argv[]) {
+	if (argc < 2) {
+		sweep_help();
+		exit(0);
+	}
+
+	sweep_options opts;
+	if (!parse_arguments(argc, argv, opts)) {
+		sweep_help();
+		exit(-1);
+	}
+
+	try {
+		// Workers may run in another directory or on another node, so they are given the same absolute path
+		opts.input = absolute_path(opts.input);
+		std::vector<double> dms = dm_trials(opts);
+		if (opts.shard >= 0) {
+			// A worker leaves the detections of its shard as they are, they are only sifted with all others
+			std::pair<size_t, size_t> range = shard_trials(dms.size(), opts.shards, (uint32_t)opts.shard);
+			write_shard(opts, search_trials(opts, dms, range.first, range.second));
+			stats::report();
+			return 0;
+		}
+
+		std::vector<periodicity_candidate> candidates;
+		if (opts.shards > 1 || opts.merge_only || !opts.launch.empty()) {
+			candidates = run_shards(opts);
+		} else {
+			candidates = search_trials(opts, dms, 0, dms.size());
+		}
+		if (opts.sift) {
+			candidates = candidate_sifter::sift(candidates, opts.sifting);
+		} else {
+			for (periodicity_candidate& candidate : candidates) {
+				candidate.dm_low = candidate.dm_high = candidate.dm;
+			}
+			std::stable_sort(candidates.begin(), candidates.end(), [](const periodicity_candidate& a, const periodicity_candidate& b) {
+				return a.sigma > b.sigma;
+			});
+		}
+
+		if (opts.output.empty()) {
+			write_candidates(std::cout, candidates);
+		} else {
+			std::ofstream file(opts.output);
+			write_candidates(file, candidates);
+			if (!file.good()) {
+				throw std::runtime_error("Failed to write candidates to " + opts.output);
+			}
+		}
+	} catch (const std::exception& ex) {
+		std::cerr << ex.what() << "\n";
+		exit(-3);
+	} catch (const char* msg) {
+		std::cerr << msg << "\n";
+		exit(-3);
+	}
+
+	stats::report();
+	return 0;
+}
+
+/**
+ * Parses the sigproc style arguments of sweep. The arguments that describe the search, rather than how the
+ * coordinator runs it, are kept to start the workers with.
+ *
+ * @param[in] argc the number of arguments provided to the program
+ * @param[in] argv the arguments provided to the program
+ * @param[out] opts the parsed options
+ * @return false when an argument is invalid or not supported
+ */
+bool parse_arguments(int32_t argc, char* argv[], sweep_options& opts) {
+	for (int32_t i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (stats::parse_argument(argv[i])) {
+			opts.worker_arguments.push_back(arg);
+			continue;
+		}
+		if (arg.size() < 2 || arg[0] != '-') {
+			if (!opts.input.empty()) {
+				std::cerr << "Only one input file can be given: " << arg << "\n";
+				return false;
+			}
+			opts.input = arg;
+			continue;
+		}
+		if (arg == "-merge") {
+			opts.merge_only = true;
+			continue;
+		}
+		if (arg == "-sumifs" || arg == "-nobaseline" || arg == "-nowhiten" || arg == "-nosift" || arg == "-noharm") {
+			opts.sum_ifs |= arg == "-sumifs";
+			opts.baseline &= arg != "-nobaseline";
+			opts.search.whiten &= arg != "-nowhiten";
+			opts.sift &= arg != "-nosift";
+			opts.sifting.merge_harmonics &= arg != "-noharm";
+			opts.worker_arguments.push_back(arg);
+			continue;
+		}
+
+		// All other options take a value
+		if (i + 1 >= argc) {
+			std::cerr << "Missing value for " << arg << "\n";
+			return false;
+		}
+		const char* value = argv[++i];
+		if (arg == "-o") {
+			opts.output = value;
+			continue;
+		}
+		if (arg == "-workdir") {
+			opts.work_directory = value;
+			continue;
+		}
+		if (arg == "-launch") {
+			opts.launch = value;
+			continue;
+		}
+		char* end = nullptr;
+		double number = strtod(value, &end);
+		bool is_number = end != value && *end == '\0';
+		if (!is_number) {
+			std::cerr << "Invalid value for " << arg << ": " << value << "\n";
+			return false;
+		} else if (arg == "-dmstart") {
+			opts.dm_start = number;
+		} else if (arg == "-dmend") {
+			opts.dm_end = number;
+		} else if (arg == "-dmstep" && number > 0) {
+			opts.dm_step = number;
+		} else if (arg == "-shards" && number >= 1) {
+			opts.shards = (uint32_t)number;
+		} else if (arg == "-shard" && number >= 0) {
+			opts.shard = (int32_t)number;
+			continue;
+		} else if (arg == "-H" && number >= 1) {
+			opts.search.harmonics = (uint32_t)number;
+		} else if (arg == "-s" && number > 0) {
+			opts.search.threshold = number;
+		} else if (arg == "-f" && number >= 0) {
+			opts.search.min_frequency = number;
+		} else if (arg == "-F" && number >= 0) {
+			opts.search.max_frequency = number;
+		} else if (arg == "-c" && number >= 0) {
+			opts.search.max_candidates = (uint32_t)number;
+		} else if (arg == "-j" && number >= 0) {
+			opts.threads = (uint32_t)number;
+		} else if (arg == "-z" && number >= 0) {
+			opts.search.zmax = (uint32_t)number;
+		} else if (arg == "-D" && number >= 0) {
+			opts.sifting.dm_tolerance = number;
+		} else if (arg == "-r" && number > 0) {
+			opts.sifting.frequency_tolerance = number;
+		} else {
+			std::cerr << "Unsupported option or value: " << arg << " " << value << "\n";
+			return false;
+		}
+		opts.worker_arguments.push_back(arg);
+		opts.worker_arguments.push_back(value);
+	}
+
+	if (filterbank::input_type(opts.input) != filterbank::ioType::FILEIO) {
+		std::cerr << "A filterbank file is required, it is read once per group of DM trials\n";
+		return false;
+	}
+	if (opts.dm_step <= 0.0 || opts.dm_end < opts.dm_start) {
+		std::cerr << "The DM trials need -dmend at least -dmstart and a -dmstep\n";
+		return false;
+	}
+	if (opts.shard >= (int32_t)opts.shards) {
+		std::cerr << "The shard must be below the number of shards: " << opts.shard << "\n";
+		return false;
+	}
+	if (opts.merge_only && opts.work_directory.empty()) {
+		std::cerr << "-merge needs the -workdir of the workers\n";
+		return false;
+	}
+	if (opts.shard >= 0 && opts.work_directory.empty()) {
+		std::cerr << "A worker needs the -workdir to leave its candidates in\n";
+		return false;
+	}
+	if (!opts.launch.empty() && opts.work_directory.empty()) {
+		std::cerr << "-launch needs a -workdir on a filesystem the nodes share\n";
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @param[in] path a file or directory that exists
+ * @return the absolute path of it
+ */
+std::string absolute_path(const std::string& path) {
+	char resolved[PATH_MAX];
+	if (!realpath(path.c_str(), resolved)) {
+		throw std::runtime_error("Failed to open " + path);
+	}
+	return resolved;
+}
+
+/**
+ * @param[in] opts the options
+ * @return the DM of every trial, from dm_start up to dm_end in steps of dm_step
+ */
+std::vector<double> dm_trials(const sweep_options& opts) {
+	// Tolerates the rounding of the step, so that a dm_end on the grid is always a trial
+	size_t n_trials = (size_t)std::floor((opts.dm_end - opts.dm_start) / opts.dm_step + 1.0e-6) + 1;
+	std::vector<double> dms(n_trials);
+	for (size_t trial = 0; trial < n_trials; ++trial) {
+		dms[trial] = opts.dm_start + (double)trial * opts.dm_step;
+	}
+	return dms;
+}
+
+/**
+ * Splits the trials into contiguous ranges of DM, which differ by at most one trial in size
+ *
+ * @return the first trial of the shard and the trial after its last
+ */
+std::pair<size_t, size_t> shard_trials(size_t n_trials, uint32_t shards, uint32_t shard) {
+	return std::make_pair(n_trials * shard / shards, n_trials * (shard + 1) / shards);
+}
+
+/**
+ * @return the options the detections of a shard depend on, so that the detections of another search
+ * left in the work directory are never merged
+ */
+std::string plan_signature(const sweep_options& opts) {
+	std::ostringstream signature;
+	signature << std::setprecision(17) << "sweep " << opts.input
+		<< " dms " << opts.dm_start << " " << opts.dm_end << " " << opts.dm_step
+		<< " shards " << opts.shards
+		<< " sumifs " << opts.sum_ifs << " baseline " << opts.baseline
+		<< " harmonics " << opts.search.harmonics << " sigma " << opts.search.threshold
+		<< " frequencies " << opts.search.min_frequency << " " << opts.search.max_frequency
+		<< " candidates " << opts.search.max_candidates << " whiten " << opts.search.whiten
+		<< " zmax " << opts.search.zmax;
+	return signature.str();
+}
+
+// the memory the time series of a group of trials take at most, a group holds at least one trial
+static const uint64_t group_bytes = 1ull << 30;
+
+/**
+ * Dedisperses and searches a range of trials. The input is read and its baseline subtracted once for a group
+ * of trials, which are dedispersed from the same blocks, several at once; the groups are as large as the
+ * memory of their time series allows. The series of a group are then searched, several at once.
+ *
+ * @param[in] opts the options
+ * @param[in] dms the DM of every trial
+ * @param[in] first the first trial to search
+ * @param[in] last the trial after the last to search
+ * @return the detections, in trial order and by significance within a trial
+ */
+std::vector<periodicity_candidate> search_trials(const sweep_options& opts, const std::vector<double>& dms, size_t first, size_t last) {
+	std::vector<periodicity_candidate> candidates;
+	if (first >= last) {
+		return candidates;
+	}
+	// Validates the options before any thread starts
+	periodicity_search check(opts.search);
+
+	const uint32_t cores = std::max(1u, std::thread::hardware_concurrency());
+	const uint32_t n_threads = (uint32_t)std::min<uint64_t>(opts.threads ? opts.threads : cores, last - first);
+	std::vector<periodicity_search> searches(n_threads, check);
+
+	// A trial holds its series and the samples its dedispersion carries over, the most at the highest DM
+	filterbank fb = filterbank::open(filterbank::ioType::FILEIO, opts.input);
+	fb.close();
+	const uint64_t values = (uint64_t)(opts.sum_ifs ? 1 : fb.header["nifs"].val.i) * fb.header["nchans"].val.i;
+	uint64_t max_delay = 0;
+	if (fb.header["tsamp"].val.d > 0.0 && fb.header["nchans"].val.i > 0) {
+		std::vector<uint32_t> delays = dedisperse_stage::channel_delays(fb.header, dms[last - 1]);
+		max_delay = *std::max_element(delays.begin(), delays.end());
+	}
+	const uint64_t trial_bytes = sizeof(float) * ((uint64_t)(uint32_t)fb.header["nsamples"].val.i + 2 * values * max_delay);
+	const size_t group = (size_t)std::max<uint64_t>(1, group_bytes / std::max<uint64_t>(1, trial_bytes));
+
+	for (size_t begin = first; begin < last; begin += group) {
+		const size_t end = std::min(last, begin + group);
+		std::unique_ptr<filterbank_source> source(new filterbank_source(filterbank::ioType::FILEIO, opts.input));
+		if (opts.sum_ifs) {
+			source->sum_ifs();
+		}
+		const double tsamp = source->fb.header["tsamp"].val.d;
+		trials_sink* trials = new trials_sink(std::vector<double>(dms.begin() + begin, dms.begin() + end), n_threads);
+
+		// The stages run one after the other on this thread, each splitting its work over the threads
+		pipeline chain;
+		chain.set_source(std::move(source));
+		if (opts.baseline) {
+			chain.add_stage(baseline_stage::running_median(1.0, tsamp, cores));
+		}
+		chain.set_sink(std::unique_ptr<sink>(trials));
+		chain.run(false);
+
+		std::vector<std::vector<periodicity_candidate>> found(end - begin);
+		std::string failure;
+		for_each_item(end - begin, n_threads, [&](uint32_t thread, uint64_t index) {
+			const std::vector<float>& series = trials->series(index);
+			found[index] = searches[thread].search(series.data(), series.size(), tsamp, dms[begin + index]);
+			for (periodicity_candidate& candidate : found[index]) {
+				candidate.trial = (uint32_t)(begin + index);
+			}
+		}, [&](uint64_t, const std::string& message) {
+			failure = message;
+		});
+		if (!failure.empty()) {
+			throw std::runtime_error(failure);
+		}
+		for (auto& trial : found) {
+			candidates.insert(candidates.end(), trial.begin(), trial.end());
+		}
+	}
+	return candidates;
+}
+
+/**
+ * @param dms the DM of every trial
+ * @param threads the number of threads the trials are dedispersed on
+ */
+trials_sink::trials_sink(const std::vector<double>& dms, uint32_t threads) : dms(dms), all_series(dms.size()), pool(threads) {
+}
+
+/**
+ * @brief Sets up the dedispersion and the series of every trial, like dedisperse into a single band
+ */
+void trials_sink::configure(std::map<std::string, header_param>& header) {
+	stages.clear();
+	sinks.clear();
+	emitters.clear();
+	for (size_t trial = 0; trial < dms.size(); ++trial) {
+		std::map<std::string, header_param> trial_header = header;
+		stages.emplace_back(new dedisperse_stage(dms[trial]));
+		stages.back()->configure(trial_header);
+		all_series[trial].clear();
+		all_series[trial].reserve((uint32_t)trial_header["nsamples"].val.i);
+		sinks.emplace_back(new series_sink(all_series[trial]));
+		sinks.back()->configure(trial_header);
+		series_sink* out = sinks.back().get();
+		emitters.emplace_back([out](block_ptr item) {
+			out->consume(*item);
+		});
+	}
+}
+
+/**
+ * @brief Dedisperses the block at every DM, the trials are split over the threads
+ */
+void trials_sink::consume(const block& input) {
+	parallel_for(pool, stages.size(), 1, [&](uint64_t begin, uint64_t end) {
+		for (uint64_t trial = begin; trial < end; ++trial) {
+			stages[trial]->dedisperse(input, emitters[trial]);
+		}
+	});
+}
+
+void trials_sink::finish() {
+	for (size_t trial = 0; trial < stages.size(); ++trial) {
+		stages[trial]->flush(emitters[trial]);
+		sinks[trial]->finish();
+	}
+}
+
+void series_sink::configure(std::map<std::string, header_param>& header) {
+	values = header["nifs"].val.i * header["nchans"].val.i;
+	if (!values) {
+		throw std::runtime_error("The dedispersed series has no channels or IFs");
+	}
+}
+
+void series_sink::consume(const block& input) {
+	const float* data = input.data.data();
+	for (uint32_t sample = 0; sample < input.nsamples; ++sample) {
+		float sum = 0.0f;
+		for (uint32_t value = 0; value < values; ++value) {
+			sum += data[(uint64_t)sample * values + value];
+		}
+		series.push_back(sum);
+	}
+}
+
+/**
+ * @return the file the worker of a shard leaves its detections in
+ */
+std::string shard_file(const sweep_options& opts, uint32_t shard) {
+	return opts.work_directory + "/shard" + std::to_string(shard) + ".cands";
+}
+
+/**
+ * Writes the detections of the shard of a worker, a line per detection after the signature of the search.
+ * The values are written with all their digits, so that they are merged exactly as found.
+ *
+ * @param[in] opts the options of the worker
+ * @param[in] candidates the detections
+ */
+void write_shard(const sweep_options& opts, const std::vector<periodicity_candidate>& candidates) {
+	scoped_timer timer("write");
+	const std::string path = shard_file(opts, (uint32_t)opts.shard);
+	const std::string partial = path + ".part";
+	{
+		std::ofstream file(partial);
+		file << "# " << plan_signature(opts) << "\n" << std::setprecision(17);
+		for (const periodicity_candidate& candidate : candidates) {
+			file << candidate.trial << " " << candidate.dm << " " << candidate.frequency << " "
+				<< candidate.fdot << " " << candidate.acceleration << " " << candidate.power << " "
+				<< candidate.sigma << " " << candidate.harmonics << " " << candidate.bin << "\n";
+		}
+		file.close();
+		if (!file.good()) {
+			throw std::runtime_error("Failed to write candidates to " + partial);
+		}
+	}
+	// Renamed once complete, so that the coordinator never reads a shard that is still being written
+	if (rename(partial.c_str(), path.c_str()) != 0) {
+		throw std::runtime_error("Failed to rename " + partial + " to " + path);
+	}
+}
+
+/**
+ * Reads the detections a worker left for a shard
+ *
+ * @param[in] opts the options of the coordinator, with the work directory
+ * @param[in] shard the shard
+ * @param[out] candidates the detections are appended to this
+ * @return false when the shard was not searched, or was searched with other options
+ */
+bool read_shard(const sweep_options& opts, uint32_t shard, std::vector<periodicity_candidate>& candidates) {
+	const std::string path = shard_file(opts, shard);
+	std::ifstream file(path);
+	std::string line;
+	if (!file.is_open() || !std::getline(file, line) || line != "# " + plan_signature(opts)) {
+		return false;
+	}
+	uint64_t number = 1;
+	while (std::getline(file, line)) {
+		number++;
+		std::istringstream fields(line);
+		periodicity_candidate candidate;
+		if (!(fields >> candidate.trial >> candidate.dm >> candidate.frequency >> candidate.fdot >> candidate.acceleration
+			>> candidate.power >> candidate.sigma >> candidate.harmonics >> candidate.bin)) {
+			throw std::runtime_error("Invalid candidate on line " + std::to_string(number) + " of " + path);
+		}
+		candidates.push_back(candidate);
+	}
+	return true;
+}
+
+/**
+ * @return the argument quoted for /bin/sh
+ */
+static std::string shell_quote(const std::string& arg) {
+	std::string quoted = "'";
+	for (char c : arg) {
+		quoted += c == '\'' ? std::string("'\\''") : std::string(1, c);
+	}
+	return quoted + "'";
+}
+
+/**
+ * Starts the workers of the shards that were not searched yet, waits for them and merges their detections
+ *
+ * @param[in] opts the options
+ * @param[in] shared the options with the absolute work directory, as given to the workers
+ * @param[in] temporary whether the work directory is removed afterwards
+ * @return the detections of all shards, in trial order
+ */
+static std::vector<periodicity_candidate> merge_shards(const sweep_options& opts, const sweep_options& shared, bool temporary) {
+	if (!opts.merge_only) {
+		char executable[PATH_MAX];
+		ssize_t length = readlink("/proc/self/exe", executable, sizeof(executable) - 1);
+		if (length <= 0) {
+			throw std::runtime_error("Failed to find the sweep executable");
+		}
+		executable[length] = '\0';
+		const uint32_t cores = std::max(1u, std::thread::hardware_concurrency());
+
+		std::vector<std::pair<pid_t, uint32_t>> workers;
+		for (uint32_t shard = 0; shard < opts.shards; ++shard) {
+			std::vector<periodicity_candidate> done;
+			if (read_shard(shared, shard, done)) {
+				continue;
+			}
+			std::vector<std::string> args = { executable, shared.input };
+			args.insert(args.end(), opts.worker_arguments.begin(), opts.worker_arguments.end());
+			args.insert(args.end(), { "-workdir", shared.work_directory, "-shard", std::to_string(shard) });
+			if (!opts.threads && opts.launch.empty()) {
+				args.insert(args.end(), { "-j", std::to_string(std::max(1u, cores / opts.shards)) });
+			}
+
+			// Everything is prepared before the fork, the child only execs
+			std::vector<char*> argv;
+			std::string command;
+			if (opts.launch.empty()) {
+				for (std::string& arg : args) {
+					argv.push_back(&arg[0]);
+				}
+				argv.push_back(nullptr);
+			} else {
+				command = opts.launch;
+				size_t at = command.find("%d");
+				if (at != std::string::npos) {
+					command.replace(at, 2, std::to_string(shard));
+				}
+				for (const std::string& arg : args) {
+					command += " " + shell_quote(arg);
+				}
+			}
+			pid_t pid = fork();
+			if (pid < 0) {
+				throw std::runtime_error("Failed to start the worker of shard " + std::to_string(shard));
+			}
+			if (pid == 0) {
+				if (opts.launch.empty()) {
+					execv(executable, argv.data());
+				} else {
+					execl("/bin/sh", "sh", "-c", command.c_str(), (char*)nullptr);
+				}
+				_exit(127);
+			}
+			workers.emplace_back(pid, shard);
+		}
+
+		scoped_timer timer("workers");
+		for (const auto& worker : workers) {
+			int status = 0;
+			if (waitpid(worker.first, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+				std::cerr << "shard " << worker.second << ": the worker failed\n";
+			}
+		}
+	}
+
+	scoped_timer timer("merge");
+	std::vector<periodicity_candidate> candidates;
+	std::string missing;
+	for (uint32_t shard = 0; shard < opts.shards; ++shard) {
+		if (!read_shard(shared, shard, candidates)) {
+			missing += " " + std::to_string(shard);
+		}
+	}
+	if (!missing.empty()) {
+		throw std::runtime_error("Shards" + missing + " were not searched, their workers left no candidates"
+			+ (temporary ? std::string() : " in " + shared.work_directory + ", running again searches only those"));
+	}
+	return candidates;
+}
+
+/**
+ * Removes a temporary work directory with the candidates the workers left in it
+ *
+ * @param[in] shared the options with the work directory
+ */
+static void remove_work_directory(const sweep_options& shared) {
+	for (uint32_t shard = 0; shard < shared.shards; ++shard) {
+		const std::string path = shard_file(shared, shard);
+		unlink(path.c_str());
+		unlink((path + ".part").c_str());
+	}
+	rmdir(shared.work_directory.c_str());
+}
+
+/**
+ * Runs the shards as worker processes and merges their detections. Local workers are started directly,
+ * sharing the cores; with a launch command every worker is started through the shell as the command
+ * followed by the worker arguments, e.g. over ssh or by a batch scheduler, and the work directory must
+ * be on a filesystem the nodes share. Shards a previous run already searched with the same options are
+ * not searched again, so after a failure only the missing shards are.
+ *
+ * @param[in] opts the options
+ * @return the detections of all shards, in trial order
+ */
+std::vector<periodicity_candidate> run_shards(const sweep_options& opts) {
+	sweep_options shared = opts;
+	// Without a work directory the local workers use a temporary one in $TMPDIR, which is removed after merging
+	const bool temporary = shared.work_directory.empty();
+	if (temporary) {
+		const char* tmpdir = getenv("TMPDIR");
+		std::string name = std::string(tmpdir && *tmpdir ? tmpdir : "/tmp") + "/sweep.XXXXXX";
+		if (!mkdtemp(&name[0])) {
+			throw std::runtime_error("Failed to create a work directory " + name);
+		}
+		shared.work_directory = name;
+	} else if (mkdir(shared.work_directory.c_str(), 0755) != 0 && errno != EEXIST) {
+		throw std::runtime_error("Failed to create work directory " + shared.work_directory);
+	}
+	shared.work_directory = absolute_path(shared.work_directory);
+
+	try {
+		std::vector<periodicity_candidate> candidates = merge_shards(opts, shared, temporary);
+		if (temporary) {
+			remove_work_directory(shared);
+		}
+		return candidates;
+	} catch (...) {
+		// Nothing can resume from a temporary directory, so it does not outlive a failure either
+		if (temporary) {
+			remove_work_directory(shared);
+		}
+		throw;
+	}
+}
+
+/**
+ * Writes the candidates as a table, one line per candidate in rank order, with the number of detections
+ * merged into it and their DM range
+ */
+void write_candidates(std::ostream& out, const std::vector<periodicity_candidate>& candidates) {
+	out << "# rank    sigma      power harm       period_ms     frequency_hz       fdot_hz/s   accel_m/s2        dm    dm_low   dm_high members\n";
+	for (size_t rank = 0; rank < candidates.size(); ++rank) {
+		const periodicity_candidate& candidate = candidates[rank];
+		out << std::setw(6) << rank + 1 << " "
+			<< std::fixed << std::setprecision(2) << std::setw(8) << candidate.sigma << " "
+			<< std::setw(10) << candidate.power << " "
+			<< std::setw(4) << candidate.harmonics << " "
+			<< std::setprecision(9) << std::setw(15) << 1.0e3 / candidate.frequency << " "
+			<< std::setw(16) << candidate.frequency << " "
+			<< std::scientific << std::setprecision(6) << std::setw(15) << candidate.fdot << " "
+			<< std::fixed << std::setprecision(3) << std::setw(12) << candidate.acceleration << " "
+			<< std::setprecision(3) << std::setw(9) << candidate.dm << " "
+			<< std::setw(9) << candidate.dm_low << " "
+			<< std::setw(9) << candidate.dm_high << " "
+			<< std::setw(7) << candidate.members << "\n";
+	}
+}
+
+void sweep_help() /*includefile*/
+{
+	std::cout << std::endl;
+	std::cout << ("sweep - dedisperse filterbank data over a range of DMs and search every trial for periodic signals") << std::endl << std::endl;
+	std::cout << ("usage: sweep {filename} -dmend dm -dmstep step -{options}") << std::endl << std::endl;
+	std::cout << ("options:") << std::endl << std::endl;
+	std::cout << ("   filename - full name of the raw data file to be read, once per group of DM trials") << std::endl;
+	std::cout << ("-dmstart dm - the first DM trial (def=0)") << std::endl;
+	std::cout << ("-dmend dm   - the last DM trial, at most") << std::endl;
+	std::cout << ("-dmstep step - the DM step between trials") << std::endl;
+	std::cout << ("-sumifs     - sum the IFs, e.g. polarizations, as the data is read (def=don't)") << std::endl;
+	std::cout << ("-nobaseline - don't subtract baseline from the data (def=subtract)") << std::endl;
+	std::cout << ("-H numharms - sum up to numharms harmonics: 1, 2, 4, 8, 16 or 32 (def=16)") << std::endl;
+	std::cout << ("-s sigma    - report candidates above this gaussian significance (def=6)") << std::endl;
+	std::cout << ("-f minfreq  - lowest frequency to search in Hz (def=0.1)") << std::endl;
+	std::cout << ("-F maxfreq  - highest frequency to search in Hz (def=Nyquist)") << std::endl;
+	std::cout << ("-c numcands - keep at most numcands candidates per DM trial, 0 for all (def=100)") << std::endl;
+	std::cout << ("-z zmax     - acceleration search over frequency drifts up to zmax bins (def=0, none)") << std::endl;
+	std::cout << ("-j threads  - number of DM trials searched at once per process (def=all cores, shared by local workers)") << std::endl;
+	std::cout << ("-o filename - output file name for the candidates (def=stdout)") << std::endl;
+	std::cout << ("-D dmtol    - DM distance within which detections are merged (def=1.5 DM steps)") << std::endl;
+	std::cout << ("-r bins     - frequency distance in Fourier bins within which detections are merged (def=1.5)") << std::endl;
+	std::cout << ("-nowhiten   - normalize by the median of the whole spectrum instead of the running median") << std::endl;
+	std::cout << ("-noharm     - do not merge candidates at harmonic ratios of a stronger candidate") << std::endl;
+	std::cout << ("-nosift     - report every detection of every trial instead of one per signal") << std::endl;
+	std::cout << ("-shards num - split the DM trials into num contiguous shards, each searched by a worker process (def=1)") << std::endl;
+	std::cout << ("-workdir dir - directory the workers leave their candidates in, on a filesystem shared by all nodes;") << std::endl;
+	std::cout << ("              shards already searched there with the same options are not searched again (def=temporary dir in $TMPDIR)") << std::endl;
+	std::cout << ("-launch cmd - start every worker as cmd followed by its arguments, %d in cmd is replaced by the shard,") << std::endl;
+	std::cout << ("              e.g. \"ssh node%d\" (def=local processes)") << std::endl;
+	std::cout << ("-shard num  - search only this shard and leave its candidates in -workdir, as a worker") << std::endl;
+	std::cout << ("-merge      - only merge the candidates of the workers in -workdir, which were started by other means") << std::endl;
+	std::cout << ("--stats[=json] - print a per stage timing breakdown to stderr (def=off)") << std::endl << std::endl;
+}